@@ -12,12 +12,20 @@ BalanceParameters::BalanceParameters() {
   startTime_ = 0;
   stopTime_ = 0;
   numRows_ = 0;
+
+  meanForceX_ = 0;
+  meanForceY_ = 0;
+  meanCopX_ = 0;
+  meanCopY_ = 0;
+
+  spectralAnalysis_ = SpectralAnalysis::None;
 }
 
 // ____________________________________________________________________________
 BalanceParameters::BalanceParameters(
     const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
         &data) {
+  spectralAnalysis_ = SpectralAnalysis::None;
   rawData_ = data;
 
   validateData();
@@ -31,6 +39,8 @@ BalanceParameters::BalanceParameters(
 void BalanceParameters::update(
     const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
         &data) {
+  TRACE_SCOPE("BalanceParameters::update");
+
   rawData_ = data;
 
   validateData();
@@ -40,18 +50,66 @@ void BalanceParameters::update(
   }
 }
 
+// ____________________________________________________________________________
+void BalanceParameters::update(const SampleView &view) {
+  TRACE_SCOPE("BalanceParameters::update");
+
+  // Nothing is copied, so there is no data to hold on to.
+  rawData_.reset();
+  data_.reset();
+
+  const float *times = view.getColumn("abs time (s)");
+  if (view.size() == 0 || times == nullptr ||
+      view.getColumn("Fx") == nullptr || view.getColumn("Fy") == nullptr) {
+    invalidate();
+    return;
+  }
+
+  isValid_ = true;
+  numRows_ = view.size();
+  startTime_ = times[0];
+  stopTime_ = times[numRows_ - 1];
+  timeframe_ = stopTime_ - startTime_;
+
+  meanForceX_ = view.getSum("Fx") / numRows_;
+  meanForceY_ = view.getSum("Fy") / numRows_;
+  // The rows without contact have a COP of 0, they add nothing to the sums.
+  int numContactRows = view.getNumContactRows();
+  meanCopX_ = numContactRows > 0 ? view.getSum("Ax") / numContactRows : 0;
+  meanCopY_ = numContactRows > 0 ? view.getSum("Ay") / numContactRows : 0;
+
+  const float *copX = view.getColumn("Ax");
+  const float *copY = view.getColumn("Ay");
+  calculateSpectra(times, copX, copY, numRows_);
+  calculateDiffusion(times, copX, copY, numRows_);
+}
+
+// ____________________________________________________________________________
+void BalanceParameters::invalidate() {
+  timeframe_ = 0;
+  startTime_ = 0;
+  stopTime_ = 0;
+  numRows_ = 0;
+  meanForceX_ = 0;
+  meanForceY_ = 0;
+  meanCopX_ = 0;
+  meanCopY_ = 0;
+  copSpectrumX_ = SpectrumSummary();
+  copSpectrumY_ = SpectrumSummary();
+  diffusionX_ = DiffusionSummary();
+  diffusionY_ = DiffusionSummary();
+  diffusionPlanar_ = DiffusionSummary();
+
+  isValid_ = false;
+}
+
 // ____________________________________________________________________________
 void BalanceParameters::validateData() {
+  TRACE_SCOPE("BalanceParameters::validateData");
+
   // Data is empty.
   if (rawData_->size() == 0) {
-    timeframe_ = 0;
-    startTime_ = 0;
-    stopTime_ = 0;
-    numRows_ = 0;
-    meanForceX_ = 0;
-    meanForceY_ = 0;
-
-    isValid_ = false;
+    invalidate();
     return;
   }
 
@@ -59,28 +117,14 @@ void BalanceParameters::validateData() {
   // direction (add more checks if other parameters are calculated).
   if (rawData_->count("abs time (s)") == 0 || rawData_->count("Fx") == 0 ||
       rawData_->count("Fy") == 0) {
-    timeframe_ = 0;
-    startTime_ = 0;
-    stopTime_ = 0;
-    numRows_ = 0;
-    meanForceX_ = 0;
-    meanForceY_ = 0;
-
-    isValid_ = false;
+    invalidate();
     return;
   }
 
   // Check if columns have the same length.
   if ((*rawData_)["Fx"].size() != (*rawData_)["Fy"].size() ||
       (*rawData_)["Fx"].size() != (*rawData_)["abs time (s)"].size()) {
-    timeframe_ = 0;
-    startTime_ = 0;
-    stopTime_ = 0;
-    numRows_ = 0;
-    meanForceX_ = 0;
-    meanForceY_ = 0;
-
-    isValid_ = false;
+    invalidate();
     return;
   }
 
@@ -94,14 +138,21 @@ void BalanceParameters::validateData() {
 
 // ____________________________________________________________________________
 void BalanceParameters::preprocess() {
+  TRACE_SCOPE("BalanceParameters::preprocess");
+
   // to be implemented if necessary
   data_ = rawData_;
 }
 
 // ____________________________________________________________________________
 void BalanceParameters::calculateParameters() {
+  TRACE_SCOPE("BalanceParameters::calculateParameters");
+
   calculateMeanForceX();
   calculateMeanForceY();
+  calculateMeanCop();
+  calculateSpectra();
+  calculateDiffusion();
   // ...
 }
 
@@ -128,7 +179,763 @@ void BalanceParameters::calculateMeanForceY() {
 }
 
 // ____________________________________________________________________________
-DataModel::DataModel() : running_(false) {
+void BalanceParameters::calculateMeanCop() {
+  meanCopX_ = 0;
+  meanCopY_ = 0;
+
+  auto ax = data_->find("Ax");
+  auto ay = data_->find("Ay");
+  if (ax == data_->end() || ay == data_->end() ||
+      ax->second.size() != ay->second.size())
+    return;
+
+  double sumX = 0;
+  double sumY = 0;
+  size_t numContactRows = 0;
+  for (size_t i = 0; i < ax->second.size(); i++) {
+    if (ax->second[i] == 0 && ay->second[i] == 0)
+      continue;
+    sumX += ax->second[i];
+    sumY += ay->second[i];
+    numContactRows++;
+  }
+
+  if (numContactRows > 0) {
+    meanCopX_ = sumX / numContactRows;
+    meanCopY_ = sumY / numContactRows;
+  }
+}
+
+// ____________________________________________________________________________
+void BalanceParameters::setSpectralAnalysis(SpectralAnalysis spectralAnalysis) {
+  if (spectralAnalysis == spectralAnalysis_)
+    return;
+  spectralAnalysis_ = spectralAnalysis;
+  copSpectrumX_ = SpectrumSummary();
+  copSpectrumY_ = SpectrumSummary();
+
+  if (spectralAnalysis_ == SpectralAnalysis::None) {
+    copAnalyzerX_.reset();
+    copAnalyzerY_.reset();
+    return;
+  }
+  bool sliding = spectralAnalysis_ == SpectralAnalysis::Sliding;
+  copAnalyzerX_ = std::make_shared<SpectralAnalyzer>(sliding);
+  copAnalyzerY_ = std::make_shared<SpectralAnalyzer>(sliding);
+}
+
+// ____________________________________________________________________________
+void BalanceParameters::calculateSpectra() {
+  auto ax = data_->find("Ax");
+  auto ay = data_->find("Ay");
+  if (ax == data_->end() || ay == data_->end()) {
+    calculateSpectra(nullptr, nullptr, nullptr, 0);
+    return;
+  }
+
+  const std::vector<float> &times = (*data_)["abs time (s)"];
+  calculateSpectra(times.data(), ax->second.data(), ay->second.data(),
+                   std::min({times.size(), ax->second.size(),
+                             ay->second.size()}));
+}
+
+// ____________________________________________________________________________
+void BalanceParameters::calculateSpectra(const float *times, const float *copX,
+                                         const float *copY, int numRows) {
+  if (spectralAnalysis_ == SpectralAnalysis::None)
+    return;
+  TRACE_SCOPE("BalanceParameters::calculateSpectra");
+
+  copSpectrumX_ = SpectrumSummary();
+  copSpectrumY_ = SpectrumSummary();
+  if (copX == nullptr || copY == nullptr)
+    return;
+
+  copAnalyzerX_->analyze(times, copX, numRows);
+  copAnalyzerY_->analyze(times, copY, numRows);
+  copSpectrumX_ = copAnalyzerX_->getSummary();
+  copSpectrumY_ = copAnalyzerY_->getSummary();
+}
+
+// ____________________________________________________________________________
+void BalanceParameters::setDiffusionAnalysis(bool diffusionAnalysis) {
+  if (diffusionAnalysis == getDiffusionAnalysis())
+    return;
+  diffusionX_ = DiffusionSummary();
+  diffusionY_ = DiffusionSummary();
+  diffusionPlanar_ = DiffusionSummary();
+  if (diffusionAnalysis)
+    diffusion_ = std::make_shared<StabilogramDiffusion>();
+  else
+    diffusion_.reset();
+}
+
+// ____________________________________________________________________________
+void BalanceParameters::calculateDiffusion() {
+  auto ax = data_->find("Ax");
+  auto ay = data_->find("Ay");
+  if (ax == data_->end() || ay == data_->end()) {
+    calculateDiffusion(nullptr, nullptr, nullptr, 0);
+    return;
+  }
+
+  const std::vector<float> &times = (*data_)["abs time (s)"];
+  calculateDiffusion(times.data(), ax->second.data(), ay->second.data(),
+                     std::min({times.size(), ax->second.size(),
+                               ay->second.size()}));
+}
+
+// ____________________________________________________________________________
+void BalanceParameters::calculateDiffusion(const float *times,
+                                           const float *copX, const float *copY,
+                                           int numRows) {
+  if (!diffusion_)
+    return;
+  TRACE_SCOPE("BalanceParameters::calculateDiffusion");
+
+  if (copX == nullptr || copY == nullptr)
+    diffusion_->reset();
+  else
+    diffusion_->analyze(times, copX, copY, numRows);
+  diffusionX_ = diffusion_->getSummaryX();
+  diffusionY_ = diffusion_->getSummaryY();
+  diffusionPlanar_ = diffusion_->getSummaryPlanar();
+}
+
+// ____________________________________________________________________________
+CopTrail::CopTrail(size_t capacity) : samples_(std::max<size_t>(capacity, 1)) {
+  clear();
+}
+
+// ____________________________________________________________________________
+void CopTrail::clear() {
+  head_ = 0;
+  size_ = 0;
+  numAppended_ = 0;
+  lastTime_ = -std::numeric_limits<float>::infinity();
+}
+
+// ____________________________________________________________________________
+size_t CopTrail::append(const std::vector<float> &time,
+                        const std::vector<float> &x,
+                        const std::vector<float> &y) {
+  size_t numRows = std::min({time.size(), x.size(), y.size()});
+
+  // The batch is sorted by time, so skip the part we already have.
+  size_t first = std::upper_bound(time.begin(), time.begin() + numRows,
+                                  lastTime_) -
+                 time.begin();
+
+  for (size_t i = first; i < numRows; i++) {
+    if (size_ < samples_.size()) {
+      samples_[(head_ + size_) % samples_.size()] = {time[i], x[i], y[i]};
+      size_++;
+    } else {
+      // Full, overwrite the oldest sample.
+      samples_[head_] = {time[i], x[i], y[i]};
+      head_ = (head_ + 1) % samples_.size();
+    }
+  }
+
+  if (first < numRows)
+    lastTime_ = time[numRows - 1];
+  numAppended_ += numRows - first;
+  return numRows - first;
+}
+
+// ____________________________________________________________________________
+CopHistogram2D::CopHistogram2D(float range, int numBins)
+    : range_(range), numBins_(std::max(numBins, 1)),
+      counts_(numBins_ * numBins_) {
+  clear();
+}
+
+// ____________________________________________________________________________
+void CopHistogram2D::clear() {
+  std::fill(counts_.begin(), counts_.end(), 0);
+  maxCount_ = 0;
+  totalCount_ = 0;
+  // Everything changed.
+  dirty_ = {0, 0, numBins_ - 1, numBins_ - 1};
+}
+
+// ____________________________________________________________________________
+int CopHistogram2D::toBin(float value) const {
+  if (!(value >= -range_ && value <= range_))
+    return -1;
+  int bin = (value + range_) / (2 * range_) * numBins_;
+  return std::min(bin, numBins_ - 1);
+}
+
+// ____________________________________________________________________________
+bool CopHistogram2D::add(float x, float y) {
+  if (x == 0 && y == 0)
+    return false;
+
+  int binX = toBin(x);
+  int binY = toBin(y);
+  if (binX < 0 || binY < 0)
+    return false;
+
+  uint32_t &count = counts_[binY * numBins_ + binX];
+  count++;
+  maxCount_ = std::max(maxCount_, count);
+  totalCount_++;
+
+  if (dirty_.isEmpty()) {
+    dirty_ = {binX, binY, binX, binY};
+  } else {
+    dirty_.firstX = std::min(dirty_.firstX, binX);
+    dirty_.firstY = std::min(dirty_.firstY, binY);
+    dirty_.lastX = std::max(dirty_.lastX, binX);
+    dirty_.lastY = std::max(dirty_.lastY, binY);
+  }
+  return true;
+}
+
+// ____________________________________________________________________________
+BinRect CopHistogram2D::takeDirtyBins() {
+  BinRect dirty = dirty_;
+  dirty_ = {0, 0, -1, -1};
+  return dirty;
+}
+
+// ____________________________________________________________________________
+void FramePool::setColumnNames(const std::vector<std::string> &columnNames) {
+  if (columnNames == columnNames_)
+    return;
+  columnNames_ = columnNames;
+  frames_.clear();
+}
+
+// ____________________________________________________________________________
+std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+FramePool::acquire(size_t numRows) {
+  // A frame is free if only the pool holds it. All its columns have the same
+  // capacity.
+  auto capacity = [](const auto &frame) {
+    return frame->empty() ? 0 : frame->begin()->second.capacity();
+  };
+  auto isBetter = [numRows](size_t capacity, size_t bestCapacity) {
+    bool fits = capacity >= numRows;
+    bool bestFits = bestCapacity >= numRows;
+    if (fits != bestFits)
+      return fits;
+    return fits ? capacity < bestCapacity : capacity > bestCapacity;
+  };
+
+  std::shared_ptr<std::unordered_map<std::string, std::vector<float>>> *best =
+      nullptr;
+  for (auto &frame : frames_)
+    if (frame.use_count() == 1 &&
+        (best == nullptr || isBetter(capacity(frame), capacity(*best))))
+      best = &frame;
+
+  // All in use, warming up.
+  if (best == nullptr) {
+    frames_.push_back(std::make_shared<
+                      std::unordered_map<std::string, std::vector<float>>>());
+    best = &frames_.back();
+    for (const auto &name : columnNames_)
+      (**best)[name];
+  }
+
+  for (auto &column : **best) {
+    column.second.clear();
+    column.second.reserve(numRows);
+  }
+  return *best;
+}
+
+// ____________________________________________________________________________
+Prefetcher::Prefetcher()
+    : chunkRows_(1), stop_(false), requestedRow_(-1), readyRow_(-1) {}
+
+// ____________________________________________________________________________
+Prefetcher::~Prefetcher() { close(); }
+
+// ____________________________________________________________________________
+void Prefetcher::open(const std::string &fileName, CorruptDataPolicy policy,
+                      std::shared_ptr<CorruptDataReport> report) {
+  close();
+
+  file_ = openKistlerFile(fileName);
+  if (!file_->isValid())
+    return;
+  file_->setCorruptDataPolicy(policy);
+  if (report)
+    file_->setCorruptDataReport(std::move(report));
+
+  chunkRows_ = std::max(
+      1, static_cast<int>(file_->getSamplingRate() * PREFETCH_MS / 1000));
+  thread_ = std::thread(&Prefetcher::run, this);
+}
+
+// ____________________________________________________________________________
+void Prefetcher::close() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+  }
+
+  stop_ = false;
+  requestedRow_ = -1;
+  readyRow_ = -1;
+  ready_.reset();
+  spare_.clear();
+}
+
+// ____________________________________________________________________________
+void Prefetcher::request(int firstRow) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_.joinable() || requestedRow_ == firstRow ||
+        readyRow_ == firstRow)
+      return;
+    requestedRow_ = firstRow;
+    readyRow_ = -1;
+    if (ready_)
+      addSpare(std::move(ready_));
+  }
+  condition_.notify_all();
+}
+
+// ____________________________________________________________________________
+void Prefetcher::addSpare(
+    std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+        chunk) {
+  // One is being read, ready or taken.
+  if (spare_.size() + 1 < PREFETCH_MAX_CHUNKS)
+    spare_.push_back(std::move(chunk));
+}
+
+// ____________________________________________________________________________
+void Prefetcher::recycle(
+    std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+        chunk) {
+  if (!chunk)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  addSpare(std::move(chunk));
+}
+
+// ____________________________________________________________________________
+std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+Prefetcher::take(int firstRow, bool wait) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (wait) {
+    TRACE_SCOPE("Prefetcher::wait");
+    condition_.wait(lock, [this, firstRow] {
+      return stop_ || readyRow_ == firstRow || requestedRow_ != firstRow;
+    });
+  }
+
+  if (readyRow_ != firstRow)
+    return nullptr;
+  readyRow_ = -1;
+  return std::move(ready_);
+}
+
+// ____________________________________________________________________________
+void Prefetcher::run() {
+  // Index the whole file first (like the DataModel does), extending the index
+  // while reading would open the file again every so often.
+  file_->getNumRows();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    condition_.wait(lock, [this] { return stop_ || requestedRow_ >= 0; });
+    if (stop_)
+      return;
+
+    // Read without holding the lock, a newer request may come meanwhile. The
+    // chunk is read into a spare one if there is one.
+    int firstRow = requestedRow_;
+    std::shared_ptr<std::unordered_map<std::string, std::vector<float>>> data;
+    if (spare_.empty()) {
+      // Sized for a chunk right away, so the columns don't grow past it.
+      data = std::make_shared<
+          std::unordered_map<std::string, std::vector<float>>>();
+      for (const auto &name : file_->getColumnNames())
+        (*data)[name].reserve(chunkRows_);
+    } else {
+      data = std::move(spare_.back());
+      spare_.pop_back();
+    }
+    lock.unlock();
+    try {
+      TRACE_SCOPE("Prefetcher::read");
+      for (auto &column : *data)
+        column.second.clear();
+      file_->readRows(firstRow, firstRow + chunkRows_ - 1, data.get());
+    } catch (CorruptKistlerFileException &e) {
+      // The reader of the DataModel runs into it as well and reports it.
+      data = nullptr;
+    }
+    lock.lock();
+
+    if (requestedRow_ == firstRow) {
+      requestedRow_ = -1;
+      readyRow_ = firstRow;
+      ready_ = data;
+      condition_.notify_all();
+    } else if (data) {
+      addSpare(std::move(data));
+    }
+  }
+}
+
+// ____________________________________________________________________________
+const float *SampleView::getColumn(const std::string &name) const {
+  if (columns_ == nullptr)
+    return nullptr;
+  auto column = columns_->find(name);
+  if (column == columns_->end())
+    return nullptr;
+  return column->second.data() + first_;
+}
+
+// ____________________________________________________________________________
+double SampleView::getSum(const std::string &name) const {
+  if (sums_ == nullptr)
+    return 0;
+  auto sums = sums_->find(name);
+  if (sums == sums_->end())
+    return 0;
+  return sums->second[first_ + numRows_] - sums->second[first_];
+}
+
+// ____________________________________________________________________________
+int SampleView::getNumContactRows() const {
+  if (contactSums_ == nullptr || contactSums_->empty())
+    return 0;
+  return (*contactSums_)[first_ + numRows_] - (*contactSums_)[first_];
+}
+
+// ____________________________________________________________________________
+SampleWindow::SampleWindow()
+    : maxRows_(0), prefetcher_(nullptr), stalled_(false),
+      spikeFilterWindow_(1) {
+  clear();
+}
+
+// ____________________________________________________________________________
+void SampleWindow::clear() {
+  columns_.clear();
+  sums_.clear();
+  contactSums_.clear();
+  tolerance_ = 0;
+  offset_ = 0;
+  firstRow_ = 0;
+  numRows_ = 0;
+  numRowsRead_ = 0;
+}
+
+// ____________________________________________________________________________
+void SampleWindow::setSpikeFilterWindow(int windowSize) {
+  windowSize = std::max(windowSize, 1);
+  if (windowSize == spikeFilterWindow_)
+    return;
+  spikeFilterWindow_ = windowSize;
+  clear();
+}
+
+// ____________________________________________________________________________
+void SampleWindow::compact() {
+  for (auto &column : columns_)
+    column.second.erase(column.second.begin(),
+                        column.second.begin() + offset_);
+
+  // The sums start over at 0, so they don't grow over a long recording.
+  auto rebase = [this](std::vector<double> *sums) {
+    if (sums->empty())
+      return;
+    double base = (*sums)[offset_];
+    sums->erase(sums->begin(), sums->begin() + offset_);
+    for (double &sum : *sums)
+      sum -= base;
+  };
+  for (auto &sums : sums_)
+    rebase(&sums.second);
+  rebase(&contactSums_);
+  offset_ = 0;
+}
+
+// ____________________________________________________________________________
+void SampleWindow::extendSums(size_t firstIndex) {
+  const size_t numIndices = offset_ + numRows_;
+  for (auto &sums : sums_) {
+    const std::vector<float> &column = columns_.at(sums.first);
+    double sum = sums.second.back();
+    for (size_t i = firstIndex; i < numIndices; i++) {
+      sum += column[i];
+      sums.second.push_back(sum);
+    }
+  }
+
+  if (contactSums_.empty())
+    return;
+  const std::vector<float> &copX = columns_.at("Ax");
+  const std::vector<float> &copY = columns_.at("Ay");
+  double numContactRows = contactSums_.back();
+  for (size_t i = firstIndex; i < numIndices; i++) {
+    if (copX[i] != 0 || copY[i] != 0)
+      numContactRows++;
+    contactSums_.push_back(numContactRows);
+  }
+}
+
+// ____________________________________________________________________________
+void SampleWindow::truncateSums() {
+  const size_t numSums = offset_ + numRows_ + 1;
+  for (auto &sums : sums_)
+    sums.second.resize(numSums);
+  if (!contactSums_.empty())
+    contactSums_.resize(numSums);
+}
+
+// ____________________________________________________________________________
+void SampleWindow::update(const KistlerFile &file, int firstRow,
+                          float stopTime) {
+  TRACE_SCOPE("SampleWindow::update");
+
+  tolerance_ = 0.25f / file.getSamplingRate();
+  if (columns_.empty()) {
+    for (const auto &name : file.getColumnNames())
+      columns_[name];
+    framePool_.setColumnNames(file.getColumnNames());
+    spikeFilter_.configure(file.getColumnNames(), spikeFilterWindow_);
+    for (const char *name : {SUMMED_COLUMNS})
+      if (columns_.count(name) > 0)
+        sums_[name] = {0};
+    if (columns_.count("Ax") > 0 && columns_.count("Ay") > 0)
+      contactSums_ = {0};
+  }
+
+  // Cut the rows at the front if there are too many.
+  int stopRow = file.getRowAfterTime(stopTime) - 1;
+  if (maxRows_ > 0)
+    firstRow = std::max(firstRow, stopRow + 1 - maxRows_);
+
+  // A jump backwards or past the resident rows, nothing to reuse (but keep
+  // the allocated memory).
+  if (firstRow < firstRow_ || firstRow > firstRow_ + numRows_) {
+    for (auto &column : columns_)
+      column.second.clear();
+    offset_ = 0;
+    numRows_ = 0;
+    firstRow_ = firstRow;
+    truncateSums();
+  }
+
+  // Drop the rows before the timeframe. They are erased once there are more
+  // dropped than resident rows, so erasing costs O(1) per row on average.
+  int numDropped = firstRow - firstRow_;
+  offset_ += numDropped;
+  numRows_ -= numDropped;
+  firstRow_ = firstRow;
+  // Evict rows at the end (kept after shrinking the timeframe) if there are
+  // too many.
+  if (maxRows_ > 0 && numRows_ > maxRows_) {
+    numRows_ = maxRows_;
+    for (auto &column : columns_)
+      column.second.resize(offset_ + numRows_);
+    truncateSums();
+  }
+
+  if (offset_ > static_cast<size_t>(numRows_))
+    compact();
+
+  // Read the rows that are missing at the end (if they exist yet). Chunks
+  // read ahead by the prefetcher are taken first, waiting for one or reading
+  // here is a stall.
+  stalled_ = false;
+  while (stopRow >= firstRow_ + numRows_) {
+    int nextRow = firstRow_ + numRows_;
+    std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+        newData;
+    if (prefetcher_ != nullptr) {
+      newData = prefetcher_->take(nextRow, false);
+      if (!newData) {
+        stalled_ = true;
+        newData = prefetcher_->take(nextRow, true);
+      }
+    }
+
+    size_t nextIndex = offset_ + numRows_;
+    int numNewRows = 0;
+    if (newData && !newData->at("abs time (s)").empty()) {
+      numNewRows = append(*newData);
+      prefetcher_->recycle(std::move(newData));
+    } else {
+      // Not prefetched, or the file has grown since. Read right into the
+      // columns.
+      if (newData)
+        prefetcher_->recycle(std::move(newData));
+      stalled_ = true;
+      numNewRows = readRows(file, nextRow, stopRow);
+    }
+
+    if (numNewRows == 0)
+      break;
+    // Filter the spikes and subtract the offsets in one pass over the new
+    // rows of every column.
+    offsetCalibrator_.apply(&columns_, nextIndex, &spikeFilter_, nextRow);
+    extendSums(nextIndex);
+  }
+
+  // Keep a chunk ahead of the timeframe (if it fits).
+  if (prefetcher_ != nullptr) {
+    int numAhead = firstRow_ + numRows_ - 1 - stopRow;
+    if (numAhead < prefetcher_->getChunkRows() &&
+        (maxRows_ == 0 || numRows_ + prefetcher_->getChunkRows() <= maxRows_))
+      prefetcher_->request(firstRow_ + numRows_);
+  }
+}
+
+// ____________________________________________________________________________
+int SampleWindow::append(
+    const std::unordered_map<std::string, std::vector<float>> &data) {
+  int numNewRows = data.at("abs time (s)").size();
+  for (auto &column : columns_) {
+    const auto &newColumn = data.at(column.first);
+    column.second.insert(column.second.end(), newColumn.begin(),
+                         newColumn.begin() + numNewRows);
+  }
+  numRows_ += numNewRows;
+  numRowsRead_ += numNewRows;
+  return numNewRows;
+}
+
+// ____________________________________________________________________________
+int SampleWindow::readRows(const KistlerFile &file, int firstRow,
+                           int stopRow) {
+  size_t numColumnRows = offset_ + numRows_;
+  int numNewRows = 0;
+  try {
+    numNewRows = file.readRows(firstRow, stopRow, &columns_);
+  } catch (CorruptKistlerFileException &e) {
+    // Part of the corrupt row may have been appended already.
+    for (auto &column : columns_)
+      column.second.resize(numColumnRows);
+    throw;
+  }
+  numRows_ += numNewRows;
+  numRowsRead_ += numNewRows;
+  return numNewRows;
+}
+
+// ____________________________________________________________________________
+void SampleWindow::findRows(float startTime, float stopTime, size_t *firstIndex,
+                            size_t *lastIndex) const {
+  *firstIndex = *lastIndex = 0;
+  auto timeColumn = columns_.find("abs time (s)");
+  if (timeColumn == columns_.end())
+    return;
+
+  // There may be more resident rows before and after (e.g. for a longer
+  // analysis window or if the timeframe was shrunk).
+  auto residentBegin = timeColumn->second.begin() + offset_;
+  auto residentEnd = residentBegin + numRows_;
+  auto first =
+      std::lower_bound(residentBegin, residentEnd, startTime - tolerance_);
+  auto last = std::upper_bound(first, residentEnd, stopTime + tolerance_);
+  *firstIndex = first - timeColumn->second.begin();
+  *lastIndex = last - timeColumn->second.begin();
+}
+
+// ____________________________________________________________________________
+std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+SampleWindow::getData(float startTime, float stopTime) const {
+  if (columns_.empty())
+    return std::make_shared<
+        std::unordered_map<std::string, std::vector<float>>>();
+
+  size_t firstIndex, lastIndex;
+  findRows(startTime, stopTime, &firstIndex, &lastIndex);
+  auto data = framePool_.acquire(lastIndex - firstIndex);
+  for (const auto &column : columns_)
+    (*data)[column.first].assign(column.second.begin() + firstIndex,
+                                 column.second.begin() + lastIndex);
+  return data;
+}
+
+// ____________________________________________________________________________
+SampleView SampleWindow::getView(float startTime, float stopTime) const {
+  SampleView view;
+  if (columns_.empty())
+    return view;
+
+  size_t lastIndex;
+  findRows(startTime, stopTime, &view.first_, &lastIndex);
+  view.columns_ = &columns_;
+  view.sums_ = &sums_;
+  view.contactSums_ = &contactSums_;
+  view.numRows_ = lastIndex - view.first_;
+  return view;
+}
+
+// ____________________________________________________________________________
+ContactDetector::ContactDetector(float onThreshold, float offThreshold)
+    : onThreshold_(onThreshold),
+      offThreshold_(std::min(offThreshold, onThreshold)) {
+  reset();
+}
+
+// ____________________________________________________________________________
+void ContactDetector::reset() {
+  inContact_ = false;
+  nextRow_ = 0;
+  periods_.clear();
+}
+
+// ____________________________________________________________________________
+void ContactDetector::update(const std::vector<float> &forces, int firstRow) {
+  // After a gap the state is kept, the rows in between stay unknown.
+  if (firstRow > nextRow_)
+    nextRow_ = firstRow;
+
+  for (size_t i = nextRow_ - firstRow; i < forces.size(); i++) {
+    // The sign of Fz depends on the coordinate system of the plate.
+    float force = std::fabs(forces[i]);
+    int row = firstRow + i;
+    if (!inContact_ && force > onThreshold_) {
+      inContact_ = true;
+      periods_.push_back({row, -1});
+    } else if (inContact_ && force < offThreshold_) {
+      inContact_ = false;
+      periods_.back().second = row - 1;
+    }
+  }
+  nextRow_ = std::max<int>(nextRow_, firstRow + forces.size());
+}
+
+// ____________________________________________________________________________
+bool ContactDetector::hasContact(int firstRow, int lastRow) const {
+  for (const auto &period : periods_) {
+    int periodEnd =
+        period.second >= 0 ? period.second : std::numeric_limits<int>::max();
+    if (period.first <= lastRow && periodEnd >= firstRow)
+      return true;
+  }
+  return false;
+}
+
+// ____________________________________________________________________________
+int ContactDetector::getNextContactStart(int row) const {
+  for (const auto &period : periods_)
+    if (period.first >= row)
+      return period.first;
+  return -1;
+}
+
+// ____________________________________________________________________________
+DataModel::DataModel()
+    : running_(false), kistlerFile_(std::make_unique<KistlerCSVFile>()) {
   fileName_ = "";
 
   configTimeframe_ = 0;
@@ -141,6 +948,21 @@ DataModel::DataModel() : running_(false) {
   lastRow_ = 0;
   numRows_ = 0;
 
+  numFileRows_ = 0;
+  firstFileTime_ = 0;
+
+  memoryBudget_ = 0;
+  prefetching_ = true;
+  corruptDataPolicy_ = CorruptDataPolicy::Interpolate;
+  corruptDataReport_ = std::make_shared<CorruptDataReport>();
+  numReportedCells_ = 0;
+  offsetCalibration_ = false;
+  calibrationStartTime_ = 0;
+  calibrationStopTime_ = 0;
+  skipNonContact_ = false;
+  spectralAnalysis_ = false;
+  setAnalysisTimeframes({MEDIUM_TIMEFRAME_S, LONG_TIMEFRAME_S});
+
   // Set up a timer for regular reprocessing.
   // Current implementation is for playback of pre-existing CSV files,
   // in a later stage we will switch to live view -> timers need to be
@@ -161,21 +983,59 @@ void DataModel::onStartProcessing(const std::string &fileName,
   configTimeframe_ = timeframe;
 
   // New file configured.
-  if (fileName != fileName_) {
+  bool newFile = fileName != fileName_;
+  if (newFile) {
     fileName_ = fileName;
-    kistlerFile_ = KistlerCSVFile(fileName_);
+    kistlerFile_ = openKistlerFile(fileName_);
+    sampleWindow_.clear();
+    contactDetector_.reset();
+
+    // A fresh report for the new file.
+    CorruptDataPolicy policy = corruptDataPolicy_ == CorruptDataPolicy::SkipRow
+                                   ? CorruptDataPolicy::Interpolate
+                                   : corruptDataPolicy_;
+    corruptDataReport_ = std::make_shared<CorruptDataReport>();
+    numReportedCells_ = 0;
+    kistlerFile_->setCorruptDataPolicy(policy);
+    kistlerFile_->setCorruptDataReport(corruptDataReport_);
+
+    // The prefetcher reads the same file with its own reader.
+    if (prefetching_ && kistlerFile_->isValid()) {
+      prefetcher_.open(fileName_, policy, corruptDataReport_);
+      sampleWindow_.setPrefetcher(&prefetcher_);
+    } else {
+      prefetcher_.close();
+      sampleWindow_.setPrefetcher(nullptr);
+    }
+    // After the prefetcher, its chunks come off the budget.
+    applyMemoryBudget();
+    numFileRows_ = 0;
+    firstFileTime_ = 0;
   }
 
   // Invalid file...
-  if (!kistlerFile_.isValid()) {
+  if (!kistlerFile_->isValid()) {
     emit invalidFileSignal();
     running_ = false;
     return;
   }
 
+  // Index the file for seeking (also picks up rows appended meanwhile).
+  numFileRows_ = kistlerFile_->getNumRows();
+  firstFileTime_ = kistlerFile_->getTimeOfRow(0);
+  if (std::isinf(firstFileTime_))
+    firstFileTime_ = 0;
+
+  // The offsets of the new file (reads the calibration interval).
+  if (newFile)
+    calibrateOffsets();
+
   // ...or all good.
   running_ = true;
 
+  // The lag is measured from the (re)start on, pausing is not lagging.
+  playbackStats_.restart();
+
   if (!processingTimer_.isActive())
     processingTimer_.start();
 }
@@ -194,25 +1054,66 @@ void DataModel::onStopProcessing() {
 
 // ____________________________________________________________________________
 void DataModel::process() {
-  // Determine number of rows we need to read with sampling rate and the
-  // configured timeframe.
-  // (sampling rate is guaranteed to be != 0)
+  TRACE_SCOPE("DataModel::process");
 
-  // +1 because with 1kHz sampling two rows are 1ms apart, so you need two of
-  // them to span 1ms.
-  size_t attemptedNumRows =
-      configTimeframe_ * kistlerFile_.getSamplingRate() + 1;
+  playbackStats_.startTick(steadyClockUs(), PLAYBACK_DELAY_MS * 1000);
+  uint64_t numAllocations = AllocationCounter::count();
 
   try {
-    auto data =
-        kistlerFile_.getData(firstRow_, firstRow_ + attemptedNumRows - 1);
+    LatencyStamps stamps;
+    stamps.readUs = steadyClockUs();
+
+    // Nothing before the contact period of the header is read.
+    if (skipNonContact_ && kistlerFile_->hasContactPeriod() &&
+        firstRow_ < kistlerFile_->getContactStartRow())
+      firstRow_ = kistlerFile_->getContactStartRow();
+
+    // The timeframe starts at firstRow_ and ends configTimeframe_ later. The
+    // end is found by time, so gaps in the recording are no problem.
+    int windowFirstRow = firstRow_;
+    float windowStartTime = kistlerFile_->getTimeOfRow(firstRow_);
+    float windowStopTime = windowStartTime + configTimeframe_;
+
+    // The analysis windows end with the timeframe, so the longest one decides
+    // from which row on the samples have to be resident. All windows are
+    // taken from the same rows, each row is read only once.
+    int residentFirstRow = firstRow_;
+    for (float analysisTimeframe : analysisTimeframes_)
+      if (analysisTimeframe > configTimeframe_)
+        residentFirstRow = std::min(
+            residentFirstRow,
+            kistlerFile_->getRowAtTime(windowStopTime - analysisTimeframe));
+    sampleWindow_.update(*kistlerFile_, residentFirstRow, windowStopTime);
+    if (sampleWindow_.hasStalled())
+      playbackStats_.countIoStall();
+
+    // Corrupt cells were repaired, the playback goes on.
+    uint64_t numCorruptCells = corruptDataReport_->getNumCells();
+    if (numCorruptCells > numReportedCells_) {
+      qWarning() << "Repaired corrupt data:"
+                 << corruptDataReport_->getSummary().c_str();
+      numReportedCells_ = numCorruptCells;
+      playbackStats_.setCorruptCells(numCorruptCells);
+    }
+    auto data = sampleWindow_.getData(windowStartTime, windowStopTime);
+
+    stamps.parsedUs = steadyClockUs();
 
     if (data->at("abs time (s)").size() != 0) {
       balanceParameters_.update(data);
 
+      // The analysis windows read the resident rows in place, their means
+      // come from the running sums. Nothing is copied, however long they are.
+      for (size_t i = 0; i < analysisTimeframes_.size(); i++)
+        analysisWindows_[i].update(sampleWindow_.getView(
+            windowStopTime - analysisTimeframes_[i], windowStopTime));
+
+      stamps.processedUs = steadyClockUs();
+      balanceParameters_.setLatencyStamps(stamps);
+
       // Period is 1 / sampling rate, * 1000 to get it in miliseconds.
-      firstRow_ =
-          firstRow_ + PLAYBACK_DELAY_MS / kistlerFile_.getSamplingRate() * 1000;
+      firstRow_ = firstRow_ +
+                  PLAYBACK_DELAY_MS / kistlerFile_->getSamplingRate() * 1000;
 
       lastRow_ = firstRow_ + data->at("abs time (s)").size();
       numRows_ = data->at("abs time (s)").size();
@@ -220,12 +1121,47 @@ void DataModel::process() {
       startTime_ = balanceParameters_.getStartTime();
       stopTime_ = balanceParameters_.getStopTime();
       timeframe_ = balanceParameters_.getTimeframe();
+
+      playbackStats_.updateLag(stamps.readUs, startTime_);
     }
 
-    emit dataUpdated(&balanceParameters_);
+    // Only the processing, not the receivers of the signals.
+    playbackStats_.countAllocations(AllocationCounter::count() -
+                                    numAllocations);
 
-    // Check if we reached EOF.
-    if (data->at("abs time (s)").size() < attemptedNumRows) {
+    emit dataUpdated(&balanceParameters_, &analysisWindows_);
+    emit positionChanged(firstRow_, startTime_, numFileRows_);
+
+    // Check if we reached EOF, i.e. the timeframe ends with the last row (the
+    // file may have grown since we counted).
+    int numRowsRead = data->at("abs time (s)").size();
+    if (windowFirstRow + numRowsRead >= numFileRows_)
+      numFileRows_ = kistlerFile_->getNumRows();
+    bool reachedEnd = windowFirstRow + numRowsRead >= numFileRows_;
+
+    // Without contact in the timeframe, jump to the next contact (or as far
+    // as the detector got this tick). After the contact period of the header
+    // there is nothing more to play.
+    if (skipNonContact_ && !reachedEnd && data->count("Fz") > 0) {
+      int windowLastRow = windowFirstRow + numRowsRead - 1;
+      contactDetector_.update(data->at("Fz"), windowFirstRow);
+      if (kistlerFile_->hasContactPeriod() &&
+          windowLastRow >= kistlerFile_->getContactEndRow()) {
+        reachedEnd = true;
+      } else if (numRowsRead > 0 &&
+                 !contactDetector_.hasContact(windowFirstRow, windowLastRow)) {
+        int nextRow = findNextContact(windowLastRow + 1);
+        if (nextRow < 0) {
+          reachedEnd = true;
+        } else {
+          firstRow_ = nextRow;
+          // The jump is not lag.
+          playbackStats_.restart();
+        }
+      }
+    }
+
+    if (reachedEnd) {
       qDebug() << "DataModel::process(): reached EOF";
       emit reachedEOF();
     }
@@ -233,12 +1169,18 @@ void DataModel::process() {
     qWarning() << e.what();
     emit corruptFileSignal();
   }
+
+  playbackStats_.finishTick(steadyClockUs());
+  emit statsUpdated(&playbackStats_);
 }
 
 // ____________________________________________________________________________
 void DataModel::onResetModel() {
   onStopProcessing();
 
+  playbackStats_.reset();
+  playbackStats_.setCorruptCells(numReportedCells_);
+
   startTime_ = 0;
   stopTime_ = 0;
   timeframe_ = 0;
@@ -246,4 +1188,205 @@ void DataModel::onResetModel() {
   firstRow_ = 0;
   lastRow_ = 0;
   numRows_ = 0;
-}
\ No newline at end of file
+
+  sampleWindow_.clear();
+  contactDetector_.reset();
+  // Start over with the offsets of the calibration interval, the drift is
+  // tracked again while playing.
+  if (kistlerFile_->isValid())
+    calibrateOffsets();
+
+  emit positionChanged(0, firstFileTime_, numFileRows_);
+}
+
+// ____________________________________________________________________________
+void DataModel::seekToRow(int row) {
+  if (!kistlerFile_->isValid())
+    return;
+
+  TRACE_SCOPE("DataModel::seekToRow");
+
+  // Leave a full timeframe (plus a row), otherwise process() would report the
+  // end of the file right away.
+  float lastTime = kistlerFile_->getTimeOfRow(numFileRows_ - 1);
+  int lastStartRow =
+      std::max(0, kistlerFile_->getRowAtTime(lastTime - configTimeframe_) - 1);
+  firstRow_ = std::min(std::max(row, 0), lastStartRow);
+
+  // The jump is not lag.
+  playbackStats_.restart();
+
+  process();
+}
+
+// ____________________________________________________________________________
+void DataModel::seekToTime(float time) {
+  if (!kistlerFile_->isValid())
+    return;
+
+  seekToRow(kistlerFile_->getRowAtTime(time));
+}
+
+// ____________________________________________________________________________
+void DataModel::onTimeframeChanged(float timeframe) {
+  if (timeframe <= 0)
+    return;
+
+  // The next tick uses it. The SampleWindow reads only the rows that are
+  // missing when growing and keeps the rest when shrinking, so there is no
+  // hiccup.
+  qInfo() << "Changing the timeframe to" << timeframe << "s";
+  configTimeframe_ = timeframe;
+}
+
+// ____________________________________________________________________________
+void DataModel::setAnalysisTimeframes(const std::vector<float> &timeframes) {
+  analysisTimeframes_.clear();
+  for (float timeframe : timeframes)
+    if (timeframe > 0)
+      analysisTimeframes_.push_back(timeframe);
+
+  analysisWindows_.assign(analysisTimeframes_.size(), BalanceParameters());
+  setSpectralAnalysis(spectralAnalysis_);
+  applyMemoryBudget();
+}
+
+// ____________________________________________________________________________
+void DataModel::setSpectralAnalysis(bool spectralAnalysis) {
+  spectralAnalysis_ = spectralAnalysis;
+  for (size_t i = 0; i < analysisWindows_.size(); i++)
+    analysisWindows_[i].setSpectralAnalysis(
+        spectralAnalysis_ && analysisTimeframes_[i] >= SPECTRUM_MIN_S
+            ? SpectralAnalysis::Sliding
+            : SpectralAnalysis::None);
+}
+
+// ____________________________________________________________________________
+void DataModel::setSkipNonContact(bool skipNonContact) {
+  skipNonContact_ = skipNonContact;
+}
+
+// ____________________________________________________________________________
+int DataModel::findNextContact(int row) {
+  // Found already, e.g. while scanning for the previous contact.
+  int contactStart = contactDetector_.getNextContactStart(row);
+  if (contactStart >= 0)
+    return contactStart;
+
+  TRACE_SCOPE("DataModel::findNextContact");
+
+  // Go on where the detector stopped, in chunks like the Prefetcher.
+  float samplingRate = kistlerFile_->getSamplingRate();
+  row = std::max(row, contactDetector_.getNextRow());
+  int stopRow = row + static_cast<int>(CONTACT_SCAN_S * samplingRate);
+  int chunkRows =
+      std::max(1, static_cast<int>(PREFETCH_MS * samplingRate / 1000));
+  while (row < stopRow) {
+    auto data =
+        kistlerFile_->getData(row, std::min(row + chunkRows, stopRow) - 1);
+    const auto &forces = data->at("Fz");
+    if (forces.empty())
+      return -1;
+
+    size_t numPeriods = contactDetector_.getContactPeriods().size();
+    contactDetector_.update(forces, row);
+    if (contactDetector_.getContactPeriods().size() > numPeriods)
+      return contactDetector_.getContactPeriods()[numPeriods].first;
+    row += forces.size();
+  }
+  return row;
+}
+
+// ____________________________________________________________________________
+void DataModel::setMemoryBudget(size_t bytes) {
+  memoryBudget_ = bytes;
+  applyMemoryBudget();
+}
+
+// ____________________________________________________________________________
+void DataModel::setOffsetCalibration(bool offsetCalibration) {
+  if (offsetCalibration == offsetCalibration_)
+    return;
+  offsetCalibration_ = offsetCalibration;
+
+  // The resident rows have the old offsets (or none), they are read again.
+  if (kistlerFile_->isValid()) {
+    calibrateOffsets();
+    sampleWindow_.clear();
+  }
+}
+
+// ____________________________________________________________________________
+void DataModel::calibrateOffsets() {
+  OffsetCalibrator &calibrator = sampleWindow_.getOffsetCalibrator();
+  if (!offsetCalibration_) {
+    calibrator.clear();
+    return;
+  }
+  TRACE_SCOPE("DataModel::calibrateOffsets");
+
+  float samplingRate = kistlerFile_->getSamplingRate();
+  calibrator.configure(kistlerFile_->getColumnNames(), samplingRate,
+                       CONTACT_OFF_THRESHOLD_N);
+
+  // The configured interval, or the unloaded plate before the contact.
+  int startRow, stopRow;
+  if (calibrationStopTime_ > calibrationStartTime_) {
+    startRow = kistlerFile_->getRowAtTime(calibrationStartTime_);
+    stopRow = kistlerFile_->getRowAfterTime(calibrationStopTime_) - 1;
+  } else {
+    int numRows = static_cast<int>(CALIBRATION_S * samplingRate);
+    stopRow = kistlerFile_->hasContactPeriod()
+                  ? kistlerFile_->getContactStartRow() - 1
+                  : numRows - 1;
+    startRow = std::max(stopRow + 1 - numRows, 0);
+  }
+  stopRow = std::min(stopRow, numFileRows_ - 1);
+
+  bool calibrated = false;
+  if (stopRow >= startRow) {
+    try {
+      calibrated = calibrator.calibrate(
+          *kistlerFile_->getData(startRow, stopRow));
+    } catch (const CorruptKistlerFileException &e) {
+      qWarning() << "Corrupt calibration interval:" << e.what();
+    }
+  }
+
+  if (calibrated)
+    qInfo() << "Zero offsets from rows" << startRow << "to" << stopRow
+            << ": Fx" << calibrator.getOffset("Fx") << "Fy"
+            << calibrator.getOffset("Fy") << "Fz"
+            << calibrator.getOffset("Fz");
+  else
+    qInfo() << "No unloaded rows to calibrate the zero offsets, taking the "
+               "first ones while playing.";
+}
+
+// ____________________________________________________________________________
+void DataModel::applyMemoryBudget() {
+  size_t numColumns = kistlerFile_->getColumnNames().size();
+  if (memoryBudget_ == 0 || numColumns == 0) {
+    sampleWindow_.setMaxRows(0);
+    return;
+  }
+
+  // The chunks of the prefetcher come off the budget first.
+  size_t budget = memoryBudget_;
+  if (prefetcher_.isOpen()) {
+    size_t prefetchBytes = PREFETCH_MAX_CHUNKS * prefetcher_.getChunkRows() *
+                           numColumns * sizeof(float);
+    budget -= std::min(budget, prefetchBytes);
+  }
+
+  // The resident rows with their running sums, plus the copy for the
+  // timeframe (at most as many rows as are resident). The analysis windows
+  // read the resident rows in place.
+  const char *summedColumns[] = {SUMMED_COLUMNS};
+  size_t numSums = std::size(summedColumns) + 1;
+  size_t bytesPerRow =
+      numColumns * sizeof(float) * 2 + numSums * sizeof(double);
+  int maxRows = std::min<size_t>(budget / bytesPerRow,
+                                 std::numeric_limits<int>::max());
+  sampleWindow_.setMaxRows(std::max(maxRows, 1));
+}
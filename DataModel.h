@@ -3,10 +3,19 @@
 
 #pragma once
 
+#include "./Diffusion.h"
+#include "./Instrumentation.h"
 #include "./KistlerFile.h"
+#include "./Preprocessing.h"
+#include "./Spectral.h"
 #include <QtCore/QDebug>
 #include <QtCore/QObject>
 #include <QtCore/QTimer>
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 // The current implementation is not for real live view, but playback of a CSV
 // file. This sets the speed of the playback (delay between re-processing in
@@ -15,13 +24,80 @@
 // 1-7ms, so sth. like 10ms seems reasonable.
 #define PLAYBACK_DELAY_MS 10
 
+// Default analysis windows in seconds next to the configured timeframe: a
+// medium one for a smoothed display and a long one for summary statistics of
+// the session.
+#define MEDIUM_TIMEFRAME_S 1
+#define LONG_TIMEFRAME_S 30
+
+// Memory budget in MB for the samples held in memory, for the DataModel and
+// for the review window each. It can be overridden by the environment
+// variable, 0 means no limit.
+#define DEFAULT_MEMORY_BUDGET_MB 256
+#define MEMORY_BUDGET_ENV_VARIABLE "FORCEPLATE_MEMORY_BUDGET_MB"
+
+// How far the Prefetcher reads ahead of the timeframe in ms (a chunk). The
+// number of rows follows from the sampling rate of the file.
+#define PREFETCH_MS 300
+
+// The Prefetcher holds at most this many chunks (one being read, ready or
+// taken, and a spare one to read into), they count against the memory budget.
+#define PREFETCH_MAX_CHUNKS 2
+
+// Vertical force (|Fz| in N) above which someone is on the plate, and below
+// which they left it again. The empty plate reads a few N of noise, standing
+// is hundreds. The gap keeps swaying around a single threshold from toggling.
+#define CONTACT_ON_THRESHOLD_N 50
+#define CONTACT_OFF_THRESHOLD_N 25
+
+// When skipping a stretch without contact, process() reads ahead at most this
+// many seconds of the file per tick to find the next contact, so a long empty
+// stretch doesn't block a single tick.
+#define CONTACT_SCAN_S 10
+
+// Analysis windows of at least this many seconds get COP spectra (if switched
+// on), shorter ones can't resolve the band below 0.5 Hz.
+#define SPECTRUM_MIN_S 5
+
+// The columns BalanceParameters averages. The SampleWindow keeps running sums
+// of them, so the mean over an analysis window takes no pass over its rows.
+#define SUMMED_COLUMNS "Fx", "Fy", "Ax", "Ay"
+
+// A range of the resident rows of a SampleWindow, read in place instead of
+// copied (see SampleWindow::getView()). The sums of the SUMMED_COLUMNS and the
+// number of rows with contact (a COP other than 0) come from the running sums
+// of the SampleWindow, in O(1) however many rows the range has. Only valid
+// until the SampleWindow is updated again.
+class SampleView {
+public:
+  int size() const { return numRows_; }
+
+  // The values of the column in the range, nullptr if there is no such
+  // column.
+  const float *getColumn(const std::string &name) const;
+
+  // The sum of one of the SUMMED_COLUMNS over the range, 0 for other columns.
+  double getSum(const std::string &name) const;
+
+  // Number of rows with contact, 0 without COP columns.
+  int getNumContactRows() const;
+
+private:
+  friend class SampleWindow;
+  const std::unordered_map<std::string, std::vector<float>> *columns_ = nullptr;
+  const std::unordered_map<std::string, std::vector<double>> *sums_ = nullptr;
+  const std::vector<double> *contactSums_ = nullptr;
+  size_t first_ = 0;
+  int numRows_ = 0;
+};
+
 // Class for the balance parameters for a specified timeframe (e.g. 50ms).
 // The constructor takes a KistlerCSVFile as input. There are methods for
 // re-calculating the parameters (i.e. to regularly update the parameters
 // with the latest data).
 // The balance parameters are calculated from the raw data.
-// For now, forces in X and Y direction are averaged over a user-configured
-// timeframe.
+// For now, forces in X and Y direction and the COP are averaged over a
+// user-configured timeframe.
 class BalanceParameters {
 public:
   // Constructor with data provided.
@@ -40,6 +116,11 @@ public:
       const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
           &data);
 
+  // Re-calculate the parameters from rows read in place, e.g. for analysis
+  // windows that move on by a few rows per tick. The means come from the
+  // running sums of the view, nothing is copied (so getData() is null after).
+  void update(const SampleView &view);
+
   // Some sanity checks on the provided data.
   void validateData();
 
@@ -52,6 +133,23 @@ public:
   void calculateParameters();
   void calculateMeanForceX();
   void calculateMeanForceY();
+  // Mean COP over the rows with plate contact (BioWare writes a COP of exactly
+  // 0 without contact). 0 if there is no contact or no COP columns.
+  void calculateMeanCop();
+  // Power spectra of COP x and y, see SpectralAnalyzer. Nothing without
+  // spectral analysis or COP columns.
+  void calculateSpectra();
+
+  // How the COP spectra are calculated, None by default. Sliding is for a
+  // window that is updated over and over as it moves on.
+  void setSpectralAnalysis(SpectralAnalysis spectralAnalysis);
+  SpectralAnalysis getSpectralAnalysis() const { return spectralAnalysis_; }
+
+  // Stabilogram diffusion of the COP, see StabilogramDiffusion. Off by
+  // default, it is for whole trials (its lags go up to DIFFUSION_MAX_LAG_S).
+  void calculateDiffusion();
+  void setDiffusionAnalysis(bool diffusionAnalysis);
+  bool getDiffusionAnalysis() const { return diffusion_ != nullptr; }
 
   // Getters.
   bool isValid() const { return isValid_; }
@@ -61,6 +159,49 @@ public:
   int getNumRows() const { return numRows_; }
   float getMeanForceX() const { return meanForceX_; }
   float getMeanForceY() const { return meanForceY_; }
+  float getMeanCopX() const { return meanCopX_; }
+  float getMeanCopY() const { return meanCopY_; }
+  const SpectrumSummary &getCopSpectrumX() const { return copSpectrumX_; }
+  const SpectrumSummary &getCopSpectrumY() const { return copSpectrumY_; }
+
+  // The analyzers with the whole spectra, null without spectral analysis.
+  // Copies of the parameters share them (only the original is updated).
+  const std::shared_ptr<SpectralAnalyzer> &getCopSpectralAnalyzerX() const {
+    return copAnalyzerX_;
+  }
+  const std::shared_ptr<SpectralAnalyzer> &getCopSpectralAnalyzerY() const {
+    return copAnalyzerY_;
+  }
+  const DiffusionSummary &getDiffusionX() const { return diffusionX_; }
+  const DiffusionSummary &getDiffusionY() const { return diffusionY_; }
+  const DiffusionSummary &getDiffusionPlanar() const {
+    return diffusionPlanar_;
+  }
+  // With the curves, null without diffusion analysis (shared by copies).
+  const std::shared_ptr<StabilogramDiffusion> &getStabilogramDiffusion() const {
+    return diffusion_;
+  }
+
+  // Drop the data, keeping only the parameters (e.g. for many trials).
+  void releaseData() {
+    rawData_.reset();
+    data_.reset();
+  }
+
+  // The preprocessed data the parameters were calculated from (e.g. for
+  // plotting the raw COP). Null if the parameters were never updated (or
+  // released).
+  const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>> &
+  getData() const {
+    return data_;
+  }
+
+  // Latency stamps of the batch these parameters were calculated from. They
+  // are set by the DataModel, see LatencyStamps in Instrumentation.h.
+  const LatencyStamps &getLatencyStamps() const { return latencyStamps_; }
+  void setLatencyStamps(const LatencyStamps &stamps) {
+    latencyStamps_ = stamps;
+  }
 
 private:
   // The raw data.
@@ -80,10 +221,375 @@ private:
   // The parameters.
   float meanForceX_;
   float meanForceY_;
+  float meanCopX_;
+  float meanCopY_;
+  SpectrumSummary copSpectrumX_;
+  SpectrumSummary copSpectrumY_;
+
+  SpectralAnalysis spectralAnalysis_;
+  std::shared_ptr<SpectralAnalyzer> copAnalyzerX_;
+  std::shared_ptr<SpectralAnalyzer> copAnalyzerY_;
+
+  DiffusionSummary diffusionX_;
+  DiffusionSummary diffusionY_;
+  DiffusionSummary diffusionPlanar_;
+  std::shared_ptr<StabilogramDiffusion> diffusion_;
+
+  LatencyStamps latencyStamps_;
+
+  // Set all parameters to 0, invalid.
+  void invalidate();
+
+  // The spectra and the diffusion of numRows rows of the columns (the COP
+  // ones may be nullptr).
+  void calculateSpectra(const float *times, const float *copX,
+                        const float *copY, int numRows);
+  void calculateDiffusion(const float *times, const float *copX,
+                          const float *copY, int numRows);
 
   FRIEND_TEST(BalanceParametersTest, calculateMeanForceX);
   FRIEND_TEST(BalanceParametersTest, calculateMeanForceY);
+  FRIEND_TEST(BalanceParametersTest, calculateMeanCop);
   FRIEND_TEST(BalanceParametersTest, validateData);
+  FRIEND_TEST(BalanceParametersTest, calculateSpectra);
+  FRIEND_TEST(BalanceParametersTest, calculateDiffusion);
+};
+
+// A single COP sample (in meters) with its time stamp (in seconds).
+struct CopSample {
+  float time;
+  float x;
+  float y;
+};
+
+// The COP samples of the last seconds for plotting the COP trajectory. The
+// samples are kept in a ring buffer of fixed capacity, so appending never
+// allocates and the oldest samples are simply overwritten.
+// The batches from the DataModel overlap (each one holds the whole timeframe),
+// so only samples newer than the last appended one are taken.
+class CopTrail {
+public:
+  explicit CopTrail(size_t capacity);
+
+  // Append the samples of a batch (columns of the same length) that are newer
+  // than the last appended sample. Returns the number of appended samples.
+  size_t append(const std::vector<float> &time, const std::vector<float> &x,
+                const std::vector<float> &y);
+
+  void clear();
+
+  // Number of samples held, the capacity and the i-th oldest sample.
+  size_t size() const { return size_; }
+  size_t capacity() const { return samples_.size(); }
+  const CopSample &operator[](size_t i) const {
+    return samples_[(head_ + i) % samples_.size()];
+  }
+
+  // Number of samples appended since the last clear(), including the
+  // overwritten ones. Sample number n (counting from 0) is at index
+  // n - (getNumAppended() - size()) as long as it is held.
+  uint64_t getNumAppended() const { return numAppended_; }
+
+  // Time of the newest sample, -infinity if there is none.
+  float getLastTime() const { return lastTime_; }
+
+private:
+  std::vector<CopSample> samples_;
+  // Index of the oldest sample.
+  size_t head_;
+  size_t size_;
+  uint64_t numAppended_;
+  float lastTime_;
+};
+
+// An inclusive range of bins of a CopHistogram2D.
+struct BinRect {
+  int firstX;
+  int firstY;
+  int lastX;
+  int lastY;
+  bool isEmpty() const { return firstX > lastX || firstY > lastY; }
+};
+
+// A 2D histogram of the COP over the plate surface, accumulated over a whole
+// session. Counting a sample is O(1). The histogram remembers which bins
+// changed (as a bounding box), so a view only has to refresh those.
+class CopHistogram2D {
+public:
+  // numBins x numBins bins covering [-range, range] in both directions.
+  CopHistogram2D(float range, int numBins);
+
+  // Count a sample. Samples without contact (COP of exactly 0) and samples
+  // outside the range are ignored. Returns true if the sample was counted.
+  bool add(float x, float y);
+
+  void clear();
+
+  float getRange() const { return range_; }
+  int getNumBins() const { return numBins_; }
+  uint32_t getCount(int binX, int binY) const {
+    return counts_[binY * numBins_ + binX];
+  }
+  uint32_t getMaxCount() const { return maxCount_; }
+  uint64_t getTotalCount() const { return totalCount_; }
+
+  // Bin of a coordinate, -1 if it is out of range.
+  int toBin(float value) const;
+
+  // The bins that changed since the last call (empty if none).
+  BinRect takeDirtyBins();
+
+private:
+  float range_;
+  int numBins_;
+  std::vector<uint32_t> counts_;
+  uint32_t maxCount_;
+  uint64_t totalCount_;
+  BinRect dirty_;
+};
+
+// Data maps ("frames") with the columns of a file, recycled so that handing
+// out the same amounts of rows tick after tick does not allocate. A frame
+// handed out by acquire() returns to the pool when the last shared_ptr to it
+// is dropped, its vectors keep their capacity. Not thread-safe, a pool is used
+// by one thread (frames may only be passed on within that thread).
+class FramePool {
+public:
+  // The columns of new frames, drops all frames if they change.
+  void setColumnNames(const std::vector<std::string> &columnNames);
+
+  // A frame with empty columns that can hold numRows rows. The frame that fits
+  // best is taken (the smallest that is large enough, otherwise the largest),
+  // so frames of windows of different lengths don't have to grow in turn.
+  std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+  acquire(size_t numRows);
+
+  void clear() { frames_.clear(); }
+
+  // Number of frames, in use or not.
+  size_t size() const { return frames_.size(); }
+
+private:
+  std::vector<std::string> columnNames_;
+  std::vector<
+      std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>>
+      frames_;
+};
+
+// Reads the rows ahead of the playback in a background thread, so process()
+// does not have to wait for the disk. A chunk of PREFETCH_MS is read while the
+// previous one is being played (double buffering).
+// The thread reads with its own KistlerFile, the row index of a KistlerCSVFile
+// (and the decoded block of a KistlerArchiveFile) is not thread-safe.
+class Prefetcher {
+public:
+  Prefetcher();
+  // Stops the thread.
+  ~Prefetcher();
+
+  // Open a file and start the thread (after closing the previous one). Does
+  // nothing more if the file is invalid. The corrupt cells are handled by the
+  // policy and added to the report (one of its own if none is given).
+  void open(const std::string &fileName,
+            CorruptDataPolicy policy = CorruptDataPolicy::Abort,
+            std::shared_ptr<CorruptDataReport> report = nullptr);
+  void close();
+
+  // If the thread is running (the file is open and valid).
+  bool isOpen() const { return thread_.joinable(); }
+
+  // Number of rows of a chunk.
+  int getChunkRows() const { return chunkRows_; }
+
+  // Start reading the chunk from firstRow on in the background. A pending
+  // chunk for another row is discarded (e.g. after seeking).
+  void request(int firstRow);
+
+  // Take the chunk from firstRow on. Returns nullptr if it was not requested,
+  // could not be read (e.g. a corrupt row) or, without wait, is not read yet.
+  std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+  take(int firstRow, bool wait);
+
+  // Give a taken chunk back when done with it, the next chunk is read into
+  // its vectors (it is dropped if there are PREFETCH_MAX_CHUNKS already).
+  void recycle(
+      std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+          chunk);
+
+private:
+  // The background thread.
+  void run();
+
+  std::unique_ptr<KistlerFile> file_;
+  int chunkRows_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stop_;
+  // First row of the requested chunk (-1 if none), and of the chunk read.
+  int requestedRow_;
+  int readyRow_;
+  std::shared_ptr<std::unordered_map<std::string, std::vector<float>>> ready_;
+  // Chunks given back (or discarded), to read into.
+  std::vector<
+      std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>>
+      spare_;
+
+  // Keep a chunk to read into, unless there are enough (call with the lock
+  // held).
+  void addSpare(
+      std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+          chunk);
+};
+
+// The rows of the file around the current timeframe (and the analysis windows
+// ending with it), kept in memory. Moving the timeframe forward only drops
+// rows at the front and reads the rows that are new at the end, so each row is
+// read from the file once. Rows after the end of the timeframe stay resident,
+// so shrinking the timeframe and growing it back (or advancing into them) does
+// not read anything either. Only a jump backwards or past the resident rows
+// starts over.
+class SampleWindow {
+public:
+  SampleWindow();
+
+  // Make the rows from firstRow up to stopTime (inclusive, within a quarter
+  // sample period) resident, reading only those that are not resident yet.
+  void update(const KistlerFile &file, int firstRow, float stopTime);
+
+  // Copy of the resident rows with startTime <= "abs time (s)" <= stopTime
+  // (within a quarter sample period), e.g. for BalanceParameters. The map is
+  // empty if update() was never called. The copies come from a FramePool,
+  // drop them when done so they can be reused.
+  std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+  getData(float startTime, float stopTime) const;
+
+  // The same rows read in place, with the running sums for their means. Only
+  // valid until the next update().
+  SampleView getView(float startTime, float stopTime) const;
+
+  void clear();
+
+  // Keep at most this many rows resident (0 for no limit). If the rows from
+  // firstRow to stopTime are more, the timeframe is cut at the front, and rows
+  // after stopTime are evicted first.
+  void setMaxRows(int maxRows) { maxRows_ = std::max(maxRows, 0); }
+  int getMaxRows() const { return maxRows_; }
+
+  // Take the rows from the prefetcher when they are needed, and keep it a
+  // chunk ahead of the timeframe (nullptr to read only when needed).
+  void setPrefetcher(Prefetcher *prefetcher) { prefetcher_ = prefetcher; }
+
+  // Filter the rows with a SpikeFilter of the given window as they are read
+  // (1 for no filtering). Drops the resident rows, they are read again.
+  void setSpikeFilterWindow(int windowSize);
+  int getSpikeFilterWindow() const { return spikeFilterWindow_; }
+
+  // Removes the offsets from the rows as they are read (after the spike
+  // filter), off until it is configured. Clear the resident rows after
+  // changing the offsets.
+  OffsetCalibrator &getOffsetCalibrator() { return offsetCalibrator_; }
+  const OffsetCalibrator &getOffsetCalibrator() const {
+    return offsetCalibrator_;
+  }
+
+  // If the last update() had to wait for rows to be read.
+  bool hasStalled() const { return stalled_; }
+
+  // First resident row and number of resident rows (also those after the
+  // timeframe).
+  int getFirstRow() const { return firstRow_; }
+  int getNumResidentRows() const { return numRows_; }
+
+  // Number of rows read from the file since the last clear().
+  uint64_t getNumRowsRead() const { return numRowsRead_; }
+
+  // Number of frames of the copies, in use or not.
+  size_t getNumFrames() const { return framePool_.size(); }
+
+private:
+  // The resident rows start at index offset_ of the columns, the rows before
+  // it were dropped but are only erased now and then.
+  std::unordered_map<std::string, std::vector<float>> columns_;
+  size_t offset_;
+  // Quarter sample period of the file.
+  float tolerance_;
+  int firstRow_;
+  int numRows_;
+  int maxRows_;
+  uint64_t numRowsRead_;
+  Prefetcher *prefetcher_;
+  bool stalled_;
+  // The copies handed out by getData().
+  mutable FramePool framePool_;
+  int spikeFilterWindow_;
+  SpikeFilter spikeFilter_;
+  OffsetCalibrator offsetCalibrator_;
+
+  // Running sums of the SUMMED_COLUMNS and of the rows with contact, aligned
+  // with the columns: entry i is the sum of the values before index i (so
+  // there is one entry more). Empty for columns the file doesn't have.
+  std::unordered_map<std::string, std::vector<double>> sums_;
+  std::vector<double> contactSums_;
+
+  // Append rows at the end, returns the number of rows.
+  int append(const std::unordered_map<std::string, std::vector<float>> &data);
+
+  // Read rows from the file and append them right to the columns, returns
+  // the number of rows.
+  int readRows(const KistlerFile &file, int firstRow, int stopRow);
+
+  // Erase the dropped rows at the front of the columns.
+  void compact();
+
+  // Extend the running sums by the rows from the index on (the ones that are
+  // new, after the preprocessing), or cut them to the resident rows.
+  void extendSums(size_t firstIndex);
+  void truncateSums();
+
+  // Indices into the columns of the resident rows from startTime to stopTime
+  // (the last one exclusive).
+  void findRows(float startTime, float stopTime, size_t *firstIndex,
+                size_t *lastIndex) const;
+};
+
+// Finds the contact periods (someone on the plate) in a stream of Fz samples,
+// by threshold with hysteresis. For files without a contact period in the
+// header, or with several.
+class ContactDetector {
+public:
+  ContactDetector(float onThreshold = CONTACT_ON_THRESHOLD_N,
+                  float offThreshold = CONTACT_OFF_THRESHOLD_N);
+
+  // Feed the Fz samples of the rows from firstRow on. Rows that were fed
+  // before are skipped, after a gap (e.g. a seek) it continues at firstRow.
+  void update(const std::vector<float> &forces, int firstRow);
+
+  // If the last row fed is in contact, and the next row to feed.
+  bool isInContact() const { return inContact_; }
+  int getNextRow() const { return nextRow_; }
+
+  // The contact periods so far, first and last row (-1 while ongoing).
+  const std::vector<std::pair<int, int>> &getContactPeriods() const {
+    return periods_;
+  }
+
+  // If there is contact in any of the rows (as far as they were fed).
+  bool hasContact(int firstRow, int lastRow) const;
+
+  // First row of the first contact period starting at or after the row, -1
+  // if none was found so far.
+  int getNextContactStart(int row) const;
+
+  void reset();
+
+private:
+  float onThreshold_;
+  float offThreshold_;
+  bool inContact_;
+  int nextRow_;
+  std::vector<std::pair<int, int>> periods_;
 };
 
 // A class for the data management. It is the "model" in the
@@ -101,22 +607,154 @@ public:
 
   bool isRunning() { return running_; }
 
+  // Timing statistics of the playback loop (for the performance HUD).
+  const PlaybackStats &getPlaybackStats() const { return playbackStats_; }
+
+  // Number of data rows of the current file (0 if none is open).
+  int getNumFileRows() const { return numFileRows_; }
+
+  // Additional analysis windows (timeframes in seconds). Their parameters are
+  // calculated in every tick over the timeframe ending with the configured
+  // one, from the same resident samples. Non-positive timeframes are ignored.
+  void setAnalysisTimeframes(const std::vector<float> &timeframes);
+  const std::vector<float> &getAnalysisTimeframes() const {
+    return analysisTimeframes_;
+  }
+
+  // COP spectra of the analysis windows of at least SPECTRUM_MIN_S (off by
+  // default). They slide on with the windows, see SpectralAnalyzer.
+  void setSpectralAnalysis(bool spectralAnalysis);
+  bool getSpectralAnalysis() const { return spectralAnalysis_; }
+
+  // Limit the memory for the samples (in bytes, 0 for no limit). Only the rows
+  // of the longest window stay in memory anyway, the budget limits that
+  // (cutting long analysis windows at the front) so the memory is bounded
+  // also for long windows of a high-rate recording. The chunks of the
+  // Prefetcher count against it. The row index of the file is not in the
+  // budget, it is bounded by ROW_INDEX_MAX_ENTRIES on its own.
+  void setMemoryBudget(size_t bytes);
+  size_t getMemoryBudget() const { return memoryBudget_; }
+
+  // Read ahead in a background thread (on by default), see Prefetcher. Takes
+  // effect with the next file.
+  void setPrefetching(bool prefetching) { prefetching_ = prefetching; }
+
+  // Only play back while someone is on the plate (off by default). The
+  // playback starts at the contact period of the header (nothing before it
+  // is read) and ends with it. Stretches without contact in between (or in
+  // files without a contact period) are found by a ContactDetector and
+  // skipped right away instead of played in real time.
+  void setSkipNonContact(bool skipNonContact);
+  bool getSkipNonContact() const { return skipNonContact_; }
+
+  // What to do with cells of the file that are no number (Interpolate by
+  // default, so a glitch doesn't end the playback). Skipping rows would shift
+  // the row numbers the playback goes by, so SkipRow interpolates as well
+  // while playing. Takes effect with the next file.
+  void setCorruptDataPolicy(CorruptDataPolicy policy) {
+    corruptDataPolicy_ = policy;
+  }
+  CorruptDataPolicy getCorruptDataPolicy() const { return corruptDataPolicy_; }
+
+  // Remove spikes with a running median over windowSize samples (1 for none,
+  // the default), see SpikeFilter. Applies from the next tick on.
+  void setSpikeFilterWindow(int windowSize) {
+    sampleWindow_.setSpikeFilterWindow(windowSize);
+  }
+  int getSpikeFilterWindow() const {
+    return sampleWindow_.getSpikeFilterWindow();
+  }
+
+  // Subtract the zero offsets of the force and moment channels (off by
+  // default), see OffsetCalibrator. They are estimated from the unloaded rows
+  // between startTime and stopTime (in s), or with stopTime <= startTime (the
+  // default) from the CALIBRATION_S before the contact period of the header
+  // (or at the start of the file without one). Applies from the next tick on,
+  // with a file that is open right away.
+  void setOffsetCalibration(bool offsetCalibration);
+  bool getOffsetCalibration() const { return offsetCalibration_; }
+  void setCalibrationInterval(float startTime, float stopTime) {
+    calibrationStartTime_ = startTime;
+    calibrationStopTime_ = stopTime;
+  }
+  const OffsetCalibrator &getOffsetCalibrator() const {
+    return sampleWindow_.getOffsetCalibrator();
+  }
+
+  // The corrupt cells of the current file found so far.
+  const CorruptDataReport &getCorruptDataReport() const {
+    return *corruptDataReport_;
+  }
+
   FRIEND_TEST(DataModelTest, defaultConstructor);
   FRIEND_TEST(DataModelTest, onStartProcessing);
   FRIEND_TEST(DataModelTest, onStopProcessing);
   FRIEND_TEST(DataModelTest, onResetModel);
   FRIEND_TEST(DataModelTest, process);
+  FRIEND_TEST(DataModelTest, playbackStats);
+  FRIEND_TEST(DataModelTest, seek);
+  FRIEND_TEST(DataModelTest, archivePlayback);
+  FRIEND_TEST(DataModelTest, onTimeframeChanged);
+  FRIEND_TEST(DataModelTest, analysisWindows);
+  FRIEND_TEST(DataModelTest, setMemoryBudget);
+  FRIEND_TEST(DataModelTest, skipNonContact);
+  FRIEND_TEST(DataModelTest, allocations);
+  FRIEND_TEST(DataModelTest, corruptData);
+  FRIEND_TEST(DataModelTest, offsetCalibration);
+  FRIEND_TEST(DataModelTest, spectralAnalysis);
 
 private:
   // State variables.
   bool running_;
 
-  // A KistlerFile to read the data from.
-  KistlerCSVFile kistlerFile_;
+  // A KistlerFile to read the data from (a BioWare export or an archive).
+  std::unique_ptr<KistlerFile> kistlerFile_;
+
+  // The rows of the current timeframe (and a few more), see SampleWindow.
+  SampleWindow sampleWindow_;
+  Prefetcher prefetcher_;
+  bool prefetching_;
 
   // Balance parameters, regularly updated by the timed function process().
   BalanceParameters balanceParameters_;
 
+  // Timeframes and parameters of the additional analysis windows.
+  std::vector<float> analysisTimeframes_;
+  std::vector<BalanceParameters> analysisWindows_;
+  bool spectralAnalysis_;
+
+  // Handling of corrupt cells, the report is shared with the prefetcher. The
+  // number of cells reported so far is for warning about new ones.
+  CorruptDataPolicy corruptDataPolicy_;
+  std::shared_ptr<CorruptDataReport> corruptDataReport_;
+  uint64_t numReportedCells_;
+
+  // Zero offset calibration and its interval (in s, empty for the one before
+  // the contact).
+  bool offsetCalibration_;
+  float calibrationStartTime_;
+  float calibrationStopTime_;
+
+  // Configure the OffsetCalibrator of the SampleWindow for the file and
+  // estimate the offsets from the calibration interval (reads only that).
+  // Switches it off without offset calibration.
+  void calibrateOffsets();
+
+  // Skipping the stretches without contact.
+  bool skipNonContact_;
+  ContactDetector contactDetector_;
+
+  // The first row of the next contact period at or after the row, read ahead
+  // by the ContactDetector for at most CONTACT_SCAN_S seconds. If none is
+  // found in that time, it returns the row after the rows read (to go on from
+  // there), and -1 at the end of the file.
+  int findNextContact(int row);
+
+  // Memory budget in bytes (0 for none) and applying it to the SampleWindow
+  // (depends on the number of columns and windows).
+  size_t memoryBudget_;
+  void applyMemoryBudget();
+
   // Name of the data file.
   std::string fileName_;
 
@@ -136,9 +774,17 @@ private:
   int firstRow_;
   int lastRow_;
 
+  // Number of data rows and time of the first sample of the file, for
+  // seeking.
+  int numFileRows_;
+  float firstFileTime_;
+
   // Timer for regular re-calculation with newest data.
   QTimer processingTimer_;
 
+  // Tick durations, dropped ticks and lag behind real time.
+  PlaybackStats playbackStats_;
+
 private slots:
   // Re-read the latest data and calculate the BalanceParameters.
   // This slot is called regularly by the timer.
@@ -152,10 +798,28 @@ public slots:
   void onStopProcessing();
   void onResetModel();
 
+  // Jump to a row or time of the file (the start of the timeframe) and
+  // process it right away, so the parameters of the new timeframe are
+  // published immediately, also while paused. The position is clamped such
+  // that a full timeframe is left before the end of the file.
+  void seekToRow(int row);
+  void seekToTime(float time);
+
+  // Change the timeframe (in seconds) while running, it applies from the next
+  // tick on.
+  void onTimeframeChanged(float timeframe);
+
 signals:
   // These signals are elicited when new parameters are calculated, when the end
   // of file is reached, when a corrupt file is detected while processing etc.
-  void dataUpdated(const BalanceParameters *balanceParameters);
+  // The parameters of the configured timeframe drive the feedback, the
+  // analysis windows are in the order of getAnalysisTimeframes().
+  void dataUpdated(const BalanceParameters *balanceParameters,
+                   const std::vector<BalanceParameters> *analysisWindows);
+  void statsUpdated(const PlaybackStats *playbackStats);
+  // The playback position (first row of the timeframe and its time) and the
+  // number of rows of the file.
+  void positionChanged(int row, float time, int numRows);
   void reachedEOF();
   void invalidFileSignal();
   void corruptFileSignal();
@@ -0,0 +1,142 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#include "./Diffusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+// ____________________________________________________________________________
+void StabilogramDiffusion::reset() {
+  curveX_.clear();
+  curveY_.clear();
+  curvePlanar_.clear();
+  lagStep_ = 0;
+  summaryX_ = DiffusionSummary();
+  summaryY_ = DiffusionSummary();
+  summaryPlanar_ = DiffusionSummary();
+}
+
+// ____________________________________________________________________________
+void StabilogramDiffusion::analyze(const float *times, const float *x,
+                                   const float *y, int numValues) {
+  reset();
+  if (numValues < 2 || times[numValues - 1] <= times[0])
+    return;
+
+  lagStep_ = (times[numValues - 1] - times[0]) / (numValues - 1);
+  const int maxLag = std::min(
+      static_cast<int>(std::lround(DIFFUSION_MAX_LAG_S / lagStep_)),
+      numValues - 1);
+  meanSquaredDisplacement(x, numValues, maxLag, &curveX_);
+  meanSquaredDisplacement(y, numValues, maxLag, &curveY_);
+  curvePlanar_.resize(maxLag + 1);
+  for (int lag = 0; lag <= maxLag; lag++)
+    curvePlanar_[lag] = curveX_[lag] + curveY_[lag];
+
+  summaryX_ = summarize(curveX_);
+  summaryY_ = summarize(curveY_);
+  summaryPlanar_ = summarize(curvePlanar_);
+}
+
+// ____________________________________________________________________________
+void StabilogramDiffusion::meanSquaredDisplacement(
+    const float *values, int numValues, int maxLag, std::vector<float> *curve) {
+  maxLag = std::min(maxLag, numValues - 1);
+  curve->assign(std::max(maxLag + 1, 0), 0);
+  if (maxLag < 1)
+    return;
+
+  // The displacements don't depend on the mean, without it the sums stay
+  // small (the COP is a few cm around a point dm away from the center).
+  double mean = 0;
+  for (int i = 0; i < numValues; i++)
+    mean += values[i];
+  mean /= numValues;
+
+  // Any length of at least twice the values pads enough, powers of two are
+  // the fastest.
+  int size = 2;
+  while (size < 2 * numValues)
+    size *= 2;
+
+  // Sums of the squares of the first i values.
+  padded_.assign(size, 0);
+  prefixSums_.resize(numValues + 1);
+  prefixSums_[0] = 0;
+  for (int i = 0; i < numValues; i++) {
+    padded_[i] = values[i] - mean;
+    prefixSums_[i + 1] = prefixSums_[i] + padded_[i] * padded_[i];
+  }
+
+  // The autocorrelation is the inverse transform of the power spectrum. That
+  // is real and symmetric, so the forward transform does (divided by the
+  // size).
+  auto fft = RealFft::get(size);
+  fft->transform(padded_.data(), &bins_, &work_);
+  for (int k = 0; k <= size / 2; k++) {
+    padded_[k] = std::norm(bins_[k]);
+    if (k > 0 && k < size / 2)
+      padded_[size - k] = padded_[k];
+  }
+  fft->transform(padded_.data(), &bins_, &work_);
+
+  // sum (x[i + lag] - x[i])^2 = sum x[i + lag]^2 + sum x[i]^2
+  //                             - 2 sum x[i] x[i + lag]
+  // over i < numValues - lag.
+  const double total = prefixSums_[numValues];
+  for (int lag = 1; lag <= maxLag; lag++) {
+    double autocorrelation = bins_[lag].real() / size;
+    double sum = total - prefixSums_[lag] + prefixSums_[numValues - lag] -
+                 2 * autocorrelation;
+    (*curve)[lag] = std::max(sum, 0.0) / (numValues - lag);
+  }
+}
+
+// ____________________________________________________________________________
+DiffusionSummary
+StabilogramDiffusion::summarize(const std::vector<float> &curve) const {
+  DiffusionSummary summary;
+
+  // Least squares lines through the curve between the lags (in s).
+  auto fit = [&](double firstLag, double lastLag, double *slope,
+                 double *intercept) {
+    double n = 0, sumT = 0, sumM = 0, sumTT = 0, sumTM = 0;
+    for (size_t lag = 1; lag < curve.size(); lag++) {
+      double t = lag * lagStep_;
+      if (t < firstLag - lagStep_ / 4 || t > lastLag + lagStep_ / 4)
+        continue;
+      n++;
+      sumT += t;
+      sumM += curve[lag];
+      sumTT += t * t;
+      sumTM += t * curve[lag];
+    }
+    double denominator = n * sumTT - sumT * sumT;
+    if (n < 2 || denominator <= 0)
+      return false;
+    *slope = (n * sumTM - sumT * sumM) / denominator;
+    *intercept = (sumM - *slope * sumT) / n;
+    return true;
+  };
+
+  double shortSlope, shortIntercept, longSlope, longIntercept;
+  bool hasShort = fit(0, DIFFUSION_SHORT_TERM_S, &shortSlope, &shortIntercept);
+  bool hasLong = fit(DIFFUSION_LONG_TERM_S, DIFFUSION_MAX_LAG_S, &longSlope,
+                     &longIntercept);
+  if (hasShort)
+    summary.shortTermCoefficient = shortSlope / 2;
+  if (hasLong)
+    summary.longTermCoefficient = longSlope / 2;
+
+  if (hasShort && hasLong && shortSlope > longSlope) {
+    double criticalTime =
+        (longIntercept - shortIntercept) / (shortSlope - longSlope);
+    if (criticalTime > 0) {
+      summary.criticalTime = criticalTime;
+      summary.criticalDisplacement =
+          shortSlope * criticalTime + shortIntercept;
+    }
+  }
+  return summary;
+}
@@ -0,0 +1,95 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#pragma once
+
+#include "./Spectral.h"
+#include <algorithm>
+#include <complex>
+#include <gtest/gtest.h>
+#include <vector>
+
+// Longest time lag in s of the stabilogram diffusion, the curves end there.
+#define DIFFUSION_MAX_LAG_S 10
+
+// The lines of the stabilogram diffusion are fitted to the short-term region
+// (lags up to the first, in s) and to the long-term region (lags from the
+// second on), the critical point is where they cross.
+#define DIFFUSION_SHORT_TERM_S 0.5
+#define DIFFUSION_LONG_TERM_S 2
+
+// Summary of a stabilogram diffusion curve (after Collins and De Luca). The
+// diffusion coefficients are half the slopes of the lines (in m^2 / s for the
+// COP), the critical point is where the short-term behaviour (sway drifting
+// away) turns into the long-term one (being pulled back).
+struct DiffusionSummary {
+  float shortTermCoefficient = 0;
+  float longTermCoefficient = 0;
+  // 0 if the lines don't cross at a positive lag.
+  float criticalTime = 0;
+  float criticalDisplacement = 0;
+};
+
+// Stabilogram diffusion of the COP: the mean squared displacement between
+// all samples a time lag apart, against the lag, in x, y and in the plane
+// (the sum of both). Directly, a lag costs a pass over the samples, so all
+// lags of a long trial take O(n^2). The sums of squares come from prefix sums
+// instead, and the sums of products x[i] x[i + lag] for all lags at once are
+// the autocorrelation, from the power spectrum with two FFTs of twice the
+// length (zero padded, so nothing wraps around) in O(n log n).
+class StabilogramDiffusion {
+public:
+  // The curves of the COP with the time stamps (in s) up to
+  // DIFFUSION_MAX_LAG_S (or the length of the data), and their lines.
+  void analyze(const std::vector<float> &times, const std::vector<float> &x,
+               const std::vector<float> &y) {
+    analyze(times.data(), x.data(), y.data(),
+            std::min({times.size(), x.size(), y.size()}));
+  }
+  // The same for numValues values read in place (e.g. from a SampleView).
+  void analyze(const float *times, const float *x, const float *y,
+               int numValues);
+
+  // Forget the curves.
+  void reset();
+
+  // The mean squared displacement by lag in samples (from 0), in m^2 for the
+  // COP. A lag is getLagStep() seconds.
+  const std::vector<float> &getCurveX() const { return curveX_; }
+  const std::vector<float> &getCurveY() const { return curveY_; }
+  const std::vector<float> &getCurvePlanar() const { return curvePlanar_; }
+  float getLagStep() const { return lagStep_; }
+
+  const DiffusionSummary &getSummaryX() const { return summaryX_; }
+  const DiffusionSummary &getSummaryY() const { return summaryY_; }
+  const DiffusionSummary &getSummaryPlanar() const { return summaryPlanar_; }
+
+  // The mean squared displacement of the values for the lags from 0 to
+  // maxLag (less than the number of values), with the FFT.
+  void meanSquaredDisplacement(const std::vector<float> &values, int maxLag,
+                               std::vector<float> *curve) {
+    meanSquaredDisplacement(values.data(), values.size(), maxLag, curve);
+  }
+  void meanSquaredDisplacement(const float *values, int numValues, int maxLag,
+                               std::vector<float> *curve);
+
+private:
+  std::vector<float> curveX_;
+  std::vector<float> curveY_;
+  std::vector<float> curvePlanar_;
+  float lagStep_ = 0;
+  DiffusionSummary summaryX_;
+  DiffusionSummary summaryY_;
+  DiffusionSummary summaryPlanar_;
+
+  // Reused for the FFTs.
+  std::vector<double> padded_;
+  std::vector<double> prefixSums_;
+  std::vector<std::complex<double>> bins_;
+  std::vector<std::complex<double>> work_;
+
+  // Fit the lines to the curve.
+  DiffusionSummary summarize(const std::vector<float> &curve) const;
+
+  FRIEND_TEST(StabilogramDiffusionTest, summarize);
+};
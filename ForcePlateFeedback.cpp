@@ -6,12 +6,13 @@
 // ____________________________________________________________________________
 ConfigWindow::ConfigWindow() {
   window_ = new QWidget();
-  window_->setFixedSize(400, 200);
+  window_->setFixedSize(400, 340);
 
   QGridLayout *windowLayout = new QGridLayout;
 
   startButton_ = new QPushButton("Start");
   setFileButton_ = new QPushButton("Set data file");
+  reviewButton_ = new QPushButton("Review");
   fileLineEdit_ = new QLineEdit();
 
   timeLabel_ = new QLabel("Time frame (ms)");
@@ -20,11 +21,27 @@ ConfigWindow::ConfigWindow() {
 
   fileDialog_ = new QFileDialog();
 
+  positionSlider_ = new QSlider(Qt::Horizontal);
+  positionSlider_->setEnabled(false);
+  positionLabel_ = new QLabel("0.0 s");
+
+  skipCheckBox_ = new QCheckBox("Skip empty plate");
+  spikeCheckBox_ = new QCheckBox("Reject spikes");
+  offsetCheckBox_ = new QCheckBox("Zero offsets");
+  spectraCheckBox_ = new QCheckBox("COP spectra");
+
   windowLayout->addWidget(startButton_, 2, 0);
+  windowLayout->addWidget(reviewButton_, 2, 1);
   windowLayout->addWidget(setFileButton_, 0, 0);
   windowLayout->addWidget(timeLabel_, 1, 0);
   windowLayout->addWidget(timeLineEdit_, 1, 1);
   windowLayout->addWidget(fileLineEdit_, 0, 1);
+  windowLayout->addWidget(positionLabel_, 3, 0);
+  windowLayout->addWidget(positionSlider_, 3, 1);
+  windowLayout->addWidget(skipCheckBox_, 4, 0, 1, 2);
+  windowLayout->addWidget(spikeCheckBox_, 5, 0, 1, 2);
+  windowLayout->addWidget(offsetCheckBox_, 6, 0, 1, 2);
+  windowLayout->addWidget(spectraCheckBox_, 7, 0, 1, 2);
 
   window_->setLayout(windowLayout);
 
@@ -34,6 +51,27 @@ ConfigWindow::ConfigWindow() {
 
   QObject::connect(startButton_, &QPushButton::released, this,
                    &ConfigWindow::handleStartButton);
+
+  QObject::connect(reviewButton_, &QPushButton::released, this,
+                   &ConfigWindow::handleReviewButton);
+
+  // The timeframe can be changed while running (on enter or focus loss).
+  QObject::connect(timeLineEdit_, &QLineEdit::editingFinished, this,
+                   &ConfigWindow::handleTimeframeEdit);
+
+  // Only user interaction, programmatic updates are blocked.
+  QObject::connect(positionSlider_, &QSlider::valueChanged, this,
+                   &ConfigWindow::handlePositionSlider);
+
+  // Applies right away, also while running.
+  QObject::connect(skipCheckBox_, &QCheckBox::toggled, this,
+                   &ConfigWindow::skipNonContactToggled);
+  QObject::connect(spikeCheckBox_, &QCheckBox::toggled, this,
+                   &ConfigWindow::spikeFilterToggled);
+  QObject::connect(offsetCheckBox_, &QCheckBox::toggled, this,
+                   &ConfigWindow::offsetCalibrationToggled);
+  QObject::connect(spectraCheckBox_, &QCheckBox::toggled, this,
+                   &ConfigWindow::spectralAnalysisToggled);
 }
 
 // ____________________________________________________________________________
@@ -43,7 +81,9 @@ void ConfigWindow::hide() { window_->hide(); }
 // ____________________________________________________________________________
 void ConfigWindow::handleFileButton() {
   QString fileName =
-      QFileDialog::getOpenFileName(this, tr("Select data file"), "", tr(""));
+      QFileDialog::getOpenFileName(this, tr("Select data file"), "",
+                                   tr("Recordings (*.txt *.txt.gz *.fpa);;"
+                                      "All files (*)"));
 
   if (!fileName.isEmpty()) {
     fileLineEdit_->setText(fileName);
@@ -56,6 +96,34 @@ void ConfigWindow::handleStartButton() {
   emit startButtonPressed(fileLineEdit_->text(), timeLineEdit_->text());
 }
 
+// ____________________________________________________________________________
+void ConfigWindow::handleReviewButton() {
+  emit reviewButtonPressed(fileLineEdit_->text());
+}
+
+// ____________________________________________________________________________
+void ConfigWindow::handleTimeframeEdit() {
+  emit timeframeEdited(timeLineEdit_->text());
+}
+
+// ____________________________________________________________________________
+void ConfigWindow::handlePositionSlider(int row) { emit seekRequested(row); }
+
+// ____________________________________________________________________________
+void ConfigWindow::onPositionChanged(int row, float time, int numRows) {
+  positionLabel_->setText(QString("%1 s").arg(time, 0, 'f', 1));
+
+  // Don't fight the user while dragging.
+  if (positionSlider_->isSliderDown())
+    return;
+
+  const QSignalBlocker blocker(positionSlider_);
+  positionSlider_->setEnabled(numRows > 0);
+  positionSlider_->setRange(0, std::max(numRows - 1, 0));
+  positionSlider_->setPageStep(std::max(numRows / 20, 1));
+  positionSlider_->setValue(row);
+}
+
 // ____________________________________________________________________________
 void ConfigWindow::onStartLiveView(const std::string &fileName,
                                    const float timeframe) {
@@ -66,8 +134,7 @@ void ConfigWindow::onStartLiveView(const std::string &fileName,
 
   setFileButton_->setEnabled(false);
   fileLineEdit_->setEnabled(false);
-  timeLineEdit_->setEnabled(false);
-  timeLabel_->setEnabled(false);
+  // The timeframe stays editable, see ForcePlateFeedback::onTimeframeEdited.
 }
 
 // ____________________________________________________________________________
@@ -76,116 +143,1332 @@ void ConfigWindow::onStopLiveView() {
 
   setFileButton_->setEnabled(true);
   fileLineEdit_->setEnabled(true);
-  timeLineEdit_->setEnabled(true);
-  timeLabel_->setEnabled(true);
 }
 
 // ____________________________________________________________________________
-OutputWindow::OutputWindow() {
+OutputWindow::OutputWindow()
+    : framePending_(false), pendingMeanForceX_(0), pendingMeanForceY_(0),
+      pendingMeanCopX_(0), pendingMeanCopY_(0), paintsPending_(0) {
   window_ = new QWidget();
-  window_->setFixedSize(1200, 600);
+  window_->setFixedSize(1600, 600);
 
   QGridLayout *windowLayout = new QGridLayout;
 
-  // Chart for Force in X direction.
-  xChart_ = new QChart();
-  xSeries_ = new QBarSeries();
-  xSet_ = new QBarSet("Values");
+  // Force in X direction as vertical bar, force in Y direction as horizontal
+  // bar.
+  xBarWidget_ = new ForceBarWidget(Qt::Vertical, "X", FORCE_RANGE_N);
+  yBarWidget_ = new ForceBarWidget(Qt::Horizontal, "Y", FORCE_RANGE_N);
 
-  *xSet_ << 0;
+  xBarWidget_->setMarkerRange(COP_RANGE_M);
+  yBarWidget_->setMarkerRange(COP_RANGE_M);
 
-  xSeries_->append(xSet_);
+  trajectoryWidget_ = new CopTrajectoryWidget(COP_RANGE_M);
+  heatmapWidget_ = new CopHeatmapWidget(COP_RANGE_M);
 
-  xChart_->addSeries(xSeries_);
-  xChart_->setAnimationOptions(QChart::NoAnimation);
-  xChart_->setTheme(QChart::ChartThemeBlueIcy);
+  windowLayout->addWidget(xBarWidget_, 0, 0);
+  windowLayout->addWidget(yBarWidget_, 0, 1);
+  windowLayout->addWidget(trajectoryWidget_, 0, 2);
+  windowLayout->addWidget(heatmapWidget_, 0, 3);
 
-  xCategories_.append("X");
+  // The longer analysis windows as text below.
+  windowsLabel_ = new QLabel();
+  windowLayout->addWidget(windowsLabel_, 1, 0, 1, 4);
 
-  xAxisX_ = new QBarCategoryAxis();
-  xAxisX_->append(xCategories_);
-  xChart_->addAxis(xAxisX_, Qt::AlignBottom);
-  xSeries_->attachAxis(xAxisX_);
+  window_->setLayout(windowLayout);
 
-  xAxisY_ = new QValueAxis();
-  xAxisY_->setRange(-80, 80); // in the test file the data is out of range
-                              // sometimes, we will have to tweak this to see
-                              // what makes sense for our practical use
-  xChart_->addAxis(xAxisY_, Qt::AlignLeft);
-  xSeries_->attachAxis(xAxisY_);
+  xBarWidget_->setPaintedCallback([this] { onWidgetPainted(); });
+  yBarWidget_->setPaintedCallback([this] { onWidgetPainted(); });
+  trajectoryWidget_->setPaintedCallback([this] { onWidgetPainted(); });
+  heatmapWidget_->setPaintedCallback([this] { onWidgetPainted(); });
+
+  crosshairShortcut_ = new QShortcut(QKeySequence(Qt::Key_F4), window_);
+  QObject::connect(crosshairShortcut_, &QShortcut::activated, this, [this] {
+    bool visible = !xBarWidget_->isMarkerVisible();
+    xBarWidget_->setMarkerVisible(visible);
+    yBarWidget_->setMarkerVisible(visible);
+  });
+
+  // Pace the rendering to the display refresh rate.
+  double refreshRate = FALLBACK_REFRESH_RATE;
+  if (QGuiApplication::primaryScreen() != nullptr &&
+      QGuiApplication::primaryScreen()->refreshRate() > 0)
+    refreshRate = QGuiApplication::primaryScreen()->refreshRate();
+
+  renderTimer_.setTimerType(Qt::PreciseTimer);
+  renderTimer_.setInterval(std::max(1, static_cast<int>(1000 / refreshRate)));
+  QObject::connect(&renderTimer_, &QTimer::timeout, this,
+                   &OutputWindow::render);
+
+  // F12 writes the trace recorded so far, e.g. right after a stutter.
+  // The same key writes the latency report.
+  traceShortcut_ = new QShortcut(QKeySequence(Qt::Key_F12), window_);
+  QObject::connect(traceShortcut_, &QShortcut::activated, this, [] {
+    const char *traceFile = std::getenv(TRACE_ENV_VARIABLE);
+    if (Tracer::isEnabled() && traceFile != nullptr &&
+        Tracer::instance().writeJson(traceFile))
+      qInfo() << "Wrote trace to" << traceFile;
+
+    const char *latencyFile = std::getenv(LATENCY_ENV_VARIABLE);
+    if (latencyFile != nullptr &&
+        LatencyMonitor::instance().writeReport(latencyFile))
+      qInfo() << "Wrote latency report to" << latencyFile;
+  });
+
+  // The HUD is a child of the window but not part of the layout, so it is
+  // drawn on top of the bars.
+  performanceHud_ = new PerformanceHud(window_);
+  hudShortcut_ = new QShortcut(QKeySequence(Qt::Key_F3), window_);
+  QObject::connect(hudShortcut_, &QShortcut::activated, performanceHud_,
+                   &PerformanceHud::toggle);
+}
 
-  // No legend
-  xChart_->legend()->setVisible(false);
+// ____________________________________________________________________________
+void OutputWindow::show() { window_->show(); }
 
-  // Create a chart view and set the chart
-  xChartView_ = new QChartView(xChart_);
-  xChartView_->setRenderHint(QPainter::Antialiasing);
+// ____________________________________________________________________________
+void OutputWindow::hide() { window_->hide(); }
 
-  // Chart for force in Y direction.
-  yChart_ = new QChart();
-  ySeries_ = new QHorizontalBarSeries();
-  ySet_ = new QBarSet("Values");
+// ____________________________________________________________________________
+void OutputWindow::onStartLiveView(const std::string &fileName,
+                                   const float timeframe) {
+  // can't get rid of "unused parameters" because signatures must match the
+  // signal
 
-  *ySet_ << 0;
+  show();
+  renderTimer_.start();
+}
 
-  ySeries_->append(ySet_);
+// ____________________________________________________________________________
+void OutputWindow::onStopLiveView() {
+  renderTimer_.stop();
+  hide();
+}
 
-  yChart_->addSeries(ySeries_);
-  yChart_->setAnimationOptions(QChart::NoAnimation);
-  yChart_->setTheme(QChart::ChartThemeBlueIcy);
+// ____________________________________________________________________________
+void OutputWindow::onDataUpdated(
+    const BalanceParameters *balanceParameters,
+    const std::vector<BalanceParameters> *analysisWindows) {
+  TRACE_SCOPE("OutputWindow::onDataUpdated");
+
+  // Only keep the latest parameters, render() picks them up.
+  if (framePending_)
+    performanceHud_->countCoalescedUpdate();
+
+  pendingMeanForceX_ = balanceParameters->getMeanForceX();
+  pendingMeanForceY_ = balanceParameters->getMeanForceY();
+  pendingMeanCopX_ = balanceParameters->getMeanCopX();
+  pendingMeanCopY_ = balanceParameters->getMeanCopY();
+  pendingStamps_ = balanceParameters->getLatencyStamps();
+  pendingWindows_ = *analysisWindows;
+  framePending_ = true;
+
+  // The trajectory and the heatmap need every sample, not only the latest
+  // parameters. The samples are only stored / counted here, render() draws
+  // them.
+  if (balanceParameters->getData()) {
+    trajectoryWidget_->addSamples(*balanceParameters->getData());
+    heatmapWidget_->addSamples(*balanceParameters->getData());
+  }
+}
 
-  yCategories_.append("Y");
+// ____________________________________________________________________________
+void OutputWindow::render() {
+  if (!framePending_)
+    return;
+
+  TRACE_SCOPE("OutputWindow::render");
+
+  // The widgets only schedule repaints for what changed on screen.
+  bool xChanged = xBarWidget_->setValue(pendingMeanForceX_);
+  bool yChanged = yBarWidget_->setValue(pendingMeanForceY_);
+  if (xBarWidget_->isMarkerVisible()) {
+    xChanged = xBarWidget_->setMarkerValue(pendingMeanCopX_) || xChanged;
+    yChanged = yBarWidget_->setMarkerValue(pendingMeanCopY_) || yChanged;
+  }
+  bool trajectoryChanged = trajectoryWidget_->flush();
+  bool heatmapChanged = heatmapWidget_->flush();
+
+  // QLabel only repaints if the text changed.
+  QString windowsText;
+  for (const auto &window : pendingWindows_) {
+    windowsText += QString("Last %1 s: Fx %2 N, Fy %3 N")
+                       .arg(window.getTimeframe(), 0, 'f', 1)
+                       .arg(window.getMeanForceX(), 0, 'f', 1)
+                       .arg(window.getMeanForceY(), 0, 'f', 1);
+    // Median frequencies of the COP.
+    if (window.getSpectralAnalysis() != SpectralAnalysis::None)
+      windowsText += QString(", MF x %1 Hz, y %2 Hz")
+                         .arg(window.getCopSpectrumX().medianFrequency, 0,
+                              'f', 2)
+                         .arg(window.getCopSpectrumY().medianFrequency, 0,
+                              'f', 2);
+    windowsText += "      ";
+  }
+  windowsLabel_->setText(windowsText.trimmed());
+
+  // If the previous frame has not been painted yet, it is superseded by this
+  // one and its latency is not recorded.
+  presentedStamps_ = pendingStamps_;
+  framePending_ = false;
+
+  // Qt merges all updates of a widget into a single paint. If nothing changed
+  // on screen, the frame is as good as presented.
+  paintsPending_ = xChanged + yChanged + trajectoryChanged + heatmapChanged;
+  if (paintsPending_ == 0) {
+    LatencyMonitor::instance().recordFrame(presentedStamps_, steadyClockUs());
+    performanceHud_->countFrame();
+  }
+}
 
-  yAxisX_ = new QValueAxis();
-  yAxisX_->setRange(-80, 80); // in the test file the data is out of range
-                              // sometimes, we will have to tweak this to see
-                              // what makes sense for our practical use
-  yChart_->addAxis(yAxisX_, Qt::AlignBottom);
-  ySeries_->attachAxis(yAxisX_);
+// ____________________________________________________________________________
+void OutputWindow::onWidgetPainted() {
+  if (paintsPending_ == 0)
+    return;
+
+  // The frame is on screen once all widgets that changed are painted.
+  if (--paintsPending_ == 0) {
+    LatencyMonitor::instance().recordFrame(presentedStamps_, steadyClockUs());
+    performanceHud_->countFrame();
+  }
+}
 
-  yAxisY_ = new QBarCategoryAxis();
-  yAxisY_->append(yCategories_);
-  yChart_->addAxis(yAxisY_, Qt::AlignLeft);
-  ySeries_->attachAxis(yAxisY_);
+// ____________________________________________________________________________
+void OutputWindow::onStatsUpdated(const PlaybackStats *playbackStats) {
+  performanceHud_->setPlaybackStats(*playbackStats);
+}
 
-  // No legend
-  yChart_->legend()->setVisible(false);
+// ____________________________________________________________________________
+PerformanceHud::PerformanceHud(QWidget *parent)
+    : QWidget(parent), numFrames_(0), lastRefreshUs_(0),
+      numCoalescedUpdates_(0) {
+  // Pure overlay: no mouse events, no background.
+  setAttribute(Qt::WA_TransparentForMouseEvents);
+  setAttribute(Qt::WA_NoSystemBackground);
+  setGeometry(10, 10, 260, 155);
+  hide();
+
+  refreshTimer_.setInterval(HUD_REFRESH_MS);
+  QObject::connect(&refreshTimer_, &QTimer::timeout, this,
+                   &PerformanceHud::refresh);
+}
 
-  // Create a chart view and set the chart
-  yChartView_ = new QChartView(yChart_);
-  yChartView_->setRenderHint(QPainter::Antialiasing);
+// ____________________________________________________________________________
+void PerformanceHud::toggle() {
+  if (isVisible()) {
+    refreshTimer_.stop();
+    hide();
+  } else {
+    numFrames_ = 0;
+    lastRefreshUs_ = steadyClockUs();
+    refresh();
+    show();
+    raise();
+    refreshTimer_.start();
+  }
+}
 
-  windowLayout->addWidget(xChartView_, 0, 0);
-  windowLayout->addWidget(yChartView_, 0, 1);
+// ____________________________________________________________________________
+void PerformanceHud::refresh() {
+  int64_t nowUs = steadyClockUs();
+  double seconds = (nowUs - lastRefreshUs_) / 1e6;
+  double framesPerSecond = seconds > 0 ? numFrames_ / seconds : 0;
+  numFrames_ = 0;
+  lastRefreshUs_ = nowUs;
+
+  text_ = QString("FPS: %1\n"
+                  "process(): %2 ms (max %3 ms)\n"
+                  "Reader lag: %4 ms\n"
+                  "Dropped ticks: %5 of %6\n"
+                  "I/O stalls: %7\n"
+                  "Coalesced updates: %8\n"
+                  "Sample-to-pixel p99: %9 ms\n"
+                  "Memory: %10 MB\n"
+                  "Allocations per tick: %11\n"
+                  "Repaired cells: %12")
+              .arg(framesPerSecond, 0, 'f', 1)
+              .arg(playbackStats_.getProcessDurationUs() / 1000.0, 0, 'f', 2)
+              .arg(playbackStats_.getMaxProcessDurationUs() / 1000.0, 0, 'f',
+                   2)
+              .arg(playbackStats_.getReaderLagMs(), 0, 'f', 1)
+              .arg(playbackStats_.getDroppedTicks())
+              .arg(playbackStats_.getNumTicks())
+              .arg(playbackStats_.getIoStalls())
+              .arg(numCoalescedUpdates_)
+              .arg(LatencyMonitor::instance()
+                           .getSampleToPixelLatency()
+                           .getPercentile(99) /
+                       1000.0,
+                   0, 'f', 2)
+              .arg(residentMemoryBytes() / (1024.0 * 1024.0), 0, 'f', 1)
+              .arg(AllocationCounter::isEnabled()
+                       ? QString::number(playbackStats_.getTickAllocations())
+                       : QString("not counted"))
+              .arg(playbackStats_.getCorruptCells());
+
+  update();
+}
 
-  window_->setLayout(windowLayout);
+// ____________________________________________________________________________
+void PerformanceHud::paintEvent(QPaintEvent *) {
+  QPainter painter(this);
+  painter.fillRect(rect(), QColor(0, 0, 0, 160));
+  painter.setPen(Qt::white);
+  painter.setFont(QFont("monospace", 9));
+  painter.drawText(rect().adjusted(8, 6, -8, -6), Qt::AlignLeft | Qt::AlignTop,
+                   text_);
 }
 
 // ____________________________________________________________________________
-void OutputWindow::show() { window_->show(); }
+ForceBarWidget::ForceBarWidget(Qt::Orientation orientation,
+                               const QString &label, float range)
+    : orientation_(orientation), label_(label), range_(range), value_(0),
+      markerRange_(1), markerValue_(0), markerVisible_(false) {
+  // We paint every pixel ourselves (from the cached background).
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  setMinimumSize(100, 100);
+}
 
 // ____________________________________________________________________________
-void OutputWindow::hide() { window_->hide(); }
+int ForceBarWidget::valueToPixel(float value, float range) const {
+  float clamped = std::min(std::max(value, -range), range);
+  float fraction = (clamped + range) / (2 * range);
+
+  if (orientation_ == Qt::Vertical)
+    return plotRect_.bottom() - fraction * plotRect_.height();
+  else
+    return plotRect_.left() + fraction * plotRect_.width();
+}
 
 // ____________________________________________________________________________
-void OutputWindow::onStartLiveView(const std::string &fileName,
-                                   const float timeframe) {
-  // can't get rid of "unused parameters" because signatures must match the
-  // signal
+QRect ForceBarWidget::barRect(float value) const {
+  int zero = valueToPixel(0, range_);
+  int end = valueToPixel(value, range_);
+
+  // The bar covers 40% of the plot width, centered.
+  if (orientation_ == Qt::Vertical) {
+    int width = plotRect_.width() * 0.4;
+    int left = plotRect_.center().x() - width / 2;
+    return QRect(QPoint(left, std::min(zero, end)),
+                 QPoint(left + width, std::max(zero, end)));
+  } else {
+    int height = plotRect_.height() * 0.4;
+    int top = plotRect_.center().y() - height / 2;
+    return QRect(QPoint(std::min(zero, end), top),
+                 QPoint(std::max(zero, end), top + height));
+  }
+}
 
-  show();
+// ____________________________________________________________________________
+QRect ForceBarWidget::markerRect(float value) const {
+  int position = valueToPixel(value, markerRange_);
+
+  // A line across the plot with a small circle in the middle, plus some
+  // margin for the pen.
+  if (orientation_ == Qt::Vertical)
+    return QRect(plotRect_.left(), position - 8, plotRect_.width() + 1, 17);
+  else
+    return QRect(position - 8, plotRect_.top(), 17, plotRect_.height() + 1);
+}
+
+// ____________________________________________________________________________
+bool ForceBarWidget::setValue(float value) {
+  value_ = value;
+
+  QRect newRect = barRect(value_);
+  if (newRect == barRect_)
+    return false;
+
+  update(barRect_.united(newRect));
+  barRect_ = newRect;
+  return true;
+}
+
+// ____________________________________________________________________________
+bool ForceBarWidget::setMarkerValue(float value) {
+  markerValue_ = value;
+
+  QRect newRect = markerRect(markerValue_);
+  if (newRect == markerRect_)
+    return false;
+
+  // The bar may cross the marker, so the old and new marker regions are
+  // repainted completely (background, bar, marker).
+  if (markerVisible_) {
+    update(markerRect_);
+    update(newRect);
+  }
+  markerRect_ = newRect;
+  return markerVisible_;
+}
+
+// ____________________________________________________________________________
+void ForceBarWidget::setMarkerVisible(bool visible) {
+  if (visible == markerVisible_)
+    return;
+
+  markerVisible_ = visible;
+  markerRect_ = markerRect(markerValue_);
+  update(markerRect_);
+}
+
+// ____________________________________________________________________________
+void ForceBarWidget::resizeEvent(QResizeEvent *event) {
+  QWidget::resizeEvent(event);
+
+  // Margins for the tick labels and the category label.
+  if (orientation_ == Qt::Vertical)
+    plotRect_ = rect().adjusted(50, 15, -15, -35);
+  else
+    plotRect_ = rect().adjusted(35, 15, -20, -35);
+
+  renderBackground();
+
+  barRect_ = barRect(value_);
+  markerRect_ = markerRect(markerValue_);
+}
+
+// ____________________________________________________________________________
+void ForceBarWidget::renderBackground() {
+  TRACE_SCOPE("ForceBarWidget::renderBackground");
+
+  background_ = QPixmap(size());
+  background_.fill(QColor(0xf5, 0xf7, 0xfa));
+
+  QPainter painter(&background_);
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.fillRect(plotRect_, Qt::white);
+
+  // Grid lines and tick labels every 20N.
+  QPen gridPen(QColor(0xd0, 0xd8, 0xe0));
+  QPen textPen(QColor(0x40, 0x48, 0x50));
+  const int tickStep = 20;
+  for (int tick = -static_cast<int>(range_); tick <= range_; tick += tickStep) {
+    int position = valueToPixel(tick, range_);
+    QString tickLabel = QString::number(tick);
+
+    painter.setPen(tick == 0 ? textPen : gridPen);
+    if (orientation_ == Qt::Vertical) {
+      painter.drawLine(plotRect_.left(), position, plotRect_.right(), position);
+      painter.setPen(textPen);
+      painter.drawText(QRect(0, position - 10, plotRect_.left() - 6, 20),
+                       Qt::AlignRight | Qt::AlignVCenter, tickLabel);
+    } else {
+      painter.drawLine(position, plotRect_.top(), position, plotRect_.bottom());
+      painter.setPen(textPen);
+      painter.drawText(QRect(position - 20, plotRect_.bottom() + 4, 40, 20),
+                       Qt::AlignHCenter | Qt::AlignTop, tickLabel);
+    }
+  }
+
+  // Category label.
+  QFont font = painter.font();
+  font.setBold(true);
+  painter.setFont(font);
+  if (orientation_ == Qt::Vertical)
+    painter.drawText(QRect(plotRect_.left(), plotRect_.bottom() + 6,
+                           plotRect_.width(), 25),
+                     Qt::AlignHCenter | Qt::AlignTop, label_);
+  else
+    painter.drawText(QRect(0, plotRect_.top(), plotRect_.left() - 6,
+                           plotRect_.height()),
+                     Qt::AlignRight | Qt::AlignVCenter, label_);
+
+  painter.setPen(textPen);
+  painter.setBrush(Qt::NoBrush);
+  painter.drawRect(plotRect_);
+}
+
+// ____________________________________________________________________________
+void ForceBarWidget::paintEvent(QPaintEvent *event) {
+  TRACE_SCOPE("ForceBarWidget::paintEvent");
+
+  QPainter painter(this);
+
+  // Only the dirty region is copied from the cache and painted over.
+  painter.drawPixmap(event->rect(), background_, event->rect());
+  painter.fillRect(barRect_.intersected(event->rect()),
+                   QColor(0x1f, 0x77, 0xb4));
+
+  if (markerVisible_ && markerRect_.intersects(event->rect())) {
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen(QColor(0xd6, 0x27, 0x28), 2));
+    painter.setBrush(Qt::NoBrush);
+    QPoint center = markerRect_.center();
+    if (orientation_ == Qt::Vertical)
+      painter.drawLine(markerRect_.left(), center.y(), markerRect_.right(),
+                       center.y());
+    else
+      painter.drawLine(center.x(), markerRect_.top(), center.x(),
+                       markerRect_.bottom());
+    painter.drawEllipse(center, 6, 6);
+  }
+
+  if (paintedCallback_)
+    paintedCallback_();
+}
+
+// ____________________________________________________________________________
+CopTrajectoryWidget::CopTrajectoryWidget(float range)
+    : range_(range), trail_(COP_TAIL_SECONDS * COP_TAIL_MAX_RATE_HZ),
+      numDrawn_(0), bands_(COP_TAIL_BANDS), currentBand_(0), bandStartTime_(0),
+      bandDuration_(1.0f * COP_TAIL_SECONDS / COP_TAIL_BANDS),
+      hasAnchor_(false), hasHead_(false) {
+  // We paint every pixel ourselves (from the history image).
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  setMinimumSize(200, 200);
+}
+
+// ____________________________________________________________________________
+QPointF CopTrajectoryWidget::copToPixel(const CopSample &sample) const {
+  // Y to the right, X upwards.
+  float scale = plotRect_.width() / (2 * range_);
+  return QPointF(plotRect_.center().x() + sample.y * scale,
+                 plotRect_.center().y() - sample.x * scale);
+}
+
+// ____________________________________________________________________________
+QRect CopTrajectoryWidget::headRect() const {
+  return QRect(head_.toPoint() - QPoint(6, 6), QSize(13, 13));
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::clear() {
+  trail_.clear();
+  numDrawn_ = 0;
+  hasAnchor_ = false;
+  hasHead_ = false;
+  for (QImage &band : bands_)
+    band.fill(Qt::transparent);
+  renderHistory();
+  update();
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::addSamples(
+    const std::unordered_map<std::string, std::vector<float>> &data) {
+  auto time = data.find("abs time (s)");
+  auto x = data.find("Ax");
+  auto y = data.find("Ay");
+  if (time == data.end() || x == data.end() || y == data.end() ||
+      time->second.empty())
+    return;
+
+  if (time->second.back() < trail_.getLastTime())
+    clear();
+
+  // The first sample starts the first band.
+  if (trail_.getNumAppended() == 0)
+    bandStartTime_ = time->second.front();
+
+  trail_.append(time->second, x->second, y->second);
+}
+
+// ____________________________________________________________________________
+QRect CopTrajectoryWidget::drawSample(QPainter &painter,
+                                      const CopSample &sample) {
+  // BioWare writes a COP of exactly 0 without contact, that breaks the line.
+  if (sample.x == 0 && sample.y == 0) {
+    hasAnchor_ = false;
+    return QRect();
+  }
+
+  QPointF point = copToPixel(sample);
+  if (!hasAnchor_) {
+    hasAnchor_ = true;
+    anchor_ = point;
+    return QRect();
+  }
+
+  // At 1kHz most samples are less than a pixel apart, no need to draw them.
+  if (std::abs(point.x() - anchor_.x()) < 1 &&
+      std::abs(point.y() - anchor_.y()) < 1)
+    return QRect();
+
+  painter.drawLine(anchor_, point);
+  QRect dirty = QRectF(anchor_, point).normalized().toAlignedRect();
+  anchor_ = point;
+  return dirty.adjusted(-2, -2, 2, 2);
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::beginBand(QPainter &painter, int band) {
+  painter.begin(&bands_[band]);
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.setPen(QPen(QColor(0x1f, 0x77, 0xb4), 2, Qt::SolidLine, Qt::RoundCap,
+                      Qt::RoundJoin));
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::rotateBands() {
+  currentBand_ = (currentBand_ + 1) % bands_.size();
+  bands_[currentBand_].fill(Qt::transparent);
+  bandStartTime_ += bandDuration_;
+}
+
+// ____________________________________________________________________________
+bool CopTrajectoryWidget::flush() {
+  uint64_t numAppended = trail_.getNumAppended();
+  if (numDrawn_ == numAppended || bands_[currentBand_].isNull()) {
+    numDrawn_ = numAppended;
+    return false;
+  }
+
+  TRACE_SCOPE("CopTrajectoryWidget::flush");
+
+  // Samples that were already overwritten in the ring buffer are lost.
+  uint64_t oldest = numAppended - trail_.size();
+  uint64_t first = std::max(numDrawn_, oldest);
+
+  QRect dirty;
+  bool rotated = false;
+  QRect oldHead = headRect();
+  bool hadHead = hasHead_;
+
+  QPainter painter;
+  beginBand(painter, currentBand_);
+
+  for (uint64_t n = first; n < numAppended; n++) {
+    const CopSample &sample = trail_[n - oldest];
+
+    // The current band is full, continue on the next one. After a long gap
+    // (more than the whole tail) all bands are cleared.
+    if (sample.time >= bandStartTime_ + bandDuration_) {
+      painter.end();
+      int numRotations = 0;
+      while (sample.time >= bandStartTime_ + bandDuration_ &&
+             numRotations < COP_TAIL_BANDS) {
+        rotateBands();
+        numRotations++;
+      }
+      if (sample.time >= bandStartTime_ + bandDuration_)
+        bandStartTime_ = sample.time;
+      beginBand(painter, currentBand_);
+      rotated = true;
+    }
+
+    dirty = dirty.united(drawSample(painter, sample));
+  }
+  painter.end();
+  numDrawn_ = numAppended;
+
+  const CopSample &latest = trail_[trail_.size() - 1];
+  hasHead_ = latest.x != 0 || latest.y != 0;
+  head_ = copToPixel(latest);
+
+  // After a rotation the older bands changed their opacity, so everything is
+  // repainted (once per band duration).
+  if (rotated) {
+    renderHistory();
+    update();
+    return true;
+  }
+
+  if (hadHead)
+    dirty = dirty.united(oldHead);
+  if (hasHead_)
+    dirty = dirty.united(headRect());
+  if (dirty.isEmpty())
+    return false;
+
+  update(dirty);
+  return true;
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::resizeEvent(QResizeEvent *event) {
+  QWidget::resizeEvent(event);
+
+  // A square plot, centered, with some margin for the labels.
+  int side = std::max(1, std::min(width(), height()) - 50);
+  plotRect_ = QRect((width() - side) / 2, (height() - side) / 2, side, side);
+
+  for (QImage &band : bands_) {
+    band = QImage(size(), QImage::Format_ARGB32_Premultiplied);
+    band.fill(Qt::transparent);
+  }
+
+  renderBackground();
+  replot();
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::replot() {
+  TRACE_SCOPE("CopTrajectoryWidget::replot");
+
+  hasAnchor_ = false;
+  hasHead_ = false;
+
+  // Sort the samples into the bands by their time, the current band starts at
+  // bandStartTime_.
+  QPainter painter;
+  int paintedBand = -1;
+  for (size_t i = 0; i < trail_.size(); i++) {
+    const CopSample &sample = trail_[i];
+    int age = sample.time >= bandStartTime_
+                  ? 0
+                  : (bandStartTime_ - sample.time) / bandDuration_ + 1;
+    if (age >= COP_TAIL_BANDS) {
+      hasAnchor_ = false;
+      continue;
+    }
+
+    int band = (currentBand_ - age + COP_TAIL_BANDS) % COP_TAIL_BANDS;
+    if (band != paintedBand) {
+      if (painter.isActive())
+        painter.end();
+      beginBand(painter, band);
+      paintedBand = band;
+    }
+    drawSample(painter, sample);
+  }
+  if (painter.isActive())
+    painter.end();
+
+  numDrawn_ = trail_.getNumAppended();
+  if (trail_.size() > 0) {
+    const CopSample &latest = trail_[trail_.size() - 1];
+    hasHead_ = latest.x != 0 || latest.y != 0;
+    head_ = copToPixel(latest);
+  }
+
+  renderHistory();
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::renderBackground() {
+  TRACE_SCOPE("CopTrajectoryWidget::renderBackground");
+
+  background_ = QImage(size(), QImage::Format_RGB32);
+  background_.fill(QColor(0xf5, 0xf7, 0xfa));
+
+  QPainter painter(&background_);
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.fillRect(plotRect_, Qt::white);
+
+  // Grid lines every 10cm, the axes through the origin.
+  QPen gridPen(QColor(0xd0, 0xd8, 0xe0));
+  QPen textPen(QColor(0x40, 0x48, 0x50));
+  const float gridStep = 0.1;
+  for (float tick = -range_; tick <= range_ + 1e-4; tick += gridStep) {
+    bool isAxis = std::abs(tick) < 1e-4;
+    painter.setPen(isAxis ? textPen : gridPen);
+    QPointF vertical = copToPixel({0, 0, tick});
+    QPointF horizontal = copToPixel({0, tick, 0});
+    painter.drawLine(QPointF(vertical.x(), plotRect_.top()),
+                     QPointF(vertical.x(), plotRect_.bottom()));
+    painter.drawLine(QPointF(plotRect_.left(), horizontal.y()),
+                     QPointF(plotRect_.right(), horizontal.y()));
+  }
+
+  QFont font = painter.font();
+  font.setBold(true);
+  painter.setFont(font);
+  painter.setPen(textPen);
+  painter.drawText(QRect(plotRect_.left(), 0, plotRect_.width(),
+                         plotRect_.top()),
+                   Qt::AlignHCenter | Qt::AlignVCenter, "X");
+  painter.drawText(QRect(plotRect_.right() + 4, plotRect_.top(),
+                         width() - plotRect_.right() - 4, plotRect_.height()),
+                   Qt::AlignLeft | Qt::AlignVCenter, "Y");
+
+  painter.setBrush(Qt::NoBrush);
+  painter.drawRect(plotRect_);
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::renderHistory() {
+  if (background_.isNull())
+    return;
+
+  TRACE_SCOPE("CopTrajectoryWidget::renderHistory");
+
+  // Oldest band first, each one a bit more opaque than the one before.
+  history_ = background_.copy();
+  QPainter painter(&history_);
+  for (int age = COP_TAIL_BANDS - 1; age > 0; age--) {
+    int band = (currentBand_ - age + COP_TAIL_BANDS) % COP_TAIL_BANDS;
+    painter.setOpacity(1 - 1.0 * age / COP_TAIL_BANDS);
+    painter.drawImage(0, 0, bands_[band]);
+  }
+}
+
+// ____________________________________________________________________________
+void CopTrajectoryWidget::paintEvent(QPaintEvent *event) {
+  TRACE_SCOPE("CopTrajectoryWidget::paintEvent");
+
+  QPainter painter(this);
+
+  // Only the dirty region is copied from the history and the current band.
+  QRect dirty = event->rect();
+  painter.drawImage(dirty, history_, dirty);
+  painter.drawImage(dirty, bands_[currentBand_], dirty);
+
+  if (hasHead_ && headRect().intersects(dirty)) {
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen(QColor(0xd6, 0x27, 0x28), 2));
+    painter.setBrush(Qt::white);
+    painter.drawEllipse(head_, 5, 5);
+  }
+
+  if (paintedCallback_)
+    paintedCallback_();
+}
+
+// ____________________________________________________________________________
+CopHeatmapWidget::CopHeatmapWidget(float range)
+    : histogram_(range, COP_HEATMAP_BINS),
+      lastTime_(-std::numeric_limits<float>::infinity()),
+      image_(COP_HEATMAP_BINS, COP_HEATMAP_BINS, QImage::Format_ARGB32),
+      colorScaleMax_(0) {
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  setMinimumSize(200, 200);
+  image_.fill(Qt::transparent);
+
+  // Light yellow to dark red. Entry 0 is for empty bins (the background
+  // shows through).
+  const QColor anchors[] = {QColor(255, 255, 204), QColor(255, 237, 160),
+                            QColor(254, 178, 76), QColor(240, 59, 32),
+                            QColor(189, 0, 38)};
+  const int numAnchors = sizeof(anchors) / sizeof(anchors[0]);
+  colorMap_[0] = qRgba(0, 0, 0, 0);
+  for (size_t i = 1; i < colorMap_.size(); i++) {
+    float position = (i - 1.0f) / (colorMap_.size() - 2) * (numAnchors - 1);
+    int anchor = std::min(static_cast<int>(position), numAnchors - 2);
+    float fraction = position - anchor;
+    const QColor &from = anchors[anchor];
+    const QColor &to = anchors[anchor + 1];
+    colorMap_[i] = qRgb(from.red() + fraction * (to.red() - from.red()),
+                        from.green() + fraction * (to.green() - from.green()),
+                        from.blue() + fraction * (to.blue() - from.blue()));
+  }
+}
+
+// ____________________________________________________________________________
+void CopHeatmapWidget::clear() {
+  histogram_.clear();
+  histogram_.takeDirtyBins();
+  lastTime_ = -std::numeric_limits<float>::infinity();
+  colorScaleMax_ = 0;
+  image_.fill(Qt::transparent);
+  update();
+}
+
+// ____________________________________________________________________________
+void CopHeatmapWidget::addSamples(
+    const std::unordered_map<std::string, std::vector<float>> &data) {
+  auto time = data.find("abs time (s)");
+  auto x = data.find("Ax");
+  auto y = data.find("Ay");
+  if (time == data.end() || x == data.end() || y == data.end() ||
+      time->second.empty())
+    return;
+
+  if (time->second.back() < lastTime_)
+    clear();
+
+  // The batches overlap, only count the samples we have not seen yet.
+  size_t numRows =
+      std::min({time->second.size(), x->second.size(), y->second.size()});
+  size_t first = std::upper_bound(time->second.begin(),
+                                  time->second.begin() + numRows, lastTime_) -
+                 time->second.begin();
+  for (size_t i = first; i < numRows; i++)
+    histogram_.add(x->second[i], y->second[i]);
+
+  if (first < numRows)
+    lastTime_ = time->second[numRows - 1];
+}
+
+// ____________________________________________________________________________
+bool CopHeatmapWidget::flush() {
+  BinRect dirty = histogram_.takeDirtyBins();
+  if (dirty.isEmpty())
+    return false;
+
+  TRACE_SCOPE("CopHeatmapWidget::flush");
+
+  // The hottest bin outgrew the colour scale, recolour everything.
+  if (histogram_.getMaxCount() >
+      colorScaleMax_ * COP_HEATMAP_RESCALE_FACTOR) {
+    colorScaleMax_ = histogram_.getMaxCount();
+    dirty = {0, 0, histogram_.getNumBins() - 1, histogram_.getNumBins() - 1};
+  }
+
+  colorBins(dirty);
+  update(binsToPixels(dirty));
+  return true;
+}
+
+// ____________________________________________________________________________
+void CopHeatmapWidget::colorBins(const BinRect &bins) {
+  // X upwards and Y to the right, like the trajectory.
+  int numBins = histogram_.getNumBins();
+  for (int binX = bins.firstX; binX <= bins.lastX; binX++) {
+    QRgb *line = reinterpret_cast<QRgb *>(image_.scanLine(numBins - 1 - binX));
+    for (int binY = bins.firstY; binY <= bins.lastY; binY++) {
+      uint32_t count = histogram_.getCount(binX, binY);
+      if (count == 0) {
+        line[binY] = colorMap_[0];
+        continue;
+      }
+      // Square root scale, so rarely visited bins are still visible.
+      float level = std::min(
+          1.0f, std::sqrt(static_cast<float>(count) / colorScaleMax_));
+      line[binY] = colorMap_[1 + level * (colorMap_.size() - 2)];
+    }
+  }
+}
+
+// ____________________________________________________________________________
+QRect CopHeatmapWidget::binsToPixels(const BinRect &bins) const {
+  int numBins = histogram_.getNumBins();
+  double binSize = static_cast<double>(plotRect_.width()) / numBins;
+  int left = plotRect_.left() + std::floor(bins.firstY * binSize);
+  int right = plotRect_.left() + std::ceil((bins.lastY + 1) * binSize);
+  int top = plotRect_.top() + std::floor((numBins - 1 - bins.lastX) * binSize);
+  int bottom = plotRect_.top() + std::ceil((numBins - bins.firstX) * binSize);
+  return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+// ____________________________________________________________________________
+void CopHeatmapWidget::resizeEvent(QResizeEvent *event) {
+  QWidget::resizeEvent(event);
+
+  // A square plot, centered, with some margin for the labels.
+  int side = std::max(1, std::min(width(), height()) - 50);
+  plotRect_ = QRect((width() - side) / 2, (height() - side) / 2, side, side);
+
+  renderBackground();
+}
+
+// ____________________________________________________________________________
+void CopHeatmapWidget::renderBackground() {
+  TRACE_SCOPE("CopHeatmapWidget::renderBackground");
+
+  background_ = QPixmap(size());
+  background_.fill(QColor(0xf5, 0xf7, 0xfa));
+
+  QPainter painter(&background_);
+  painter.fillRect(plotRect_, Qt::white);
+
+  QPen textPen(QColor(0x40, 0x48, 0x50));
+  painter.setPen(QColor(0xd0, 0xd8, 0xe0));
+  QPoint center = plotRect_.center();
+  painter.drawLine(center.x(), plotRect_.top(), center.x(), plotRect_.bottom());
+  painter.drawLine(plotRect_.left(), center.y(), plotRect_.right(), center.y());
+
+  QFont font = painter.font();
+  font.setBold(true);
+  painter.setFont(font);
+  painter.setPen(textPen);
+  painter.drawText(QRect(plotRect_.left(), 0, plotRect_.width(),
+                         plotRect_.top()),
+                   Qt::AlignHCenter | Qt::AlignVCenter, "X (density)");
+  painter.drawText(QRect(plotRect_.right() + 4, plotRect_.top(),
+                         width() - plotRect_.right() - 4, plotRect_.height()),
+                   Qt::AlignLeft | Qt::AlignVCenter, "Y");
+  painter.setBrush(Qt::NoBrush);
+  painter.drawRect(plotRect_);
+}
+
+// ____________________________________________________________________________
+void CopHeatmapWidget::paintEvent(QPaintEvent *event) {
+  TRACE_SCOPE("CopHeatmapWidget::paintEvent");
+
+  QPainter painter(this);
+  painter.drawPixmap(event->rect(), background_, event->rect());
+
+  // The painter is clipped to the dirty region, so only that part of the
+  // image is scaled.
+  painter.setClipRect(event->rect().intersected(plotRect_));
+  painter.drawImage(plotRect_, image_);
+
+  if (paintedCallback_)
+    paintedCallback_();
+}
+
+// ____________________________________________________________________________
+RecordingView::RecordingView()
+    : memoryBudget_(0), samplingRate_(1), firstTime_(0), viewFirst_(0),
+      viewLast_(0), fitAll_(true), detailFirst_(0), dragStartX_(0),
+      dragStartFirst_(0) {
+  setAttribute(Qt::WA_OpaquePaintEvent);
+  setMinimumSize(600, 400);
+}
+
+// ____________________________________________________________________________
+void RecordingView::reset(const std::vector<std::string> &channels,
+                          float samplingRate) {
+  channels_ = channels;
+  pyramids_.assign(channels_.size(), MinMaxPyramid());
+  detailPyramids_.clear();
+  setMemoryBudget(memoryBudget_);
+  samplingRate_ = samplingRate > 0 ? samplingRate : 1;
+  firstTime_ = 0;
+  fitAll();
+}
+
+// ____________________________________________________________________________
+void RecordingView::setMemoryBudget(size_t bytes) {
+  memoryBudget_ = bytes;
+  for (auto &pyramid : pyramids_)
+    pyramid.setMaxBytes(memoryBudget_ / pyramids_.size());
+}
+
+// ____________________________________________________________________________
+size_t RecordingView::getNumSamples() const {
+  return pyramids_.empty() ? 0 : pyramids_.front().getNumSamples();
+}
+
+// ____________________________________________________________________________
+void RecordingView::append(
+    const std::unordered_map<std::string, std::vector<float>> &data) {
+  TRACE_SCOPE("RecordingView::append");
+
+  auto time = data.find("abs time (s)");
+  if (getNumSamples() == 0 && time != data.end() && !time->second.empty())
+    firstTime_ = time->second.front();
+
+  size_t oldNumSamples = getNumSamples();
+  for (size_t i = 0; i < channels_.size(); i++) {
+    auto column = data.find(channels_[i]);
+    if (column != data.end())
+      pyramids_[i].append(column->second);
+  }
+
+  // Follow new data if the view shows the end of the recording.
+  double span = viewLast_ - viewFirst_;
+  if (fitAll_) {
+    viewFirst_ = 0;
+    viewLast_ = getNumSamples();
+  } else if (viewLast_ >= oldNumSamples) {
+    viewLast_ = getNumSamples();
+    viewFirst_ = viewLast_ - span;
+  }
+  update();
+}
+
+// ____________________________________________________________________________
+void RecordingView::fitAll() {
+  fitAll_ = true;
+  viewFirst_ = 0;
+  viewLast_ = getNumSamples();
+  update();
+}
+
+// ____________________________________________________________________________
+QRect RecordingView::plotRect() const {
+  // Margins for the channel labels and the time axis.
+  return rect().adjusted(60, 10, -10, -30);
+}
+
+// ____________________________________________________________________________
+void RecordingView::clampView() {
+  double numSamples = getNumSamples();
+  double span = std::min(viewLast_ - viewFirst_, numSamples);
+  // Zooming in further than a few samples across the whole plot is pointless.
+  span = std::max(span, 8.0);
+
+  viewFirst_ = std::max(0.0, std::min(viewFirst_, numSamples - span));
+  viewLast_ = viewFirst_ + span;
+  fitAll_ = viewFirst_ <= 0 && viewLast_ >= numSamples;
+}
+
+// ____________________________________________________________________________
+void RecordingView::wheelEvent(QWheelEvent *event) {
+  if (getNumSamples() == 0 || event->angleDelta().y() == 0)
+    return;
+
+  // Zoom around the sample under the mouse.
+  QRect plot = plotRect();
+  double fraction =
+      std::min(std::max((event->position().x() - plot.left()) / plot.width(),
+                        0.0),
+               1.0);
+  double anchor = viewFirst_ + fraction * (viewLast_ - viewFirst_);
+  double factor = event->angleDelta().y() > 0 ? 0.8 : 1.25;
+  double span = (viewLast_ - viewFirst_) * factor;
+
+  viewFirst_ = anchor - fraction * span;
+  viewLast_ = viewFirst_ + span;
+  clampView();
+  update();
+}
+
+// ____________________________________________________________________________
+void RecordingView::mousePressEvent(QMouseEvent *event) {
+  dragStartX_ = event->position().x();
+  dragStartFirst_ = viewFirst_;
 }
 
 // ____________________________________________________________________________
-void OutputWindow::onStopLiveView() { hide(); }
+void RecordingView::mouseMoveEvent(QMouseEvent *event) {
+  if (!(event->buttons() & Qt::LeftButton) || getNumSamples() == 0)
+    return;
+
+  double span = viewLast_ - viewFirst_;
+  double samplesPerPixel = span / std::max(plotRect().width(), 1);
+  viewFirst_ =
+      dragStartFirst_ - (event->position().x() - dragStartX_) * samplesPerPixel;
+  viewLast_ = viewFirst_ + span;
+  clampView();
+  update();
+}
+
+// ____________________________________________________________________________
+void RecordingView::mouseDoubleClickEvent(QMouseEvent *) { fitAll(); }
+
+// ____________________________________________________________________________
+void RecordingView::paintEvent(QPaintEvent *) {
+  TRACE_SCOPE("RecordingView::paintEvent");
+
+  QPainter painter(this);
+  painter.fillRect(rect(), QColor(0xf5, 0xf7, 0xfa));
+
+  QRect plot = plotRect();
+  painter.fillRect(plot, Qt::white);
+  if (channels_.empty() || plot.width() <= 0)
+    return;
+
+  updateDetail(plot.width());
+
+  int laneHeight = plot.height() / channels_.size();
+  for (size_t i = 0; i < channels_.size(); i++) {
+    QRect lane(plot.left(), plot.top() + i * laneHeight, plot.width(),
+               laneHeight);
+    paintLane(painter, lane, i);
+  }
+
+  paintTimeAxis(painter, plot);
+}
 
 // ____________________________________________________________________________
-void OutputWindow::onDataUpdated(const BalanceParameters *balanceParameters) {
-  xSet_->replace(0, balanceParameters->getMeanForceX());
-  ySet_->replace(0, balanceParameters->getMeanForceY());
+void RecordingView::paintLane(QPainter &painter, const QRect &lane,
+                              size_t channel) {
+  QPen textPen(QColor(0x40, 0x48, 0x50));
+  painter.setPen(QColor(0xd0, 0xd8, 0xe0));
+  painter.drawLine(lane.bottomLeft(), lane.bottomRight());
+  painter.setPen(textPen);
+  painter.drawText(QRect(0, lane.top(), lane.left() - 6, lane.height()),
+                   Qt::AlignRight | Qt::AlignVCenter,
+                   QString::fromStdString(channels_[channel]));
+
+  // One min/max pair per pixel column.
+  if (detailPyramids_.empty())
+    pyramids_[channel].query(viewFirst_, viewLast_, lane.width(), &columns_);
+  else
+    detailPyramids_[channel].query(viewFirst_ - detailFirst_,
+                                   viewLast_ - detailFirst_, lane.width(),
+                                   &columns_);
+
+  // Scale to the visible range.
+  float min = std::numeric_limits<float>::infinity();
+  float max = -std::numeric_limits<float>::infinity();
+  for (const MinMax &column : columns_) {
+    if (std::isnan(column.min))
+      continue;
+    min = std::min(min, column.min);
+    max = std::max(max, column.max);
+  }
+  if (min > max)
+    return;
+  if (max - min < 1e-6) {
+    min -= 0.5;
+    max += 0.5;
+  }
+  float scale = (lane.height() - 6) / (max - min);
+  int bottom = lane.bottom() - 3;
+
+  // A vertical line per column, stretched to touch the previous column so
+  // the curve is connected when zoomed in.
+  lines_.clear();
+  const MinMax *previous = nullptr;
+  for (size_t x = 0; x < columns_.size(); x++) {
+    const MinMax &column = columns_[x];
+    if (std::isnan(column.min)) {
+      previous = nullptr;
+      continue;
+    }
+    float low = column.min;
+    float high = column.max;
+    if (previous != nullptr) {
+      low = std::min(low, previous->max);
+      high = std::max(high, previous->min);
+    }
+    lines_.append(QLineF(lane.left() + x, bottom - (low - min) * scale,
+                         lane.left() + x, bottom - (high - min) * scale));
+    previous = &column;
+  }
+
+  painter.setPen(QColor(0x1f, 0x77, 0xb4));
+  painter.drawLines(lines_);
 
-  xChartView_->repaint();
-  yChartView_->repaint();
+  painter.setPen(textPen);
+  painter.drawText(lane.adjusted(4, 2, -4, -2), Qt::AlignRight | Qt::AlignTop,
+                   QString::number(max, 'g', 4));
+  painter.drawText(lane.adjusted(4, 2, -4, -2),
+                   Qt::AlignRight | Qt::AlignBottom,
+                   QString::number(min, 'g', 4));
+}
+
+// ____________________________________________________________________________
+void RecordingView::updateDetail(int numPixels) {
+  double span = viewLast_ - viewFirst_;
+  if (!detailSource_ || pyramids_.empty() ||
+      span / numPixels >= pyramids_.front().getBucketSize(0)) {
+    detailPyramids_.clear();
+    return;
+  }
+
+  // Still covered by the rows read before.
+  if (!detailPyramids_.empty() && viewFirst_ >= detailFirst_ &&
+      viewLast_ <= detailFirst_ + detailPyramids_.front().getNumSamples())
+    return;
+
+  TRACE_SCOPE("RecordingView::updateDetail");
+
+  // The visible rows and as many on both sides, so panning a bit does not
+  // read again. This is at most a few pixels' worth of buckets of the finest
+  // level times the plot width.
+  int first = std::max(0.0, std::floor(viewFirst_ - span));
+  int last = std::min(static_cast<double>(getNumSamples()) - 1,
+                      std::ceil(viewLast_ + span));
+  auto data = detailSource_(first, last);
+
+  detailFirst_ = first;
+  detailPyramids_.assign(channels_.size(), MinMaxPyramid());
+  for (size_t i = 0; i < channels_.size(); i++) {
+    auto column = data->find(channels_[i]);
+    if (column != data->end())
+      detailPyramids_[i].append(column->second);
+  }
+
+  // Nothing read (e.g. a corrupt row), fall back to the coarse pyramids.
+  if (detailPyramids_.front().getNumSamples() == 0)
+    detailPyramids_.clear();
+}
+
+// ____________________________________________________________________________
+void RecordingView::paintTimeAxis(QPainter &painter, const QRect &plot) {
+  double firstTime = viewFirst_ / samplingRate_;
+  double span = (viewLast_ - viewFirst_) / samplingRate_;
+  if (span <= 0)
+    return;
+
+  // Around 10 ticks at a step of 1, 2 or 5 times a power of 10.
+  double step = std::pow(10, std::floor(std::log10(span / 10)));
+  if (span / step > 50)
+    step *= 5;
+  else if (span / step > 20)
+    step *= 2;
+
+  painter.setPen(QColor(0x40, 0x48, 0x50));
+  for (double tick = std::ceil(firstTime / step) * step;
+       tick <= firstTime + span; tick += step) {
+    int x = plot.left() + (tick - firstTime) / span * plot.width();
+    painter.drawLine(x, plot.bottom(), x, plot.bottom() + 4);
+    painter.drawText(QRect(x - 40, plot.bottom() + 6, 80, 20),
+                     Qt::AlignHCenter | Qt::AlignTop,
+                     QString::number(firstTime_ + tick, 'g', 6) + " s");
+  }
+}
+
+// ____________________________________________________________________________
+ReviewWindow::ReviewWindow() : nextRow_(0) {
+  window_ = new QWidget();
+  window_->resize(1200, 800);
+  window_->setWindowTitle("Review");
+
+  QGridLayout *windowLayout = new QGridLayout;
+
+  view_ = new RecordingView();
+  statusLabel_ = new QLabel();
+
+  windowLayout->addWidget(view_, 0, 0);
+  windowLayout->addWidget(statusLabel_, 1, 0);
+
+  window_->setLayout(windowLayout);
+
+  QObject::connect(&loadTimer_, &QTimer::timeout, this,
+                   &ReviewWindow::loadChunk);
+
+  // The pyramids may be too coarse for zooming in on a long recording, then
+  // the rows are read from the file again.
+  view_->setDetailSource([this](int firstRow, int lastRow) {
+    try {
+      return file_->getData(firstRow, lastRow);
+    } catch (CorruptKistlerFileException &e) {
+      return std::make_shared<
+          std::unordered_map<std::string, std::vector<float>>>();
+    }
+  });
+}
+
+// ____________________________________________________________________________
+void ReviewWindow::show() { window_->show(); }
+
+// ____________________________________________________________________________
+void ReviewWindow::hide() {
+  loadTimer_.stop();
+  window_->hide();
+}
+
+// ____________________________________________________________________________
+bool ReviewWindow::open(const std::string &fileName) {
+  loadTimer_.stop();
+
+  auto file = openKistlerFile(fileName);
+  if (!file->isValid())
+    return false;
+
+  // All columns but the time, which is the x axis.
+  std::vector<std::string> channels;
+  for (const auto &column : file->getColumnNames()) {
+    if (column != "abs time (s)")
+      channels.push_back(column);
+  }
+
+  file_ = std::move(file);
+  nextRow_ = 0;
+  view_->reset(channels, file_->getSamplingRate());
+  window_->setWindowTitle(QString("Review: %1").arg(fileName.c_str()));
+
+  loadTimer_.setInterval(0);
+  loadTimer_.start();
+  return true;
+}
+
+// ____________________________________________________________________________
+void ReviewWindow::loadChunk() {
+  TRACE_SCOPE("ReviewWindow::loadChunk");
+
+  std::shared_ptr<std::unordered_map<std::string, std::vector<float>>> data;
+  try {
+    data = file_->getData(nextRow_, nextRow_ + REVIEW_CHUNK_ROWS - 1);
+  } catch (CorruptKistlerFileException &e) {
+    loadTimer_.stop();
+    statusLabel_->setText(
+        QString("Stopped loading at row %1: %2").arg(nextRow_).arg(e.what()));
+    return;
+  }
+
+  size_t numRows = data->empty() ? 0 : data->begin()->second.size();
+  if (numRows > 0) {
+    view_->append(*data);
+    nextRow_ += numRows;
+  }
+
+  // Read on as fast as possible while there is data, then only check for new
+  // rows from time to time.
+  bool complete = numRows < REVIEW_CHUNK_ROWS;
+  loadTimer_.setInterval(complete ? REVIEW_FOLLOW_MS : 0);
+
+  statusLabel_->setText(
+      QString("%1 samples (%2 s)%3 - mouse wheel: zoom, drag: pan, "
+              "double-click: show all")
+          .arg(view_->getNumSamples())
+          .arg(view_->getNumSamples() / file_->getSamplingRate(), 0, 'f', 1)
+          .arg(complete ? "" : ", loading..."));
 }
 
 // ____________________________________________________________________________
@@ -195,13 +1478,27 @@ ForcePlateFeedback::ForcePlateFeedback() {
   timeframe_ = 0;
   configWindow_ = new ConfigWindow();
   outputWindow_ = new OutputWindow();
+  reviewWindow_ = new ReviewWindow();
   dataModel_ = new DataModel();
   messageHandler_ = new DefaultMessageHandler();
 
+  // Memory budget for the samples, so also multi-hour recordings don't grow
+  // the memory without limit.
+  size_t memoryBudgetMb = DEFAULT_MEMORY_BUDGET_MB;
+  const char *memoryBudgetEnv = std::getenv(MEMORY_BUDGET_ENV_VARIABLE);
+  if (memoryBudgetEnv != nullptr)
+    memoryBudgetMb = std::strtoul(memoryBudgetEnv, nullptr, 10);
+  dataModel_->setMemoryBudget(memoryBudgetMb << 20);
+  reviewWindow_->setMemoryBudget(memoryBudgetMb << 20);
+
   // Signal for start button pressed.
   QObject::connect(configWindow_, &ConfigWindow::startButtonPressed, this,
                    &ForcePlateFeedback::onStartButtonPressed);
 
+  // Signal for review button pressed.
+  QObject::connect(configWindow_, &ConfigWindow::reviewButtonPressed, this,
+                   &ForcePlateFeedback::onReviewButtonPressed);
+
   // State notification signals.
   // Start live view.
   QObject::connect(this, &ForcePlateFeedback::startLiveViewSignal,
@@ -227,6 +1524,42 @@ ForcePlateFeedback::ForcePlateFeedback() {
   QObject::connect(dataModel_, &DataModel::dataUpdated, outputWindow_,
                    &OutputWindow::onDataUpdated);
 
+  QObject::connect(dataModel_, &DataModel::statsUpdated, outputWindow_,
+                   &OutputWindow::onStatsUpdated);
+
+  // Playback position and seeking.
+  QObject::connect(dataModel_, &DataModel::positionChanged, configWindow_,
+                   &ConfigWindow::onPositionChanged);
+
+  QObject::connect(configWindow_, &ConfigWindow::seekRequested, dataModel_,
+                   &DataModel::seekToRow);
+
+  // Timeframe changed while running.
+  QObject::connect(configWindow_, &ConfigWindow::timeframeEdited, this,
+                   &ForcePlateFeedback::onTimeframeEdited);
+
+  QObject::connect(this, &ForcePlateFeedback::timeframeChanged, dataModel_,
+                   &DataModel::onTimeframeChanged);
+
+  // Skipping the stretches without contact switched.
+  QObject::connect(configWindow_, &ConfigWindow::skipNonContactToggled,
+                   dataModel_, &DataModel::setSkipNonContact);
+
+  // Spike filter switched.
+  QObject::connect(configWindow_, &ConfigWindow::spikeFilterToggled,
+                   dataModel_, [this](bool spikeFilter) {
+                     dataModel_->setSpikeFilterWindow(
+                         spikeFilter ? SPIKE_FILTER_WINDOW : 1);
+                   });
+
+  // Zero offset calibration switched.
+  QObject::connect(configWindow_, &ConfigWindow::offsetCalibrationToggled,
+                   dataModel_, &DataModel::setOffsetCalibration);
+
+  // COP spectra switched.
+  QObject::connect(configWindow_, &ConfigWindow::spectralAnalysisToggled,
+                   dataModel_, &DataModel::setSpectralAnalysis);
+
   // Reached EOF.
   QObject::connect(dataModel_, &DataModel::reachedEOF, this,
                    &ForcePlateFeedback::onReachedEOF);
@@ -247,6 +1580,7 @@ ForcePlateFeedback::ForcePlateFeedback() {
 // ____________________________________________________________________________
 ForcePlateFeedback::~ForcePlateFeedback() {
   delete outputWindow_;
+  delete reviewWindow_;
   delete configWindow_;
   delete dataModel_;
   delete messageHandler_;
@@ -297,6 +1631,38 @@ void ForcePlateFeedback::onStartButtonPressed(const QString &fileName,
     startLiveView(fileName, timeframe);
 }
 
+// ____________________________________________________________________________
+void ForcePlateFeedback::onTimeframeEdited(const QString &timeframe) {
+  // When not running, the timeframe is taken on start.
+  if (!running_)
+    return;
+
+  float timeframeFloat = timeframe.toFloat() / 1000; // ms to s
+  if (!validateConfigOptions(fileName_, timeframeFloat) ||
+      timeframeFloat == timeframe_)
+    return;
+
+  timeframe_ = timeframeFloat;
+  emit timeframeChanged(timeframe_);
+}
+
+// ____________________________________________________________________________
+void ForcePlateFeedback::onReviewButtonPressed(const QString &fileName) {
+  if (fileName.isEmpty()) {
+    messageHandler_->showDialog("Please select a file.");
+    return;
+  }
+
+  if (!reviewWindow_->open(fileName.toStdString())) {
+    messageHandler_->showDialog(
+        "File does not "
+        "appear to be a valid BioWare file. Please double-check.");
+    return;
+  }
+
+  reviewWindow_->show();
+}
+
 // ____________________________________________________________________________
 bool ForcePlateFeedback::validateConfigOptions(const std::string &fileName,
                                                const float timeframe) {
@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <array>
 #include <fstream>
+#include <functional>
 #include <gtest/gtest.h>
 #include <map>
 #include <string>
@@ -11,14 +13,20 @@
 #include <vector>
 
 #include "./DataModel.h"
-#include <QtCharts/QBarCategoryAxis>
-#include <QtCharts/QBarSeries>
-#include <QtCharts/QBarSet>
-#include <QtCharts/QChartView>
-#include <QtCharts/QHorizontalBarSeries>
-#include <QtCharts/QValueAxis>
+#include "./MinMaxPyramid.h"
+#include "./TrialSegmenter.h"
+#include <QtGui/QGuiApplication>
+#include <QtGui/QImage>
 #include <QtGui/QIntValidator>
+#include <QtGui/QMouseEvent>
+#include <QtGui/QPaintEvent>
+#include <QtGui/QPainter>
+#include <QtGui/QPixmap>
+#include <QtGui/QScreen>
+#include <QtGui/QShortcut>
+#include <QtGui/QWheelEvent>
 #include <QtWidgets/QApplication>
+#include <QtWidgets/QCheckBox>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QGridLayout>
 #include <QtWidgets/QLabel>
@@ -26,12 +34,297 @@
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QPushButton>
+#include <QtWidgets/QSlider>
 
 // Maximum timeframe in miliseconds over which the parameters may be calculated.
 #define MAX_TIMEFRAME 10'000
 
+// Refresh interval of the performance HUD in ms. The HUD only formats its text
+// at this rate, independent of the data and frame rate.
+#define HUD_REFRESH_MS 250
+
+// An overlay for the output window showing whether the machine keeps up:
+// frames per second, duration of DataModel::process(), lag of the reader
+// behind real time, dropped timer ticks, the p99 sample-to-pixel latency and
+// the memory use. It is toggled with F3 and costs nothing while hidden. While
+// shown, counting a frame is an increment and the text is only rebuilt every
+// HUD_REFRESH_MS.
+class PerformanceHud : public QWidget {
+public:
+  explicit PerformanceHud(QWidget *parent);
+
+  // Toggle visibility (starts/stops the refresh timer).
+  void toggle();
+
+  // Count a rendered frame.
+  void countFrame() { numFrames_++; }
+
+  // Count a data update that was dropped because a newer one arrived before
+  // the next frame.
+  void countCoalescedUpdate() { numCoalescedUpdates_++; }
+
+  // Latest statistics of the playback loop (copied, the DataModel owns them).
+  void setPlaybackStats(const PlaybackStats &playbackStats) {
+    playbackStats_ = playbackStats;
+  }
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+
+private:
+  // Rebuild the text from the counters, called by the refresh timer.
+  void refresh();
+
+  QTimer refreshTimer_;
+  QString text_;
+
+  // Frames counted since the last refresh.
+  int numFrames_;
+  int64_t lastRefreshUs_;
+
+  // Coalesced data updates since the HUD was created.
+  int64_t numCoalescedUpdates_;
+
+  PlaybackStats playbackStats_;
+};
+
+// Refresh rate in Hz to pace the rendering with if the screen does not report
+// one.
+#define FALLBACK_REFRESH_RATE 60
+
+// Range of the force bars in Newton. In the test file the data is out of range
+// sometimes, we will have to tweak this to see what makes sense for our
+// practical use.
+#define FORCE_RANGE_N 80
+
+// Range of the COP crosshair in meters (half the plate size).
+#define COP_RANGE_M 0.3
+
+// A lightweight widget showing a single force as a bar (drawn from zero), and
+// optionally a crosshair marker, e.g. for the COP along the same axis.
+// There is no scene graph: axes, ticks and labels are drawn once into a
+// cached pixmap (rebuilt on resize), and a new value only repaints the region
+// between the old and the new bar.
+class ForceBarWidget : public QWidget {
+public:
+  // Vertical bars grow up/down from zero, horizontal bars left/right.
+  ForceBarWidget(Qt::Orientation orientation, const QString &label,
+                 float range);
+
+  // Set the bar value. Returns true if a repaint was scheduled (i.e. the bar
+  // changed on screen).
+  bool setValue(float value);
+
+  // The crosshair marker, in its own range [-range, range].
+  bool setMarkerValue(float value);
+  void setMarkerRange(float range) { markerRange_ = range; }
+  void setMarkerVisible(bool visible);
+  bool isMarkerVisible() const { return markerVisible_; }
+
+  // Called after every paint, so the render path knows when a frame is on
+  // screen.
+  void setPaintedCallback(std::function<void()> callback) {
+    paintedCallback_ = std::move(callback);
+  }
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+
+private:
+  // Map a value to the pixel position along the value axis.
+  int valueToPixel(float value, float range) const;
+
+  // Geometry of the bar and the marker for the given values.
+  QRect barRect(float value) const;
+  QRect markerRect(float value) const;
+
+  // Draw the static parts (background, axis, ticks, labels) into the cache.
+  void renderBackground();
+
+  Qt::Orientation orientation_;
+  QString label_;
+  float range_;
+  float value_;
+  QRect barRect_;
+
+  float markerRange_;
+  float markerValue_;
+  bool markerVisible_;
+  QRect markerRect_;
+
+  // The area inside the axes and the cached background.
+  QRect plotRect_;
+  QPixmap background_;
+
+  std::function<void()> paintedCallback_;
+};
+
+// Length of the fading COP tail in seconds.
+#define COP_TAIL_SECONDS 30
+
+// The tail is split into this many bands of equal duration, each with its own
+// backing image. The bands fade out in steps as they get older.
+#define COP_TAIL_BANDS 10
+
+// Highest sample rate for which the whole tail is kept in the ring buffer
+// (only needed to redraw the tail after a resize).
+#define COP_TAIL_MAX_RATE_HZ 1000
+
+// The live COP trajectory with a fading tail of the last COP_TAIL_SECONDS.
+// Like for the bars, X is drawn vertically and Y horizontally.
+// The samples are kept in a CopTrail (ring buffer). New samples are drawn
+// incrementally as line segments onto the backing image of the current band,
+// a repaint only covers the new segments. When the current band is full, the
+// oldest band is cleared and reused, and the older bands are composited once
+// (with decreasing opacity) into an opaque history image. So a frame costs a
+// few segments and two blits of the dirty region, independent of the tail
+// length. The whole trail is only re-plotted after a resize.
+class CopTrajectoryWidget : public QWidget {
+public:
+  // The COP range in meters, in both directions.
+  explicit CopTrajectoryWidget(float range);
+
+  // Append the new samples of a batch ("abs time (s)", "Ax", "Ay"). If the
+  // time jumps back (restarted playback), the trail is cleared first.
+  void addSamples(
+      const std::unordered_map<std::string, std::vector<float>> &data);
+
+  // Draw the samples added since the last call. Returns true if a repaint was
+  // scheduled.
+  bool flush();
+
+  // Forget the trail.
+  void clear();
+
+  void setPaintedCallback(std::function<void()> callback) {
+    paintedCallback_ = std::move(callback);
+  }
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+
+private:
+  QPointF copToPixel(const CopSample &sample) const;
+  // The marker of the latest sample.
+  QRect headRect() const;
+
+  // Draw a sample onto the given painter (a line segment from the previous
+  // sample if both have contact). Returns the dirty rectangle.
+  QRect drawSample(QPainter &painter, const CopSample &sample);
+
+  // Start drawing on a band image.
+  void beginBand(QPainter &painter, int band);
+
+  // Clear the oldest band and make it the current one.
+  void rotateBands();
+
+  // Draw the static parts (background, grid, labels) and composite the older
+  // bands on top of them.
+  void renderBackground();
+  void renderHistory();
+
+  // Draw the whole trail again, e.g. after a resize.
+  void replot();
+
+  float range_;
+  CopTrail trail_;
+  // Number of samples of the trail that are already drawn.
+  uint64_t numDrawn_;
+
+  // The band images, bands_[currentBand_] is the one drawn to. The older
+  // bands precede it (cyclically).
+  std::vector<QImage> bands_;
+  int currentBand_;
+  float bandStartTime_;
+  float bandDuration_;
+
+  // Square area of the plot, the static background and background plus older
+  // bands.
+  QRect plotRect_;
+  QImage background_;
+  QImage history_;
+
+  // The last drawn point. Samples closer than a pixel to it are skipped.
+  bool hasAnchor_;
+  QPointF anchor_;
+
+  // The latest sample (drawn as a marker on top).
+  bool hasHead_;
+  QPointF head_;
+
+  std::function<void()> paintedCallback_;
+};
+
+// Number of bins per direction of the COP heatmap (5mm bins on the plate).
+#define COP_HEATMAP_BINS 120
+
+// The heatmap colours are scaled to the highest bin count, but all bins are
+// only recoloured when it grew by more than this factor since the last time.
+// In between, the hottest bins saturate.
+#define COP_HEATMAP_RESCALE_FACTOR 1.25
+
+// A heatmap of where the COP has been during the session (a CopHistogram2D),
+// oriented like the trajectory. New samples are counted in O(1) each, and the
+// colour-mapped image (one pixel per bin) is only recoloured in the bounding
+// box of the changed bins, which is also the only region repainted. Only
+// when the highest count outgrew the colour scale (rarely, see
+// COP_HEATMAP_RESCALE_FACTOR) the whole image is recoloured.
+class CopHeatmapWidget : public QWidget {
+public:
+  // The COP range in meters, in both directions.
+  explicit CopHeatmapWidget(float range);
+
+  // Count the new samples of a batch ("abs time (s)", "Ax", "Ay"). If the
+  // time jumps back (restarted playback), the heatmap is cleared first.
+  void addSamples(
+      const std::unordered_map<std::string, std::vector<float>> &data);
+
+  // Recolour the changed bins. Returns true if a repaint was scheduled.
+  bool flush();
+
+  void clear();
+
+  void setPaintedCallback(std::function<void()> callback) {
+    paintedCallback_ = std::move(callback);
+  }
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+
+private:
+  // Update the colours of the given bins in the image.
+  void colorBins(const BinRect &bins);
+
+  // The widget area covered by the given bins.
+  QRect binsToPixels(const BinRect &bins) const;
+
+  void renderBackground();
+
+  CopHistogram2D histogram_;
+  // Time of the newest counted sample.
+  float lastTime_;
+
+  // One pixel per bin, drawn scaled to plotRect_.
+  QImage image_;
+  // The count that maps to the hottest colour.
+  uint32_t colorScaleMax_;
+  std::array<QRgb, 256> colorMap_;
+
+  QRect plotRect_;
+  QPixmap background_;
+
+  std::function<void()> paintedCallback_;
+};
+
 // A class for the implementation of the output window.
 // The window will show the plots to the participant.
+// Rendering is decoupled from the data rate: onDataUpdated() only keeps the
+// latest parameters, and a timer paced to the display refresh rate applies
+// them and schedules an asynchronous repaint. Intermediate updates between
+// two frames are dropped, so slow rendering never holds up the DataModel.
 class OutputWindow : public QWidget {
   Q_OBJECT
 
@@ -51,21 +344,46 @@ private:
   QWidget *window_;
   QLabel *label_;
 
-  // The plot.
-  QChart *xChart_;
-  QBarSeries *xSeries_;
-  QBarSet *xSet_;
-  QStringList xCategories_;
-  QBarCategoryAxis *xAxisX_;
-  QValueAxis *xAxisY_;
-  QChartView *xChartView_;
-  QChart *yChart_;
-  QHorizontalBarSeries *ySeries_;
-  QBarSet *ySet_;
-  QStringList yCategories_;
-  QBarCategoryAxis *yAxisY_;
-  QValueAxis *yAxisX_;
-  QChartView *yChartView_;
+  // The plot: force in X direction as vertical bar, force in Y direction as
+  // horizontal bar. The COP crosshair is toggled with F4.
+  ForceBarWidget *xBarWidget_;
+  ForceBarWidget *yBarWidget_;
+  QShortcut *crosshairShortcut_;
+
+  // The COP trajectory and heatmap next to the bars.
+  CopTrajectoryWidget *trajectoryWidget_;
+  CopHeatmapWidget *heatmapWidget_;
+
+  // Mean forces of the longer analysis windows (e.g. 1 s and 30 s).
+  QLabel *windowsLabel_;
+
+  // The render path. The latest published parameters wait in pending*_ until
+  // the next render tick.
+  QTimer renderTimer_;
+  bool framePending_;
+  float pendingMeanForceX_;
+  float pendingMeanForceY_;
+  float pendingMeanCopX_;
+  float pendingMeanCopY_;
+  LatencyStamps pendingStamps_;
+  std::vector<BalanceParameters> pendingWindows_;
+  // Stamps of the frame being painted and the number of widgets that still
+  // have to paint it.
+  LatencyStamps presentedStamps_;
+  int paintsPending_;
+
+  // Apply the pending parameters and schedule a repaint (render timer).
+  void render();
+  // Called by the widgets when they finished painting.
+  void onWidgetPainted();
+
+  // Keyboard shortcut for writing the trace file and the latency report on
+  // demand (if enabled, see Instrumentation.h).
+  QShortcut *traceShortcut_;
+
+  // The performance overlay and the key to toggle it.
+  PerformanceHud *performanceHud_;
+  QShortcut *hudShortcut_;
 
 public slots:
   // Communication with ForcePlateFeedback class. These functions are connected
@@ -73,12 +391,138 @@ public slots:
   // elicited.
   void onStartLiveView(const std::string &fileName, const float timeframe);
   void onStopLiveView();
-  void onDataUpdated(const BalanceParameters *balanceParameters);
+  void onDataUpdated(const BalanceParameters *balanceParameters,
+                     const std::vector<BalanceParameters> *analysisWindows);
+  void onStatsUpdated(const PlaybackStats *playbackStats);
 
   // On const-correctness of signals:
   // https://stackoverflow.com/questions/39281740/why-are-qt-signals-not-const
 };
 
+// Number of rows the review window reads per step. The recording is read in
+// steps so the window stays responsive and the plot fills up while loading.
+#define REVIEW_CHUNK_ROWS 65'536
+
+// Interval in ms for checking if a recording has grown, once the review window
+// has read everything.
+#define REVIEW_FOLLOW_MS 500
+
+// Plots all channels of a recording over its full duration, one lane per
+// channel, with zoom (mouse wheel) and pan (drag), double-click shows the whole
+// recording. Every channel has a MinMaxPyramid, so a repaint draws one
+// vertical min/max line per pixel column and lane, no matter how long the
+// recording is or how far it is zoomed out. The data is appended chunk-wise;
+// if the view shows the end of the recording, it follows new data.
+class RecordingView : public QWidget {
+public:
+  RecordingView();
+
+  // Start over with the given channels (column names) and sampling rate.
+  void reset(const std::vector<std::string> &channels, float samplingRate);
+
+  // Append the next rows of the recording.
+  void append(const std::unordered_map<std::string, std::vector<float>> &data);
+
+  size_t getNumSamples() const;
+
+  // Show the whole recording (and keep doing so while data is appended).
+  void fitAll();
+
+  // Limit the memory of the pyramids of all channels together (in bytes, 0 for
+  // no limit). Long recordings then lose the finest levels, see MinMaxPyramid.
+  void setMemoryBudget(size_t bytes);
+
+  // Where to read the rows [firstRow, lastRow] of the recording from when
+  // zoomed in beyond the finest level of the pyramids.
+  void setDetailSource(
+      const std::function<
+          std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>(
+              int, int)> &detailSource) {
+    detailSource_ = detailSource;
+  }
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void wheelEvent(QWheelEvent *event) override;
+  void mousePressEvent(QMouseEvent *event) override;
+  void mouseMoveEvent(QMouseEvent *event) override;
+  void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private:
+  // The area of the lanes (without labels and time axis).
+  QRect plotRect() const;
+
+  // Keep the visible range within the recording.
+  void clampView();
+
+  // Read the rows around the visible range from the detail source if the
+  // pyramids are too coarse for it, or drop them if not needed anymore.
+  void updateDetail(int numPixels);
+
+  // Draw a single channel into its lane.
+  void paintLane(QPainter &painter, const QRect &lane, size_t channel);
+  void paintTimeAxis(QPainter &painter, const QRect &plot);
+
+  std::vector<std::string> channels_;
+  std::vector<MinMaxPyramid> pyramids_;
+  size_t memoryBudget_;
+  float samplingRate_;
+  float firstTime_;
+
+  // The visible range in samples (fractional when zoomed in).
+  double viewFirst_;
+  double viewLast_;
+  bool fitAll_;
+
+  // Full-resolution pyramids of the rows from detailFirst_ on, read from the
+  // detail source when zoomed in far (empty otherwise).
+  std::function<
+      std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>(
+          int, int)>
+      detailSource_;
+  std::vector<MinMaxPyramid> detailPyramids_;
+  int detailFirst_;
+
+  // Start of a drag (pan).
+  int dragStartX_;
+  double dragStartFirst_;
+
+  // Scratch buffers for painting, reused to avoid allocations per frame.
+  std::vector<MinMax> columns_;
+  QVector<QLineF> lines_;
+};
+
+// A window for reviewing a whole recording, see RecordingView. It reads the
+// recording in steps of REVIEW_CHUNK_ROWS and keeps checking for new rows, so
+// it also follows a recording that is still being written.
+class ReviewWindow : public QWidget {
+public:
+  ReviewWindow();
+
+  // Open a recording for review. Returns false if it is not a valid BioWare
+  // file.
+  bool open(const std::string &fileName);
+
+  // See RecordingView::setMemoryBudget.
+  void setMemoryBudget(size_t bytes) { view_->setMemoryBudget(bytes); }
+
+  void show();
+  void hide();
+
+private:
+  // Read the next chunk of rows (load timer).
+  void loadChunk();
+
+  // Qt stuff.
+  QWidget *window_;
+  QLabel *statusLabel_;
+  RecordingView *view_;
+
+  QTimer loadTimer_;
+  std::unique_ptr<KistlerFile> file_;
+  int nextRow_;
+};
+
 // A class for the implementation of the configuration window.
 // This is the first window that the researcher sees, if she opens the app.
 // There, she can make settings like setting the file to read from, and a
@@ -101,15 +545,32 @@ private:
   QWidget *window_;
   QPushButton *startButton_;
   QPushButton *setFileButton_;
+  QPushButton *reviewButton_;
   QLabel *timeLabel_;
   QLineEdit *timeLineEdit_;
   QLineEdit *fileLineEdit_;
   QFileDialog *fileDialog_;
 
+  // Playback position, drag it to seek.
+  QSlider *positionSlider_;
+  QLabel *positionLabel_;
+
+  // Skip the stretches without someone on the plate.
+  QCheckBox *skipCheckBox_;
+  // Filter the spikes out of the samples.
+  QCheckBox *spikeCheckBox_;
+  // Subtract the zero offsets of the channels.
+  QCheckBox *offsetCheckBox_;
+  // Calculate the COP spectra of the long analysis windows.
+  QCheckBox *spectraCheckBox_;
+
 private slots:
-  // Event handlers for start button and file selection dialog.
+  // Event handlers for start button, file selection dialog and review button.
   void handleStartButton();
   void handleFileButton();
+  void handleReviewButton();
+  void handleTimeframeEdit();
+  void handlePositionSlider(int row);
 
 public slots:
   // Communication with ForcePlateFeedback class. These functions are connected
@@ -117,11 +578,33 @@ public slots:
   // elicited.
   void onStartLiveView(const std::string &fileName, const float timeframe);
   void onStopLiveView();
+  void onPositionChanged(int row, float time, int numRows);
 
 signals:
+  // Emitted when the user moves the position slider.
+  void seekRequested(int row);
+
   // Communication with ForcePlateFeedback class. This signal is emitted when
   // the start button is pressed. The actual logic is in ForcePlateFeedback.
   void startButtonPressed(const QString &fileName, const QString &timeframe);
+
+  // Emitted when the review button is pressed.
+  void reviewButtonPressed(const QString &fileName);
+
+  // Emitted when the user finished editing the timeframe (in ms).
+  void timeframeEdited(const QString &timeframe);
+
+  // Emitted when skipping the stretches without contact is switched.
+  void skipNonContactToggled(bool skipNonContact);
+
+  // Emitted when the spike filter is switched.
+  void spikeFilterToggled(bool spikeFilter);
+
+  // Emitted when the zero offset calibration is switched.
+  void offsetCalibrationToggled(bool offsetCalibration);
+
+  // Emitted when the COP spectra are switched.
+  void spectralAnalysisToggled(bool spectralAnalysis);
 };
 
 // Class which abstracts QMessageBox such that a mock message dialog can be
@@ -167,6 +650,7 @@ private:
   // The GUI layer.
   ConfigWindow *configWindow_;
   OutputWindow *outputWindow_;
+  ReviewWindow *reviewWindow_;
 
   // The data model responsible for continuously calculating the parameters.
   DataModel *dataModel_;
@@ -202,11 +686,19 @@ signals:
   void startLiveViewSignal(const std::string &fileName, const float timeframe);
   void stopLiveViewSignal();
   void resetModel();
+  // The timeframe (in seconds) was changed while running.
+  void timeframeChanged(const float timeframe);
 
 private slots:
   // Start button was pressed.
   void onStartButtonPressed(const QString &fileName, const QString &timeframe);
 
+  // Review button was pressed.
+  void onReviewButtonPressed(const QString &fileName);
+
+  // The timeframe was edited, applies it right away if running.
+  void onTimeframeEdited(const QString &timeframe);
+
 public slots:
   // These slots are called by the DataModel on end of file, invalid file, etc.
   void onReachedEOF();
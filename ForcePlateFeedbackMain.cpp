@@ -4,10 +4,41 @@
 #include "./ForcePlateFeedback.h"
 
 int main(int argc, char **argv) {
+  // Convert a BioWare export into an archive (see KistlerArchiveFile), no GUI
+  // needed for that.
+  if (argc == 4 && std::string(argv[1]) == "--archive") {
+    KistlerCSVFile source(argv[2]);
+    return KistlerArchiveFile::write(source, argv[3]) ? 0 : 1;
+  }
+
+  // Split a recording into its standing trials and print their parameters as
+  // a table (see TrialSegmenter).
+  if (argc == 3 && std::string(argv[1]) == "--trials") {
+    TrialSegmenter::writeTable(TrialSegmenter().run(argv[2]), std::cout);
+    return 0;
+  }
+
   QApplication app(argc, argv);
 
+  // Tracing of the processing pipeline, see Instrumentation.h.
+  const char *traceFile = std::getenv(TRACE_ENV_VARIABLE);
+  if (traceFile != nullptr) {
+    qInfo() << "Tracing enabled, writing trace to" << traceFile << "on exit.";
+    Tracer::setEnabled(true);
+  }
+
   ForcePlateFeedback forcePlateFeedback;
   forcePlateFeedback.showConfigWindow();
 
-  return app.exec();
+  int exitCode = app.exec();
+
+  if (traceFile != nullptr)
+    Tracer::instance().writeJson(traceFile);
+
+  // Latency histograms of the sample-to-pixel path, see Instrumentation.h.
+  const char *latencyFile = std::getenv(LATENCY_ENV_VARIABLE);
+  if (latencyFile != nullptr)
+    LatencyMonitor::instance().writeReport(latencyFile);
+
+  return exitCode;
 }
\ No newline at end of file
@@ -2,7 +2,14 @@
 // Author: Paul Soelder <p.soelder@mailbox.org>
 
 #include "./ForcePlateFeedback.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 // ____________________________________________________________________________
 // I couldn't test the elicitation of the signals with gtest. Therefore, unit
 // tests for the signals are missing. However, the logic is in the slots, which
@@ -10,6 +17,29 @@
 // of the signals via a signal counter.
 // ____________________________________________________________________________
 
+// ____________________________________________________________________________
+// A file in the temp directory, named after the test and the process so that
+// concurrent runs don't write to the same file. It is removed when it goes out
+// of scope, also if an assertion fails before the end of the test.
+class TemporaryFile {
+public:
+  explicit TemporaryFile(const std::string &suffix) {
+    auto test = testing::UnitTest::GetInstance()->current_test_info();
+    std::string name = std::string("ForcePlateFeedbackTest_") +
+                       test->test_suite_name() + "_" + test->name() + "_" +
+                       std::to_string(getpid()) + suffix;
+    name_ = (std::filesystem::temp_directory_path() / name).string();
+  }
+  ~TemporaryFile() { std::remove(name_.c_str()); }
+  TemporaryFile(const TemporaryFile &) = delete;
+  TemporaryFile &operator=(const TemporaryFile &) = delete;
+
+  const std::string &getName() const { return name_; }
+
+private:
+  std::string name_;
+};
+
 // ____________________________________________________________________________
 TEST(KistlerCSVFileTest, validateFile) {
   // A proper file.
@@ -142,6 +172,9 @@ TEST(KistlerCSVFileTest, parseMetaData) {
   ASSERT_STREQ(kistlerFile.columnNames_[8].c_str(), "Ay");
   ASSERT_FLOAT_EQ(kistlerFile.getSamplingRate(), 1000.0);
   ASSERT_TRUE(kistlerFile.isValid());
+  ASSERT_TRUE(kistlerFile.hasContactPeriod());
+  ASSERT_EQ(kistlerFile.getContactStartRow(), 3257);
+  ASSERT_EQ(kistlerFile.getContactEndRow(), 58490);
 
   // Other column names.
   kistlerFile = KistlerCSVFile("example_data/KistlerCSV_wrong_column.txt");
@@ -369,6 +402,625 @@ TEST(KistlerCSVFileTest, getDataByIndices) {
   ASSERT_FLOAT_EQ(data->at("Ay")[1], 0);
 }
 
+// ____________________________________________________________________________
+// Write a BioWare-style test file with the header of the example file and
+// numRows rows at 1kHz (time in the first column, the row number in the
+// others, the COP is 0.1 + row / 10000). The rows can be appended to an
+// existing file, with an offset on the time (a gap).
+void writeKistlerTestFile(const std::string &fileName, int numRows,
+                          int firstRow = 0, bool truncate = true,
+                          double timeOffset = 0) {
+  std::ofstream file(fileName, truncate ? std::ios::trunc : std::ios::app);
+  if (truncate) {
+    std::ifstream example("example_data/KistlerCSV_example.txt");
+    std::string line;
+    for (int i = 0; i < 19; i++) {
+      std::getline(example, line);
+      file << line << "\n";
+    }
+  }
+  for (int row = firstRow; row < firstRow + numRows; row++) {
+    file << row / 1000.0 + timeOffset;
+    for (int column = 0; column < 6; column++)
+      file << "\t" << row;
+    file << "\t" << 0.1 + row / 10000.0 << "\t" << 0.1 + row / 10000.0
+         << "\n";
+  }
+}
+
+// ____________________________________________________________________________
+TEST(KistlerCSVFileTest, rowIndex) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 1000);
+
+  KistlerCSVFile kistlerFile(fileName);
+  ASSERT_TRUE(kistlerFile.isValid());
+
+  // Only the first row is indexed after opening.
+  ASSERT_EQ(kistlerFile.rowIndex_.size(), 1);
+
+  // Reading a row extends the index until there.
+  auto data = kistlerFile.getData(300, 302);
+  ASSERT_EQ(data->at("abs time (s)").size(), 3);
+  ASSERT_FLOAT_EQ(data->at("abs time (s)")[0], 0.3);
+  ASSERT_FLOAT_EQ(data->at("Fx")[2], 302);
+  ASSERT_GE(kistlerFile.rowIndex_.size(), 3);
+
+  // Counting the rows indexes the whole file.
+  ASSERT_EQ(kistlerFile.getNumRows(), 1000);
+  ASSERT_EQ(kistlerFile.rowIndex_.size(), 1000 / ROW_INDEX_STRIDE + 1);
+
+  // Random access gives the same rows as reading everything.
+  auto all = kistlerFile.getData();
+  ASSERT_EQ(all->at("Fz").size(), 1000);
+  for (int row : {0, 1, 127, 128, 129, 511, 512, 998, 999}) {
+    data = kistlerFile.getData(row, row);
+    ASSERT_EQ(data->at("Fz").size(), 1);
+    ASSERT_FLOAT_EQ(data->at("Fz")[0], all->at("Fz")[row]);
+  }
+
+  // Past the end.
+  data = kistlerFile.getData(1000, 1010);
+  ASSERT_EQ(data->at("Fz").size(), 0);
+
+  // A copy starts with the index (e.g. for another thread).
+  KistlerCSVFile copy(kistlerFile);
+  ASSERT_EQ(copy.rowIndex_, kistlerFile.rowIndex_);
+  ASSERT_EQ(copy.indexedRows_, 1000);
+  ASSERT_FLOAT_EQ(copy.getData(511, 511)->at("Fz")[0], 511);
+
+  // The file grows (e.g. still recording), including an incomplete row.
+  writeKistlerTestFile(fileName, 200, 1000, false);
+  {
+    std::ofstream file(fileName, std::ios::app);
+    file << "1.2\t1";
+  }
+  ASSERT_EQ(kistlerFile.getNumRows(), 1201);
+  data = kistlerFile.getData(1150, 1150);
+  ASSERT_FLOAT_EQ(data->at("Fz")[0], 1150);
+}
+
+// ____________________________________________________________________________
+TEST(KistlerCSVFileTest, rowIndexBounded) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+
+  // An index of at most 4 entries, so it is coarsened a few times.
+  KistlerCSVFile kistlerFile(fileName);
+  ASSERT_TRUE(kistlerFile.isValid());
+  kistlerFile.maxRowIndexSize_ = 4;
+  ASSERT_EQ(kistlerFile.getNumRows(), 5000);
+  ASSERT_LE(kistlerFile.rowIndex_.size(), 4);
+  ASSERT_EQ(kistlerFile.rowIndex_.size(), kistlerFile.rowIndexTimes_.size());
+  ASSERT_EQ(kistlerFile.rowIndexStride_, 2048);
+
+  // Seeking and looking up times still give the right rows.
+  for (int row : {0, 1, 2047, 2048, 2049, 4095, 4096, 4999}) {
+    auto data = kistlerFile.getData(row, row);
+    ASSERT_EQ(data->at("Fz").size(), 1);
+    ASSERT_FLOAT_EQ(data->at("Fz")[0], row);
+  }
+  ASSERT_EQ(kistlerFile.getRowAtTime(3.2), 3200);
+  ASSERT_FLOAT_EQ(kistlerFile.getTimeOfRow(4500), 4.5);
+}
+
+// ____________________________________________________________________________
+TEST(KistlerCSVFileTest, getDataByTime) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 1000);
+
+  KistlerCSVFile kistlerFile(fileName);
+  ASSERT_TRUE(kistlerFile.isValid());
+
+  // Both bounds are inclusive.
+  auto data = kistlerFile.getDataByTime(0.2, 0.25);
+  ASSERT_EQ(data->at("Fz").size(), 51);
+  ASSERT_FLOAT_EQ(data->at("Fz").front(), 200);
+  ASSERT_FLOAT_EQ(data->at("Fz").back(), 250);
+
+  // Between two samples.
+  data = kistlerFile.getDataByTime(0.2005, 0.2035);
+  ASSERT_EQ(data->at("Fz").size(), 3);
+  ASSERT_FLOAT_EQ(data->at("Fz").front(), 201);
+
+  // No samples in range.
+  data = kistlerFile.getDataByTime(0.2003, 0.2006);
+  ASSERT_EQ(data->at("Fz").size(), 0);
+  data = kistlerFile.getDataByTime(5, 6);
+  ASSERT_EQ(data->at("Fz").size(), 0);
+
+  ASSERT_TRUE(kistlerFile.isUniformlySampled());
+  ASSERT_EQ(kistlerFile.getRowAtTime(0), 0);
+  ASSERT_EQ(kistlerFile.getRowAtTime(0.5), 500);
+  ASSERT_EQ(kistlerFile.getRowAtTime(10), 1000);
+  ASSERT_FLOAT_EQ(kistlerFile.getTimeOfRow(700), 0.7);
+  ASSERT_TRUE(std::isinf(kistlerFile.getTimeOfRow(1000)));
+
+  // A gap of half a second after row 999 (times 1.5s and later).
+  writeKistlerTestFile(fileName, 1000, 1000, false, 0.5);
+  KistlerCSVFile gappy(fileName);
+  ASSERT_EQ(gappy.getNumRows(), 2000);
+  ASSERT_FALSE(gappy.isUniformlySampled());
+
+  // Rows before the gap are still found exactly, the gap is empty.
+  ASSERT_EQ(gappy.getRowAtTime(0.3), 300);
+  ASSERT_EQ(gappy.getRowAtTime(1.2), 1000);
+  ASSERT_EQ(gappy.getRowAtTime(1.6), 1100);
+  ASSERT_FLOAT_EQ(gappy.getTimeOfRow(1100), 1.6);
+  data = gappy.getDataByTime(1.1, 1.4);
+  ASSERT_EQ(data->at("Fz").size(), 0);
+
+  // A range across the gap.
+  data = gappy.getDataByTime(0.99, 1.51);
+  ASSERT_EQ(data->at("Fz").size(), 10 + 11);
+  ASSERT_FLOAT_EQ(data->at("Fz").front(), 990);
+  ASSERT_FLOAT_EQ(data->at("Fz").back(), 1010);
+  ASSERT_FLOAT_EQ(data->at("abs time (s)").back(), 1.51);
+}
+
+// ____________________________________________________________________________
+TEST(KistlerCSVFileTest, metaData) {
+  KistlerCSVFile kistlerFile("example_data/KistlerCSV_example.txt");
+  const KistlerMetaData &metaData = kistlerFile.getMetaData();
+  ASSERT_EQ(metaData.version, "BioWare Version 5.3.0.7 Export");
+  ASSERT_EQ(metaData.devices.size(), 8u);
+  ASSERT_EQ(metaData.devices[0], "9260AA6");
+  ASSERT_EQ(metaData.getNumSamples(), 59118);
+  ASSERT_EQ(metaData.rates.size(), 8u);
+  ASSERT_TRUE(metaData.hasConsistentRates());
+  ASSERT_EQ(metaData.contactStart[7], 3257);
+  ASSERT_EQ(metaData.contactEnd[0], 58490);
+  ASSERT_FLOAT_EQ(metaData.contactStartTime[0], 3.257);
+  ASSERT_FLOAT_EQ(metaData.contactEndTime[0], 58.490002);
+  ASSERT_FLOAT_EQ(metaData.firstSampleTime[0], 0);
+  ASSERT_FLOAT_EQ(metaData.normalizedForce[0], 800);
+  ASSERT_FLOAT_EQ(metaData.normalizedLength[0], 1);
+  ASSERT_EQ(metaData.fileInformation.at("Date"), "Jul 04, 2024  17:58:42");
+  ASSERT_EQ(metaData.fileInformation.at("Name"), "");
+  ASSERT_EQ(metaData.units.size(), 9u);
+  ASSERT_EQ(metaData.units[3], "N");
+  ASSERT_EQ(metaData.units[6], "N m");
+
+  // Different rates per channel are reported, the first one is used. The
+  // number of samples in the header sizes the columns when reading all rows.
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 1000);
+  {
+    std::ifstream file(fileName);
+    std::string text((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    text.replace(text.find("59118"), 5, "01000");
+    text.replace(text.find("1000.000000", text.find("Rate")), 11,
+                 "500.0000000");
+    std::ofstream(fileName) << text;
+  }
+  KistlerCSVFile inconsistent(fileName);
+  ASSERT_TRUE(inconsistent.isValid());
+  ASSERT_FALSE(inconsistent.getMetaData().hasConsistentRates());
+  ASSERT_FLOAT_EQ(inconsistent.getSamplingRate(), 500);
+  ASSERT_EQ(inconsistent.getMetaData().getNumSamples(), 1000);
+  auto data = inconsistent.getData();
+  ASSERT_EQ(data->at("Fz").size(), 1000u);
+  ASSERT_EQ(data->at("Fz").capacity(), 1000u);
+  data = inconsistent.getData(600);
+  ASSERT_EQ(data->at("Fz").capacity(), 400u);
+}
+
+// ____________________________________________________________________________
+// Write a test file with corrupt cells in rows 10 (Fx), 11 (Fx, empty) and 12
+// (Ay), and 18 rows in total.
+void writeCorruptTestFile(const std::string &fileName) {
+  writeKistlerTestFile(fileName, 10);
+  {
+    std::ofstream file(fileName, std::ios::app);
+    file << "0.01\tglitch\t10\t10\t10\t10\t10\t0.101\t0.101\n"
+         << "0.011\t\t11\t11\t11\t11\t11\t0.1011\t0.1011\n"
+         << "0.012\t12\t12\t12\t12\t12\t12\t0.1012\tnope\n";
+  }
+  writeKistlerTestFile(fileName, 5, 13, false);
+}
+
+// ____________________________________________________________________________
+TEST(KistlerCSVFileTest, corruptDataPolicy) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeCorruptTestFile(fileName);
+
+  // Abort by default, but only if a corrupt row is read.
+  KistlerCSVFile kistlerFile(fileName);
+  ASSERT_EQ(kistlerFile.getCorruptDataPolicy(), CorruptDataPolicy::Abort);
+  ASSERT_EQ(kistlerFile.getData(0, 9)->at("Fx").size(), 10u);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getNumCells(), 0u);
+  ASSERT_THROW(kistlerFile.getData(8, 12), CorruptKistlerFileException);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getNumCells(), 1u);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getCells()[0].row, 10);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getCells()[0].column, 1);
+
+  // Skip the rows.
+  kistlerFile.setCorruptDataPolicy(CorruptDataPolicy::SkipRow);
+  auto data = kistlerFile.getData();
+  ASSERT_EQ(data->at("Fx").size(), 15u);
+  ASSERT_EQ(data->at("Ay").size(), 15u);
+  ASSERT_FLOAT_EQ(data->at("Fx")[9], 9);
+  ASSERT_FLOAT_EQ(data->at("Fx")[10], 13);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getNumCells(), 3u);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getSummary(),
+            "3 corrupt cells in rows 10-12");
+
+  // Interpolate between the neighbours, the cells are only reported once.
+  kistlerFile.setCorruptDataPolicy(CorruptDataPolicy::Interpolate);
+  data = kistlerFile.getData();
+  ASSERT_EQ(data->at("Fx").size(), 18u);
+  ASSERT_FLOAT_EQ(data->at("Fx")[10], 10);
+  ASSERT_FLOAT_EQ(data->at("Fx")[11], 11);
+  ASSERT_FLOAT_EQ(data->at("Fy")[11], 11);
+  ASSERT_FLOAT_EQ(data->at("Ay")[12], 0.1012);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getNumCells(), 3u);
+
+  // The last valid value is held at the end of a read, the next one at the
+  // beginning.
+  ASSERT_FLOAT_EQ(kistlerFile.getData(5, 11)->at("Fx").back(), 9);
+  ASSERT_FLOAT_EQ(kistlerFile.getData(10, 14)->at("Fx").front(), 12);
+
+  // A shared report.
+  auto report = std::make_shared<CorruptDataReport>();
+  KistlerCSVFile other(fileName);
+  other.setCorruptDataPolicy(CorruptDataPolicy::Interpolate);
+  other.setCorruptDataReport(report);
+  other.getData(11, 11);
+  ASSERT_EQ(report->getNumCells(), 1u);
+  ASSERT_EQ(report->getSummary(), "1 corrupt cell in row 11");
+  report->clear();
+  ASSERT_EQ(report->getSummary(), "0 corrupt cells");
+}
+
+// ____________________________________________________________________________
+TEST(CorruptDataReportTest, add) {
+  // Cells past the kept ones are only counted once too.
+  CorruptDataReport report;
+  for (int i = 0; i < 2; i++) {
+    for (int row = 0; row < CORRUPT_REPORT_MAX_CELLS + 100; row++)
+      report.add(row, 1);
+    report.add(5, 2);
+  }
+  ASSERT_EQ(report.getNumCells(), CORRUPT_REPORT_MAX_CELLS + 101u);
+  ASSERT_EQ(report.getCells().size(),
+            static_cast<size_t>(CORRUPT_REPORT_MAX_CELLS));
+
+  // Joining the ranges before and after, backwards.
+  report.clear();
+  report.add(3, 0);
+  report.add(1, 0);
+  report.add(2, 0);
+  report.add(0, 0);
+  report.add(2, 0);
+  report.add(2, 1);
+  ASSERT_EQ(report.getNumCells(), 5u);
+  ASSERT_EQ(report.getSummary(), "5 corrupt cells in rows 0-3");
+
+  // Re-read a file with more corrupt rows than kept.
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 10);
+  {
+    std::ofstream file(fileName, std::ios::app);
+    for (int row = 10; row < CORRUPT_REPORT_MAX_CELLS + 110; row++)
+      file << "0.01\tglitch\t10\t10\t10\t10\t10\t0.101\t0.101\n";
+  }
+  KistlerCSVFile kistlerFile(fileName);
+  kistlerFile.setCorruptDataPolicy(CorruptDataPolicy::SkipRow);
+  ASSERT_EQ(kistlerFile.getData()->at("Fx").size(), 10u);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getNumCells(),
+            CORRUPT_REPORT_MAX_CELLS + 100u);
+  kistlerFile.getData();
+  kistlerFile.getData(CORRUPT_REPORT_MAX_CELLS + 50);
+  ASSERT_EQ(kistlerFile.getCorruptDataReport().getNumCells(),
+            CORRUPT_REPORT_MAX_CELLS + 100u);
+}
+
+// ____________________________________________________________________________
+TEST(KistlerCSVFileTest, gzip) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  TemporaryFile tempGzipFile(".txt.gz");
+  const std::string gzipName = tempGzipFile.getName();
+  writeKistlerTestFile(fileName, 100000);
+
+  // Compress it as two gzip members (like gzip a.txt; cat a.txt.gz b.txt.gz).
+  std::ifstream plainFile(fileName, std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(plainFile)),
+                   std::istreambuf_iterator<char>());
+  size_t half = text.size() / 2;
+  gzFile gzipFile = gzopen(gzipName.c_str(), "wb");
+  gzwrite(gzipFile, text.data(), half);
+  gzclose(gzipFile);
+  gzipFile = gzopen(gzipName.c_str(), "ab");
+  gzwrite(gzipFile, text.data() + half, text.size() - half);
+  gzclose(gzipFile);
+
+  KistlerCSVFile plain(fileName);
+  KistlerCSVFile compressed(gzipName);
+  ASSERT_TRUE(compressed.isValid());
+  ASSERT_EQ(compressed.compression_, Compression::Gzip);
+  ASSERT_EQ(compressed.getColumnNames(), plain.getColumnNames());
+  ASSERT_FLOAT_EQ(compressed.getSamplingRate(), plain.getSamplingRate());
+
+  // Counting the rows decompresses everything and leaves access points.
+  ASSERT_EQ(compressed.getNumRows(), 100000);
+  ASSERT_GE(compressed.gzipIndex_->size(),
+            text.size() / GZIP_ACCESS_POINT_SPAN - 1);
+
+  // Random access, forwards and backwards (from the access points).
+  for (int row : {99990, 50, 70000, 69999, 12345, 0, 50000}) {
+    auto data = compressed.getData(row, row + 9);
+    auto expected = plain.getData(row, row + 9);
+    ASSERT_EQ(data->at("Fz").size(), expected->at("Fz").size());
+    ASSERT_EQ(data->at("Fz"), expected->at("Fz"));
+    ASSERT_EQ(data->at("Ay"), expected->at("Ay"));
+  }
+  auto data = compressed.getDataByTime(61.5, 62.5);
+  ASSERT_EQ(data->at("Fz").size(), 1001);
+  ASSERT_FLOAT_EQ(data->at("Fz").front(), 61500);
+  ASSERT_FLOAT_EQ(compressed.getTimeOfRow(99999), 99.999);
+
+  // Seeking within a stream on the file.
+  GzipInputStream stream(gzipName, compressed.gzipIndex_);
+  for (size_t offset : {text.size() - 10, size_t(3000000), size_t(17)}) {
+    std::string bytes(10, ' ');
+    stream.seekg(offset);
+    stream.read(&bytes[0], bytes.size());
+    ASSERT_EQ(bytes, text.substr(offset, 10));
+    ASSERT_EQ(static_cast<size_t>(stream.tellg()), offset + 10);
+  }
+
+  // A file that is still being written: the stream and the file go on once
+  // it grows.
+  TemporaryFile tempGrowingFile(".txt.gz");
+  const std::string growingName = tempGrowingFile.getName();
+  size_t firstPart = text.size() / 3;
+  gzipFile = gzopen(growingName.c_str(), "wb");
+  gzwrite(gzipFile, text.data(), firstPart);
+  gzflush(gzipFile, Z_SYNC_FLUSH);
+  GzipInputStream growingStream(growingName, nullptr);
+  std::string bytes((std::istreambuf_iterator<char>(growingStream)),
+                    std::istreambuf_iterator<char>());
+  ASSERT_EQ(bytes, text.substr(0, firstPart));
+  KistlerCSVFile growing(growingName);
+  ASSERT_TRUE(growing.isValid());
+  int firstRows = growing.getNumRows();
+  ASSERT_LT(firstRows, 40000);
+
+  gzwrite(gzipFile, text.data() + firstPart, text.size() - firstPart);
+  gzclose(gzipFile);
+  growingStream.clear();
+  bytes.assign(std::istreambuf_iterator<char>(growingStream),
+               std::istreambuf_iterator<char>());
+  ASSERT_EQ(bytes, text.substr(firstPart));
+  ASSERT_EQ(growing.getNumRows(), 100000);
+  data = growing.getData(99990, 99999);
+  ASSERT_EQ(data->at("Fz"), plain.getData(99990, 99999)->at("Fz"));
+
+  // zstd is detected, but not supported.
+  TemporaryFile tempZstdFile(".txt.zst");
+  const std::string zstdName = tempZstdFile.getName();
+  {
+    std::ofstream zstdFile(zstdName, std::ios::binary);
+    zstdFile << "\x28\xb5\x2f\xfd" << text.substr(0, 100);
+  }
+  ASSERT_EQ(detectCompression(zstdName), Compression::Zstd);
+  KistlerCSVFile zstd(zstdName);
+  ASSERT_FALSE(zstd.isValid());
+}
+
+// ____________________________________________________________________________
+TEST(KistlerArchiveFileTest, encodeColumn) {
+  auto roundTrip = [](const std::vector<float> &values) {
+    std::string buffer;
+    KistlerArchiveFile::encodeColumn(values, &buffer);
+    size_t numBytes = buffer.size();
+    buffer.append(8, '\0');
+    const unsigned char *data =
+        reinterpret_cast<const unsigned char *>(buffer.data());
+    std::vector<float> decoded;
+    EXPECT_TRUE(KistlerArchiveFile::decodeColumn(&data, data + numBytes,
+                                                 values.size(), &decoded));
+    EXPECT_EQ(data, reinterpret_cast<const unsigned char *>(buffer.data()) +
+                        numBytes);
+    EXPECT_EQ(decoded.size(), values.size());
+    if (!values.empty()) {
+      EXPECT_EQ(std::memcmp(decoded.data(), values.data(),
+                            values.size() * sizeof(float)),
+                0);
+    }
+    return numBytes;
+  };
+
+  // Decimals like in BioWare exports, across several frames.
+  std::vector<float> values;
+  for (int i = 0; i < 1000; i++)
+    values.push_back(std::stof(std::to_string(700 + (i * 37 % 101) / 100.0)));
+  size_t numBytes = roundTrip(values);
+  // 7 bits per value for deltas between -1 and 1 in steps of 0.01.
+  ASSERT_LT(numBytes, 1000);
+
+  // A constant step packs to nothing, except for the first frame (2 bits per
+  // value, the deltas of its first lanes go back to the first value).
+  values.clear();
+  for (int i = 0; i < 1000; i++)
+    values.push_back(std::stof(std::to_string(12.5 + i / 1000.0)));
+  ASSERT_LT(roundTrip(values), 50 + ARCHIVE_FRAME_VALUES * 2 / 8);
+
+  // Arbitrary floats, NaN, infinity, huge values and -0 fall back to XOR.
+  values.clear();
+  srand(42);
+  for (int i = 0; i < 300; i++)
+    values.push_back(static_cast<float>(rand()) / RAND_MAX * 3.14159f);
+  values[10] = std::numeric_limits<float>::quiet_NaN();
+  values[20] = std::numeric_limits<float>::infinity();
+  values[30] = 1e12;
+  values[40] = -0.0f;
+  roundTrip(values);
+
+  // Full frames (packed in lanes) with every bit width.
+  for (int width = 0; width <= 32; width++) {
+    uint32_t mask = width == 32 ? ~0u : (1u << width) - 1;
+    uint32_t topBit = width > 0 ? 1u << (width - 1) : 0;
+    values.assign(1, std::numeric_limits<float>::quiet_NaN());
+    uint32_t bits;
+    std::memcpy(&bits, &values[0], sizeof(bits));
+    for (int i = 0; i < 2 * ARCHIVE_FRAME_VALUES; i++) {
+      bits ^= (static_cast<uint32_t>(rand()) | topBit) & mask;
+      values.push_back(0);
+      std::memcpy(&values.back(), &bits, sizeof(bits));
+    }
+    roundTrip(values);
+  }
+
+  // Single and no values.
+  roundTrip({-3.25});
+  roundTrip({});
+
+  // A truncated column is detected.
+  std::string buffer;
+  KistlerArchiveFile::encodeColumn(std::vector<float>(200, 1.5), &buffer);
+  buffer.append(8, '\0');
+  const unsigned char *data =
+      reinterpret_cast<const unsigned char *>(buffer.data());
+  std::vector<float> decoded;
+  ASSERT_FALSE(KistlerArchiveFile::decodeColumn(&data, data + 4, 200,
+                                                &decoded));
+}
+
+// ____________________________________________________________________________
+TEST(KistlerArchiveFileTest, write) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  TemporaryFile tempArchive(".fpa");
+  const std::string archiveName = tempArchive.getName();
+  writeKistlerTestFile(fileName, 10000);
+  KistlerCSVFile source(fileName);
+  ASSERT_TRUE(KistlerArchiveFile::write(source, archiveName));
+
+  KistlerArchiveFile archive(archiveName);
+  ASSERT_TRUE(archive.isValid());
+  ASSERT_EQ(archive.getColumnNames(), source.getColumnNames());
+  ASSERT_FLOAT_EQ(archive.getSamplingRate(), source.getSamplingRate());
+  ASSERT_EQ(archive.getNumRows(), 10000);
+  ASSERT_EQ(archive.getBlocks().size(), 3);
+
+  // At least 5x smaller than the text.
+  std::ifstream text(fileName, std::ios::binary | std::ios::ate);
+  std::ifstream binary(archiveName, std::ios::binary | std::ios::ate);
+  ASSERT_LT(binary.tellg() * 5, text.tellg());
+
+  // Lossless, also across block boundaries.
+  auto all = archive.getData();
+  auto expected = source.getData();
+  for (const auto &column : source.getColumnNames())
+    ASSERT_EQ(all->at(column), expected->at(column));
+  auto data = archive.getData(4090, 8200);
+  ASSERT_EQ(data->at("Fz").size(), 4111);
+  ASSERT_FLOAT_EQ(data->at("Fz").front(), 4090);
+  ASSERT_FLOAT_EQ(data->at("Ax").back(), expected->at("Ax")[8200]);
+  ASSERT_EQ(archive.getData(9999, 20000)->at("Fz").size(), 1);
+  ASSERT_EQ(archive.getData(10000, 20000)->at("Fz").size(), 0);
+
+  // The same time ranges as the text file.
+  for (auto range : std::vector<std::pair<float, float>>{
+           {0.2, 0.25}, {4.0, 4.2}, {0.2005, 0.2035}, {9.5, 20}, {20, 30}}) {
+    data = archive.getDataByTime(range.first, range.second);
+    ASSERT_EQ(data->at("Fz"),
+              source.getDataByTime(range.first, range.second)->at("Fz"));
+  }
+
+  // The block statistics.
+  const auto &blocks = archive.getBlocks();
+  ASSERT_EQ(blocks[1].firstRow, 4096);
+  ASSERT_EQ(blocks[1].numRows, 4096);
+  ASSERT_FLOAT_EQ(blocks[1].firstTime, 4.096);
+  ASSERT_FLOAT_EQ(blocks[1].min[3], 4096);
+  ASSERT_FLOAT_EQ(blocks[1].max[3], 8191);
+  ASSERT_EQ(archive.getBlocksInRange("Fz", 5000, 9000),
+            std::vector<int>({1, 2}));
+  ASSERT_EQ(archive.getBlocksInRange("Fz", -10, -1), std::vector<int>());
+
+  // Corrupt archives.
+  {
+    std::ofstream file(archiveName, std::ios::binary | std::ios::in);
+    file.seekp(-4, std::ios::end);
+    file << "XXXX";
+  }
+  KistlerArchiveFile corrupt(archiveName);
+  ASSERT_FALSE(corrupt.isValid());
+  KistlerArchiveFile text2(fileName);
+  ASSERT_FALSE(text2.isValid());
+}
+
+// ____________________________________________________________________________
+TEST(KistlerArchiveFileTest, exampleExport) {
+  const std::string fileName = "example_data/KistlerCSV_example.txt";
+  TemporaryFile tempArchive(".fpa");
+  const std::string archiveName = tempArchive.getName();
+  KistlerCSVFile source(fileName);
+  ASSERT_TRUE(source.isValid());
+  ASSERT_TRUE(KistlerArchiveFile::write(source, archiveName));
+
+  // Opened as an archive by its magic number, the export as text.
+  auto file = openKistlerFile(archiveName);
+  auto *archive = dynamic_cast<KistlerArchiveFile *>(file.get());
+  ASSERT_NE(archive, nullptr);
+  ASSERT_TRUE(archive->isValid());
+  ASSERT_NE(dynamic_cast<KistlerCSVFile *>(openKistlerFile(fileName).get()),
+            nullptr);
+
+  // At least 4x smaller than the text, even for these few rows (the columns
+  // of a block have a few bytes each to start with).
+  std::ifstream text(fileName, std::ios::binary | std::ios::ate);
+  std::ifstream binary(archiveName, std::ios::binary | std::ios::ate);
+  ASSERT_LT(binary.tellg() * 4, text.tellg());
+
+  // Every value comes back bit for bit.
+  int numRows = source.getNumRows();
+  ASSERT_EQ(archive->getNumRows(), numRows);
+  auto all = archive->getData();
+  auto expected = source.getData();
+  for (const auto &column : source.getColumnNames()) {
+    ASSERT_EQ(all->at(column).size(), numRows);
+    ASSERT_EQ(std::memcmp(all->at(column).data(),
+                          expected->at(column).data(),
+                          numRows * sizeof(float)),
+              0);
+  }
+
+  // The playback reads a few rows at a time and looks up times, like in the
+  // text. In blocks of 8 rows, so reading goes across blocks.
+  ASSERT_TRUE(KistlerArchiveFile::write(source, archiveName, 8));
+  file = openKistlerFile(archiveName);
+  archive = dynamic_cast<KistlerArchiveFile *>(file.get());
+  ASSERT_NE(archive, nullptr);
+  ASSERT_GT(archive->getBlocks().size(), 2);
+  std::unordered_map<std::string, std::vector<float>> rows;
+  for (int row = 0; row < numRows; row += 3)
+    ASSERT_EQ(archive->readRows(row, row + 2, &rows),
+              std::min(3, numRows - row));
+  ASSERT_EQ(rows.at("Ay"), expected->at("Ay"));
+  ASSERT_EQ(archive->readRows(numRows, numRows + 5, &rows), 0);
+  for (int row : {0, 7, 8, 9, numRows - 1, numRows}) {
+    float time = source.getTimeOfRow(row);
+    ASSERT_EQ(archive->getTimeOfRow(row), time);
+    if (std::isinf(time))
+      continue;
+    ASSERT_EQ(archive->getRowAtTime(time), source.getRowAtTime(time));
+    ASSERT_EQ(archive->getRowAfterTime(time), source.getRowAfterTime(time));
+  }
+  ASSERT_EQ(archive->getRowAtTime(100), numRows);
+  ASSERT_EQ(archive->getRowAtTime(-1), 0);
+}
+
 // ____________________________________________________________________________
 TEST(BalanceParametersTest, defaultConstructor) {
   BalanceParameters balanceParameters;
@@ -485,6 +1137,70 @@ TEST(BalanceParametersTest, calculateMeanForceY) {
   ASSERT_FLOAT_EQ(balanceParameters.getMeanForceY(), 0.0317253);
 }
 
+// ____________________________________________________________________________
+TEST(BalanceParametersTest, calculateMeanCop) {
+  auto data =
+      std::make_shared<std::unordered_map<std::string, std::vector<float>>>();
+
+  // No COP columns should yield 0.
+  BalanceParameters balanceParameters;
+  balanceParameters.data_ = data;
+  balanceParameters.calculateMeanCop();
+  ASSERT_FLOAT_EQ(balanceParameters.meanCopX_, 0);
+  ASSERT_FLOAT_EQ(balanceParameters.meanCopY_, 0);
+
+  // Rows without contact (COP exactly 0) are ignored.
+  (*data)["Ax"] = {0, 0.1, 0.2, 0};
+  (*data)["Ay"] = {0, -0.1, 0.3, 0};
+  balanceParameters.calculateMeanCop();
+  ASSERT_FLOAT_EQ(balanceParameters.meanCopX_, 0.15);
+  ASSERT_FLOAT_EQ(balanceParameters.meanCopY_, 0.1);
+
+  // No contact at all.
+  (*data)["Ax"] = {0, 0};
+  (*data)["Ay"] = {0, 0};
+  balanceParameters.calculateMeanCop();
+  ASSERT_FLOAT_EQ(balanceParameters.meanCopX_, 0);
+  ASSERT_FLOAT_EQ(balanceParameters.meanCopY_, 0);
+}
+
+// ____________________________________________________________________________
+TEST(CopTrailTest, append) {
+  CopTrail trail(4);
+  ASSERT_EQ(trail.size(), 0);
+  ASSERT_EQ(trail.capacity(), 4);
+
+  ASSERT_EQ(trail.append({0.000, 0.001, 0.002}, {1, 2, 3}, {4, 5, 6}), 3);
+  ASSERT_EQ(trail.size(), 3);
+  ASSERT_FLOAT_EQ(trail.getLastTime(), 0.002);
+  ASSERT_FLOAT_EQ(trail[0].x, 1);
+  ASSERT_FLOAT_EQ(trail[2].y, 6);
+
+  // Overlapping batch, only the new samples are taken.
+  ASSERT_EQ(trail.append({0.001, 0.002, 0.003}, {2, 3, 7}, {5, 6, 8}), 1);
+  ASSERT_EQ(trail.size(), 4);
+  ASSERT_FLOAT_EQ(trail[3].time, 0.003);
+  ASSERT_FLOAT_EQ(trail[3].x, 7);
+
+  // Nothing new.
+  ASSERT_EQ(trail.append({0.002, 0.003}, {3, 7}, {6, 8}), 0);
+  ASSERT_EQ(trail.getNumAppended(), 4);
+
+  // Full, the oldest samples are overwritten.
+  ASSERT_EQ(trail.append({0.004, 0.005}, {9, 10}, {11, 12}), 2);
+  ASSERT_EQ(trail.size(), 4);
+  ASSERT_EQ(trail.getNumAppended(), 6);
+  ASSERT_FLOAT_EQ(trail[0].time, 0.002);
+  ASSERT_FLOAT_EQ(trail[3].time, 0.005);
+  ASSERT_FLOAT_EQ(trail[3].y, 12);
+
+  trail.clear();
+  ASSERT_EQ(trail.size(), 0);
+  ASSERT_EQ(trail.getNumAppended(), 0);
+  ASSERT_EQ(trail.append({0.000}, {1}, {2}), 1);
+  ASSERT_FLOAT_EQ(trail[0].time, 0);
+}
+
 // ____________________________________________________________________________
 TEST(BalanceParametersTest, validateData) {
   // Regular case.
@@ -1151,6 +1867,1643 @@ TEST(ForcePlateFeedbackTest, combinedTest) {
   delete[] argv;
 }
 
+// ____________________________________________________________________________
+TEST(TracerTest, disabled) {
+  Tracer::setEnabled(false);
+  Tracer::instance().clear();
+
+  {
+    TRACE_SCOPE("disabled scope");
+  }
+
+  ASSERT_EQ(Tracer::instance().getNumEvents(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(TracerTest, recordAndWriteJson) {
+  Tracer::setEnabled(true);
+  Tracer::instance().clear();
+
+  {
+    TRACE_SCOPE("outer scope");
+    TRACE_SCOPE("inner scope");
+  }
+  ASSERT_EQ(Tracer::instance().getNumEvents(), 2);
+
+  // Events from another thread go to their own buffer.
+  std::thread thread([] {
+    for (int i = 0; i < 10; i++) {
+      TRACE_SCOPE("worker scope");
+    }
+  });
+  thread.join();
+  ASSERT_EQ(Tracer::instance().getNumEvents(), 12);
+  ASSERT_EQ(Tracer::instance().getNumDropped(), 0);
+
+  // Events with arguments.
+  Tracer::instance().record("with args", 10, 5, "rows", 51, "bytes", 4096);
+  ASSERT_EQ(Tracer::instance().getNumEvents(), 13);
+
+  // Trace points in the pipeline.
+  KistlerCSVFile kistlerFile("example_data/KistlerCSV_example.txt");
+  kistlerFile.getData(0, 9);
+  Tracer::setEnabled(false);
+
+  TemporaryFile tempFile(".json");
+  std::string fileName = tempFile.getName();
+  ASSERT_TRUE(Tracer::instance().writeJson(fileName));
+
+  std::ifstream file(fileName);
+  std::stringstream json;
+  json << file.rdbuf();
+  std::string str = json.str();
+
+  ASSERT_EQ(str.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0);
+  ASSERT_NE(str.find("\"name\":\"outer scope\",\"ph\":\"X\""),
+            std::string::npos);
+  ASSERT_NE(str.find("\"name\":\"inner scope\""), std::string::npos);
+  ASSERT_NE(str.find("\"name\":\"worker scope\",\"ph\":\"X\",\"pid\":1"),
+            std::string::npos);
+  ASSERT_NE(str.find("\"ts\":10,\"dur\":5,\"args\":{\"rows\":51,"
+                     "\"bytes\":4096}"),
+            std::string::npos);
+  ASSERT_NE(str.find("\"name\":\"KistlerCSVFile::getData\""),
+            std::string::npos);
+  ASSERT_NE(str.find("\"name\":\"KistlerCSVFile::parse\""),
+            std::string::npos);
+  ASSERT_EQ(str.substr(str.size() - 3), "]}\n");
+
+  Tracer::instance().clear();
+  ASSERT_EQ(Tracer::instance().getNumEvents(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(LatencyHistogramTest, bucketIndex) {
+  // Values below the number of sub-buckets are exact.
+  ASSERT_EQ(LatencyHistogram::bucketIndex(0), 0);
+  ASSERT_EQ(LatencyHistogram::bucketIndex(-5), 0);
+  ASSERT_EQ(LatencyHistogram::bucketIndex(127), 127);
+  ASSERT_EQ(LatencyHistogram::bucketLowestValue(127), 127);
+  ASSERT_EQ(LatencyHistogram::bucketHighestValue(127), 127);
+
+  // Above, buckets get wider with every power of two.
+  ASSERT_EQ(LatencyHistogram::bucketIndex(128), 128);
+  ASSERT_EQ(LatencyHistogram::bucketIndex(129), 128);
+  ASSERT_EQ(LatencyHistogram::bucketLowestValue(128), 128);
+  ASSERT_EQ(LatencyHistogram::bucketHighestValue(128), 129);
+  ASSERT_EQ(LatencyHistogram::bucketIndex(256), 192);
+  ASSERT_EQ(LatencyHistogram::bucketHighestValue(192), 259);
+
+  // Every value lies within its bucket, and the relative error is small.
+  for (int64_t value : {1'000, 12'345, 999'999, 60'000'000}) {
+    int index = LatencyHistogram::bucketIndex(value);
+    ASSERT_LE(LatencyHistogram::bucketLowestValue(index), value);
+    ASSERT_GE(LatencyHistogram::bucketHighestValue(index), value);
+    ASSERT_LT(LatencyHistogram::bucketHighestValue(index) -
+                  LatencyHistogram::bucketLowestValue(index),
+              value / 60);
+  }
+
+  // Huge values are clamped to the last bucket.
+  ASSERT_EQ(LatencyHistogram::bucketIndex(int64_t{1} << 50),
+            LatencyHistogram::kNumBuckets - 1);
+}
+
+// ____________________________________________________________________________
+TEST(LatencyHistogramTest, percentiles) {
+  LatencyHistogram histogram;
+  ASSERT_EQ(histogram.getCount(), 0);
+  ASSERT_EQ(histogram.getPercentile(50), 0);
+  ASSERT_EQ(histogram.getMax(), 0);
+
+  // 1ms to 10ms in steps of 1us.
+  for (int64_t value = 1'000; value <= 10'000; value++)
+    histogram.record(value);
+
+  ASSERT_EQ(histogram.getCount(), 9'001);
+  ASSERT_EQ(histogram.getMin(), 1'000);
+  ASSERT_EQ(histogram.getMax(), 10'000);
+  ASSERT_NEAR(histogram.getMean(), 5'500, 1e-6);
+  ASSERT_NEAR(histogram.getPercentile(50), 5'500, 5'500 / 64);
+  ASSERT_NEAR(histogram.getPercentile(99), 9'910, 9'910 / 64);
+  ASSERT_EQ(histogram.getPercentile(100), 10'000);
+  ASSERT_EQ(histogram.getPercentile(0), histogram.getMin());
+
+  // An outlier shows up in the max and the far tail only.
+  histogram.record(500'000);
+  ASSERT_EQ(histogram.getMax(), 500'000);
+  ASSERT_LT(histogram.getPercentile(99.9), 11'000);
+
+  histogram.reset();
+  ASSERT_EQ(histogram.getCount(), 0);
+  ASSERT_EQ(histogram.getMax(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(LatencyHistogramTest, writePercentileDistribution) {
+  LatencyHistogram histogram;
+  for (int64_t value = 1; value <= 1'000; value++)
+    histogram.record(value * 10);
+
+  std::stringstream out;
+  histogram.writePercentileDistribution(out);
+  std::string str = out.str();
+
+  ASSERT_EQ(str.find("       Value     Percentile TotalCount 1/(1-Percentile)"),
+            0);
+  ASSERT_NE(str.find("      10.000 1.000000000000       1000"),
+            std::string::npos);
+  ASSERT_NE(str.find("#[Max     =       10.000, "
+                     "Total count    =         1000]"),
+            std::string::npos);
+}
+
+// ____________________________________________________________________________
+TEST(LatencyMonitorTest, recordFrame) {
+  LatencyMonitor &monitor = LatencyMonitor::instance();
+  monitor.reset();
+
+  // Unstamped batches are ignored.
+  monitor.recordFrame(LatencyStamps(), 1'000);
+  ASSERT_EQ(monitor.getSampleToPixelLatency().getCount(), 0);
+
+  LatencyStamps stamps;
+  stamps.readUs = 1'000;
+  stamps.parsedUs = 1'300;
+  stamps.processedUs = 1'350;
+  monitor.recordFrame(stamps, 5'350);
+
+  ASSERT_EQ(monitor.getReadLatency().getMax(), 300);
+  ASSERT_EQ(monitor.getProcessLatency().getMax(), 50);
+  ASSERT_EQ(monitor.getRenderLatency().getMax(), 4'000);
+  ASSERT_EQ(monitor.getSampleToPixelLatency().getMax(), 4'350);
+
+  TemporaryFile tempFile(".txt");
+  std::string fileName = tempFile.getName();
+  ASSERT_TRUE(monitor.writeReport(fileName));
+  std::ifstream file(fileName);
+  std::string line;
+  std::getline(file, line);
+  ASSERT_EQ(line, "# Latency summary (ms)");
+  std::getline(file, line);
+  ASSERT_EQ(line, "# sample-to-pixel  count        1  p50     4.350  p99     "
+                  "4.350  max     4.350");
+
+  monitor.reset();
+  ASSERT_EQ(monitor.getSampleToPixelLatency().getCount(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(BalanceParametersTest, latencyStamps) {
+  BalanceParameters balanceParameters;
+  ASSERT_EQ(balanceParameters.getLatencyStamps().readUs, 0);
+
+  LatencyStamps stamps;
+  stamps.readUs = 1;
+  stamps.parsedUs = 2;
+  stamps.processedUs = 3;
+  balanceParameters.setLatencyStamps(stamps);
+  ASSERT_EQ(balanceParameters.getLatencyStamps().readUs, 1);
+  ASSERT_EQ(balanceParameters.getLatencyStamps().parsedUs, 2);
+  ASSERT_EQ(balanceParameters.getLatencyStamps().processedUs, 3);
+}
+
+// ____________________________________________________________________________
+TEST(PlaybackStatsTest, ticks) {
+  PlaybackStats stats;
+  ASSERT_EQ(stats.getNumTicks(), 0);
+  ASSERT_EQ(stats.getDroppedTicks(), 0);
+
+  // Ticks in time.
+  stats.startTick(0, 10'000);
+  stats.finishTick(2'000);
+  stats.startTick(10'000, 10'000);
+  stats.finishTick(13'000);
+  stats.startTick(21'000, 10'000);
+  stats.finishTick(22'000);
+  ASSERT_EQ(stats.getNumTicks(), 3);
+  ASSERT_EQ(stats.getDroppedTicks(), 0);
+  ASSERT_EQ(stats.getProcessDurationUs(), 1'000);
+  ASSERT_EQ(stats.getMaxProcessDurationUs(), 3'000);
+
+  // A tick 30ms late means three intervals were missed.
+  stats.startTick(61'000, 10'000);
+  ASSERT_EQ(stats.getNumTicks(), 4);
+  ASSERT_EQ(stats.getDroppedTicks(), 3);
+
+  stats.reset();
+  ASSERT_EQ(stats.getNumTicks(), 0);
+  ASSERT_EQ(stats.getDroppedTicks(), 0);
+  ASSERT_EQ(stats.getMaxProcessDurationUs(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(PlaybackStatsTest, readerLag) {
+  PlaybackStats stats;
+
+  // The first update is the reference point.
+  stats.updateLag(1'000'000, 3.0);
+  ASSERT_DOUBLE_EQ(stats.getReaderLagMs(), 0);
+
+  // Data advanced by 100ms in 100ms wall time.
+  stats.updateLag(1'100'000, 3.1);
+  ASSERT_NEAR(stats.getReaderLagMs(), 0, 1e-3);
+
+  // Data advanced by 100ms in 150ms wall time.
+  stats.updateLag(1'250'000, 3.2);
+  ASSERT_NEAR(stats.getReaderLagMs(), 50, 1e-3);
+
+  // After a restart (e.g. pause), the reference is set again.
+  stats.restart();
+  stats.updateLag(9'000'000, 3.3);
+  ASSERT_DOUBLE_EQ(stats.getReaderLagMs(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, playbackStats) {
+  DataModel dataModel;
+  dataModel.onStartProcessing("example_data/KistlerCSV_example.txt", 0.01);
+  ASSERT_EQ(dataModel.getPlaybackStats().getNumTicks(), 0);
+
+  dataModel.process();
+  dataModel.process();
+  ASSERT_EQ(dataModel.getPlaybackStats().getNumTicks(), 2);
+  ASSERT_GT(dataModel.getPlaybackStats().getMaxProcessDurationUs(), 0);
+
+  dataModel.onResetModel();
+  ASSERT_EQ(dataModel.getPlaybackStats().getNumTicks(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, seek) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+
+  DataModel dataModel;
+  // Seeking without a file does nothing.
+  dataModel.seekToRow(100);
+  ASSERT_EQ(dataModel.firstRow_, 0);
+
+  // 50ms timeframe at 1kHz: 51 rows.
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  ASSERT_EQ(dataModel.getNumFileRows(), 5000);
+
+  // The new timeframe is processed right away (and the position advanced as
+  // in every tick).
+  dataModel.seekToRow(3000);
+  ASSERT_EQ(dataModel.firstRow_, 3000 + PLAYBACK_DELAY_MS);
+  ASSERT_FLOAT_EQ(dataModel.startTime_, 3.0);
+  ASSERT_FLOAT_EQ(dataModel.stopTime_, 3.05);
+  ASSERT_EQ(dataModel.numRows_, 51);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceX(), 3025);
+
+  // Backwards.
+  dataModel.seekToTime(1.2);
+  ASSERT_FLOAT_EQ(dataModel.startTime_, 1.2);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceY(), 1225);
+
+  // Clamped to the file, with a full timeframe at the end.
+  dataModel.seekToRow(-5);
+  ASSERT_FLOAT_EQ(dataModel.startTime_, 0);
+  dataModel.seekToTime(100);
+  ASSERT_FLOAT_EQ(dataModel.startTime_, 4.948);
+  ASSERT_EQ(dataModel.numRows_, 51);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, archivePlayback) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  TemporaryFile tempArchive(".fpa");
+  const std::string archiveName = tempArchive.getName();
+  writeKistlerTestFile(fileName, 5000);
+  ASSERT_TRUE(KistlerArchiveFile::write(KistlerCSVFile(fileName), archiveName));
+
+  // The archive plays like the export it was written from.
+  DataModel text;
+  DataModel archive;
+  text.onStartProcessing(fileName, 0.05);
+  text.onStopProcessing();
+  archive.onStartProcessing(archiveName, 0.05);
+  archive.onStopProcessing();
+  ASSERT_NE(dynamic_cast<KistlerArchiveFile *>(archive.kistlerFile_.get()),
+            nullptr);
+  ASSERT_EQ(archive.getNumFileRows(), 5000);
+
+  for (int row : {3000, 4090, 120}) {
+    text.seekToRow(row);
+    archive.seekToRow(row);
+    ASSERT_EQ(archive.numRows_, text.numRows_);
+    ASSERT_FLOAT_EQ(archive.startTime_, text.startTime_);
+    ASSERT_FLOAT_EQ(archive.balanceParameters_.getMeanForceX(),
+                    text.balanceParameters_.getMeanForceX());
+    ASSERT_FLOAT_EQ(archive.balanceParameters_.getMeanCopY(),
+                    text.balanceParameters_.getMeanCopY());
+  }
+  for (int tick = 0; tick < 20; tick++) {
+    text.process();
+    archive.process();
+  }
+  ASSERT_EQ(archive.firstRow_, text.firstRow_);
+  ASSERT_FLOAT_EQ(archive.balanceParameters_.getMeanForceY(),
+                  text.balanceParameters_.getMeanForceY());
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, onTimeframeChanged) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+
+  DataModel dataModel;
+  // Only the configured timeframe, longer analysis windows and prefetching
+  // would keep more rows resident.
+  dataModel.setAnalysisTimeframes({});
+  dataModel.setPrefetching(false);
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+
+  dataModel.process();
+  dataModel.process();
+  ASSERT_EQ(dataModel.numRows_, 51);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceX(), 10 + 25);
+  // Every row was read once.
+  ASSERT_EQ(dataModel.sampleWindow_.getNumRowsRead(), 61u);
+
+  // Invalid timeframes are ignored.
+  dataModel.onTimeframeChanged(0);
+  ASSERT_FLOAT_EQ(dataModel.configTimeframe_, 0.05);
+
+  // Growing only reads the new rows.
+  dataModel.onTimeframeChanged(1.0);
+  dataModel.process();
+  ASSERT_FLOAT_EQ(dataModel.startTime_, 0.02);
+  ASSERT_FLOAT_EQ(dataModel.stopTime_, 1.02);
+  ASSERT_EQ(dataModel.numRows_, 1001);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceX(), 20 + 500);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumRowsRead(), 1021u);
+
+  // Shrinking and growing back within the resident rows reads nothing.
+  dataModel.onTimeframeChanged(0.05);
+  dataModel.process();
+  ASSERT_EQ(dataModel.numRows_, 51);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceX(), 30 + 25);
+  dataModel.onTimeframeChanged(0.5);
+  dataModel.process();
+  ASSERT_EQ(dataModel.numRows_, 501);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceX(), 40 + 250);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumRowsRead(), 1021u);
+  ASSERT_EQ(dataModel.sampleWindow_.getFirstRow(), 40);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumResidentRows(), 1021 - 40);
+
+  // A jump starts over.
+  dataModel.seekToRow(3000);
+  ASSERT_EQ(dataModel.numRows_, 501);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceX(), 3000 + 250);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumRowsRead(), 1021u + 501);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumResidentRows(), 501);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, analysisWindows) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+
+  DataModel dataModel;
+  ASSERT_EQ(dataModel.getAnalysisTimeframes().size(), 2u);
+  ASSERT_FLOAT_EQ(dataModel.getAnalysisTimeframes()[1], LONG_TIMEFRAME_S);
+
+  // Non-positive timeframes are dropped.
+  dataModel.setAnalysisTimeframes({1.0, -1, 30.0});
+  // Count only the rows needed.
+  dataModel.setPrefetching(false);
+  ASSERT_EQ(dataModel.getAnalysisTimeframes().size(), 2u);
+  ASSERT_EQ(dataModel.analysisWindows_.size(), 2u);
+
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+
+  // All windows end with the configured timeframe at 3.05s. The 30s window
+  // is cut off at the start of the file.
+  dataModel.seekToRow(3000);
+  ASSERT_EQ(dataModel.numRows_, 51);
+  ASSERT_FLOAT_EQ(dataModel.balanceParameters_.getMeanForceX(), 3025);
+  const auto &medium = dataModel.analysisWindows_[0];
+  ASSERT_EQ(medium.getNumRows(), 1001);
+  ASSERT_FLOAT_EQ(medium.getStartTime(), 2.05);
+  ASSERT_FLOAT_EQ(medium.getStopTime(), 3.05);
+  ASSERT_FLOAT_EQ(medium.getMeanForceX(), 2550);
+  const auto &large = dataModel.analysisWindows_[1];
+  ASSERT_EQ(large.getNumRows(), 3051);
+  ASSERT_FLOAT_EQ(large.getStartTime(), 0);
+  ASSERT_FLOAT_EQ(large.getMeanForceY(), 1525);
+
+  // One pass over the file for all windows, and they are not copied.
+  ASSERT_EQ(dataModel.sampleWindow_.getNumRowsRead(), 3051u);
+  ASSERT_EQ(large.getData(), nullptr);
+  dataModel.process();
+  ASSERT_FLOAT_EQ(dataModel.analysisWindows_[0].getMeanForceX(), 2560);
+  ASSERT_EQ(dataModel.analysisWindows_[1].getNumRows(), 3061);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumRowsRead(), 3061u);
+  // Only the timeframe is copied (the new copy while the last one is held).
+  ASSERT_EQ(dataModel.sampleWindow_.getNumFrames(), 2u);
+}
+
+// ____________________________________________________________________________
+TEST(SampleWindowTest, getView) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+  KistlerCSVFile file(fileName);
+
+  // The sums of a view are those of a copy of the rows, also as the window
+  // moves on, is compacted, jumps or evicts rows.
+  SampleWindow window;
+  auto check = [&window](float startTime, float stopTime) {
+    auto data = window.getData(startTime, stopTime);
+    SampleView view = window.getView(startTime, stopTime);
+    ASSERT_EQ(view.size(), data->at("Fx").size());
+    if (view.size() == 0)
+      return;
+    ASSERT_FLOAT_EQ(view.getColumn("abs time (s)")[0],
+                    data->at("abs time (s)").front());
+    for (const char *name : {"Fx", "Fy", "Ax", "Ay"})
+      ASSERT_NEAR(view.getSum(name),
+                  std::accumulate(data->at(name).begin(), data->at(name).end(),
+                                  0.0),
+                  1e-6 * std::abs(view.getSum(name)) + 1e-6);
+    ASSERT_EQ(view.getSum("Fz"), 0);
+    ASSERT_EQ(view.getColumn("no column"), nullptr);
+  };
+  ASSERT_EQ(window.getView(0, 1).size(), 0);
+
+  for (int row = 0; row < 3000; row += 70) {
+    window.update(file, row, row / 1000.0 + 1.0);
+    check(row / 1000.0, row / 1000.0 + 1.0);
+    check(row / 1000.0 + 0.5, row / 1000.0 + 0.6);
+  }
+  window.update(file, 100, 0.2);
+  check(0.1, 0.2);
+  window.setMaxRows(50);
+  window.update(file, 4000, 4.5);
+  check(4.4, 4.5);
+
+  // The COP of the test file is never 0, every row has contact.
+  ASSERT_EQ(window.getView(4.4, 4.5).getNumContactRows(), 50);
+}
+
+// ____________________________________________________________________________
+TEST(ContactDetectorTest, update) {
+  ContactDetector detector(50, 25);
+  ASSERT_FALSE(detector.isInContact());
+
+  // On above 50, off only below 25.
+  detector.update({0, 10, 60, 40, 30, 26, 24, 60, 49}, 0);
+  ASSERT_TRUE(detector.isInContact());
+  ASSERT_EQ(detector.getNextRow(), 9);
+  std::vector<std::pair<int, int>> expected = {{2, 5}, {7, -1}};
+  ASSERT_EQ(detector.getContactPeriods(), expected);
+  ASSERT_FALSE(detector.hasContact(0, 1));
+  ASSERT_TRUE(detector.hasContact(5, 6));
+  ASSERT_FALSE(detector.hasContact(6, 6));
+  ASSERT_TRUE(detector.hasContact(100, 200));
+
+  // Rows fed before are skipped.
+  detector.update({0, 0, 0}, 7);
+  expected = {{2, 5}, {7, 8}};
+  ASSERT_EQ(detector.getContactPeriods(), expected);
+  ASSERT_EQ(detector.getNextRow(), 10);
+
+  // After a gap it goes on, negative forces count as well.
+  detector.update({-80}, 20);
+  ASSERT_TRUE(detector.isInContact());
+  ASSERT_EQ(detector.getNextContactStart(3), 7);
+  ASSERT_EQ(detector.getNextContactStart(10), 20);
+  ASSERT_EQ(detector.getNextContactStart(21), -1);
+
+  detector.reset();
+  ASSERT_FALSE(detector.isInContact());
+  ASSERT_EQ(detector.getContactPeriods().size(), 0u);
+}
+
+// Write a test file like writeKistlerTestFile(), with Fz from the segments
+// (number of rows and force), the row number as Fx and without a contact
+// period in the header.
+void writeContactTestFile(const std::string &fileName,
+                          const std::vector<std::pair<int, float>> &segments) {
+  std::ofstream file(fileName);
+  std::ifstream example("example_data/KistlerCSV_example.txt");
+  std::string line;
+  for (int i = 0; i < 19; i++) {
+    std::getline(example, line);
+    if (line.rfind("Contact period", 0) == 0)
+      line = line.substr(0, line.find(':') + 1);
+    file << line << "\n";
+  }
+  int row = 0;
+  for (const auto &segment : segments) {
+    for (int i = 0; i < segment.first; i++, row++)
+      file << row / 1000.0 << "\t" << row << "\t0\t" << segment.second
+           << "\t0\t0\t0\t0.1\t0.1\n";
+  }
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, skipNonContact) {
+  // Empty plate, contact, empty plate (also within the hysteresis), contact.
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeContactTestFile(
+      fileName, {{1000, 2}, {2000, -700}, {3000, 1}, {1000, 30}, {2000, -700}});
+
+  DataModel dataModel;
+  dataModel.setAnalysisTimeframes({});
+  dataModel.setPrefetching(false);
+  ASSERT_FALSE(dataModel.getSkipNonContact());
+  dataModel.setSkipNonContact(true);
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  ASSERT_FALSE(dataModel.kistlerFile_->hasContactPeriod());
+
+  // The first tick finds the contact, from there on it plays normally.
+  dataModel.process();
+  ASSERT_EQ(dataModel.firstRow_, 1000);
+  dataModel.process();
+  ASSERT_EQ(dataModel.firstRow_, 1010);
+
+  // Played until the contact ends, then it jumps over the empty plate.
+  dataModel.seekToRow(2980);
+  ASSERT_EQ(dataModel.firstRow_, 2990);
+  dataModel.process();
+  ASSERT_EQ(dataModel.firstRow_, 3000);
+  dataModel.process();
+  ASSERT_EQ(dataModel.firstRow_, 7000);
+  std::vector<std::pair<int, int>> expected = {{1000, 2999}, {7000, -1}};
+  ASSERT_EQ(dataModel.contactDetector_.getContactPeriods(), expected);
+
+  // With the contact period of the header, nothing before it is read.
+  TemporaryFile tempHeaderFile("_header.txt");
+  const std::string headerFileName = tempHeaderFile.getName();
+  writeKistlerTestFile(headerFileName, 5000);
+  DataModel headerModel;
+  headerModel.setAnalysisTimeframes({});
+  headerModel.setPrefetching(false);
+  headerModel.setSkipNonContact(true);
+  headerModel.onStartProcessing(headerFileName, 0.05);
+  headerModel.onStopProcessing();
+  headerModel.process();
+  ASSERT_EQ(headerModel.firstRow_, 3267);
+  ASSERT_EQ(headerModel.sampleWindow_.getFirstRow(), 3257);
+  ASSERT_EQ(headerModel.sampleWindow_.getNumRowsRead(), 51u);
+}
+
+// ____________________________________________________________________________
+TEST(TrialSegmenterTest, run) {
+  // Two trials, and a contact too short for a trial in between.
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeContactTestFile(fileName, {{500, 2},
+                                  {3000, -700},
+                                  {300, 1},
+                                  {1000, -700},
+                                  {500, 3},
+                                  {2500, -700}});
+
+  TrialSegmenter segmenter;
+  KistlerCSVFile file(fileName);
+  auto trials = segmenter.segment(file);
+  ASSERT_EQ(trials.size(), 2u);
+  ASSERT_EQ(trials[0].firstRow, 500);
+  ASSERT_EQ(trials[0].lastRow, 3499);
+  // The last one ends with the file.
+  ASSERT_EQ(trials[1].firstRow, 5300);
+  ASSERT_EQ(trials[1].lastRow, 7799);
+  ASSERT_FALSE(trials[0].parameters.isValid());
+
+  // The same parameters on one thread as on several.
+  segmenter.calculateParameters(file, &trials, 1);
+  auto parallel = segmenter.run(fileName, 4);
+  ASSERT_EQ(parallel.size(), 2u);
+  for (size_t i = 0; i < trials.size(); i++) {
+    ASSERT_TRUE(parallel[i].parameters.isValid());
+    ASSERT_EQ(parallel[i].parameters.getNumRows(),
+              trials[i].parameters.getNumRows());
+    ASSERT_FLOAT_EQ(parallel[i].parameters.getMeanForceX(),
+                    trials[i].parameters.getMeanForceX());
+    ASSERT_EQ(parallel[i].parameters.getData(), nullptr);
+  }
+  ASSERT_FLOAT_EQ(parallel[0].parameters.getMeanForceX(), 1999.5);
+  ASSERT_FLOAT_EQ(parallel[0].parameters.getStartTime(), 0.5);
+  ASSERT_FLOAT_EQ(parallel[1].parameters.getStopTime(), 7.799);
+  ASSERT_EQ(parallel[1].parameters.getNumRows(), 2500);
+
+  // A header and a line per trial.
+  std::ostringstream table;
+  TrialSegmenter::writeTable(parallel, table);
+  std::string text = table.str();
+  ASSERT_EQ(std::count(text.begin(), text.end(), '\n'), 3);
+  ASSERT_NE(text.find("\n2\t5300\t7799\t5.3\t7.799\t"), std::string::npos);
+
+  // Invalid files have no trials.
+  ASSERT_EQ(segmenter.run("example_data/KistlerCSV_empty.txt").size(), 0u);
+}
+
+// ____________________________________________________________________________
+TEST(SampleWindowTest, setMaxRows) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+  KistlerCSVFile file(fileName);
+
+  SampleWindow window;
+  window.setMaxRows(300);
+
+  // The timeframe is cut at the front.
+  window.update(file, 0, 1.0);
+  ASSERT_EQ(window.getFirstRow(), 701);
+  ASSERT_EQ(window.getNumResidentRows(), 300);
+  auto data = window.getData(0, 1.0);
+  ASSERT_EQ(data->at("Fx").size(), 300u);
+  ASSERT_FLOAT_EQ(data->at("abs time (s)").front(), 0.701);
+
+  // Shorter: the rows after the timeframe stay, nothing is read.
+  window.update(file, 800, 0.9);
+  ASSERT_EQ(window.getNumResidentRows(), 201);
+  ASSERT_EQ(window.getNumRowsRead(), 300u);
+  ASSERT_EQ(window.getData(0.8, 0.9)->at("Fy").size(), 101u);
+
+  // With a lower limit, the rows after the timeframe are evicted first.
+  window.setMaxRows(150);
+  window.update(file, 800, 0.9);
+  ASSERT_EQ(window.getFirstRow(), 800);
+  ASSERT_EQ(window.getNumResidentRows(), 150);
+  ASSERT_FLOAT_EQ(window.getData(0.8, 0.9)->at("Mz").back(), 900);
+  ASSERT_EQ(window.getNumRowsRead(), 300u);
+}
+
+// ____________________________________________________________________________
+TEST(PrefetcherTest, take) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+
+  Prefetcher prefetcher;
+  // Nothing open.
+  prefetcher.request(0);
+  ASSERT_EQ(prefetcher.take(0, true), nullptr);
+
+  // 300ms at 1kHz.
+  prefetcher.open(fileName);
+  ASSERT_EQ(prefetcher.getChunkRows(), 300);
+
+  prefetcher.request(100);
+  auto data = prefetcher.take(100, true);
+  ASSERT_NE(data, nullptr);
+  ASSERT_EQ(data->at("Fx").size(), 300u);
+  ASSERT_FLOAT_EQ(data->at("Fx").front(), 100);
+  ASSERT_FLOAT_EQ(data->at("Fx").back(), 399);
+  // Taken already, and other rows were not requested.
+  ASSERT_EQ(prefetcher.take(100, true), nullptr);
+  ASSERT_EQ(prefetcher.take(400, true), nullptr);
+
+  // A newer request replaces the pending one.
+  prefetcher.request(1000);
+  prefetcher.request(4900);
+  ASSERT_EQ(prefetcher.take(1000, true), nullptr);
+  data = prefetcher.take(4900, true);
+  ASSERT_NE(data, nullptr);
+  ASSERT_EQ(data->at("Fy").size(), 100u);
+
+  prefetcher.close();
+  prefetcher.request(0);
+  ASSERT_EQ(prefetcher.take(0, true), nullptr);
+}
+
+// ____________________________________________________________________________
+TEST(SampleWindowTest, setPrefetcher) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+  KistlerCSVFile file(fileName);
+  Prefetcher prefetcher;
+  prefetcher.open(fileName);
+
+  SampleWindow window;
+  window.setPrefetcher(&prefetcher);
+
+  // Nothing prefetched yet, then a chunk is requested after the timeframe.
+  window.update(file, 0, 0.05);
+  ASSERT_TRUE(window.hasStalled());
+  ASSERT_EQ(window.getNumResidentRows(), 51);
+
+  // The next rows come from the chunk (waiting for it if it is not read yet).
+  window.update(file, 10, 0.06);
+  ASSERT_EQ(window.getNumResidentRows(), 341);
+  ASSERT_EQ(window.getNumRowsRead(), 351u);
+  auto data = window.getData(0.01, 0.06);
+  ASSERT_EQ(data->at("Fx").size(), 51u);
+  ASSERT_FLOAT_EQ(data->at("Fx").back(), 60);
+
+  // Now they are there already.
+  window.update(file, 20, 0.07);
+  ASSERT_FALSE(window.hasStalled());
+  ASSERT_EQ(window.getNumRowsRead(), 351u);
+  ASSERT_FLOAT_EQ(window.getData(0.02, 0.07)->at("Mx").front(), 20);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, setMemoryBudget) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 5000);
+
+  DataModel dataModel;
+  dataModel.setAnalysisTimeframes({3.0});
+  dataModel.setPrefetching(false);
+  // 9 columns, the resident rows plus the copy for the timeframe, and the
+  // running sums of 4 columns and of the contact rows.
+  dataModel.setMemoryBudget(1000 *
+                            (9 * sizeof(float) * 2 + 5 * sizeof(double)));
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  ASSERT_EQ(dataModel.sampleWindow_.getMaxRows(), 1000);
+
+  // The 3s window is cut to the budget.
+  dataModel.seekToRow(3000);
+  ASSERT_EQ(dataModel.numRows_, 51);
+  ASSERT_EQ(dataModel.analysisWindows_[0].getNumRows(), 1000);
+  ASSERT_FLOAT_EQ(dataModel.analysisWindows_[0].getStopTime(), 3.05);
+  ASSERT_LE(dataModel.sampleWindow_.getNumResidentRows(), 1000);
+
+  // No limit.
+  dataModel.setMemoryBudget(0);
+  ASSERT_EQ(dataModel.sampleWindow_.getMaxRows(), 0);
+  dataModel.seekToRow(3000);
+  ASSERT_EQ(dataModel.analysisWindows_[0].getNumRows(), 3001);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, corruptData) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeCorruptTestFile(fileName);
+  writeKistlerTestFile(fileName, 1000, 18, false);
+
+  // The glitch is interpolated and reported, the playback goes on.
+  DataModel dataModel;
+  ASSERT_EQ(dataModel.getCorruptDataPolicy(), CorruptDataPolicy::Interpolate);
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  for (int i = 0; i < 5; i++)
+    dataModel.process();
+  ASSERT_EQ(dataModel.getCorruptDataReport().getNumCells(), 3u);
+  ASSERT_EQ(dataModel.getPlaybackStats().getCorruptCells(), 3u);
+  ASSERT_TRUE(dataModel.balanceParameters_.isValid());
+  ASSERT_EQ(dataModel.firstRow_, 5 * PLAYBACK_DELAY_MS);
+
+  // Aborting stops at the first corrupt row. SkipRow interpolates as well.
+  dataModel.setCorruptDataPolicy(CorruptDataPolicy::Abort);
+  dataModel.onStartProcessing("example_data/KistlerCSV_example.txt", 0.05);
+  dataModel.onStopProcessing();
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  dataModel.onResetModel();
+  ASSERT_EQ(dataModel.getCorruptDataReport().getNumCells(), 0u);
+  dataModel.process();
+  ASSERT_EQ(dataModel.getCorruptDataReport().getNumCells(), 1u);
+  ASSERT_EQ(dataModel.firstRow_, 0);
+  ASSERT_EQ(dataModel.kistlerFile_->getCorruptDataPolicy(),
+            CorruptDataPolicy::Abort);
+
+  dataModel.setCorruptDataPolicy(CorruptDataPolicy::SkipRow);
+  dataModel.onStartProcessing("example_data/KistlerCSV_example.txt", 0.05);
+  dataModel.onStopProcessing();
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  ASSERT_EQ(dataModel.kistlerFile_->getCorruptDataPolicy(),
+            CorruptDataPolicy::Interpolate);
+}
+
+// ____________________________________________________________________________
+TEST(FramePoolTest, acquire) {
+  FramePool pool;
+  pool.setColumnNames({"abs time (s)", "Fx"});
+
+  auto frame = pool.acquire(10);
+  ASSERT_EQ(pool.size(), 1u);
+  ASSERT_EQ(frame->size(), 2u);
+  ASSERT_TRUE(frame->at("Fx").empty());
+  ASSERT_GE(frame->at("Fx").capacity(), 10u);
+  auto *small = frame.get();
+
+  // Dropped frames are reused, emptied.
+  frame->at("Fx").push_back(1);
+  frame.reset();
+  frame = pool.acquire(5);
+  ASSERT_EQ(frame.get(), small);
+  ASSERT_TRUE(frame->at("Fx").empty());
+
+  // In use, so there is a new one.
+  auto other = pool.acquire(100);
+  ASSERT_EQ(pool.size(), 2u);
+  auto *large = other.get();
+
+  // The frame that fits best is taken.
+  frame.reset();
+  other.reset();
+  frame = pool.acquire(50);
+  ASSERT_EQ(frame.get(), large);
+  other = pool.acquire(5);
+  ASSERT_EQ(other.get(), small);
+  other.reset();
+  frame.reset();
+  frame = pool.acquire(500);
+  ASSERT_EQ(frame.get(), large);
+  ASSERT_EQ(pool.size(), 2u);
+
+  // Other columns, other frames.
+  pool.setColumnNames({"abs time (s)", "Fx"});
+  ASSERT_EQ(pool.size(), 2u);
+  pool.setColumnNames({"abs time (s)", "Fy"});
+  ASSERT_EQ(pool.size(), 0u);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, allocations) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 10000);
+
+  DataModel dataModel;
+  dataModel.setAnalysisTimeframes({1.0});
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+
+  // Warm up until the analysis window is full.
+  for (int i = 0; i < 200; i++)
+    dataModel.process();
+  size_t numFrames = dataModel.sampleWindow_.getNumFrames();
+  ASSERT_GT(numFrames, 0u);
+  uint64_t numAllocations = dataModel.getPlaybackStats().getAllocations();
+
+  // From now on the frames are reused, and (if counted) nothing is
+  // allocated at all.
+  for (int i = 0; i < 300; i++)
+    dataModel.process();
+  ASSERT_FLOAT_EQ(dataModel.analysisWindows_[0].getStopTime(), 5.04);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumFrames(), numFrames);
+  if (AllocationCounter::isEnabled()) {
+    ASSERT_EQ(dataModel.getPlaybackStats().getAllocations(), numAllocations);
+    ASSERT_EQ(dataModel.getPlaybackStats().getTickAllocations(), 0u);
+  }
+}
+
+// ____________________________________________________________________________
+TEST(InstrumentationTest, residentMemoryBytes) {
+  // Some MB for sure, but not absurdly much.
+  ASSERT_GT(residentMemoryBytes(), 1'000'000);
+  ASSERT_LT(residentMemoryBytes(), int64_t{1} << 40);
+}
+
+// ____________________________________________________________________________
+TEST(CopHistogram2DTest, add) {
+  CopHistogram2D histogram(0.3, 6);
+  ASSERT_EQ(histogram.getNumBins(), 6);
+
+  // A new histogram is dirty as a whole.
+  BinRect dirty = histogram.takeDirtyBins();
+  ASSERT_EQ(dirty.firstX, 0);
+  ASSERT_EQ(dirty.lastY, 5);
+  ASSERT_TRUE(histogram.takeDirtyBins().isEmpty());
+
+  // Bins are 10cm wide.
+  ASSERT_EQ(histogram.toBin(-0.3), 0);
+  ASSERT_EQ(histogram.toBin(-0.15), 1);
+  ASSERT_EQ(histogram.toBin(0.05), 3);
+  ASSERT_EQ(histogram.toBin(0.3), 5);
+  ASSERT_EQ(histogram.toBin(0.31), -1);
+  ASSERT_EQ(histogram.toBin(std::nanf("")), -1);
+
+  ASSERT_TRUE(histogram.add(0.05, -0.15));
+  ASSERT_TRUE(histogram.add(0.06, -0.12));
+  ASSERT_TRUE(histogram.add(-0.25, 0.25));
+  // No contact and out of range.
+  ASSERT_FALSE(histogram.add(0, 0));
+  ASSERT_FALSE(histogram.add(0.5, 0));
+
+  ASSERT_EQ(histogram.getCount(3, 1), 2);
+  ASSERT_EQ(histogram.getCount(0, 5), 1);
+  ASSERT_EQ(histogram.getMaxCount(), 2);
+  ASSERT_EQ(histogram.getTotalCount(), 3);
+
+  // The bounding box of the changed bins.
+  dirty = histogram.takeDirtyBins();
+  ASSERT_EQ(dirty.firstX, 0);
+  ASSERT_EQ(dirty.lastX, 3);
+  ASSERT_EQ(dirty.firstY, 1);
+  ASSERT_EQ(dirty.lastY, 5);
+  ASSERT_TRUE(histogram.takeDirtyBins().isEmpty());
+
+  histogram.add(0.05, -0.15);
+  dirty = histogram.takeDirtyBins();
+  ASSERT_EQ(dirty.firstX, 3);
+  ASSERT_EQ(dirty.lastX, 3);
+  ASSERT_EQ(dirty.firstY, 1);
+  ASSERT_EQ(dirty.lastY, 1);
+  ASSERT_EQ(histogram.getMaxCount(), 3);
+
+  histogram.clear();
+  ASSERT_EQ(histogram.getCount(3, 1), 0);
+  ASSERT_EQ(histogram.getMaxCount(), 0);
+  ASSERT_EQ(histogram.getTotalCount(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(MinMaxPyramidTest, append) {
+  MinMaxPyramid pyramid;
+  ASSERT_EQ(pyramid.getNumSamples(), 0);
+  ASSERT_EQ(pyramid.getNumLevels(), 0);
+
+  // Appending in chunks of odd sizes gives the same pyramid as appending all
+  // at once.
+  std::vector<float> values;
+  for (int i = 0; i < 1000; i++)
+    values.push_back(std::sin(i * 0.1) * i);
+
+  MinMaxPyramid chunked;
+  for (size_t i = 0; i < values.size(); i += 37) {
+    size_t end = std::min(values.size(), i + 37);
+    chunked.append(values.data() + i, end - i);
+  }
+  pyramid.append(values);
+
+  ASSERT_EQ(pyramid.getNumSamples(), 1000);
+  // 1000 samples, 1000 / 2^9 = 2 buckets on level 9, 1 on level 10.
+  ASSERT_EQ(pyramid.getNumLevels(), 11);
+  ASSERT_EQ(chunked.getNumLevels(), pyramid.getNumLevels());
+  for (int level = 0; level < pyramid.getNumLevels(); level++) {
+    ASSERT_EQ(chunked.getLevel(level).size(), pyramid.getLevel(level).size());
+    for (size_t i = 0; i < pyramid.getLevel(level).size(); i++) {
+      ASSERT_FLOAT_EQ(chunked.getLevel(level)[i].min,
+                      pyramid.getLevel(level)[i].min);
+      ASSERT_FLOAT_EQ(chunked.getLevel(level)[i].max,
+                      pyramid.getLevel(level)[i].max);
+    }
+  }
+
+  // Every bucket is the min/max of its samples.
+  for (int level = 0; level < pyramid.getNumLevels(); level++) {
+    size_t bucketSize = pyramid.getBucketSize(level);
+    const auto &buckets = pyramid.getLevel(level);
+    ASSERT_EQ(buckets.size(), (values.size() + bucketSize - 1) / bucketSize);
+    for (size_t i = 0; i < buckets.size(); i++) {
+      auto first = values.begin() + i * bucketSize;
+      auto last =
+          values.begin() + std::min(values.size(), (i + 1) * bucketSize);
+      ASSERT_FLOAT_EQ(buckets[i].min, *std::min_element(first, last));
+      ASSERT_FLOAT_EQ(buckets[i].max, *std::max_element(first, last));
+    }
+  }
+
+  MinMax range = pyramid.getRange();
+  ASSERT_FLOAT_EQ(range.min, *std::min_element(values.begin(), values.end()));
+  ASSERT_FLOAT_EQ(range.max, *std::max_element(values.begin(), values.end()));
+
+  // With a base level, level 0 already holds buckets of 4 samples.
+  MinMaxPyramid coarse(2);
+  coarse.append(values);
+  ASSERT_EQ(coarse.getBucketSize(0), 4);
+  ASSERT_EQ(coarse.getLevel(0).size(), 250);
+  ASSERT_FLOAT_EQ(coarse.getLevel(0)[1].min,
+                  *std::min_element(values.begin() + 4, values.begin() + 8));
+
+  pyramid.clear();
+  ASSERT_EQ(pyramid.getNumSamples(), 0);
+  ASSERT_EQ(pyramid.getNumLevels(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(MinMaxPyramidTest, query) {
+  std::vector<float> values;
+  for (int i = 0; i < 10'000; i++)
+    values.push_back(std::cos(i * 0.01) + (i % 7 == 0 ? 0.5 : 0));
+
+  MinMaxPyramid pyramid;
+  pyramid.append(values);
+
+  // Zoomed out: 10000 samples on 100 pixels uses level 6 (64 samples per
+  // bucket), and every column is the exact min/max of its samples.
+  std::vector<MinMax> columns;
+  ASSERT_EQ(pyramid.query(0, 10'000, 100, &columns), 6);
+  ASSERT_EQ(columns.size(), 100);
+  for (size_t pixel = 0; pixel < columns.size(); pixel++) {
+    // The buckets may reach a bit into the neighbouring columns.
+    auto first = values.begin() + pixel * 100;
+    auto last = first + 100;
+    ASSERT_LE(columns[pixel].min, *std::min_element(first, last));
+    ASSERT_GE(columns[pixel].max, *std::max_element(first, last));
+  }
+
+  // Columns aligned to the buckets are exact.
+  ASSERT_EQ(pyramid.query(0, 6400, 100, &columns), 6);
+  for (size_t pixel = 0; pixel < columns.size(); pixel++) {
+    auto first = values.begin() + pixel * 64;
+    auto last = first + 64;
+    ASSERT_FLOAT_EQ(columns[pixel].min, *std::min_element(first, last));
+    ASSERT_FLOAT_EQ(columns[pixel].max, *std::max_element(first, last));
+  }
+
+  // Zoomed in beyond the samples: every column shows a single sample.
+  ASSERT_EQ(pyramid.query(100, 110, 20, &columns), 0);
+  ASSERT_FLOAT_EQ(columns[0].min, values[100]);
+  ASSERT_FLOAT_EQ(columns[1].max, values[100]);
+  ASSERT_FLOAT_EQ(columns[19].min, values[109]);
+
+  // Columns outside the recording are NaN.
+  pyramid.query(9'990, 10'010, 20, &columns);
+  ASSERT_FLOAT_EQ(columns[9].min, values[9'999]);
+  ASSERT_TRUE(std::isnan(columns[10].min));
+  pyramid.query(-10, 10, 20, &columns);
+  ASSERT_TRUE(std::isnan(columns[9].max));
+  ASSERT_FLOAT_EQ(columns[10].max, values[0]);
+}
+
+// ____________________________________________________________________________
+TEST(MinMaxPyramidTest, setMaxBytes) {
+  std::vector<float> values;
+  for (int i = 0; i < 100'000; i++)
+    values.push_back(std::sin(i * 0.001) * (i % 13));
+
+  // Growing in chunks stays within the limit by dropping the finest levels.
+  MinMaxPyramid pyramid;
+  pyramid.setMaxBytes(16'384);
+  for (size_t i = 0; i < values.size(); i += 1000) {
+    pyramid.append(values.data() + i, 1000);
+    ASSERT_LE(pyramid.getMemoryBytes(), 16'384u);
+  }
+  ASSERT_EQ(pyramid.getNumSamples(), 100'000);
+  ASSERT_GT(pyramid.getBaseLevel(), 0);
+
+  // The remaining levels are the same as without a limit.
+  MinMaxPyramid reference(pyramid.getBaseLevel());
+  reference.append(values);
+  ASSERT_EQ(pyramid.getNumLevels(), reference.getNumLevels());
+  for (int level = 0; level < pyramid.getNumLevels(); level++) {
+    ASSERT_EQ(pyramid.getLevel(level).size(), reference.getLevel(level).size());
+    for (size_t i = 0; i < pyramid.getLevel(level).size(); i++) {
+      ASSERT_FLOAT_EQ(pyramid.getLevel(level)[i].min,
+                      reference.getLevel(level)[i].min);
+      ASSERT_FLOAT_EQ(pyramid.getLevel(level)[i].max,
+                      reference.getLevel(level)[i].max);
+    }
+  }
+
+  // Starting over gives the full resolution again.
+  pyramid.clear();
+  ASSERT_EQ(pyramid.getBaseLevel(), 0);
+}
+
+// ____________________________________________________________________________
+TEST(RunningMedianTest, push) {
+  // Against sorting the window, for odd and even windows and with ties.
+  for (int windowSize : {1, 2, 5, 8, 31}) {
+    RunningMedian median(windowSize);
+    std::vector<float> values;
+    for (int i = 0; i < 500; i++) {
+      float value = rand() % 20;
+      values.push_back(value);
+      std::vector<float> window(
+          values.end() - std::min<int>(values.size(), windowSize),
+          values.end());
+      std::sort(window.begin(), window.end());
+      size_t middle = window.size() / 2;
+      float expected = window.size() % 2 == 1
+                           ? window[middle]
+                           : (window[middle - 1] + window[middle]) / 2;
+      ASSERT_FLOAT_EQ(median.push(value), expected);
+      ASSERT_EQ(median.size(), std::min<int>(i + 1, windowSize));
+    }
+  }
+
+  RunningMedian median(3);
+  ASSERT_FLOAT_EQ(median.getMedian(), 0);
+  median.push(1);
+  median.push(100);
+  ASSERT_FLOAT_EQ(median.push(2), 2);
+  median.reset();
+  ASSERT_EQ(median.size(), 0);
+  ASSERT_FLOAT_EQ(median.push(7), 7);
+}
+
+// ____________________________________________________________________________
+TEST(SpikeFilterTest, apply) {
+  std::unordered_map<std::string, std::vector<float>> columns;
+  columns["abs time (s)"] = {0, 1, 2, 3, 4, 5, 6};
+  columns["Fx"] = {1, 1, 1, 50, 1, 1, 1};
+  columns["Fy"] = {0, 0, 0, 0, 5, 5, 5};
+
+  // Switched off.
+  SpikeFilter filter;
+  filter.configure({"abs time (s)", "Fx", "Fy"}, 1);
+  ASSERT_FALSE(filter.isEnabled());
+  filter.apply(&columns, 0, 0);
+  ASSERT_FLOAT_EQ(columns["Fx"][3], 50);
+
+  // The spike is gone, the step is delayed by a sample, the time is kept.
+  filter.configure({"abs time (s)", "Fx", "Fy"}, 3);
+  filter.apply(&columns, 0, 0);
+  ASSERT_EQ(columns["Fx"], std::vector<float>(7, 1));
+  ASSERT_EQ(columns["Fy"], std::vector<float>({0, 0, 0, 0, 0, 5, 5}));
+  ASSERT_FLOAT_EQ(columns["abs time (s)"][6], 6);
+
+  // Continuing rows go on with the window.
+  columns["Fx"].push_back(50);
+  columns["Fy"].push_back(5);
+  filter.apply(&columns, 7, 7);
+  ASSERT_FLOAT_EQ(columns["Fx"][7], 1);
+
+  // Other rows start over.
+  columns["Fx"].push_back(50);
+  columns["Fy"].push_back(5);
+  filter.apply(&columns, 8, 100);
+  ASSERT_FLOAT_EQ(columns["Fx"][8], 50);
+}
+
+// ____________________________________________________________________________
+TEST(SampleWindowTest, setSpikeFilterWindow) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 1000);
+  KistlerCSVFile file(fileName);
+
+  // The ramp of the test file is delayed by 2 samples, the rows are filtered
+  // as they are read (in two steps here).
+  SampleWindow window;
+  window.update(file, 0, 0.05);
+  window.setSpikeFilterWindow(5);
+  ASSERT_EQ(window.getNumResidentRows(), 0);
+  window.update(file, 0, 0.05);
+  window.update(file, 10, 0.1);
+  auto data = window.getData(0.01, 0.1);
+  ASSERT_EQ(data->at("Fx").size(), 91u);
+  for (size_t i = 0; i < data->at("Fx").size(); i++) {
+    ASSERT_FLOAT_EQ(data->at("abs time (s)")[i], (i + 10) / 1000.0);
+    ASSERT_FLOAT_EQ(data->at("Fz")[i], i + 8);
+  }
+}
+
+// ____________________________________________________________________________
+TEST(OffsetCalibratorTest, apply) {
+  std::unordered_map<std::string, std::vector<float>> columns;
+  columns["abs time (s)"] = {0, 1, 2, 3};
+  columns["Fx"] = {1, 3, 10, 10};
+  columns["Fz"] = {-2, -4, -700, -700};
+  columns["Ax"] = {0.1, 0.1, 0.2, 0.2};
+  const std::vector<std::string> columnNames = {"abs time (s)", "Fx", "Fz",
+                                                "Ax"};
+
+  // Off until configured.
+  OffsetCalibrator calibrator;
+  ASSERT_FALSE(calibrator.isEnabled());
+  ASSERT_FALSE(calibrator.calibrate(columns));
+  calibrator.apply(&columns, 0);
+  ASSERT_FLOAT_EQ(columns["Fx"][0], 1);
+
+  // The means of the unloaded rows, only of the forces and moments.
+  calibrator.configure(columnNames, 1, 25);
+  calibrator.setDriftTime(0);
+  ASSERT_TRUE(calibrator.calibrate(columns));
+  ASSERT_TRUE(calibrator.isCalibrated());
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Fx"), 2);
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Fz"), -3);
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Ax"), 0);
+  ASSERT_FLOAT_EQ(calibrator.getOffset("abs time (s)"), 0);
+
+  // No unloaded rows, the offsets are kept.
+  auto loaded = columns;
+  loaded["Fz"] = {-700, -700, -700, -700};
+  ASSERT_FALSE(calibrator.calibrate(loaded));
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Fx"), 2);
+
+  // Only the new rows are corrected.
+  calibrator.apply(&columns, 2);
+  ASSERT_EQ(columns["Fx"], std::vector<float>({1, 3, 8, 8}));
+  ASSERT_EQ(columns["Fz"], std::vector<float>({-2, -4, -697, -697}));
+  ASSERT_FLOAT_EQ(columns["Ax"][2], 0.2);
+  ASSERT_FLOAT_EQ(columns["abs time (s)"][3], 3);
+
+  // Tracking the drift: a time constant of one sample takes the mean of the
+  // unloaded rows right away (for the rows after them).
+  calibrator.setDriftTime(1);
+  columns["Fx"].insert(columns["Fx"].end(), {6, 6, 106});
+  columns["Fz"].insert(columns["Fz"].end(), {1, 1, -700});
+  calibrator.apply(&columns, 4);
+  ASSERT_FLOAT_EQ(columns["Fx"][4], 4);
+  ASSERT_FLOAT_EQ(columns["Fx"][6], 104);
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Fx"), 6);
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Fz"), 1);
+
+  // With a longer time constant the offsets follow slowly: 2 samples of
+  // 100 move them 1 - (1 - 1/10)^2 of the way.
+  calibrator.setDriftTime(10);
+  columns["Fx"].insert(columns["Fx"].end(), {106, 106});
+  columns["Fz"].insert(columns["Fz"].end(), {1, 1});
+  calibrator.apply(&columns, 7);
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Fx"), 6 + 0.19 * 100);
+
+  // Not calibrated yet, the first unloaded rows calibrate it.
+  calibrator.configure(columnNames, 1, 25);
+  std::unordered_map<std::string, std::vector<float>> live;
+  live["Fx"] = {5, 5};
+  live["Fz"] = {-700, -700};
+  calibrator.apply(&live, 0);
+  ASSERT_FALSE(calibrator.isCalibrated());
+  ASSERT_EQ(live["Fx"], std::vector<float>({5, 5}));
+  live["Fx"].insert(live["Fx"].end(), {2, 4});
+  live["Fz"].insert(live["Fz"].end(), {3, 3});
+  calibrator.apply(&live, 2);
+  ASSERT_TRUE(calibrator.isCalibrated());
+  ASSERT_EQ(live["Fx"], std::vector<float>({5, 5, -1, 1}));
+
+  // With the spike filter in the same pass, the same as filtering first (the
+  // unloaded rows are found from the filtered Fz).
+  std::unordered_map<std::string, std::vector<float>> separate;
+  separate["abs time (s)"] = {0, 1, 2, 3, 4, 5};
+  separate["Fx"] = {1, 3, 40, 3, 5, 5};
+  separate["Fz"] = {2, 2, -700, 1, -700, -700};
+  separate["Ax"] = {0.1, 0.1, 0.5, 0.1, 0.2, 0.2};
+  auto fused = separate;
+  SpikeFilter separateFilter;
+  SpikeFilter fusedFilter;
+  OffsetCalibrator fusedCalibrator;
+  for (auto *filter : {&separateFilter, &fusedFilter})
+    filter->configure(columnNames, 3);
+  for (auto *offsets : {&calibrator, &fusedCalibrator}) {
+    offsets->configure(columnNames, 1, 25);
+    offsets->setDriftTime(2);
+    ASSERT_TRUE(offsets->calibrate(separate));
+  }
+  for (size_t firstIndex : {0, 6}) {
+    if (firstIndex > 0) {
+      for (auto *data : {&separate, &fused}) {
+        (*data)["abs time (s)"].insert((*data)["abs time (s)"].end(), {6, 7});
+        (*data)["Fx"].insert((*data)["Fx"].end(), {4, 4});
+        (*data)["Fz"].insert((*data)["Fz"].end(), {3, 1});
+        (*data)["Ax"].insert((*data)["Ax"].end(), {0.1, 0.1});
+      }
+    }
+    separateFilter.apply(&separate, firstIndex, firstIndex);
+    calibrator.apply(&separate, firstIndex);
+    fusedCalibrator.apply(&fused, firstIndex, &fusedFilter, firstIndex);
+    ASSERT_EQ(fused, separate);
+    for (const auto &name : columnNames)
+      ASSERT_EQ(fusedCalibrator.getOffset(name), calibrator.getOffset(name));
+  }
+  ASSERT_NE(calibrator.getOffset("Fx"), 2);
+
+  // Switched off.
+  calibrator.clear();
+  ASSERT_FALSE(calibrator.isEnabled());
+  ASSERT_FLOAT_EQ(calibrator.getOffset("Fx"), 0);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, offsetCalibration) {
+  // Fz of 2 N and Fx of the row number on the empty plate, then someone on
+  // it. The file has no contact period, so the first second is taken.
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeContactTestFile(fileName, {{1000, 2}, {2000, -700}});
+
+  DataModel dataModel;
+  dataModel.setAnalysisTimeframes({});
+  dataModel.setPrefetching(false);
+  ASSERT_FALSE(dataModel.getOffsetCalibration());
+  dataModel.setOffsetCalibration(true);
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  ASSERT_TRUE(dataModel.getOffsetCalibrator().isCalibrated());
+  ASSERT_FLOAT_EQ(dataModel.getOffsetCalibrator().getOffset("Fx"), 499.5);
+  ASSERT_FLOAT_EQ(dataModel.getOffsetCalibrator().getOffset("Fz"), 2);
+
+  // The rows are corrected as they are read, the mean force with them.
+  dataModel.seekToRow(1500);
+  auto data = dataModel.sampleWindow_.getData(1.5, 1.55);
+  ASSERT_EQ(data->at("Fz").size(), 51u);
+  for (size_t i = 0; i < data->at("Fz").size(); i++) {
+    ASSERT_FLOAT_EQ(data->at("Fz")[i], -702);
+    ASSERT_FLOAT_EQ(data->at("Fx")[i], 1500 + i - 499.5);
+  }
+  ASSERT_NEAR(dataModel.balanceParameters_.getMeanForceX(), 1025.5, 0.01);
+
+  // A configured interval, taking effect with the next file (or reset).
+  dataModel.setCalibrationInterval(0.5, 0.6);
+  dataModel.onResetModel();
+  ASSERT_FLOAT_EQ(dataModel.getOffsetCalibrator().getOffset("Fx"), 550);
+
+  // Switched off, the rows are read again without offsets.
+  dataModel.seekToRow(1500);
+  dataModel.setOffsetCalibration(false);
+  ASSERT_EQ(dataModel.sampleWindow_.getNumResidentRows(), 0);
+  ASSERT_FALSE(dataModel.getOffsetCalibrator().isEnabled());
+  dataModel.seekToRow(1500);
+  data = dataModel.sampleWindow_.getData(1.5, 1.5);
+  ASSERT_FLOAT_EQ(data->at("Fz")[0], -700);
+  ASSERT_FLOAT_EQ(data->at("Fx")[0], 1500);
+}
+
+// ____________________________________________________________________________
+TEST(RealFftTest, transform) {
+  ASSERT_EQ(RealFft::getGoodSize(10001), 10000);
+  ASSERT_EQ(RealFft::getGoodSize(9999), 9720);
+  ASSERT_EQ(RealFft::getGoodSize(15), 12);
+  ASSERT_EQ(RealFft::getGoodSize(3), 2);
+  ASSERT_EQ(RealFft::getGoodSize(1), 0);
+
+  // Cached by size.
+  ASSERT_EQ(RealFft::get(90), RealFft::get(90));
+  ASSERT_NE(RealFft::get(90), RealFft::get(60));
+
+  // Against the definition.
+  const double pi = std::acos(-1.0);
+  std::vector<std::complex<double>> bins;
+  std::vector<std::complex<double>> work;
+  for (int size : {2, 4, 6, 10, 64, 90, 1000}) {
+    std::vector<float> values(size);
+    for (auto &value : values)
+      value = rand() % 1000 / 100.0 - 5;
+    auto fft = RealFft::get(size);
+    fft->transform(values.data(), &bins, &work);
+    ASSERT_EQ(bins.size(), static_cast<size_t>(size / 2 + 1));
+    for (int k = 0; k <= size / 2; k++) {
+      std::complex<double> expected = 0;
+      for (int i = 0; i < size; i++)
+        expected += static_cast<double>(values[i]) *
+                    std::polar(1.0, -2 * pi * k * i / size);
+      ASSERT_NEAR(bins[k].real(), expected.real(), 1e-9);
+      ASSERT_NEAR(bins[k].imag(), expected.imag(), 1e-9);
+    }
+    if (size > 2) {
+      ASSERT_NEAR(fft->getHannPower(), 3.0 * size / 8, 1e-6);
+    }
+  }
+}
+
+// ____________________________________________________________________________
+TEST(SlidingDftTest, push) {
+  const int size = 60;
+  std::vector<float> values(200);
+  for (auto &value : values)
+    value = rand() % 1000 / 100.0 - 5;
+
+  // After sliding on, the bins are those of the window of the last values.
+  auto fft = RealFft::get(size);
+  SlidingDft dft;
+  dft.reset(fft, values.data(), 5);
+  ASSERT_EQ(dft.getSize(), size);
+  ASSERT_EQ(dft.getBins().size(), 5u);
+  for (int i = size; i < 140; i++)
+    dft.push(values[i]);
+  ASSERT_EQ(dft.getNumPushed(), 80);
+
+  std::vector<std::complex<double>> bins;
+  std::vector<std::complex<double>> work;
+  fft->transform(values.data() + 80, &bins, &work);
+  for (int k = 0; k < 5; k++) {
+    ASSERT_NEAR(dft.getBins()[k].real(), bins[k].real(), 1e-9);
+    ASSERT_NEAR(dft.getBins()[k].imag(), bins[k].imag(), 1e-9);
+  }
+}
+
+// ____________________________________________________________________________
+TEST(SpectralAnalyzerTest, analyze) {
+  // 100 Hz, sines of 0.25 Hz (amplitude 2, power 2) and 2 Hz (amplitude 1,
+  // power 0.5) around 10, which is removed.
+  const double pi = std::acos(-1.0);
+  std::vector<float> times(4000);
+  std::vector<float> values(4000);
+  for (size_t i = 0; i < times.size(); i++) {
+    times[i] = i / 100.0;
+    values[i] = 10 + 2 * std::sin(2 * pi * 0.25 * times[i]) +
+                std::sin(2 * pi * 2 * times[i]);
+  }
+
+  // 20 s, the resolution is 0.05 Hz.
+  SpectralAnalyzer full;
+  std::vector<float> windowTimes(times.begin(), times.begin() + 2000);
+  std::vector<float> windowValues(values.begin(), values.begin() + 2000);
+  full.analyze(windowTimes, windowValues);
+  ASSERT_EQ(full.getSize(), 2000);
+  ASSERT_NEAR(full.getResolution(), 0.05, 1e-4);
+  ASSERT_EQ(full.getPowerSpectrum().size(), 201u);
+  const SpectrumSummary &summary = full.getSummary();
+  ASSERT_NEAR(summary.totalPower, 2.5, 0.01);
+  ASSERT_NEAR(summary.bandPower[0], 2, 0.01);
+  ASSERT_NEAR(summary.bandPower[1], 0, 0.01);
+  ASSERT_NEAR(summary.bandPower[2], 0.5, 0.01);
+  ASSERT_GT(summary.medianFrequency, 0.2);
+  ASSERT_LT(summary.medianFrequency, 0.3);
+
+  // Sliding the window on by 5 values at a time gives the same spectra with a
+  // single FFT (until the window has turned over).
+  SpectralAnalyzer sliding(true);
+  for (size_t first = 0; first + 2000 <= times.size(); first += 5) {
+    windowTimes.assign(times.begin() + first, times.begin() + first + 2000);
+    windowValues.assign(values.begin() + first,
+                        values.begin() + first + 2000);
+    sliding.analyze(windowTimes, windowValues);
+    if (first % 100 != 0)
+      continue;
+    full.analyze(windowTimes, windowValues);
+    for (size_t k = 0; k < full.getPowerSpectrum().size(); k++)
+      ASSERT_NEAR(sliding.getPowerSpectrum()[k], full.getPowerSpectrum()[k],
+                  1e-6 * (1 + full.getPowerSpectrum()[k]));
+    ASSERT_NEAR(sliding.getSummary().medianFrequency,
+                full.getSummary().medianFrequency, 1e-4);
+  }
+  ASSERT_EQ(sliding.getNumTransforms(), 1u);
+
+  // A jump starts over.
+  sliding.analyze(std::vector<float>(times.begin(), times.begin() + 2000),
+                  std::vector<float>(values.begin(), values.begin() + 2000));
+  ASSERT_EQ(sliding.getNumTransforms(), 2u);
+
+  // Too few values.
+  sliding.analyze({0, 0.01}, {1, 2});
+  ASSERT_EQ(sliding.getSize(), 0);
+  ASSERT_FLOAT_EQ(sliding.getSummary().totalPower, 0);
+}
+
+// ____________________________________________________________________________
+TEST(BalanceParametersTest, calculateSpectra) {
+  // 10 s at 1 kHz, COP x sways at 0.4 Hz, y at 2 Hz.
+  const double pi = std::acos(-1.0);
+  auto data =
+      std::make_shared<std::unordered_map<std::string, std::vector<float>>>();
+  for (int i = 0; i < 10000; i++) {
+    float time = i / 1000.0;
+    (*data)["abs time (s)"].push_back(time);
+    (*data)["Fx"].push_back(0);
+    (*data)["Fy"].push_back(0);
+    (*data)["Ax"].push_back(0.1 + 0.01 * std::sin(2 * pi * 0.4 * time));
+    (*data)["Ay"].push_back(0.1 + 0.01 * std::sin(2 * pi * 2 * time));
+  }
+
+  // Off by default.
+  BalanceParameters parameters(data);
+  ASSERT_EQ(parameters.getSpectralAnalysis(), SpectralAnalysis::None);
+  ASSERT_EQ(parameters.getCopSpectralAnalyzerX(), nullptr);
+  ASSERT_FLOAT_EQ(parameters.getCopSpectrumX().totalPower, 0);
+
+  parameters.setSpectralAnalysis(SpectralAnalysis::Full);
+  parameters.update(data);
+  ASSERT_NEAR(parameters.getCopSpectrumX().totalPower, 5e-5, 1e-6);
+  ASSERT_NEAR(parameters.getCopSpectrumX().bandPower[0], 5e-5, 1e-6);
+  ASSERT_NEAR(parameters.getCopSpectrumX().medianFrequency, 0.4, 0.05);
+  ASSERT_NEAR(parameters.getCopSpectrumY().bandPower[2], 5e-5, 1e-6);
+  ASSERT_NEAR(parameters.getCopSpectrumY().medianFrequency, 2, 0.05);
+  ASSERT_EQ(parameters.getCopSpectralAnalyzerY()->getSize(), 10000);
+
+  // Kept without the data.
+  parameters.releaseData();
+  ASSERT_NEAR(parameters.getCopSpectrumY().medianFrequency, 2, 0.05);
+
+  // No COP, no spectra.
+  data->erase("Ax");
+  parameters.update(data);
+  ASSERT_FLOAT_EQ(parameters.getCopSpectrumY().totalPower, 0);
+}
+
+// ____________________________________________________________________________
+TEST(DataModelTest, spectralAnalysis) {
+  TemporaryFile tempFile(".txt");
+  const std::string fileName = tempFile.getName();
+  writeKistlerTestFile(fileName, 8000);
+
+  // Only the window of 5 s gets spectra.
+  DataModel dataModel;
+  dataModel.setAnalysisTimeframes({1, SPECTRUM_MIN_S});
+  dataModel.setPrefetching(false);
+  ASSERT_FALSE(dataModel.getSpectralAnalysis());
+  dataModel.setSpectralAnalysis(true);
+  ASSERT_EQ(dataModel.analysisWindows_[0].getSpectralAnalysis(),
+            SpectralAnalysis::None);
+  ASSERT_EQ(dataModel.analysisWindows_[1].getSpectralAnalysis(),
+            SpectralAnalysis::Sliding);
+
+  // The window slides on with the ticks, a single FFT.
+  dataModel.onStartProcessing(fileName, 0.05);
+  dataModel.onStopProcessing();
+  dataModel.seekToRow(6000);
+  for (int i = 0; i < 10; i++)
+    dataModel.process();
+  const BalanceParameters &window = dataModel.analysisWindows_[1];
+  ASSERT_GT(window.getCopSpectrumX().totalPower, 0);
+  ASSERT_GT(window.getCopSpectrumX().medianFrequency, 0);
+  ASSERT_EQ(window.getCopSpectralAnalyzerX()->getSize(), 5000);
+  ASSERT_EQ(window.getCopSpectralAnalyzerX()->getNumTransforms(), 1u);
+
+  // Switched off.
+  dataModel.setSpectralAnalysis(false);
+  ASSERT_EQ(dataModel.analysisWindows_[1].getSpectralAnalysis(),
+            SpectralAnalysis::None);
+}
+
+// ____________________________________________________________________________
+TEST(StabilogramDiffusionTest, meanSquaredDisplacement) {
+  // A random walk around 10 cm, against the sums over all pairs of samples.
+  std::vector<float> values(3000);
+  float value = 0.1;
+  for (auto &v : values) {
+    value += (rand() % 1000 - 500) / 1e7;
+    v = value;
+  }
+
+  StabilogramDiffusion diffusion;
+  std::vector<float> curve;
+  diffusion.meanSquaredDisplacement(values, values.size() - 1, &curve);
+  ASSERT_EQ(curve.size(), values.size());
+  ASSERT_FLOAT_EQ(curve[0], 0);
+  for (size_t lag = 1; lag < values.size(); lag++) {
+    double sum = 0;
+    for (size_t i = 0; i + lag < values.size(); i++) {
+      double displacement = values[i + lag] - values[i];
+      sum += displacement * displacement;
+    }
+    double expected = sum / (values.size() - lag);
+    ASSERT_NEAR(curve[lag], expected, 1e-4 * expected + 1e-15);
+  }
+
+  // Up to a lag, and not more than there are.
+  diffusion.meanSquaredDisplacement(values, 10, &curve);
+  ASSERT_EQ(curve.size(), 11u);
+  diffusion.meanSquaredDisplacement({1, 2}, 10, &curve);
+  ASSERT_EQ(curve, std::vector<float>({0, 1}));
+}
+
+// ____________________________________________________________________________
+TEST(StabilogramDiffusionTest, summarize) {
+  // Diffusing with 1e-3 up to 1 s, then with 1e-4.
+  StabilogramDiffusion diffusion;
+  diffusion.lagStep_ = 0.01;
+  std::vector<float> curve(1001);
+  for (size_t lag = 0; lag < curve.size(); lag++) {
+    double t = lag * 0.01;
+    curve[lag] = t <= 1 ? 2e-3 * t : 2e-3 + 2e-4 * (t - 1);
+  }
+  DiffusionSummary summary = diffusion.summarize(curve);
+  ASSERT_NEAR(summary.shortTermCoefficient, 1e-3, 1e-7);
+  ASSERT_NEAR(summary.longTermCoefficient, 1e-4, 1e-7);
+  ASSERT_NEAR(summary.criticalTime, 1, 1e-3);
+  ASSERT_NEAR(summary.criticalDisplacement, 2e-3, 1e-6);
+
+  // Too short for the long-term region, no critical point.
+  curve.resize(101);
+  summary = diffusion.summarize(curve);
+  ASSERT_NEAR(summary.shortTermCoefficient, 1e-3, 1e-7);
+  ASSERT_FLOAT_EQ(summary.longTermCoefficient, 0);
+  ASSERT_FLOAT_EQ(summary.criticalTime, 0);
+}
+
+// ____________________________________________________________________________
+TEST(BalanceParametersTest, calculateDiffusion) {
+  // 20 s at 1 kHz, COP x a random walk, y still.
+  auto data =
+      std::make_shared<std::unordered_map<std::string, std::vector<float>>>();
+  float x = 0.1;
+  for (int i = 0; i < 20000; i++) {
+    x += (rand() % 2 ? 1 : -1) * 1e-5;
+    (*data)["abs time (s)"].push_back(i / 1000.0);
+    (*data)["Fx"].push_back(0);
+    (*data)["Fy"].push_back(0);
+    (*data)["Ax"].push_back(x);
+    (*data)["Ay"].push_back(0.05);
+  }
+
+  // Off by default.
+  BalanceParameters parameters(data);
+  ASSERT_FALSE(parameters.getDiffusionAnalysis());
+  ASSERT_FLOAT_EQ(parameters.getDiffusionX().shortTermCoefficient, 0);
+
+  // Steps of 1e-5 m per ms diffuse with (1e-5)^2 / (2 * 1e-3) m^2/s.
+  parameters.setDiffusionAnalysis(true);
+  parameters.update(data);
+  auto diffusion = parameters.getStabilogramDiffusion();
+  ASSERT_EQ(diffusion->getCurveX().size(), 10001u);
+  ASSERT_NEAR(diffusion->getLagStep(), 1e-3, 1e-6);
+  ASSERT_NEAR(parameters.getDiffusionX().shortTermCoefficient, 5e-8, 1e-8);
+  ASSERT_FLOAT_EQ(parameters.getDiffusionY().shortTermCoefficient, 0);
+  ASSERT_FLOAT_EQ(parameters.getDiffusionPlanar().shortTermCoefficient,
+                  parameters.getDiffusionX().shortTermCoefficient);
+
+  // Kept without the data.
+  parameters.releaseData();
+  ASSERT_NEAR(parameters.getDiffusionX().shortTermCoefficient, 5e-8, 1e-8);
+}
+
 // ____________________________________________________________________________
 int main() {
   ::testing::InitGoogleTest();
@@ -0,0 +1,392 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#include "./GzipStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// ____________________________________________________________________________
+Compression detectCompression(const std::string &fileName) {
+  std::ifstream file(fileName, std::ios::binary);
+  unsigned char magic[4] = {0, 0, 0, 0};
+  file.read(reinterpret_cast<char *>(magic), sizeof(magic));
+  std::streamsize numBytes = file.gcount();
+
+  if (numBytes >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+    return Compression::Gzip;
+  if (numBytes >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+      magic[2] == 0x2f && magic[3] == 0xfd)
+    return Compression::Zstd;
+  return Compression::None;
+}
+
+// ____________________________________________________________________________
+bool GzipIndex::find(int64_t out, GzipAccessPoint *point) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // The points are sorted by their offsets.
+  auto it = std::upper_bound(
+      points_.begin(), points_.end(), out,
+      [](int64_t value, const GzipAccessPoint &p) { return value < p.out; });
+  if (it == points_.begin())
+    return false;
+  *point = *(it - 1);
+  return true;
+}
+
+// ____________________________________________________________________________
+bool GzipIndex::wants(int64_t out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t last = points_.empty() ? 0 : points_.back().out;
+  return out - last >= GZIP_ACCESS_POINT_SPAN;
+}
+
+// ____________________________________________________________________________
+void GzipIndex::add(GzipAccessPoint point) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Several streams may decompress the same part, only keep the first point.
+  int64_t last = points_.empty() ? 0 : points_.back().out;
+  if (point.out - last >= GZIP_ACCESS_POINT_SPAN)
+    points_.push_back(std::move(point));
+}
+
+// ____________________________________________________________________________
+size_t GzipIndex::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return points_.size();
+}
+
+// ____________________________________________________________________________
+GzipStreamBuf::GzipStreamBuf(const std::string &fileName,
+                             std::shared_ptr<GzipIndex> index)
+    : fileName_(fileName), index_(std::move(index)), isOpen_(false),
+      streamInitialized_(false), raw_(false), memberEnded_(false),
+      trailerBytesLeft_(0), input_(GZIP_BLOCK_BYTES / 4), fileOffset_(0),
+      outputOffset_(0), failed_(false), finished_(true), stop_(false),
+      currentOffset_(0) {
+  if (!index_)
+    index_ = std::make_shared<GzipIndex>();
+  start(nullptr);
+  isOpen_ = static_cast<bool>(file_);
+}
+
+// ____________________________________________________________________________
+GzipStreamBuf::~GzipStreamBuf() {
+  stop();
+  if (streamInitialized_)
+    inflateEnd(&stream_);
+}
+
+// ____________________________________________________________________________
+void GzipStreamBuf::start(const GzipAccessPoint *point) {
+  stop();
+
+  if (streamInitialized_) {
+    inflateEnd(&stream_);
+    streamInitialized_ = false;
+  }
+  std::memset(&stream_, 0, sizeof(stream_));
+
+  file_.close();
+  file_.clear();
+  file_.open(fileName_, std::ios::binary);
+  queue_.clear();
+  finished_ = true;
+  stop_ = false;
+  failed_ = false;
+  memberEnded_ = false;
+  trailerBytesLeft_ = 0;
+  if (!file_) {
+    std::cerr << "Error in GzipStreamBuf::start(): Could not open file "
+              << fileName_ << std::endl;
+    return;
+  }
+
+  if (point == nullptr) {
+    // windowBits 15 + 32: a gzip (or zlib) header is detected.
+    if (inflateInit2(&stream_, 15 + 32) != Z_OK)
+      return;
+    raw_ = false;
+    fileOffset_ = 0;
+    outputOffset_ = 0;
+    history_.clear();
+  } else {
+    // The access point is in the middle of the deflate data, so no header.
+    if (inflateInit2(&stream_, -15) != Z_OK)
+      return;
+    raw_ = true;
+    fileOffset_ = point->in - (point->bits > 0 ? 1 : 0);
+    file_.seekg(fileOffset_);
+    if (point->bits > 0) {
+      int byte = file_.get();
+      fileOffset_++;
+      inflatePrime(&stream_, point->bits, byte >> (8 - point->bits));
+    }
+    inflateSetDictionary(&stream_, point->window.data(),
+                         static_cast<uInt>(point->window.size()));
+    outputOffset_ = point->out;
+    history_ = point->window;
+  }
+  streamInitialized_ = true;
+
+  finished_ = false;
+  thread_ = std::thread(&GzipStreamBuf::run, this);
+}
+
+// ____________________________________________________________________________
+void GzipStreamBuf::stop() {
+  if (!thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  thread_.join();
+}
+
+// ____________________________________________________________________________
+void GzipStreamBuf::run() {
+  while (true) {
+    std::vector<char> block;
+    bool more = decompress(&block);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] {
+      return stop_ || queue_.size() < GZIP_QUEUE_BLOCKS;
+    });
+    if (stop_)
+      return;
+    if (!block.empty())
+      queue_.push_back(std::move(block));
+    if (!more)
+      finished_ = true;
+    condition_.notify_all();
+    if (!more)
+      return;
+  }
+}
+
+// ____________________________________________________________________________
+bool GzipStreamBuf::resume() {
+  if (failed_ || !streamInitialized_)
+    return false;
+
+  // The thread is done, so the decompressor can be used here.
+  if (thread_.joinable())
+    thread_.join();
+  file_.clear();
+  file_.seekg(0, std::ios::end);
+  if (!file_ || file_.tellg() <= fileOffset_)
+    return false;
+
+  // Go on right where the data ended, the decompressor keeps its state.
+  file_.seekg(fileOffset_);
+  finished_ = false;
+  stop_ = false;
+  thread_ = std::thread(&GzipStreamBuf::run, this);
+  return true;
+}
+
+// ____________________________________________________________________________
+bool GzipStreamBuf::refill() {
+  file_.read(reinterpret_cast<char *>(input_.data()), input_.size());
+  std::streamsize numBytes = file_.gcount();
+  if (numBytes <= 0)
+    return false;
+  fileOffset_ += numBytes;
+  stream_.next_in = input_.data();
+  stream_.avail_in = static_cast<uInt>(numBytes);
+  return true;
+}
+
+// ____________________________________________________________________________
+bool GzipStreamBuf::decompress(std::vector<char> *block) {
+  block->resize(GZIP_BLOCK_BYTES);
+  stream_.next_out = reinterpret_cast<Bytef *>(block->data());
+  stream_.avail_out = static_cast<uInt>(block->size());
+  bool more = true;
+
+  while (stream_.avail_out > 0) {
+    if (stream_.avail_in == 0 && !refill()) {
+      more = false;
+      break;
+    }
+
+    // After raw deflate data, zlib doesn't know about the gzip trailer.
+    if (trailerBytesLeft_ > 0) {
+      uInt numBytes =
+          std::min(stream_.avail_in, static_cast<uInt>(trailerBytesLeft_));
+      stream_.next_in += numBytes;
+      stream_.avail_in -= numBytes;
+      trailerBytesLeft_ -= numBytes;
+      continue;
+    }
+
+    // Another gzip member follows.
+    if (memberEnded_) {
+      inflateReset2(&stream_, 15 + 32);
+      raw_ = false;
+      memberEnded_ = false;
+    }
+
+    int ret = inflate(&stream_, Z_BLOCK);
+    if (ret == Z_STREAM_END) {
+      memberEnded_ = true;
+      trailerBytesLeft_ = raw_ ? 8 : 0;
+      continue;
+    }
+    if (ret == Z_BUF_ERROR && stream_.avail_in == 0)
+      continue;
+    if (ret != Z_OK) {
+      std::cerr << "Error in GzipStreamBuf::decompress(): Could not "
+                   "decompress "
+                << fileName_ << " ("
+                << (stream_.msg != nullptr ? stream_.msg : "zlib error")
+                << ")" << std::endl;
+      failed_ = true;
+      more = false;
+      break;
+    }
+
+    // At the end of a deflate block (but not the last one) decompression
+    // can start over, given the window.
+    if ((stream_.data_type & 128) != 0 && (stream_.data_type & 64) == 0)
+      addAccessPoint(*block, block->size() - stream_.avail_out);
+  }
+  block->resize(block->size() - stream_.avail_out);
+
+  // Keep the last window for the access points in the next block.
+  if (block->size() >= GZIP_WINDOW_BYTES) {
+    history_.assign(block->end() - GZIP_WINDOW_BYTES, block->end());
+  } else {
+    history_.insert(history_.end(), block->begin(), block->end());
+    if (history_.size() > GZIP_WINDOW_BYTES)
+      history_.erase(history_.begin(), history_.end() - GZIP_WINDOW_BYTES);
+  }
+  outputOffset_ += block->size();
+
+  return more && !block->empty();
+}
+
+// ____________________________________________________________________________
+void GzipStreamBuf::addAccessPoint(const std::vector<char> &block,
+                                   size_t numBytes) {
+  int64_t out = outputOffset_ + static_cast<int64_t>(numBytes);
+  if (!index_->wants(out))
+    return;
+
+  GzipAccessPoint point;
+  point.out = out;
+  point.in = fileOffset_ - stream_.avail_in;
+  point.bits = stream_.data_type & 7;
+
+  // The window is the end of the history and the start of this block.
+  size_t fromBlock = std::min(numBytes, static_cast<size_t>(GZIP_WINDOW_BYTES));
+  size_t fromHistory =
+      std::min(history_.size(), GZIP_WINDOW_BYTES - fromBlock);
+  point.window.reserve(fromHistory + fromBlock);
+  point.window.insert(point.window.end(), history_.end() - fromHistory,
+                      history_.end());
+  point.window.insert(point.window.end(),
+                      block.begin() + (numBytes - fromBlock),
+                      block.begin() + numBytes);
+  index_->add(std::move(point));
+}
+
+// ____________________________________________________________________________
+GzipStreamBuf::int_type GzipStreamBuf::underflow() {
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  std::vector<char> block;
+  while (block.empty()) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] { return !queue_.empty() || finished_; });
+      if (!queue_.empty()) {
+        block = std::move(queue_.front());
+        queue_.pop_front();
+      }
+    }
+    condition_.notify_all();
+
+    // The thread is at the end of the file, which may have grown since (e.g.
+    // a recording compressed while it is written).
+    if (block.empty() && !resume())
+      return traits_type::eof();
+  }
+
+  currentOffset_ += current_.size();
+  current_ = std::move(block);
+  setg(current_.data(), current_.data(), current_.data() + current_.size());
+  return traits_type::to_int_type(*gptr());
+}
+
+// ____________________________________________________________________________
+GzipStreamBuf::pos_type GzipStreamBuf::seekoff(off_type offset,
+                                               std::ios_base::seekdir direction,
+                                               std::ios_base::openmode mode) {
+  if (direction == std::ios_base::beg)
+    return seekpos(pos_type(offset), mode);
+  if (direction == std::ios_base::cur) {
+    int64_t position = currentOffset_ + (gptr() - eback());
+    if (offset == 0)
+      return pos_type(position);
+    return seekpos(pos_type(position + offset), mode);
+  }
+  // The decompressed size is unknown until the end was read.
+  return pos_type(off_type(-1));
+}
+
+// ____________________________________________________________________________
+GzipStreamBuf::pos_type GzipStreamBuf::seekpos(pos_type position,
+                                               std::ios_base::openmode) {
+  int64_t target = static_cast<int64_t>(position);
+  int64_t blockEnd = currentOffset_ + static_cast<int64_t>(current_.size());
+  if (target < 0)
+    return pos_type(off_type(-1));
+
+  // Within the current block.
+  if (target >= currentOffset_ && target <= blockEnd) {
+    setg(eback(), eback() + (target - currentOffset_), egptr());
+    return position;
+  }
+
+  // Going back, or far ahead: start over at an access point. Otherwise
+  // decompressing up to the target from here is shorter.
+  GzipAccessPoint point;
+  bool hasPoint = index_->find(target, &point);
+  if (target < currentOffset_ || (hasPoint && point.out > blockEnd)) {
+    start(hasPoint ? &point : nullptr);
+    currentOffset_ = hasPoint ? point.out : 0;
+    current_.clear();
+    setg(nullptr, nullptr, nullptr);
+  }
+
+  while (true) {
+    setg(eback(), egptr(), egptr());
+    if (underflow() == traits_type::eof()) {
+      // Seeking to the end of the data is fine.
+      if (target == currentOffset_ + static_cast<int64_t>(current_.size()))
+        return position;
+      return pos_type(off_type(-1));
+    }
+    if (target < currentOffset_ + static_cast<int64_t>(current_.size())) {
+      setg(eback(), eback() + (target - currentOffset_), egptr());
+      return position;
+    }
+  }
+}
+
+// ____________________________________________________________________________
+GzipInputStream::GzipInputStream(const std::string &fileName,
+                                 std::shared_ptr<GzipIndex> index)
+    : std::istream(nullptr), buffer_(fileName, std::move(index)) {
+  rdbuf(&buffer_);
+  if (!buffer_.isOpen())
+    setstate(std::ios::failbit);
+}
@@ -0,0 +1,160 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+// Size of the decompressed blocks the decompression thread hands to the
+// parser.
+#define GZIP_BLOCK_BYTES (1 << 18)
+
+// Number of decompressed blocks the decompression thread may be ahead of the
+// parser.
+#define GZIP_QUEUE_BLOCKS 4
+
+// Distance of the access points in decompressed bytes. A seek decompresses at
+// most this much before the target. Every access point holds the 32 KB window
+// of the decompressor, so the index is around 3% of the decompressed size.
+#define GZIP_ACCESS_POINT_SPAN (1 << 20)
+
+// Size of the deflate window.
+#define GZIP_WINDOW_BYTES 32768
+
+// Compression of an input file.
+enum class Compression { None, Gzip, Zstd };
+
+// Detect the compression of a file by its magic number (None if it can't be
+// read).
+Compression detectCompression(const std::string &fileName);
+
+// A position in a gzip file where decompression can start: the offsets in the
+// decompressed and compressed data, the number of bits of the byte before the
+// compressed offset that belong to it, and the last 32 KB decompressed before
+// it (the dictionary to start with).
+struct GzipAccessPoint {
+  int64_t out;
+  int64_t in;
+  int bits;
+  std::vector<unsigned char> window;
+};
+
+// The access points of a gzip file (like zran.c of zlib). They are added
+// while decompressing, so the index grows as far as the file was ever read.
+// It is shared by all streams on the same file, hence the mutex.
+class GzipIndex {
+public:
+  // The last access point at or before the decompressed offset (copied),
+  // false if there is none.
+  bool find(int64_t out, GzipAccessPoint *point) const;
+
+  // If an access point at the decompressed offset would be added (it is far
+  // enough after the last one).
+  bool wants(int64_t out) const;
+  void add(GzipAccessPoint point);
+
+  size_t size() const;
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<GzipAccessPoint> points_;
+};
+
+// A stream buffer decompressing a gzip file on a background thread, so
+// decompressing and parsing overlap. Seeking (absolute, or relative to the
+// current position) starts over at the closest access point before the target
+// instead of at the beginning of the file. Concatenated gzip members are
+// read as one. At the end of the data, the stream goes on if the file has
+// grown since (e.g. still being written).
+class GzipStreamBuf : public std::streambuf {
+public:
+  GzipStreamBuf(const std::string &fileName, std::shared_ptr<GzipIndex> index);
+  ~GzipStreamBuf() override;
+
+  bool isOpen() const { return isOpen_; }
+
+protected:
+  int_type underflow() override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                   std::ios_base::openmode mode) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+private:
+  // Start the thread at the access point (nullptr for the beginning of the
+  // file), after stopping it.
+  void start(const GzipAccessPoint *point);
+  void stop();
+
+  // The thread: decompress blocks into the queue until the end of the data.
+  void run();
+
+  // Restart the finished thread where it stopped if the file has grown, false
+  // if it hasn't (or decompression failed).
+  bool resume();
+
+  // Decompress the next block. Returns false at the end of the data (also if
+  // the file ends in the middle, e.g. while it is being written) or on an
+  // error.
+  bool decompress(std::vector<char> *block);
+
+  // Read more compressed data, false at the end of the file.
+  bool refill();
+
+  // Add an access point at the current position if the index wants one.
+  void addAccessPoint(const std::vector<char> &block, size_t numBytes);
+
+  std::string fileName_;
+  std::shared_ptr<GzipIndex> index_;
+  bool isOpen_;
+
+  // The decompressor, only used by the thread while it runs.
+  std::ifstream file_;
+  z_stream stream_;
+  bool streamInitialized_;
+  // Raw deflate data (after starting at an access point) or a gzip member.
+  bool raw_;
+  bool memberEnded_;
+  int trailerBytesLeft_;
+  std::vector<unsigned char> input_;
+  // Compressed offset after the data read into input_, decompressed offset
+  // of the next block and the last window before it.
+  int64_t fileOffset_;
+  int64_t outputOffset_;
+  std::vector<unsigned char> history_;
+  // Decompression failed (corrupt data), there is no going on.
+  bool failed_;
+
+  // Hand-over of the blocks from the thread.
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<std::vector<char>> queue_;
+  bool finished_;
+  bool stop_;
+
+  // The block being parsed and its decompressed offset.
+  std::vector<char> current_;
+  int64_t currentOffset_;
+};
+
+// An input stream on a gzip file, see GzipStreamBuf. Fails to open like an
+// std::ifstream.
+class GzipInputStream : public std::istream {
+public:
+  GzipInputStream(const std::string &fileName,
+                  std::shared_ptr<GzipIndex> index);
+
+private:
+  GzipStreamBuf buffer_;
+};
@@ -0,0 +1,483 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#include "./Instrumentation.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <unistd.h>
+
+std::atomic<bool> Tracer::enabled_{false};
+std::atomic<uint64_t> AllocationCounter::count_{0};
+
+#ifdef FPF_COUNT_ALLOCATIONS
+// The counting replacements of the global allocator, see AllocationCounter.
+// The array and nothrow versions of the library call these.
+
+// ____________________________________________________________________________
+void *operator new(size_t size) {
+  AllocationCounter::add();
+  void *pointer = std::malloc(size > 0 ? size : 1);
+  if (pointer == nullptr)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+// ____________________________________________________________________________
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+// ____________________________________________________________________________
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+#endif
+
+// ____________________________________________________________________________
+int64_t steadyClockUs() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+// ____________________________________________________________________________
+int64_t residentMemoryBytes() {
+  FILE *file = std::fopen("/proc/self/statm", "r");
+  if (file == nullptr)
+    return 0;
+
+  // Second field is the number of resident pages.
+  long size = 0;
+  long resident = 0;
+  int numRead = std::fscanf(file, "%ld %ld", &size, &resident);
+  std::fclose(file);
+
+  if (numRead != 2)
+    return 0;
+
+  return static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// ____________________________________________________________________________
+Tracer &Tracer::instance() {
+  // Intentionally leaked, so that threads may still record while static
+  // objects are destroyed at exit.
+  static Tracer *tracer = new Tracer();
+  return *tracer;
+}
+
+// ____________________________________________________________________________
+void Tracer::setEnabled(bool enabled) {
+  // Make sure the epoch is set before the first event is recorded.
+  nowUs();
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+// ____________________________________________________________________________
+Tracer::ThreadBuffer *Tracer::threadBuffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+
+  if (buffer == nullptr) {
+    auto newBuffer = std::make_unique<ThreadBuffer>();
+    newBuffer->events = std::make_unique<TraceEvent[]>(TRACE_EVENTS_PER_THREAD);
+
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    newBuffer->threadId = buffers_.size() + 1;
+    buffer = newBuffer.get();
+    buffers_.push_back(std::move(newBuffer));
+  }
+
+  return buffer;
+}
+
+// ____________________________________________________________________________
+void Tracer::record(const char *name, int64_t startUs, int64_t durationUs,
+                    const char *argName0, int64_t argValue0,
+                    const char *argName1, int64_t argValue1) {
+  ThreadBuffer *buffer = threadBuffer();
+
+  // Only this thread writes to the buffer, so a relaxed load is enough here.
+  size_t size = buffer->size.load(std::memory_order_relaxed);
+  if (size >= TRACE_EVENTS_PER_THREAD) {
+    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  buffer->events[size] = TraceEvent{
+      name, startUs, durationUs, {argName0, argName1}, {argValue0, argValue1}};
+
+  // Publish the event to writeJson().
+  buffer->size.store(size + 1, std::memory_order_release);
+}
+
+// ____________________________________________________________________________
+// Write a string literal as JSON string (names are ours, but be safe).
+static void writeJsonString(std::ostream &out, const char *str) {
+  out << '"';
+  for (const char *c = str; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\')
+      out << '\\';
+    out << *c;
+  }
+  out << '"';
+}
+
+// ____________________________________________________________________________
+bool Tracer::writeJson(const std::string &fileName) const {
+  std::ofstream file(fileName);
+
+  if (!file) {
+    std::cerr << "Error in Tracer::writeJson(): Cannot open file for writing: "
+              << fileName << std::endl;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(registryMutex_);
+
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  bool first = true;
+  for (const auto &buffer : buffers_) {
+    // Thread name metadata, so Perfetto shows something readable.
+    if (!first)
+      file << ",";
+    first = false;
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+         << buffer->threadId << ",\"args\":{\"name\":\""
+         << (buffer->threadId == 1 ? "main" : "worker") << " "
+         << buffer->threadId << "\"}}";
+
+    size_t size = buffer->size.load(std::memory_order_acquire);
+    for (size_t i = 0; i < size; i++) {
+      const TraceEvent &event = buffer->events[i];
+
+      file << ",{\"name\":";
+      writeJsonString(file, event.name);
+      file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+           << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs;
+
+      if (event.argNames[0] != nullptr) {
+        file << ",\"args\":{";
+        writeJsonString(file, event.argNames[0]);
+        file << ":" << event.argValues[0];
+        if (event.argNames[1] != nullptr) {
+          file << ",";
+          writeJsonString(file, event.argNames[1]);
+          file << ":" << event.argValues[1];
+        }
+        file << "}";
+      }
+      file << "}";
+    }
+  }
+
+  file << "]}" << std::endl;
+
+  return static_cast<bool>(file);
+}
+
+// ____________________________________________________________________________
+size_t Tracer::getNumEvents() const {
+  std::lock_guard<std::mutex> lock(registryMutex_);
+
+  size_t numEvents = 0;
+  for (const auto &buffer : buffers_)
+    numEvents += buffer->size.load(std::memory_order_acquire);
+
+  return numEvents;
+}
+
+// ____________________________________________________________________________
+size_t Tracer::getNumDropped() const {
+  std::lock_guard<std::mutex> lock(registryMutex_);
+
+  size_t numDropped = 0;
+  for (const auto &buffer : buffers_)
+    numDropped += buffer->dropped.load(std::memory_order_relaxed);
+
+  return numDropped;
+}
+
+// ____________________________________________________________________________
+void Tracer::clear() {
+  std::lock_guard<std::mutex> lock(registryMutex_);
+
+  // Buffers stay registered, threads keep their thread_local pointers.
+  for (auto &buffer : buffers_) {
+    buffer->size.store(0, std::memory_order_release);
+    buffer->dropped.store(0, std::memory_order_relaxed);
+  }
+}
+
+// ____________________________________________________________________________
+void LatencyHistogram::reset() {
+  counts_.fill(0);
+  count_ = 0;
+  min_ = 0;
+  max_ = 0;
+  sum_ = 0;
+  sumOfSquares_ = 0;
+}
+
+// ____________________________________________________________________________
+int LatencyHistogram::bucketIndex(int64_t valueUs) {
+  if (valueUs < kSubBucketCount)
+    return valueUs < 0 ? 0 : valueUs;
+
+  // Clamp to the largest trackable value.
+  if (valueUs >= (int64_t{1} << LATENCY_MAX_EXPONENT))
+    return kNumBuckets - 1;
+
+  // Position of the highest set bit, >= LATENCY_SUB_BUCKET_BITS here.
+  int msb = 63 - __builtin_clzll(valueUs);
+  // Shift such that the value falls into the upper half of the sub-buckets.
+  int shift = msb - LATENCY_SUB_BUCKET_BITS + 1;
+  int subBucket = valueUs >> shift;
+
+  return kSubBucketCount + (shift - 1) * kHalfSubBucketCount +
+         (subBucket - kHalfSubBucketCount);
+}
+
+// ____________________________________________________________________________
+int64_t LatencyHistogram::bucketLowestValue(int index) {
+  if (index < kSubBucketCount)
+    return index;
+
+  int shift = (index - kSubBucketCount) / kHalfSubBucketCount + 1;
+  int64_t subBucket =
+      (index - kSubBucketCount) % kHalfSubBucketCount + kHalfSubBucketCount;
+
+  return subBucket << shift;
+}
+
+// ____________________________________________________________________________
+int64_t LatencyHistogram::bucketHighestValue(int index) {
+  if (index < kSubBucketCount)
+    return index;
+
+  int shift = (index - kSubBucketCount) / kHalfSubBucketCount + 1;
+
+  return bucketLowestValue(index) + (int64_t{1} << shift) - 1;
+}
+
+// ____________________________________________________________________________
+void LatencyHistogram::record(int64_t valueUs) {
+  if (valueUs < 0)
+    valueUs = 0;
+
+  counts_[bucketIndex(valueUs)]++;
+
+  if (count_ == 0 || valueUs < min_)
+    min_ = valueUs;
+  if (valueUs > max_)
+    max_ = valueUs;
+
+  count_++;
+  sum_ += valueUs;
+  sumOfSquares_ += static_cast<double>(valueUs) * valueUs;
+}
+
+// ____________________________________________________________________________
+double LatencyHistogram::getMean() const {
+  return count_ == 0 ? 0 : sum_ / count_;
+}
+
+// ____________________________________________________________________________
+double LatencyHistogram::getStdDeviation() const {
+  if (count_ == 0)
+    return 0;
+
+  double mean = getMean();
+  double variance = sumOfSquares_ / count_ - mean * mean;
+
+  return variance > 0 ? std::sqrt(variance) : 0;
+}
+
+// ____________________________________________________________________________
+int64_t LatencyHistogram::getPercentile(double percentile) const {
+  if (count_ == 0)
+    return 0;
+
+  // The lowest value is known exactly.
+  if (percentile <= 0)
+    return min_;
+
+  percentile = std::min(percentile, 100.0);
+
+  // Number of values at or below the percentile (at least one).
+  int64_t countAtPercentile =
+      std::max<int64_t>(1, std::ceil(percentile / 100 * count_));
+
+  int64_t cumulativeCount = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    cumulativeCount += counts_[i];
+    if (cumulativeCount >= countAtPercentile)
+      return std::min(bucketHighestValue(i), max_);
+  }
+
+  return max_;
+}
+
+// ____________________________________________________________________________
+void LatencyHistogram::writePercentileDistribution(std::ostream &out) const {
+  out << std::setw(12) << "Value" << " " << std::setw(14) << "Percentile"
+      << " " << std::setw(10) << "TotalCount"
+      << " " << std::setw(14) << "1/(1-Percentile)" << "\n\n";
+
+  out << std::fixed;
+
+  // Like HdrHistogram: 5 reporting ticks per half distance to 100%, i.e. the
+  // resolution gets finer towards the tail of the distribution.
+  const int ticksPerHalfDistance = 5;
+  double percentile = 0;
+  while (count_ > 0) {
+    int64_t value = getPercentile(percentile);
+
+    // Number of recorded values at or below this value.
+    int64_t totalCount = 0;
+    for (int i = 0; i <= bucketIndex(value); i++)
+      totalCount += counts_[i];
+
+    out << std::setw(12) << std::setprecision(3) << value / 1000.0 << " "
+        << std::setw(14) << std::setprecision(12) << percentile / 100 << " "
+        << std::setw(10) << totalCount << " ";
+    if (percentile < 100)
+      out << std::setw(14) << std::setprecision(2)
+          << 1 / (1 - percentile / 100);
+    out << "\n";
+
+    if (percentile >= 100)
+      break;
+
+    // Once less than a single value is left in the tail, report the maximum.
+    if ((100 - percentile) / 100 * count_ < 1) {
+      percentile = 100;
+      continue;
+    }
+
+    int halvings = std::floor(std::log2(100 / (100 - percentile))) + 1;
+    percentile += 100 / (ticksPerHalfDistance * std::pow(2.0, halvings));
+  }
+
+  out << std::setprecision(3);
+  out << "#[Mean    = " << std::setw(12) << getMean() / 1000
+      << ", StdDeviation   = " << std::setw(12) << getStdDeviation() / 1000
+      << "]\n";
+  out << "#[Max     = " << std::setw(12) << getMax() / 1000.0
+      << ", Total count    = " << std::setw(12) << count_ << "]\n";
+  out << "#[Buckets = " << std::setw(12) << kNumBuckets
+      << ", SubBuckets     = " << std::setw(12) << kSubBucketCount << "]\n";
+
+  out.unsetf(std::ios_base::floatfield);
+}
+
+// ____________________________________________________________________________
+LatencyMonitor &LatencyMonitor::instance() {
+  static LatencyMonitor monitor;
+  return monitor;
+}
+
+// ____________________________________________________________________________
+void LatencyMonitor::recordFrame(const LatencyStamps &stamps,
+                                 int64_t paintedUs) {
+  // Batches without stamps (e.g. the initial frame) are not counted.
+  if (stamps.readUs == 0)
+    return;
+
+  read_.record(stamps.parsedUs - stamps.readUs);
+  process_.record(stamps.processedUs - stamps.parsedUs);
+  render_.record(paintedUs - stamps.processedUs);
+  sampleToPixel_.record(paintedUs - stamps.readUs);
+}
+
+// ____________________________________________________________________________
+void LatencyMonitor::reset() {
+  read_.reset();
+  process_.reset();
+  render_.reset();
+  sampleToPixel_.reset();
+}
+
+// ____________________________________________________________________________
+bool LatencyMonitor::writeReport(const std::string &fileName) const {
+  std::ofstream file(fileName);
+
+  if (!file) {
+    std::cerr << "Error in LatencyMonitor::writeReport(): Cannot open file "
+                 "for writing: "
+              << fileName << std::endl;
+    return false;
+  }
+
+  const std::pair<const char *, const LatencyHistogram *> stages[] = {
+      {"sample-to-pixel", &sampleToPixel_},
+      {"read", &read_},
+      {"process", &process_},
+      {"render", &render_}};
+
+  // Short summary first, all values in milliseconds.
+  file << "# Latency summary (ms)\n";
+  file << std::fixed << std::setprecision(3);
+  for (const auto &stage : stages) {
+    file << "# " << std::left << std::setw(16) << stage.first << std::right
+         << " count " << std::setw(8) << stage.second->getCount() << "  p50 "
+         << std::setw(9) << stage.second->getPercentile(50) / 1000.0
+         << "  p99 " << std::setw(9) << stage.second->getPercentile(99) / 1000.0
+         << "  max " << std::setw(9) << stage.second->getMax() / 1000.0 << "\n";
+  }
+
+  for (const auto &stage : stages) {
+    file << "\n# Percentile distribution: " << stage.first << " (ms)\n";
+    stage.second->writePercentileDistribution(file);
+  }
+
+  return static_cast<bool>(file);
+}
+
+// ____________________________________________________________________________
+void PlaybackStats::reset() {
+  numTicks_ = 0;
+  droppedTicks_ = 0;
+  ioStalls_ = 0;
+  tickAllocations_ = 0;
+  allocations_ = 0;
+  corruptCells_ = 0;
+  lastTickUs_ = -1;
+  processDurationUs_ = 0;
+  maxProcessDurationUs_ = 0;
+  lagReferenceUs_ = -1;
+  lagReferenceDataTime_ = 0;
+  readerLagMs_ = 0;
+}
+
+// ____________________________________________________________________________
+void PlaybackStats::startTick(int64_t nowUs, int64_t intervalUs) {
+  if (lastTickUs_ >= 0 && intervalUs > 0) {
+    int64_t gapUs = nowUs - lastTickUs_;
+    if (gapUs * 2 > intervalUs * 3)
+      droppedTicks_ += (gapUs + intervalUs / 2) / intervalUs - 1;
+  }
+
+  lastTickUs_ = nowUs;
+  numTicks_++;
+}
+
+// ____________________________________________________________________________
+void PlaybackStats::finishTick(int64_t nowUs) {
+  processDurationUs_ = nowUs - lastTickUs_;
+  maxProcessDurationUs_ = std::max(maxProcessDurationUs_, processDurationUs_);
+}
+
+// ____________________________________________________________________________
+void PlaybackStats::updateLag(int64_t nowUs, float dataTime) {
+  if (lagReferenceUs_ < 0) {
+    lagReferenceUs_ = nowUs;
+    lagReferenceDataTime_ = dataTime;
+  }
+
+  readerLagMs_ = (nowUs - lagReferenceUs_) / 1000.0 -
+                 (dataTime - lagReferenceDataTime_) * 1000.0;
+}
@@ -0,0 +1,329 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Maximum number of trace events kept per thread. When a buffer is full,
+// further events of that thread are dropped (and counted) instead of growing
+// the buffer while the playback is running. 64k events are around 3MB per
+// thread and cover several minutes of playback.
+#define TRACE_EVENTS_PER_THREAD 65'536
+
+// Name of the environment variable that enables tracing. If it is set, its
+// value is used as the file name for the Chrome trace JSON.
+#define TRACE_ENV_VARIABLE "FORCEPLATE_TRACE"
+
+// Name of the environment variable for the latency report. If it is set, the
+// latency histograms are written to this file on exit.
+#define LATENCY_ENV_VARIABLE "FORCEPLATE_LATENCY"
+
+// Number of linear sub-buckets per power of two in the latency histograms.
+// 2^7 = 128 sub-buckets give a relative precision of better than 1.6%.
+#define LATENCY_SUB_BUCKET_BITS 7
+
+// Largest power of two (in microseconds) covered by the latency histograms,
+// 2^36us is around 19 hours. Larger values are clamped.
+#define LATENCY_MAX_EXPONENT 36
+
+// Microseconds since the first call (monotonic clock). This is the common
+// clock for trace events and latency stamps.
+int64_t steadyClockUs();
+
+// Resident memory (RSS) of the process in bytes, 0 if unknown. Reads
+// /proc/self/statm, so this only works on Linux.
+int64_t residentMemoryBytes();
+
+// A single "complete" event in the Chrome trace event format (phase "X").
+// The name must be a string literal (or otherwise outlive the tracer), because
+// only the pointer is stored. Up to two integer arguments can be attached,
+// e.g. the number of rows read.
+struct TraceEvent {
+  const char *name;
+  int64_t startUs;
+  int64_t durationUs;
+  const char *argNames[2];
+  int64_t argValues[2];
+};
+
+// Collects trace events of the processing pipeline and writes them as a
+// Chrome/Perfetto trace JSON (open it with chrome://tracing or
+// https://ui.perfetto.dev).
+// Every thread writes to its own fixed-size buffer, so recording an event
+// does not take any lock. The registry lock is only taken once per thread
+// (when the first event is recorded) and when writing the JSON.
+// When tracing is disabled, a trace point costs a single relaxed atomic load.
+class Tracer {
+public:
+  // There is only one tracer per process.
+  static Tracer &instance();
+
+  // Enable or disable tracing at runtime.
+  static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+  static void setEnabled(bool enabled);
+
+  // Microseconds on the common clock, see steadyClockUs().
+  static int64_t nowUs() { return steadyClockUs(); }
+
+  // Record a complete event for the calling thread.
+  void record(const char *name, int64_t startUs, int64_t durationUs,
+              const char *argName0 = nullptr, int64_t argValue0 = 0,
+              const char *argName1 = nullptr, int64_t argValue1 = 0);
+
+  // Write all events recorded so far as Chrome trace JSON. Can be called at any
+  // time (e.g. on demand while running), threads keep recording meanwhile.
+  // Returns false if the file could not be written.
+  bool writeJson(const std::string &fileName) const;
+
+  // Number of recorded / dropped events over all threads.
+  size_t getNumEvents() const;
+  size_t getNumDropped() const;
+
+  // Forget all recorded events. Must not be called while other threads are
+  // recording.
+  void clear();
+
+private:
+  Tracer() {}
+
+  // The per-thread event buffer. Only the owning thread writes events and
+  // bumps size, readers see all events up to size (release/acquire).
+  struct ThreadBuffer {
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<size_t> size{0};
+    std::atomic<size_t> dropped{0};
+    int threadId;
+  };
+
+  // Get (or register) the buffer of the calling thread.
+  ThreadBuffer *threadBuffer();
+
+  static std::atomic<bool> enabled_;
+
+  mutable std::mutex registryMutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+// RAII helper for tracing a scope, use it via the TRACE_SCOPE macro below.
+// The time is only taken if tracing is enabled when entering the scope.
+class ScopedTrace {
+public:
+  explicit ScopedTrace(const char *name)
+      : name_(Tracer::isEnabled() ? name : nullptr),
+        startUs_(name_ ? Tracer::nowUs() : 0) {}
+
+  ~ScopedTrace() {
+    if (name_)
+      Tracer::instance().record(name_, startUs_, Tracer::nowUs() - startUs_);
+  }
+
+  ScopedTrace(const ScopedTrace &) = delete;
+  ScopedTrace &operator=(const ScopedTrace &) = delete;
+
+private:
+  const char *name_;
+  int64_t startUs_;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// Trace the enclosing scope under the given name (a string literal).
+#define TRACE_SCOPE(name) ScopedTrace TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+// Timestamps (steadyClockUs()) of a batch of samples on its way from the file
+// to the screen. They are set by the DataModel and carried along with the
+// BalanceParameters through the dataUpdated signal to the OutputWindow.
+struct LatencyStamps {
+  // Right before the batch is read from the file.
+  int64_t readUs = 0;
+  // After the batch is read and converted to floats.
+  int64_t parsedUs = 0;
+  // After the balance parameters are calculated, right before the signal.
+  int64_t processedUs = 0;
+};
+
+// A histogram of latencies in microseconds in the style of HdrHistogram:
+// Buckets are linear within each power of two (see LATENCY_SUB_BUCKET_BITS),
+// so the relative error is bounded over the whole range while the memory is
+// fixed (a few kB). Recording is O(1) and never allocates.
+class LatencyHistogram {
+public:
+  LatencyHistogram() { reset(); }
+
+  // Record a single latency value in microseconds. Negative values are
+  // recorded as 0.
+  void record(int64_t valueUs);
+
+  void reset();
+
+  // Getters, all values in microseconds.
+  int64_t getCount() const { return count_; }
+  int64_t getMin() const { return count_ == 0 ? 0 : min_; }
+  int64_t getMax() const { return max_; }
+  double getMean() const;
+  double getStdDeviation() const;
+
+  // Value at the given percentile (0 to 100). Like HdrHistogram, this returns
+  // the highest value that is equivalent (i.e. in the same bucket) to the
+  // value at the percentile, but never more than the recorded maximum.
+  int64_t getPercentile(double percentile) const;
+
+  // Write the percentile distribution (in milliseconds) in the plain-text
+  // format of HdrHistogram (.hgrm), so the usual plotting tools work on it.
+  void writePercentileDistribution(std::ostream &out) const;
+
+  // Index of the bucket a value falls into and the value range of a bucket.
+  static int bucketIndex(int64_t valueUs);
+  static int64_t bucketLowestValue(int index);
+  static int64_t bucketHighestValue(int index);
+
+  static constexpr int kSubBucketCount = 1 << LATENCY_SUB_BUCKET_BITS;
+  static constexpr int kHalfSubBucketCount = kSubBucketCount / 2;
+  static constexpr int kNumBuckets =
+      kSubBucketCount +
+      (LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS) * kHalfSubBucketCount;
+
+private:
+  std::array<int64_t, kNumBuckets> counts_;
+  int64_t count_;
+  int64_t min_;
+  int64_t max_;
+  // For mean and standard deviation (exact, not from the buckets).
+  double sum_;
+  double sumOfSquares_;
+};
+
+// The latency histograms of the sample-to-pixel path. There is one monitor per
+// process, the stages are recorded by the OutputWindow once a frame with the
+// batch is on screen.
+class LatencyMonitor {
+public:
+  static LatencyMonitor &instance();
+
+  // Record all stages of a batch that has just been painted at paintedUs.
+  void recordFrame(const LatencyStamps &stamps, int64_t paintedUs);
+
+  void reset();
+
+  // Reading and converting the batch from the file.
+  const LatencyHistogram &getReadLatency() const { return read_; }
+  // Calculating the balance parameters.
+  const LatencyHistogram &getProcessLatency() const { return process_; }
+  // From the dataUpdated signal until the repaint finished.
+  const LatencyHistogram &getRenderLatency() const { return render_; }
+  // End-to-end: from reading the batch until it is on screen.
+  const LatencyHistogram &getSampleToPixelLatency() const {
+    return sampleToPixel_;
+  }
+
+  // Write a summary (p50/p99/max) and the full distributions of all stages.
+  // Returns false if the file could not be written.
+  bool writeReport(const std::string &fileName) const;
+
+private:
+  LatencyMonitor() {}
+
+  LatencyHistogram read_;
+  LatencyHistogram process_;
+  LatencyHistogram render_;
+  LatencyHistogram sampleToPixel_;
+};
+
+// Counts the calls of the global allocator (operator new), to check that the
+// playback loop does not allocate once it runs. Only with the debug build
+// flag -DFPF_COUNT_ALLOCATIONS, which replaces operator new and delete with
+// counting ones (see the Makefile), otherwise the count stays 0.
+class AllocationCounter {
+public:
+  static constexpr bool isEnabled() {
+#ifdef FPF_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Number of allocations since the start of the program (all threads).
+  static uint64_t count() { return count_.load(std::memory_order_relaxed); }
+
+  static void add() { count_.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+  static std::atomic<uint64_t> count_;
+};
+
+// Statistics of the timed playback loop (DataModel::process()), shown in the
+// performance HUD of the OutputWindow. All times in microseconds on the
+// steadyClockUs() clock.
+class PlaybackStats {
+public:
+  PlaybackStats() { reset(); }
+
+  void reset();
+
+  // Called at the beginning of every tick. A tick that comes later than 1.5
+  // timer intervals after the previous one means the timer could not keep up,
+  // the missed intervals are counted as dropped ticks.
+  void startTick(int64_t nowUs, int64_t intervalUs);
+
+  // Called at the end of every tick.
+  void finishTick(int64_t nowUs);
+
+  // Called whenever new data was processed. dataTime is the start time of the
+  // processed data in seconds. The lag is how far the reader is behind real
+  // time since the first call after a restart().
+  void updateLag(int64_t nowUs, float dataTime);
+
+  // Forget the reference point of the lag, e.g. after pausing.
+  void restart() { lagReferenceUs_ = -1; }
+
+  // Called when a tick had to wait for data to be read from the file.
+  void countIoStall() { ioStalls_++; }
+
+  // Number of corrupt cells of the file repaired so far.
+  void setCorruptCells(uint64_t numCells) { corruptCells_ = numCells; }
+
+  // Called with the number of allocations (see AllocationCounter) of the
+  // processing of a tick.
+  void countAllocations(uint64_t numAllocations) {
+    tickAllocations_ = numAllocations;
+    allocations_ += numAllocations;
+  }
+
+  // Getters.
+  int64_t getNumTicks() const { return numTicks_; }
+  int64_t getDroppedTicks() const { return droppedTicks_; }
+  int64_t getProcessDurationUs() const { return processDurationUs_; }
+  int64_t getMaxProcessDurationUs() const { return maxProcessDurationUs_; }
+  double getReaderLagMs() const { return readerLagMs_; }
+  int64_t getIoStalls() const { return ioStalls_; }
+  uint64_t getTickAllocations() const { return tickAllocations_; }
+  uint64_t getAllocations() const { return allocations_; }
+  uint64_t getCorruptCells() const { return corruptCells_; }
+
+private:
+  int64_t numTicks_;
+  int64_t droppedTicks_;
+  int64_t ioStalls_;
+  uint64_t tickAllocations_;
+  uint64_t allocations_;
+  uint64_t corruptCells_;
+  int64_t lastTickUs_;
+  int64_t processDurationUs_;
+  int64_t maxProcessDurationUs_;
+
+  // Wall clock and data time when the lag measurement started.
+  int64_t lagReferenceUs_;
+  float lagReferenceDataTime_;
+  double readerLagMs_;
+};
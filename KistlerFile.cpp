@@ -2,6 +2,13 @@
 // Author: Paul Soelder <p.soelder@mailbox.org>
 
 #include "./KistlerFile.h"
+#include "./Instrumentation.h"
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 
 // ____________________________________________________________________________
 KistlerCSVFile::KistlerCSVFile(const std::string &fileName)
@@ -16,12 +23,38 @@ KistlerCSVFile::KistlerCSVFile(const std::string &fileName)
   // Now we're ready for getting data
 }
 
+// ____________________________________________________________________________
+KistlerCSVFile::KistlerCSVFile(const KistlerCSVFile &other)
+    : KistlerFile(other), numCols_(other.numCols_), metaData_(other.metaData_),
+      compression_(other.compression_), gzipIndex_(other.gzipIndex_),
+      rowIndex_(other.rowIndex_), rowIndexTimes_(other.rowIndexTimes_),
+      rowIndexStride_(other.rowIndexStride_),
+      maxRowIndexSize_(other.maxRowIndexSize_),
+      uniformSampling_(other.uniformSampling_),
+      indexedRows_(other.indexedRows_), indexedBytes_(other.indexedBytes_),
+      hasPartialRow_(other.hasPartialRow_) {}
+
 // ____________________________________________________________________________
 void KistlerCSVFile::validateFile() {
-  std::ifstream file(fileName_);
+  TRACE_SCOPE("KistlerCSVFile::validateFile");
 
   isValid_ = true;
 
+  // (0) Compressed exports are decompressed while reading, only gzip for now.
+  compression_ = detectCompression(fileName_);
+  if (compression_ == Compression::Zstd) {
+    isValid_ = false;
+    std::cerr << "Error in KistlerCSVFile::validateFile(): zstd-compressed "
+                 "files are not supported, please use gzip: "
+              << fileName_ << std::endl;
+    return;
+  }
+  if (compression_ == Compression::Gzip && !gzipIndex_)
+    gzipIndex_ = std::make_shared<GzipIndex>();
+
+  auto stream = openFile();
+  std::istream &file = *stream;
+
   // (1) Check if file exists.
   if (!file) {
     isValid_ = false;
@@ -33,7 +66,7 @@ void KistlerCSVFile::validateFile() {
 
   // (1) Check if file is non-empty.
   // Thanks https://stackoverflow.com/a/2390938
-  if (file.peek() == std::ifstream::traits_type::eof()) {
+  if (file.peek() == std::istream::traits_type::eof()) {
     isValid_ = false;
     std::cerr << "Error in KistlerCSVFile::validateFile(): File is empty: "
               << fileName_ << std::endl;
@@ -70,12 +103,56 @@ void KistlerCSVFile::validateFile() {
   }
 }
 
+// ____________________________________________________________________________
+// The numbers in the fields of a header line, NaN for fields that are no
+// number. Empty fields (e.g. after a trailing tab) are skipped.
+static std::vector<float> parseFloats(const std::vector<std::string> &fields) {
+  std::vector<float> numbers;
+  for (const auto &field : fields) {
+    if (field.empty())
+      continue;
+    char *end = nullptr;
+    float number = std::strtof(field.c_str(), &end);
+    numbers.push_back(end != field.c_str()
+                          ? number
+                          : std::numeric_limits<float>::quiet_NaN());
+  }
+  return numbers;
+}
+
+// ____________________________________________________________________________
+// Same for integers, -1 for fields that are no number.
+static std::vector<long> parseIntegers(const std::vector<std::string> &fields) {
+  std::vector<long> numbers;
+  for (const auto &field : fields) {
+    if (field.empty())
+      continue;
+    char *end = nullptr;
+    long number = std::strtol(field.c_str(), &end, 10);
+    numbers.push_back(end != field.c_str() ? number : -1);
+  }
+  return numbers;
+}
+
+// ____________________________________________________________________________
+long KistlerMetaData::getNumSamples() const {
+  return samples.empty() ? -1 : samples[0];
+}
+
+// ____________________________________________________________________________
+bool KistlerMetaData::hasConsistentRates() const {
+  for (float rate : rates)
+    if (!(rate == rates[0]))
+      return false;
+  return true;
+}
+
 // ____________________________________________________________________________
 void KistlerCSVFile::parseMetaData() {
-  // Get the sample rate.
+  TRACE_SCOPE("KistlerCSVFile::parseMetaData");
 
-  // Get the column headers.
-  std::ifstream file(fileName_);
+  auto stream = openFile();
+  std::istream &file = *stream;
 
   if (!isValid_) {
     std::cerr << "Error in KistlerCSVFile::parseMetaData(): File does not "
@@ -84,66 +161,352 @@ void KistlerCSVFile::parseMetaData() {
     return;
   }
 
+  // One pass over the header. The version is in line 1, the fields in lines
+  // 2-17 start with their label, the column names are in line 18 and the
+  // units in line 19.
+  KistlerMetaData metaData;
   std::string line;
   std::getline(file, line);
+  std::vector<std::string> firstLine = sliceRow(line, '\t');
+  metaData.version = firstLine.empty() ? "" : firstLine[0];
 
-  // Sampling rates are in line 4.
-  for (int i = 0; i < 3; i++) {
+  for (int i = 0; i < 16; i++) {
     std::getline(file, line);
-  }
+    std::vector<std::string> fields = sliceRow(line, '\t'); // hard-coded
+    if (fields.empty())
+      continue;
+    std::string label = fields[0];
+    fields.erase(fields.begin());
 
-  std::vector<std::string> samplingRates_ =
-      sliceRow(line, '\t'); // hard-coded delimiter ...
+    if (label == "Device:") {
+      // BioWare puts a space before the device names.
+      for (const auto &field : fields) {
+        size_t begin = field.find_first_not_of(' ');
+        metaData.devices.push_back(
+            begin != std::string::npos ? field.substr(begin) : "");
+      }
+    } else if (label == "Samples (#):") {
+      metaData.samples = parseIntegers(fields);
+    } else if (label == "Rate (Hz):") {
+      metaData.rates = parseFloats(fields);
+    } else if (label == "Contact period start (sample #):") {
+      metaData.contactStart = parseIntegers(fields);
+    } else if (label == "Contact period end (sample #):") {
+      metaData.contactEnd = parseIntegers(fields);
+    } else if (label == "Contact period start time (s):") {
+      metaData.contactStartTime = parseFloats(fields);
+    } else if (label == "Contact period end time (s):") {
+      metaData.contactEndTime = parseFloats(fields);
+    } else if (label == "First sample time (s):") {
+      metaData.firstSampleTime = parseFloats(fields);
+    } else if (label == "Normalized force (N):") {
+      metaData.normalizedForce = parseFloats(fields);
+    } else if (label == "Normalized length (m):") {
+      metaData.normalizedLength = parseFloats(fields);
+    } else if (label == "Date" || label == "Name" || label == "ID" ||
+               label == "Classification" || label == "Description") {
+      metaData.fileInformation[label] = fields.empty() ? "" : fields[0];
+    }
+  }
 
-  if (!(samplingRates_[0] == "Rate (Hz):")) {
+  // The sampling rate is required. All channels are sampled at the same rate
+  // as far as we know, the first one is taken.
+  if (metaData.rates.empty()) {
     std::cerr << "Error in KistlerCSVFile::parseMetaData(): Could not "
                  "determine the sampling rate of the file, it does not appear "
                  "to be a valid BioWare file: "
               << fileName_ << std::endl;
     isValid_ = false;
     return;
-  } else {
-    // Assuming that the sampling rate is the same for each channel.
-    if (samplingRates_.size() > 1) {
-      float samplingRate;
-      try {
-        samplingRate = std::stof(samplingRates_[1]);
-      } catch (std::exception &e) {
-        // failed to parse sampling rate -> invalid file
-        isValid_ = false;
-        return;
+  }
+  if (!(metaData.rates[0] > 0)) {
+    std::cerr << "Error in KistlerCSVFile::parseMetaData(): Determined an "
+                 "invalid sampling rate of the file, it does not appear to "
+                 "be a valid BioWare file: "
+              << fileName_ << std::endl;
+    isValid_ = false;
+    return;
+  }
+  if (!metaData.hasConsistentRates()) {
+    qWarning() << "The channels of" << fileName_.c_str()
+               << "have different sampling rates, using the first one of"
+               << metaData.rates[0] << "Hz.";
+  }
+  samplingRate_ = metaData.rates[0];
+  qDebug() << "Detected sampling rate of" << samplingRate_ << "Hz.";
+
+  // The contact period (first and last sample with someone on the plate), if
+  // BioWare detected one. The samples are numbered from 0 like our rows.
+  contactStartRow_ = -1;
+  contactEndRow_ = -1;
+  if (!metaData.contactStart.empty() && !metaData.contactEnd.empty() &&
+      metaData.contactStart[0] >= 0 &&
+      metaData.contactEnd[0] >= metaData.contactStart[0]) {
+    contactStartRow_ = metaData.contactStart[0];
+    contactEndRow_ = metaData.contactEnd[0];
+  }
+
+  std::getline(file, line);
+  columnNames_ = sliceRow(line, '\t'); // hard-coded delimiter ...
+
+  numCols_ = columnNames_.size();
+
+  // The units in line 19, the data starts right after. That's the first
+  // entry of the row index.
+  std::getline(file, line);
+  metaData.units = sliceRow(line, '\t');
+  metaData_ = std::move(metaData);
+  rowIndex_.clear();
+  rowIndexTimes_.clear();
+  rowIndexStride_ = ROW_INDEX_STRIDE;
+  uniformSampling_ = true;
+  indexedRows_ = 0;
+  indexedBytes_ = file.tellg();
+  hasPartialRow_ = false;
+  if (indexedBytes_ >= 0)
+    rowIndex_.push_back(indexedBytes_);
+}
+
+// ____________________________________________________________________________
+void KistlerCSVFile::extendRowIndex(int row, float time) const {
+  // No index (invalid file).
+  if (rowIndex_.empty())
+    return;
+
+  // The time stamp of a new index entry is read right after it is added, so
+  // the text may span two blocks. Only at the end of the file (a row that is
+  // still being written) it stays missing until the next call, which resumes
+  // at that row.
+  bool readingTime = rowIndexTimes_.size() < rowIndex_.size();
+  std::string timeText;
+
+  auto isCovered = [&] {
+    return !readingTime &&
+           static_cast<int>(rowIndex_.size()) > row / rowIndexStride_ &&
+           (rowIndexTimes_.empty() || rowIndexTimes_.back() > time);
+  };
+  if (isCovered())
+    return;
+
+  TRACE_SCOPE("KistlerCSVFile::extendRowIndex");
+
+  auto stream = openFile(std::ios::binary);
+  std::istream &file = *stream;
+  file.seekg(indexedBytes_);
+
+  // Count the newlines block-wise, without looking at the rows.
+  std::vector<char> block(1 << 16);
+  std::streamoff blockOffset = indexedBytes_;
+  hasPartialRow_ = false;
+  while (!isCovered()) {
+    file.read(block.data(), block.size());
+    std::streamsize numBytes = file.gcount();
+    if (numBytes <= 0)
+      break;
+
+    const char *begin = block.data();
+    const char *end = begin + numBytes;
+    const char *position = begin;
+    while (position < end) {
+      if (readingTime) {
+        const char *delimiter = position;
+        while (delimiter < end && *delimiter != '\t' && *delimiter != '\n' &&
+               *delimiter != '\r')
+          delimiter++;
+        timeText.append(position, delimiter);
+        if (delimiter == end)
+          break;
+        addRowIndexTime(timeText);
+        readingTime = false;
+        if (rowIndex_.size() > maxRowIndexSize_)
+          coarsenRowIndex();
+        position = delimiter;
       }
 
-      if (samplingRate <= 0) {
-        std::cerr << "Error in KistlerCSVFile::parseMetaData(): Determined an "
-                     "invalid sampling rate of the file, it does not appear to "
-                     "be a valid BioWare file: "
-                  << fileName_ << std::endl;
-        isValid_ = false;
-        return;
+      const char *newline = static_cast<const char *>(
+          memchr(position, '\n', end - position));
+      if (newline == nullptr)
+        break;
+
+      indexedRows_++;
+      indexedBytes_ = blockOffset + (newline - begin) + 1;
+      if (indexedRows_ % rowIndexStride_ == 0) {
+        rowIndex_.push_back(indexedBytes_);
+        readingTime = true;
+        timeText.clear();
       }
-      samplingRate_ = samplingRate;
-      qDebug() << "Detected sampling rate of" << samplingRate_ << "Hz.";
-
-    } else {
-      std::cerr
-          << "Error in KistlerCSVFile::parseMetaData(): Could not "
-             "determine the sampling rate of the file, it does not appear "
-             "to be a valid BioWare file: "
-          << fileName_ << std::endl;
-      isValid_ = false;
-      return;
+      position = newline + 1;
     }
+    blockOffset += numBytes;
   }
 
-  // Column headers are in line 18 (4 already read for the sampling rate).
-  for (int i = 0; i < 14; i++) {
-    std::getline(file, line);
+  // Something left after the last newline is a row that is still being
+  // written (or a last row without newline).
+  hasPartialRow_ = blockOffset > indexedBytes_ && file.eof();
+}
+
+// ____________________________________________________________________________
+void KistlerCSVFile::addRowIndexTime(const std::string &timeText) const {
+  char *end = nullptr;
+  float time = std::strtof(timeText.c_str(), &end);
+  // Not a number, it sorts after everything.
+  if (end == timeText.c_str())
+    time = std::numeric_limits<float>::infinity();
+
+  // Compare with the time expected from the first row and the sampling rate.
+  if (!rowIndexTimes_.empty()) {
+    float expected = rowIndexTimes_.front() +
+                     rowIndexTimes_.size() * rowIndexStride_ / samplingRate_;
+    if (!(std::abs(time - expected) <= 0.25f / samplingRate_))
+      uniformSampling_ = false;
   }
+  rowIndexTimes_.push_back(time);
+}
 
-  columnNames_ = sliceRow(line, '\t'); // hard-coded delimiter ...
+// ____________________________________________________________________________
+void KistlerCSVFile::coarsenRowIndex() const {
+  // Entry k of the new index is entry 2k of the old one.
+  for (size_t k = 1; 2 * k < rowIndex_.size(); k++) {
+    rowIndex_[k] = rowIndex_[2 * k];
+    rowIndexTimes_[k] = rowIndexTimes_[2 * k];
+  }
+  rowIndex_.resize((rowIndex_.size() + 1) / 2);
+  rowIndexTimes_.resize(rowIndex_.size());
+  rowIndexStride_ *= 2;
+}
 
-  numCols_ = columnNames_.size();
+// ____________________________________________________________________________
+int KistlerCSVFile::getNumRows() const {
+  if (rowIndex_.empty())
+    return 0;
+
+  // Scan until the end of the file.
+  extendRowIndex(std::numeric_limits<int>::max());
+  return indexedRows_ + hasPartialRow_;
+}
+
+// ____________________________________________________________________________
+int KistlerCSVFile::findRow(float threshold) const {
+  if (rowIndex_.empty())
+    return 0;
+
+  // Index until the first time stamp >= threshold (or the end).
+  extendRowIndex(0, threshold);
+  if (rowIndexTimes_.empty() || threshold <= rowIndexTimes_.front())
+    return 0;
+
+  // Uniform sampling: no lookup needed up to the last indexed row, which is
+  // where the sampling was verified.
+  int lastIndexedRow = (rowIndexTimes_.size() - 1) * rowIndexStride_;
+  if (uniformSampling_) {
+    int row = std::ceil((threshold - rowIndexTimes_.front()) * samplingRate_);
+    if (row <= lastIndexedRow)
+      return row;
+  }
+
+  // The last indexed row before the threshold, then read on from there.
+  size_t checkpoint = std::lower_bound(rowIndexTimes_.begin(),
+                                       rowIndexTimes_.end(), threshold) -
+                      rowIndexTimes_.begin() - 1;
+
+  std::istream &file = reader();
+  file.seekg(rowIndex_[checkpoint]);
+  int row = checkpoint * rowIndexStride_;
+  while (std::getline(file, line_)) {
+    char *end = nullptr;
+    float time = std::strtof(line_.c_str(), &end);
+    if (end != line_.c_str() && time >= threshold)
+      return row;
+    row++;
+  }
+  return row;
+}
+
+// ____________________________________________________________________________
+int KistlerCSVFile::getRowAtTime(float time) const {
+  return findRow(time - 0.25f / samplingRate_);
+}
+
+// ____________________________________________________________________________
+int KistlerCSVFile::getRowAfterTime(float time) const {
+  return findRow(time + 0.25f / samplingRate_);
+}
+
+// ____________________________________________________________________________
+float KistlerCSVFile::getTimeOfRow(int row) const {
+  const float infinity = std::numeric_limits<float>::infinity();
+  if (rowIndex_.empty() || row < 0)
+    return infinity;
+
+  extendRowIndex(row);
+  if (rowIndexTimes_.empty())
+    return infinity;
+
+  int lastIndexedRow = (rowIndexTimes_.size() - 1) * rowIndexStride_;
+  if (uniformSampling_ && row <= lastIndexedRow)
+    return rowIndexTimes_.front() + row / samplingRate_;
+
+  std::istream &file = reader();
+  seekToRow(file, row);
+  if (!std::getline(file, line_))
+    return infinity;
+
+  char *end = nullptr;
+  float time = std::strtof(line_.c_str(), &end);
+  return end != line_.c_str() ? time : infinity;
+}
+
+// ____________________________________________________________________________
+const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+KistlerCSVFile::getDataByTime(float startTime, float stopTime) const {
+  TRACE_SCOPE("KistlerCSVFile::getDataByTime");
+
+  int startRow = getRowAtTime(startTime);
+  int stopRow = getRowAfterTime(stopTime) - 1;
+
+  if (stopRow < startRow) {
+    auto data = std::make_shared<
+        std::unordered_map<std::string, std::vector<float>>>();
+    for (const auto &column : columnNames_)
+      (*data)[column] = std::vector<float>();
+    return data;
+  }
+
+  return getData(startRow, stopRow);
+}
+
+// ____________________________________________________________________________
+int KistlerCSVFile::seekToRow(std::istream &file, int row) const {
+  // No index, skip the header and all rows before.
+  if (rowIndex_.empty()) {
+    file.seekg(0);
+    for (int i = 0; i < 19 + row; i++)
+      std::getline(file, line_);
+    return 19 + row;
+  }
+
+  extendRowIndex(row);
+
+  // The closest checkpoint before the row (the index may end before it if the
+  // file is shorter).
+  size_t checkpoint =
+      std::min<size_t>(row / rowIndexStride_, rowIndex_.size() - 1);
+  file.seekg(rowIndex_[checkpoint]);
+
+  int numSkipped = row - checkpoint * rowIndexStride_;
+  for (int i = 0; i < numSkipped; i++)
+    std::getline(file, line_);
+  return numSkipped;
+}
+
+// ____________________________________________________________________________
+std::unique_ptr<std::istream>
+KistlerCSVFile::openFile(std::ios::openmode mode) const {
+  // The gzip stream is always binary, the text mode makes no difference on
+  // Linux anyways.
+  if (compression_ == Compression::Gzip)
+    return std::make_unique<GzipInputStream>(fileName_, gzipIndex_);
+  return std::make_unique<std::ifstream>(fileName_, mode | std::ios::in);
 }
 
 // ____________________________________________________________________________
@@ -173,6 +536,153 @@ std::vector<std::string> KistlerCSVFile::sliceRow(std::string line,
 // ____________________________________________________________________________
 const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
 KistlerCSVFile::getData(int startRow, int stopRow) const {
+  TRACE_SCOPE("KistlerCSVFile::getData");
+
+  auto data =
+      std::make_shared<std::unordered_map<std::string, std::vector<float>>>();
+
+  for (const auto &column : columnNames_) {
+    (*data)[column] = std::vector<float>();
+  }
+
+  // We can reserve some memory in advance to avoid multiple allocations.
+  // Reading to the end, the number of samples in the header tells how many
+  // rows are left (at most one per two bytes per column, in case the header
+  // is off).
+  long numReserved = 0;
+  if (stopRow != -1) {
+    numReserved = stopRow - std::max(startRow, 0) + 1;
+  } else if (metaData_.getNumSamples() > 0) {
+    long numSamples = metaData_.getNumSamples() - std::max(startRow, 0);
+    if (compression_ == Compression::None && !rowIndex_.empty()) {
+      std::ifstream sizeFile(fileName_, std::ios::binary | std::ios::ate);
+      long maxRows = (static_cast<long>(sizeFile.tellg()) - rowIndex_[0]) /
+                     (2 * std::max(numCols_, 1));
+      numSamples = std::min(numSamples, maxRows);
+    }
+    numReserved = numSamples;
+  }
+  if (numReserved > 0) {
+    for (auto &column : *data) {
+      column.second.reserve(numReserved);
+    }
+  }
+
+  readRows(startRow, stopRow, data.get());
+  return data;
+}
+
+// ____________________________________________________________________________
+// Convert the field at position and move position to the next field. False if
+// the field is no number.
+static inline bool parseField(const char **position, float *value) {
+  // strtof skips leading whitespace, which includes the tab of an empty field,
+  // so the field must not contain one before the number.
+  char *end = nullptr;
+  errno = 0;
+  *value = std::strtof(*position, &end);
+  bool isNumber = end != *position && errno != ERANGE &&
+                  memchr(*position, '\t', end - *position) == nullptr;
+
+  // Whatever follows the number in the field is ignored (like std::stof
+  // did).
+  const char *fieldEnd = isNumber ? end : *position;
+  const char *delimiter = std::strchr(fieldEnd, '\t');
+  *position =
+      delimiter != nullptr ? delimiter + 1 : fieldEnd + std::strlen(fieldEnd);
+  return isNumber;
+}
+
+// ____________________________________________________________________________
+void CorruptDataReport::add(int row, int column) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // The ranges of the column before and after the row, skip the cell if it's
+  // in the one before, and join the ones it touches.
+  auto next = ranges_.upper_bound({column, row});
+  auto prev = next != ranges_.begin() ? std::prev(next) : ranges_.end();
+  bool hasPrev = prev != ranges_.end() && prev->first.first == column;
+  if (hasPrev && prev->second >= row)
+    return;
+  bool joinsPrev = hasPrev && prev->second == row - 1;
+  bool joinsNext = next != ranges_.end() && next->first.first == column &&
+                   next->first.second == row + 1;
+  int last = joinsNext ? next->second : row;
+  if (joinsNext)
+    next = ranges_.erase(next);
+  if (joinsPrev)
+    prev->second = last;
+  else
+    ranges_.emplace_hint(next, std::make_pair(column, row), last);
+  if (cells_.size() < CORRUPT_REPORT_MAX_CELLS)
+    cells_.push_back({row, column});
+  numCells_++;
+}
+
+// ____________________________________________________________________________
+void CorruptDataReport::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cells_.clear();
+  numCells_ = 0;
+  ranges_.clear();
+}
+
+// ____________________________________________________________________________
+uint64_t CorruptDataReport::getNumCells() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return numCells_;
+}
+
+// ____________________________________________________________________________
+std::vector<CorruptCell> CorruptDataReport::getCells() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cells_;
+}
+
+// ____________________________________________________________________________
+std::string CorruptDataReport::getSummary() const {
+  std::vector<CorruptCell> cells = getCells();
+  std::vector<int> rows;
+  for (const auto &cell : cells)
+    rows.push_back(cell.row);
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+  uint64_t numCells = getNumCells();
+  std::string summary = std::to_string(numCells) + " corrupt cell" +
+                        (numCells == 1 ? "" : "s");
+  if (rows.empty())
+    return summary;
+
+  summary += rows.size() == 1 ? " in row " : " in rows ";
+  for (size_t i = 0; i < rows.size();) {
+    size_t last = i;
+    while (last + 1 < rows.size() && rows[last + 1] == rows[last] + 1)
+      last++;
+    if (i > 0)
+      summary += ", ";
+    summary += std::to_string(rows[i]);
+    if (last > i)
+      summary += "-" + std::to_string(rows[last]);
+    i = last + 1;
+  }
+  if (numCells > cells.size())
+    summary += ", ...";
+  return summary;
+}
+
+// ____________________________________________________________________________
+std::istream &KistlerCSVFile::reader() const {
+  if (!reader_)
+    reader_ = openFile(std::ios::binary);
+  // Forget the EOF of the last read, the file may have grown since.
+  reader_->clear();
+  return *reader_;
+}
+
+// ____________________________________________________________________________
+int KistlerCSVFile::readRows(
+    int startRow, int stopRow,
+    std::unordered_map<std::string, std::vector<float>> *data) const {
   // Check for invalid row indices.
   if (stopRow < startRow && stopRow != -1) {
     std::cerr << "Error in KistlerCSVFile::getData(): Invalid row indices "
@@ -182,32 +692,32 @@ KistlerCSVFile::getData(int startRow, int stopRow) const {
     exit(EXIT_FAILURE); // replace with exception handling
   }
 
-  auto data =
-      std::make_shared<std::unordered_map<std::string, std::vector<float>>>();
+  // Look up the columns once, not for every value.
+  targetColumns_.clear();
+  for (const auto &column : columnNames_)
+    targetColumns_.push_back(&(*data)[column]);
 
-  for (const auto &column : columnNames_) {
-    (*data)[column] = std::vector<float>();
-  }
+  int64_t traceStartUs = Tracer::isEnabled() ? Tracer::nowUs() : 0;
 
-  std::ifstream file(fileName_);
-  std::string line;
-  std::getline(file, line);
+  std::istream &file = reader();
 
-  // Data starts at line 20.
-  for (int i = 0; i < 18; i++) {
-    std::getline(file, line);
+  if (Tracer::isEnabled()) {
+    int64_t nowUs = Tracer::nowUs();
+    Tracer::instance().record("KistlerCSVFile::open", traceStartUs,
+                              nowUs - traceStartUs);
+    traceStartUs = nowUs;
   }
 
-  // Take care of startRow.
-  if (startRow != -1) {
-    for (int i = 0; i < startRow; i++) {
-      std::getline(file, line);
-    }
-  }
+  // Data starts at line 20, jump to startRow via the row index.
+  int skippedLines = seekToRow(file, startRow != -1 ? startRow : 0);
 
-  // Note: This is a big performance limitation, as the number of I/O operations
-  // increase linearly with application runtime. We will have to think about
-  // buffering or using byte-wise access with istream::seekg().
+  if (Tracer::isEnabled()) {
+    int64_t nowUs = Tracer::nowUs();
+    Tracer::instance().record("KistlerCSVFile::skipRows", traceStartUs,
+                              nowUs - traceStartUs, "skippedLines",
+                              skippedLines);
+    traceStartUs = nowUs;
+  }
 
   // Take care of stopRow.
   int nRows;
@@ -219,43 +729,934 @@ KistlerCSVFile::getData(int startRow, int stopRow) const {
     nRows = -1; // indicator to read until EOF in the loop below.
   }
 
-  // We can reserve some memory in advance to avoid multiple allocations.
-  if (nRows != -1) {
-    for (auto &column : *data) {
-      column.second.reserve(nRows);
+  // Row number of the first row read, for the report.
+  int firstRow = startRow != -1 ? startRow : 0;
+
+  // Read nRows lines (or until EOF for nRows == -1).
+  // The fields are converted right in the line buffer, which is reused for
+  // all rows, so a row costs no allocation (except for growing the columns).
+  // Corrupt cells are handled after the row, so the loop over the fields has
+  // no exceptions in it.
+  // When tracing, the time spent reading and converting is summed up over all
+  // rows and attached to a single "parse" event, one event per row would
+  // flood the trace buffer.
+  bool tracing = Tracer::isEnabled();
+  int64_t readUs = 0;
+  int64_t convertUs = 0;
+
+  int i = 0;
+  for (; nRows == -1 || i < nRows; i++) {
+    int64_t t0 = tracing ? Tracer::nowUs() : 0;
+
+    if (!std::getline(file, line_)) {
+      qDebug() << "KistlerCSVFile::getData(int, int): reached EOF";
+      break;
+    }
+
+    int64_t t1 = tracing ? Tracer::nowUs() : 0;
+
+    // A cell that is no number gets a 0 for now, the policy decides what
+    // happens to it after the row.
+    const char *position = line_.c_str();
+    bool isCorrupt = false;
+    for (size_t j = 0; j < targetColumns_.size(); j++) {
+      float value;
+      if (!parseField(&position, &value)) {
+        isCorrupt = true;
+        value = 0;
+        corruptDataReport_->add(firstRow + i, j);
+        if (corruptDataPolicy_ == CorruptDataPolicy::Interpolate)
+          repairs_.emplace_back(targetColumns_[j]->size(), j);
+      }
+      targetColumns_[j]->push_back(value);
+    }
+
+    if (isCorrupt && corruptDataPolicy_ != CorruptDataPolicy::Interpolate) {
+      for (auto *column : targetColumns_)
+        column->pop_back();
+      if (corruptDataPolicy_ == CorruptDataPolicy::Abort) {
+        repairs_.clear();
+        throw CorruptKistlerFileException(
+            "Error in KistlerCSVFile::getData(): Cannot convert string to "
+            "float in row " +
+            std::to_string(firstRow + i) +
+            ". Seems like the data is corrupt.");
+      }
+    }
+
+    if (tracing) {
+      readUs += t1 - t0;
+      convertUs += Tracer::nowUs() - t1;
     }
   }
 
-  // Read nRows lines.
-  bool done = false;
-  int i = 0;
-  do {
-    // Continue if we have not reached nRows yet OR we should read until EOF
-    // (nRows == -1).
-    if ((nRows != -1 && i < nRows) || nRows == -1) {
-      if (!std::getline(file, line)) {
-        qDebug() << "KistlerCSVFile::getData(int, int): reached EOF";
-        // reached EOF.
-        done = true;
+  if (!repairs_.empty())
+    repairCells();
+
+  if (tracing) {
+    Tracer::instance().record("KistlerCSVFile::parse", traceStartUs,
+                              Tracer::nowUs() - traceStartUs, "readUs", readUs,
+                              "convertUs", convertUs);
+  }
+
+  return i;
+}
+
+// ____________________________________________________________________________
+void KistlerCSVFile::repairCells() const {
+  // The cells were added row by row, so per column they are in order.
+  for (size_t j = 0; j < targetColumns_.size(); j++) {
+    std::vector<float> &column = *targetColumns_[j];
+    for (size_t k = 0; k < repairs_.size(); k++) {
+      if (repairs_[k].second != j)
+        continue;
+
+      // A run of corrupt cells in a row of the column, from first to last.
+      size_t first = repairs_[k].first;
+      size_t last = first;
+      size_t next = k + 1;
+      while (true) {
+        while (next < repairs_.size() && repairs_[next].second != j)
+          next++;
+        if (next == repairs_.size() || repairs_[next].first != last + 1)
+          break;
+        last = repairs_[next].first;
+        next++;
+      }
+      k = next - 1;
+
+      // Between the valid neighbours, or held if there is only one (0 if
+      // there is none).
+      bool hasBefore = first > 0;
+      bool hasAfter = last + 1 < column.size();
+      float before = hasBefore ? column[first - 1] : 0;
+      float after = hasAfter ? column[last + 1] : 0;
+      if (!hasBefore)
+        before = after;
+      if (!hasAfter)
+        after = before;
+      for (size_t index = first; index <= last; index++) {
+        float weight =
+            static_cast<float>(index - first + 1) / (last - first + 2);
+        column[index] = before + weight * (after - before);
+      }
+    }
+  }
+  repairs_.clear();
+}
+
+// Powers of ten for the decimal encoding of the archive and their inverses.
+static const double kPowersOfTen[ARCHIVE_MAX_DECIMALS + 1] = {
+    1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7};
+static const double kInversePowersOfTen[ARCHIVE_MAX_DECIMALS + 1] = {
+    1, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7};
+
+// ____________________________________________________________________________
+// Append the bytes of a value to the buffer (the archive is little endian,
+// like all platforms we run on).
+template <typename T> static void appendValue(std::string *buffer, T value) {
+  buffer->append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// ____________________________________________________________________________
+// Read a value and move data after it, false if it would end after the end.
+template <typename T>
+static bool readValue(const unsigned char **data, const unsigned char *end,
+                      T *value) {
+  if (end - *data < static_cast<std::ptrdiff_t>(sizeof(T)))
+    return false;
+  std::memcpy(value, *data, sizeof(T));
+  *data += sizeof(T);
+  return true;
+}
+
+// ____________________________________________________________________________
+// A value of the decimal encoding. The encoder checks with this very function
+// if a value is represented exactly.
+static inline float decimalToFloat(int64_t integer, int decimals) {
+  return static_cast<float>(static_cast<double>(integer) *
+                            kInversePowersOfTen[decimals]);
+}
+
+// ____________________________________________________________________________
+// Number of bits needed for a value.
+static inline int bitWidth(uint32_t value) {
+  return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+// ____________________________________________________________________________
+// Append count values with the given bit width to the buffer (LSB first).
+static void packFrame(const uint32_t *values, int count, int width,
+                      std::string *buffer) {
+  size_t start = buffer->size();
+  buffer->resize(start + (static_cast<size_t>(count) * width + 7) / 8, '\0');
+  unsigned char *out = reinterpret_cast<unsigned char *>(&(*buffer)[start]);
+
+  uint64_t accumulator = 0;
+  int numBits = 0;
+  for (int i = 0; i < count; i++) {
+    accumulator |= static_cast<uint64_t>(values[i]) << numBits;
+    numBits += width;
+    while (numBits >= 8) {
+      *out++ = static_cast<unsigned char>(accumulator);
+      accumulator >>= 8;
+      numBits -= 8;
+    }
+  }
+  if (numBits > 0)
+    *out = static_cast<unsigned char>(accumulator);
+}
+
+// ____________________________________________________________________________
+// Unpack count values with the given bit width. Every value is one unaligned
+// 8 byte load, a shift and a mask, so there must be 8 readable bytes after
+// the packed bits.
+static void unpackFrame(const unsigned char *data, int count, int width,
+                        uint32_t *values) {
+  uint64_t mask = (static_cast<uint64_t>(1) << width) - 1;
+  for (int i = 0; i < count; i++) {
+    size_t bit = static_cast<size_t>(i) * width;
+    uint64_t word;
+    std::memcpy(&word, data + bit / 8, sizeof(word));
+    values[i] = static_cast<uint32_t>((word >> (bit % 8)) & mask);
+  }
+}
+
+// ____________________________________________________________________________
+// Append a full frame with the given bit width to the buffer. Value j is in
+// lane j % ARCHIVE_FRAME_LANES, the values of a lane are packed LSB first
+// into width words, and word w of lane l is the word w * ARCHIVE_FRAME_LANES
+// + l.
+static void packLanes(const uint32_t *values, int width, std::string *buffer) {
+  uint32_t words[ARCHIVE_FRAME_VALUES] = {0};
+  for (int j = 0; j < ARCHIVE_FRAME_VALUES; j++) {
+    int bit = j / ARCHIVE_FRAME_LANES * width;
+    int word = bit / 32 * ARCHIVE_FRAME_LANES + j % ARCHIVE_FRAME_LANES;
+    words[word] |= values[j] << (bit % 32);
+    if (bit % 32 + width > 32)
+      words[word + ARCHIVE_FRAME_LANES] |= values[j] >> (32 - bit % 32);
+  }
+  buffer->append(reinterpret_cast<const char *>(words),
+                 ARCHIVE_FRAME_LANES * width * sizeof(uint32_t));
+}
+
+// ____________________________________________________________________________
+// Unpack a full frame packed by packLanes(). The bit width is fixed, so all
+// shifts are constants and the same for all lanes.
+template <int Width>
+static void unpackLanes(const unsigned char *data, uint32_t *values) {
+  if constexpr (Width == 0) {
+    std::fill(values, values + ARCHIVE_FRAME_VALUES, 0);
+  } else {
+    const uint32_t mask = Width == 32 ? ~0u : (1u << Width) - 1;
+    uint32_t words[ARCHIVE_FRAME_LANES * Width];
+    std::memcpy(words, data, sizeof(words));
+    for (int k = 0; k < ARCHIVE_FRAME_VALUES / ARCHIVE_FRAME_LANES; k++) {
+      const int bit = k * Width;
+      const int word = bit / 32 * ARCHIVE_FRAME_LANES;
+      const int shift = bit % 32;
+      uint32_t *lanes = values + k * ARCHIVE_FRAME_LANES;
+      for (int l = 0; l < ARCHIVE_FRAME_LANES; l++)
+        lanes[l] = words[word + l] >> shift;
+      if (shift + Width > 32) {
+        for (int l = 0; l < ARCHIVE_FRAME_LANES; l++)
+          lanes[l] |= words[word + ARCHIVE_FRAME_LANES + l] << (32 - shift);
+      }
+      for (int l = 0; l < ARCHIVE_FRAME_LANES; l++)
+        lanes[l] &= mask;
+    }
+  }
+}
+
+// unpackLanes() for every bit width from 0 to 32.
+template <int... Widths>
+static constexpr std::array<void (*)(const unsigned char *, uint32_t *),
+                            sizeof...(Widths)>
+makeUnpackLanes(std::integer_sequence<int, Widths...>) {
+  return {&unpackLanes<Widths>...};
+}
+static constexpr auto kUnpackLanes =
+    makeUnpackLanes(std::make_integer_sequence<int, 33>());
+
+// ____________________________________________________________________________
+// Pack the residuals of a frame, in lanes if it's a full one.
+static void packResiduals(const uint32_t *residuals, int count, int width,
+                          std::string *buffer) {
+  if (count == ARCHIVE_FRAME_VALUES)
+    packLanes(residuals, width, buffer);
+  else
+    packFrame(residuals, count, width, buffer);
+}
+
+// ____________________________________________________________________________
+// Unpack the residuals of a frame (see packResiduals()) and move data after
+// them. Returns false if they would end after the end.
+static bool unpackResiduals(const unsigned char **data,
+                            const unsigned char *end, int count, int width,
+                            uint32_t *residuals) {
+  size_t numBytes = count == ARCHIVE_FRAME_VALUES
+                        ? ARCHIVE_FRAME_LANES * width * sizeof(uint32_t)
+                        : (static_cast<size_t>(count) * width + 7) / 8;
+  if (static_cast<size_t>(end - *data) < numBytes)
+    return false;
+  if (count == ARCHIVE_FRAME_VALUES)
+    kUnpackLanes[width](*data, residuals);
+  else
+    unpackFrame(*data, count, width, residuals);
+  *data += numBytes;
+  return true;
+}
+
+// ____________________________________________________________________________
+// Write the running sum (or XOR, depending on op) of the residuals of a frame
+// to values, the ARCHIVE_FRAME_LANES values before values are the ones before
+// the frame. The residuals of a full frame are to the value
+// ARCHIVE_FRAME_LANES before, so the lanes don't depend on each other and the
+// sum vectorizes.
+template <typename Op>
+static void accumulateFrame(const uint32_t *residuals, int count, Op op,
+                            uint32_t *values) {
+  if (count == ARCHIVE_FRAME_VALUES) {
+    for (int j = 0; j < ARCHIVE_FRAME_VALUES; j++)
+      values[j] = op(values[j - ARCHIVE_FRAME_LANES], residuals[j]);
+  } else {
+    for (int j = 0; j < count; j++)
+      values[j] = op(values[j - 1], residuals[j]);
+  }
+}
+
+// ____________________________________________________________________________
+// The values of the decimal encoding, like decimalToFloat().
+static inline void decimalsToFloats(const uint32_t *integers, int count,
+                                    double scale, float *values) {
+  for (int j = 0; j < count; j++) {
+    values[j] = static_cast<float>(
+        static_cast<double>(static_cast<int32_t>(integers[j])) * scale);
+  }
+}
+
+// ____________________________________________________________________________
+KistlerArchiveFile::KistlerArchiveFile(const std::string &fileName)
+    : KistlerFile(fileName) {
+  validateFile();
+}
+
+// ____________________________________________________________________________
+void KistlerArchiveFile::validateFile() {
+  TRACE_SCOPE("KistlerArchiveFile::validateFile");
+
+  isValid_ = false;
+  blocks_.clear();
+  columnNames_.clear();
+  numRows_ = 0;
+  timeColumn_ = -1;
+  reader_.reset();
+  cachedBlock_ = -1;
+  cachedRows_.clear();
+
+  std::ifstream file(fileName_, std::ios::binary);
+  if (!file) {
+    std::cerr << "Error in KistlerArchiveFile::validateFile(): No such file or "
+                 "directory: "
+              << fileName_ << std::endl;
+    return;
+  }
+
+  auto readBytes = [&file](void *data, size_t size) {
+    file.read(static_cast<char *>(data), size);
+    return static_cast<bool>(file);
+  };
+  auto invalid = [this]() {
+    std::cerr << "Error in KistlerArchiveFile::validateFile(): File does not "
+                 "appear to be a valid archive: "
+              << fileName_ << std::endl;
+  };
+
+  // The header: magic number, sampling rate and column names.
+  char magic[8];
+  uint32_t numColumns;
+  if (!readBytes(magic, sizeof(magic)) ||
+      std::memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)) != 0 ||
+      !readBytes(&samplingRate_, sizeof(samplingRate_)) ||
+      !readBytes(&numColumns, sizeof(numColumns)) || numColumns > 1024) {
+    invalid();
+    return;
+  }
+  for (uint32_t i = 0; i < numColumns; i++) {
+    uint16_t length;
+    std::string name;
+    if (!readBytes(&length, sizeof(length))) {
+      invalid();
+      return;
+    }
+    name.resize(length);
+    if (!readBytes(&name[0], length)) {
+      invalid();
+      return;
+    }
+    if (name == "abs time (s)")
+      timeColumn_ = i;
+    columnNames_.push_back(name);
+  }
+  std::streamoff headerEnd = file.tellg();
+
+  // The trailer: offset of the index and the magic number again.
+  int64_t indexOffset;
+  file.seekg(-static_cast<std::streamoff>(sizeof(indexOffset) + 8),
+             std::ios::end);
+  std::streamoff trailerStart = file.tellg();
+  if (!readBytes(&indexOffset, sizeof(indexOffset)) ||
+      !readBytes(magic, sizeof(magic)) ||
+      std::memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)) != 0 ||
+      indexOffset < headerEnd || indexOffset > trailerStart) {
+    invalid();
+    return;
+  }
+
+  // The index with the statistics of all blocks.
+  file.seekg(indexOffset);
+  uint32_t numBlocks;
+  if (!readBytes(&numBlocks, sizeof(numBlocks))) {
+    invalid();
+    return;
+  }
+  for (uint32_t i = 0; i < numBlocks; i++) {
+    KistlerArchiveBlock block;
+    int32_t numBytes, firstRow, numRows;
+    block.min.resize(numColumns);
+    block.max.resize(numColumns);
+    bool ok = readBytes(&block.offset, sizeof(block.offset)) &&
+              readBytes(&numBytes, sizeof(numBytes)) &&
+              readBytes(&firstRow, sizeof(firstRow)) &&
+              readBytes(&numRows, sizeof(numRows)) &&
+              readBytes(&block.firstTime, sizeof(block.firstTime)) &&
+              readBytes(&block.lastTime, sizeof(block.lastTime));
+    for (uint32_t c = 0; ok && c < numColumns; c++) {
+      ok = readBytes(&block.min[c], sizeof(float)) &&
+           readBytes(&block.max[c], sizeof(float));
+    }
+    if (!ok || numBytes < 0 || numRows <= 0 || firstRow != numRows_ ||
+        block.offset < headerEnd || block.offset + numBytes > indexOffset) {
+      invalid();
+      return;
+    }
+    block.numBytes = numBytes;
+    block.firstRow = firstRow;
+    block.numRows = numRows;
+    numRows_ += numRows;
+    blocks_.push_back(std::move(block));
+  }
+
+  isValid_ = true;
+}
+
+// ____________________________________________________________________________
+std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+KistlerArchiveFile::makeData() const {
+  auto data =
+      std::make_shared<std::unordered_map<std::string, std::vector<float>>>();
+  for (const auto &column : columnNames_)
+    (*data)[column] = std::vector<float>();
+  return data;
+}
+
+// ____________________________________________________________________________
+const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+KistlerArchiveFile::getData(int startRow, int stopRow) const {
+  TRACE_SCOPE("KistlerArchiveFile::getData");
+
+  auto data = makeData();
+  if (!isValid_)
+    return data;
+
+  startRow = std::max(startRow, 0);
+  if (stopRow < 0 || stopRow >= numRows_)
+    stopRow = numRows_ - 1;
+  if (stopRow < startRow)
+    return data;
+
+  for (auto &column : *data)
+    column.second.reserve(stopRow - startRow + 1);
+
+  // The block with the start row, then until the stop row.
+  std::ifstream file(fileName_, std::ios::binary);
+  for (size_t block = findBlock(startRow);
+       block < blocks_.size() && blocks_[block].firstRow <= stopRow; block++) {
+    const auto &info = blocks_[block];
+    int fromRow = std::max(startRow - info.firstRow, 0);
+    int toRow = std::min(stopRow - info.firstRow + 1, info.numRows);
+    decodeBlock(file, block, fromRow, toRow, data.get());
+  }
+
+  return data;
+}
+
+// ____________________________________________________________________________
+int KistlerArchiveFile::readRows(
+    int startRow, int stopRow,
+    std::unordered_map<std::string, std::vector<float>> *data) const {
+  TRACE_SCOPE("KistlerArchiveFile::readRows");
+
+  for (const auto &column : columnNames_)
+    (*data)[column];
+  if (!isValid_)
+    return 0;
+
+  startRow = std::max(startRow, 0);
+  if (stopRow < 0 || stopRow >= numRows_)
+    stopRow = numRows_ - 1;
+  if (stopRow < startRow)
+    return 0;
+
+  // Copy the rows out of the decoded blocks.
+  for (size_t block = findBlock(startRow);
+       block < blocks_.size() && blocks_[block].firstRow <= stopRow; block++) {
+    const auto &info = blocks_[block];
+    int fromRow = std::max(startRow - info.firstRow, 0);
+    int toRow = std::min(stopRow - info.firstRow + 1, info.numRows);
+    for (const auto &column : getBlock(block)) {
+      auto &result = (*data)[column.first];
+      result.insert(result.end(), column.second.begin() + fromRow,
+                    column.second.begin() + toRow);
+    }
+  }
+
+  return stopRow - startRow + 1;
+}
+
+// ____________________________________________________________________________
+const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+KistlerArchiveFile::getDataByTime(float startTime, float stopTime) const {
+  TRACE_SCOPE("KistlerArchiveFile::getDataByTime");
+
+  auto data = makeData();
+  if (!isValid_ || timeColumn_ < 0)
+    return data;
+
+  // The same bounds as KistlerCSVFile::getRowAtTime() and getRowAfterTime().
+  float tolerance = samplingRate_ > 0 ? 0.25 / samplingRate_ : 0;
+  float lower = startTime - tolerance;
+  float upper = stopTime + tolerance;
+
+  std::ifstream file(fileName_, std::ios::binary);
+  std::unordered_map<std::string, std::vector<float>> blockData;
+  for (size_t block = 0; block < blocks_.size(); block++) {
+    const auto &info = blocks_[block];
+    if (info.lastTime < lower || info.firstTime >= upper)
+      continue;
+
+    for (auto &column : blockData)
+      column.second.clear();
+    decodeBlock(file, block, 0, info.numRows, &blockData);
+
+    const auto &times = blockData[columnNames_[timeColumn_]];
+    size_t fromRow =
+        std::lower_bound(times.begin(), times.end(), lower) - times.begin();
+    size_t toRow =
+        std::lower_bound(times.begin(), times.end(), upper) - times.begin();
+    for (const auto &column : columnNames_) {
+      const auto &values = blockData[column];
+      auto &result = (*data)[column];
+      result.insert(result.end(), values.begin() + fromRow,
+                    values.begin() + toRow);
+    }
+  }
+
+  return data;
+}
+
+// ____________________________________________________________________________
+int KistlerArchiveFile::findBlock(int row) const {
+  return std::upper_bound(blocks_.begin(), blocks_.end(), row,
+                          [](int value, const KistlerArchiveBlock &b) {
+                            return value < b.firstRow;
+                          }) -
+         blocks_.begin() - 1;
+}
+
+// ____________________________________________________________________________
+const std::unordered_map<std::string, std::vector<float>> &
+KistlerArchiveFile::getBlock(int block) const {
+  if (block == cachedBlock_)
+    return cachedRows_;
+
+  if (!reader_)
+    reader_ = std::make_unique<std::ifstream>(fileName_, std::ios::binary);
+
+  // Decode into the vectors of the last block.
+  cachedBlock_ = -1;
+  for (auto &column : cachedRows_)
+    column.second.clear();
+  decodeBlock(*reader_, block, 0, blocks_[block].numRows, &cachedRows_);
+  cachedBlock_ = block;
+  return cachedRows_;
+}
+
+// ____________________________________________________________________________
+int KistlerArchiveFile::findRow(float threshold) const {
+  if (timeColumn_ < 0)
+    return numRows_;
+
+  // The first block that ends at or after the threshold, then the row in it.
+  auto it = std::lower_bound(blocks_.begin(), blocks_.end(), threshold,
+                             [](const KistlerArchiveBlock &b, float time) {
+                               return b.lastTime < time;
+                             });
+  if (it == blocks_.end())
+    return numRows_;
+  const auto &times =
+      getBlock(it - blocks_.begin()).at(columnNames_[timeColumn_]);
+  return it->firstRow +
+         (std::lower_bound(times.begin(), times.end(), threshold) -
+          times.begin());
+}
+
+// ____________________________________________________________________________
+int KistlerArchiveFile::getRowAtTime(float time) const {
+  return findRow(time - 0.25f / samplingRate_);
+}
+
+// ____________________________________________________________________________
+int KistlerArchiveFile::getRowAfterTime(float time) const {
+  return findRow(time + 0.25f / samplingRate_);
+}
+
+// ____________________________________________________________________________
+float KistlerArchiveFile::getTimeOfRow(int row) const {
+  if (row < 0 || row >= numRows_ || timeColumn_ < 0)
+    return std::numeric_limits<float>::infinity();
+
+  int block = findBlock(row);
+  const auto &times = getBlock(block).at(columnNames_[timeColumn_]);
+  return times[row - blocks_[block].firstRow];
+}
+
+// ____________________________________________________________________________
+std::vector<int> KistlerArchiveFile::getBlocksInRange(const std::string &column,
+                                                      float lower,
+                                                      float upper) const {
+  std::vector<int> result;
+  auto it = std::find(columnNames_.begin(), columnNames_.end(), column);
+  if (it == columnNames_.end())
+    return result;
+
+  size_t c = it - columnNames_.begin();
+  for (size_t block = 0; block < blocks_.size(); block++) {
+    if (blocks_[block].max[c] >= lower && blocks_[block].min[c] <= upper)
+      result.push_back(block);
+  }
+  return result;
+}
+
+// ____________________________________________________________________________
+void KistlerArchiveFile::decodeBlock(
+    std::istream &file, int block, int fromRow, int toRow,
+    std::unordered_map<std::string, std::vector<float>> *data) const {
+  const auto &info = blocks_[block];
+
+  // 8 bytes more for unpackFrame().
+  std::vector<unsigned char> buffer(info.numBytes + 8);
+  file.clear();
+  file.seekg(info.offset);
+  file.read(reinterpret_cast<char *>(buffer.data()), info.numBytes);
+  if (!file) {
+    throw CorruptKistlerFileException("Could not read block " +
+                                      std::to_string(block) + " of " +
+                                      fileName_);
+  }
+
+  const unsigned char *cursor = buffer.data();
+  const unsigned char *end = buffer.data() + info.numBytes;
+  std::vector<float> values;
+  for (const auto &column : columnNames_) {
+    if (!decodeColumn(&cursor, end, info.numRows, &values)) {
+      throw CorruptKistlerFileException("Could not decode column " + column +
+                                        " of block " + std::to_string(block) +
+                                        " of " + fileName_);
+    }
+    auto &result = (*data)[column];
+    result.insert(result.end(), values.begin() + fromRow,
+                  values.begin() + toRow);
+  }
+}
+
+// ____________________________________________________________________________
+void KistlerArchiveFile::encodeColumn(const std::vector<float> &values,
+                                      std::string *buffer) {
+  int numValues = values.size();
+
+  // The fewest decimals that represent all values exactly, if any. The
+  // integers are limited to 2^30, so the deltas fit into 32 bits.
+  int decimals = -1;
+  std::vector<int64_t> integers(numValues);
+  for (int d = 0; d <= ARCHIVE_MAX_DECIMALS && decimals < 0; d++) {
+    bool isExact = true;
+    for (int i = 0; i < numValues && isExact; i++) {
+      double scaled = static_cast<double>(values[i]) * kPowersOfTen[d];
+      if (!(std::fabs(scaled) < (1 << 30))) {
+        isExact = false;
         break;
       }
+      integers[i] = std::llround(scaled);
+      float decoded = decimalToFloat(integers[i], d);
+      isExact = std::memcmp(&decoded, &values[i], sizeof(float)) == 0;
+    }
+    if (isExact)
+      decimals = d;
+  }
+
+  appendValue<uint8_t>(buffer, decimals >= 0 ? 0 : 1);
+  appendValue<uint8_t>(buffer, std::max(decimals, 0));
+  if (numValues == 0)
+    return;
+
+  uint32_t residuals[ARCHIVE_FRAME_VALUES];
+  if (decimals >= 0) {
+    // Deltas, minus the smallest delta of the frame.
+    appendValue<int32_t>(buffer, integers[0]);
+    for (int i = 1; i < numValues; i += ARCHIVE_FRAME_VALUES) {
+      int count = std::min(ARCHIVE_FRAME_VALUES, numValues - i);
+      int stride = count == ARCHIVE_FRAME_VALUES ? ARCHIVE_FRAME_LANES : 1;
+      int64_t deltas[ARCHIVE_FRAME_VALUES];
+      for (int j = 0; j < count; j++)
+        deltas[j] = integers[i + j] - integers[std::max(i + j - stride, 0)];
+      int64_t base = *std::min_element(deltas, deltas + count);
+      uint32_t maxResidual = 0;
+      for (int j = 0; j < count; j++) {
+        residuals[j] = static_cast<uint32_t>(deltas[j] - base);
+        maxResidual = std::max(maxResidual, residuals[j]);
+      }
+      int width = bitWidth(maxResidual);
+      appendValue<uint8_t>(buffer, width);
+      appendValue<int32_t>(buffer, base);
+      packResiduals(residuals, count, width, buffer);
+    }
+  } else {
+    // XOR with the previous value, similar values share the sign, exponent
+    // and upper mantissa bits.
+    std::vector<uint32_t> bits(numValues);
+    std::memcpy(bits.data(), values.data(), numValues * sizeof(float));
+    appendValue<uint32_t>(buffer, bits[0]);
+    for (int i = 1; i < numValues; i += ARCHIVE_FRAME_VALUES) {
+      int count = std::min(ARCHIVE_FRAME_VALUES, numValues - i);
+      int stride = count == ARCHIVE_FRAME_VALUES ? ARCHIVE_FRAME_LANES : 1;
+      uint32_t maxResidual = 0;
+      for (int j = 0; j < count; j++) {
+        residuals[j] = bits[i + j] ^ bits[std::max(i + j - stride, 0)];
+        maxResidual = std::max(maxResidual, residuals[j]);
+      }
+      int width = bitWidth(maxResidual);
+      appendValue<uint8_t>(buffer, width);
+      packResiduals(residuals, count, width, buffer);
+    }
+  }
+}
+
+// ____________________________________________________________________________
+bool KistlerArchiveFile::decodeColumn(const unsigned char **data,
+                                      const unsigned char *end, int numValues,
+                                      std::vector<float> *values) {
+  uint8_t encoding, decimals;
+  if (!readValue(data, end, &encoding) || !readValue(data, end, &decimals) ||
+      encoding > 1 || decimals > ARCHIVE_MAX_DECIMALS)
+    return false;
+
+  values->resize(numValues);
+  if (numValues == 0)
+    return true;
+
+  float *out = values->data();
+  uint32_t residuals[ARCHIVE_FRAME_VALUES];
+  // The values of a frame, after the last ARCHIVE_FRAME_LANES values before
+  // it (all the first value before the first frame).
+  uint32_t history[ARCHIVE_FRAME_LANES + ARCHIVE_FRAME_VALUES];
+  uint32_t *frame = history + ARCHIVE_FRAME_LANES;
+  if (encoding == 0) {
+    // The integers fit into 32 bits, so the sums can wrap around.
+    int32_t first;
+    if (!readValue(data, end, &first))
+      return false;
+    out[0] = decimalToFloat(first, decimals);
+    std::fill(history, frame, first);
+    double scale = kInversePowersOfTen[decimals];
+
+    for (int i = 1; i < numValues; i += ARCHIVE_FRAME_VALUES) {
+      int count = std::min(ARCHIVE_FRAME_VALUES, numValues - i);
+      uint8_t width;
+      int32_t base;
+      if (!readValue(data, end, &width) || width > 32 ||
+          !readValue(data, end, &base) ||
+          !unpackResiduals(data, end, count, width, residuals))
+        return false;
+
+      uint32_t delta = base;
+      auto add = [delta](uint32_t value, uint32_t residual) {
+        return value + delta + residual;
+      };
+      // Separately for full frames, so the loops have a fixed length.
+      if (count == ARCHIVE_FRAME_VALUES) {
+        accumulateFrame(residuals, ARCHIVE_FRAME_VALUES, add, frame);
+        decimalsToFloats(frame, ARCHIVE_FRAME_VALUES, scale, &out[i]);
+      } else {
+        accumulateFrame(residuals, count, add, frame);
+        decimalsToFloats(frame, count, scale, &out[i]);
+      }
+      std::memmove(history, frame + count - ARCHIVE_FRAME_LANES,
+                   ARCHIVE_FRAME_LANES * sizeof(uint32_t));
+    }
+  } else {
+    uint32_t bits;
+    if (!readValue(data, end, &bits))
+      return false;
+    std::memcpy(&out[0], &bits, sizeof(float));
+    std::fill(history, frame, bits);
+    auto exclusiveOr = [](uint32_t value, uint32_t residual) {
+      return value ^ residual;
+    };
+
+    for (int i = 1; i < numValues; i += ARCHIVE_FRAME_VALUES) {
+      int count = std::min(ARCHIVE_FRAME_VALUES, numValues - i);
+      uint8_t width;
+      if (!readValue(data, end, &width) || width > 32 ||
+          !unpackResiduals(data, end, count, width, residuals))
+        return false;
+
+      accumulateFrame(residuals, count, exclusiveOr, frame);
+      std::memcpy(&out[i], frame, count * sizeof(float));
+      std::memmove(history, frame + count - ARCHIVE_FRAME_LANES,
+                   ARCHIVE_FRAME_LANES * sizeof(uint32_t));
+    }
+  }
+  return true;
+}
+
+// ____________________________________________________________________________
+bool KistlerArchiveFile::write(const KistlerFile &source,
+                               const std::string &fileName, int blockRows) {
+  TRACE_SCOPE("KistlerArchiveFile::write");
 
-      auto row = sliceRow(line, '\t');
+  const std::vector<std::string> &columnNames = source.getColumnNames();
+  if (!source.isValid() || columnNames.empty()) {
+    std::cerr << "Error in KistlerArchiveFile::write(): Nothing to write from "
+              << source.getFilename() << std::endl;
+    return false;
+  }
+  std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    std::cerr << "Error in KistlerArchiveFile::write(): Could not open "
+              << fileName << std::endl;
+    return false;
+  }
+  blockRows = std::max(blockRows, 1);
+  int timeColumn = std::find(columnNames.begin(), columnNames.end(),
+                             "abs time (s)") -
+                   columnNames.begin();
 
-      for (size_t j = 0; j < columnNames_.size(); j++) {
-        try {
-          float value = std::stof(row[j]);
-          data->at(columnNames_[j]).push_back(value);
-        } catch (std::exception &e) {
-          throw CorruptKistlerFileException(
-              "Error in KistlerCSVFile::getData(): Cannot convert string to "
-              "float. Seems like the data is corrupt.");
+  // The header: magic number, sampling rate and column names.
+  std::string buffer(ARCHIVE_MAGIC, 8);
+  appendValue<float>(&buffer, source.getSamplingRate());
+  appendValue<uint32_t>(&buffer, columnNames.size());
+  for (const auto &column : columnNames) {
+    appendValue<uint16_t>(&buffer, column.size());
+    buffer += column;
+  }
+  file.write(buffer.data(), buffer.size());
+  int64_t offset = buffer.size();
+
+  // The blocks, read from the source one at a time.
+  std::vector<KistlerArchiveBlock> blocks;
+  int firstRow = 0;
+  try {
+    while (true) {
+      auto data = source.getData(firstRow, firstRow + blockRows - 1);
+      auto first = data->find(columnNames[0]);
+      int numRows = first != data->end() ? first->second.size() : 0;
+      if (numRows == 0)
+        break;
+
+      KistlerArchiveBlock block;
+      block.offset = offset;
+      block.firstRow = firstRow;
+      block.numRows = numRows;
+      buffer.clear();
+      for (const auto &column : columnNames) {
+        auto it = data->find(column);
+        if (it == data->end() ||
+            static_cast<int>(it->second.size()) != numRows) {
+          std::cerr << "Error in KistlerArchiveFile::write(): Column " << column
+                    << " has missing rows in " << source.getFilename()
+                    << std::endl;
+          return false;
+        }
+        const auto &values = it->second;
+        encodeColumn(values, &buffer);
+
+        float min = std::numeric_limits<float>::infinity();
+        float max = -std::numeric_limits<float>::infinity();
+        for (float value : values) {
+          min = std::min(min, value);
+          max = std::max(max, value);
         }
+        block.min.push_back(min);
+        block.max.push_back(max);
       }
-      i++;
-    } else
-      done = true;
-  } while (!done);
+      if (timeColumn < static_cast<int>(columnNames.size())) {
+        block.firstTime = data->at(columnNames[timeColumn]).front();
+        block.lastTime = data->at(columnNames[timeColumn]).back();
+      } else {
+        block.firstTime = firstRow / source.getSamplingRate();
+        block.lastTime = (firstRow + numRows - 1) / source.getSamplingRate();
+      }
+      block.numBytes = buffer.size();
 
-  return data;
-}
\ No newline at end of file
+      file.write(buffer.data(), buffer.size());
+      offset += buffer.size();
+      blocks.push_back(std::move(block));
+      firstRow += numRows;
+      if (numRows < blockRows)
+        break;
+    }
+  } catch (CorruptKistlerFileException &e) {
+    std::cerr << "Error in KistlerArchiveFile::write(): " << e.what()
+              << std::endl;
+    return false;
+  }
+
+  // The index with the statistics of all blocks, then where it starts.
+  buffer.clear();
+  appendValue<uint32_t>(&buffer, blocks.size());
+  for (const auto &block : blocks) {
+    appendValue<int64_t>(&buffer, block.offset);
+    appendValue<int32_t>(&buffer, block.numBytes);
+    appendValue<int32_t>(&buffer, block.firstRow);
+    appendValue<int32_t>(&buffer, block.numRows);
+    appendValue<float>(&buffer, block.firstTime);
+    appendValue<float>(&buffer, block.lastTime);
+    for (size_t c = 0; c < columnNames.size(); c++) {
+      appendValue<float>(&buffer, block.min[c]);
+      appendValue<float>(&buffer, block.max[c]);
+    }
+  }
+  appendValue<int64_t>(&buffer, offset);
+  buffer.append(ARCHIVE_MAGIC, 8);
+  file.write(buffer.data(), buffer.size());
+
+  if (!file) {
+    std::cerr << "Error in KistlerArchiveFile::write(): Could not write "
+              << fileName << std::endl;
+    return false;
+  }
+  qInfo() << "Wrote" << firstRow << "rows in" << blocks.size()
+          << "blocks to" << fileName.c_str();
+  return true;
+}
+
+// ____________________________________________________________________________
+std::unique_ptr<KistlerFile> openKistlerFile(const std::string &fileName) {
+  std::ifstream file(fileName, std::ios::binary);
+  char magic[8] = {};
+  file.read(magic, sizeof(magic));
+  if (file && std::memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)) == 0)
+    return std::make_unique<KistlerArchiveFile>(fileName);
+  return std::make_unique<KistlerCSVFile>(fileName);
+}
@@ -3,16 +3,85 @@
 
 #pragma once
 
+#include "./GzipStream.h"
 #include <QtCore/QDebug>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <stdlib.h>
 #include <string>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
+// getData() keeps a sparse index with the byte offset and the time stamp of
+// every ROW_INDEX_STRIDE-th data row, so it can seek close to any row or time
+// instead of reading all rows before it. At most ROW_INDEX_STRIDE - 1 rows are
+// skipped after the seek, and the index costs 12 bytes per ROW_INDEX_STRIDE
+// rows.
+#define ROW_INDEX_STRIDE 128
+
+// The index has at most this many entries (12 MB, a day and a half at 1 kHz).
+// Beyond, every other entry is dropped and the stride doubles, so the index
+// stays bounded however long the recording is (a seek skips more rows).
+#define ROW_INDEX_MAX_ENTRIES (1 << 20)
+
+// Maximum number of cells kept in a CorruptDataReport, further ones are only
+// counted.
+#define CORRUPT_REPORT_MAX_CELLS 1000
+
+// What getData() does with a cell that is no number.
+enum class CorruptDataPolicy {
+  // Throw a CorruptKistlerFileException.
+  Abort,
+  // Drop the whole row, the rows after it move up in the result.
+  SkipRow,
+  // Interpolate linearly between the valid neighbours in the column. At the
+  // end of a read the last valid value is held.
+  Interpolate
+};
+
+// A cell that is no number: the data row (from 0) and the column index.
+struct CorruptCell {
+  int row;
+  int column;
+};
+
+// The corrupt cells found while reading a file. Several readers of the same
+// file (e.g. the DataModel and its Prefetcher) can share one, so it is
+// thread-safe.
+class CorruptDataReport {
+public:
+  // Add a cell, cells that were added before are ignored (also the ones past
+  // the kept cells).
+  void add(int row, int column);
+
+  void clear();
+
+  // Number of corrupt cells, including the ones not kept.
+  uint64_t getNumCells() const;
+
+  // The first CORRUPT_REPORT_MAX_CELLS cells.
+  std::vector<CorruptCell> getCells() const;
+
+  // The rows with corrupt cells as ranges, e.g. "3 corrupt cells in rows 17,
+  // 20-21".
+  std::string getSummary() const;
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<CorruptCell> cells_;
+  uint64_t numCells_ = 0;
+  // All the reported cells as row ranges, (column, first row) -> last row.
+  std::map<std::pair<int, int>, int> ranges_;
+};
+
 // Abstract class for representing input data files.
 // There are two file formats: a CSV-style plain-text format, and a binary
 // encoded ".dat" format. The input data files store information from the
@@ -30,6 +99,7 @@ public:
   KistlerFile() : fileName_(""), isValid_(false), samplingRate_(0) {}
   KistlerFile(const std::string &fileName)
       : fileName_(fileName), isValid_(false), samplingRate_(0) {}
+  virtual ~KistlerFile() = default;
 
   // Method for some sanity checks on the file:
   // Does the file type match the subclass, is there the right magic number,
@@ -46,20 +116,121 @@ public:
   // will return data from row 27 until the end of the file.
   // It returns a map, so that the data columns can be accessed by their
   // column names, e.g. "Fx"
+  // Everything returned is held in memory, so for long recordings read in
+  // ranges of rows (the row index makes that cheap) instead of all at once.
   virtual const std::shared_ptr<
       std::unordered_map<std::string, std::vector<float>>>
   getData(int startRow = -1, int stopRow = -1) const = 0;
 
+  // Like getData(), but append the rows to the columns of the given map
+  // (missing columns are added), so a caller reading over and over can reuse
+  // its vectors. Returns the number of rows read from the file (skipped rows
+  // included).
+  virtual int
+  readRows(int startRow, int stopRow,
+           std::unordered_map<std::string, std::vector<float>> *data) const = 0;
+
+  // Get the rows with startTime <= "abs time (s)" <= stopTime. Time stamps
+  // within a quarter sample period of the bounds count as inside (the times
+  // in the files are rounded).
+  virtual const std::shared_ptr<
+      std::unordered_map<std::string, std::vector<float>>>
+  getDataByTime(float startTime, float stopTime) const = 0;
+
+  // Number of data rows in the file.
+  virtual int getNumRows() const = 0;
+
+  // The first row at or after the given time (within a quarter sample
+  // period), getNumRows() if there is none.
+  virtual int getRowAtTime(float time) const = 0;
+
+  // The first row after the given time (by more than a quarter sample period),
+  // getNumRows() if there is none.
+  virtual int getRowAfterTime(float time) const = 0;
+
+  // Time stamp of a row, infinity if the row does not exist (yet).
+  virtual float getTimeOfRow(int row) const = 0;
+
   std::string getFilename() const { return fileName_; }
 
   bool isValid() const { return isValid_; }
 
   float getSamplingRate() const { return samplingRate_; }
 
+  // Column/variable names in the order of the file, e.g. "abs time (s)", "Fx".
+  const std::vector<std::string> &getColumnNames() const {
+    return columnNames_;
+  }
+
+  // The contact period (first and last row with someone on the plate, as
+  // detected by BioWare), -1 if the file has none.
+  bool hasContactPeriod() const { return contactStartRow_ >= 0; }
+  int getContactStartRow() const { return contactStartRow_; }
+  int getContactEndRow() const { return contactEndRow_; }
+
+  // What to do with cells that are no number, Abort by default. The cells are
+  // added to the report in any case, it can be shared with other readers of
+  // the file (each file has its own by default). Only text files can have
+  // such cells.
+  void setCorruptDataPolicy(CorruptDataPolicy policy) {
+    corruptDataPolicy_ = policy;
+  }
+  CorruptDataPolicy getCorruptDataPolicy() const { return corruptDataPolicy_; }
+  void setCorruptDataReport(std::shared_ptr<CorruptDataReport> report) {
+    corruptDataReport_ = std::move(report);
+  }
+  const CorruptDataReport &getCorruptDataReport() const {
+    return *corruptDataReport_;
+  }
+
 protected:
   std::string fileName_;
   bool isValid_;
   float samplingRate_;
+  // Column/variable names of the file.
+  std::vector<std::string> columnNames_;
+
+  // The contact period, -1 if there is none.
+  int contactStartRow_ = -1;
+  int contactEndRow_ = -1;
+
+  CorruptDataPolicy corruptDataPolicy_ = CorruptDataPolicy::Abort;
+  std::shared_ptr<CorruptDataReport> corruptDataReport_ =
+      std::make_shared<CorruptDataReport>();
+};
+
+// Open a BioWare export or an archive, by the magic number of the archives.
+// The file is invalid if it can't be read.
+std::unique_ptr<KistlerFile> openKistlerFile(const std::string &fileName);
+
+// The header of a BioWare export. Most fields are written once per channel
+// (every column after the time), they are kept like that. Numbers that can't
+// be read are NaN (-1 for the sample numbers).
+struct KistlerMetaData {
+  // Line 1, e.g. "BioWare Version 5.3.0.7 Export".
+  std::string version;
+  std::vector<std::string> devices;
+  std::vector<long> samples;
+  std::vector<float> rates;
+  // The contact period in samples (numbered from 0) and in seconds.
+  std::vector<long> contactStart;
+  std::vector<long> contactEnd;
+  std::vector<float> contactStartTime;
+  std::vector<float> contactEndTime;
+  std::vector<float> firstSampleTime;
+  // Normalization constants of BioWare (body weight and height).
+  std::vector<float> normalizedForce;
+  std::vector<float> normalizedLength;
+  // Date, Name, ID, Classification and Description.
+  std::map<std::string, std::string> fileInformation;
+  // The units of the columns (line 19).
+  std::vector<std::string> units;
+
+  // Number of samples of the first channel, -1 if unknown.
+  long getNumSamples() const;
+
+  // If all channels have the same sampling rate.
+  bool hasConsistentRates() const;
 };
 
 // Subclass to represent CSV files with raw data.
@@ -69,9 +240,17 @@ public:
   KistlerCSVFile() : KistlerFile() {}
   KistlerCSVFile(const std::string &fileName);
 
+  // A copy has the row index built so far (and shares the access points of a
+  // gzipped file), so e.g. another thread can read the file without scanning
+  // it again. It opens its own stream for reading.
+  KistlerCSVFile(const KistlerCSVFile &other);
+  KistlerCSVFile(KistlerCSVFile &&other) = default;
+  KistlerCSVFile &operator=(KistlerCSVFile &&other) = default;
+
   // CSV-specific implementations of sanity checks for the file.
   // This will check:
-  // (1) If the file exists and is non-empty.
+  // (1) If the file exists and is non-empty (and not zstd-compressed, gzip
+  //     is decompressed on the fly).
   // (2) If there is a "BioWare" string in the first line.
   // (3) If there are sensible column headers in line 18 (the variable name)
   // (4) If there are sensible column headers in line 19 (the SI units, e.g.
@@ -82,22 +261,259 @@ public:
   const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
   getData(int startRow = -1, int stopRow = -1) const override;
 
-  // Parse the CSV header to get metadata like sampling rate and column names.
+  // CSV-specific implementation of readRows. Reading allocates nothing once
+  // the columns are large enough.
+  int readRows(int startRow, int stopRow,
+               std::unordered_map<std::string, std::vector<float>> *data)
+      const override;
+
+  // Parse the CSV header to get metadata like sampling rate and column names,
+  // in one pass. Channels with different sampling rates are reported, the
+  // rate of the first one is used.
   void parseMetaData();
 
+  // All fields of the header.
+  const KistlerMetaData &getMetaData() const { return metaData_; }
+
+  // Number of data rows in the file. The first call scans the whole file (for
+  // newlines only, which is fast), later calls only scan what was appended
+  // since.
+  int getNumRows() const override;
+
+  // CSV-specific implementation of getDataByTime. The rows are found by time
+  // stamp, so this is exact also if the recording has gaps.
+  const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+  getDataByTime(float startTime, float stopTime) const override;
+
+  int getRowAtTime(float time) const override;
+  int getRowAfterTime(float time) const override;
+  float getTimeOfRow(int row) const override;
+
+  // If the time stamps at all indexed rows so far match a uniform sampling at
+  // the sampling rate (no gaps). Then times and rows are converted directly.
+  bool isUniformlySampled() const { return uniformSampling_; }
+
   // Slice a single CSV row into separate strings by a given delimiter.
   static std::vector<std::string> sliceRow(std::string line_,
                                            const char delimiter);
 
   FRIEND_TEST(KistlerFileTest, KistlerCSVFileConstructor);
   FRIEND_TEST(KistlerCSVFileTest, parseMetaData);
+  FRIEND_TEST(KistlerCSVFileTest, rowIndex);
+  FRIEND_TEST(KistlerCSVFileTest, rowIndexBounded);
+  FRIEND_TEST(KistlerCSVFileTest, getDataByTime);
+  FRIEND_TEST(KistlerCSVFileTest, gzip);
 
 private:
-  // Column/variable names of the file.
-  std::vector<std::string> columnNames_;
-
   // The number of columns in the file.
   int numCols_;
+
+  KistlerMetaData metaData_;
+
+  // Scan the file for newlines until the index covers the given row and has
+  // a time stamp after the given time (or the end of the file is reached).
+  void extendRowIndex(
+      int row, float time = -std::numeric_limits<float>::infinity()) const;
+
+  // Add the time stamp of the latest indexed row (the text of the first
+  // column) and check if the sampling is still uniform.
+  void addRowIndexTime(const std::string &timeText) const;
+
+  // Drop every other entry of the index and double the stride, once it has
+  // more than maxRowIndexSize_ entries.
+  void coarsenRowIndex() const;
+
+  // The first row with a time stamp >= threshold (getNumRows() if there is
+  // none). With uniform sampling computed directly, otherwise by binary search
+  // over the indexed rows and reading at most rowIndexStride_ time stamps.
+  int findRow(float threshold) const;
+
+  // Position the stream at the beginning of the given data row, using the
+  // row index. Returns the number of lines skipped after the seek.
+  int seekToRow(std::istream &file, int row) const;
+
+  // Open the file for reading, decompressing it on the fly if it is gzipped.
+  std::unique_ptr<std::istream> openFile(
+      std::ios::openmode mode = std::ios::in) const;
+
+  // The stream for reading rows, opened on first use and kept open, so a read
+  // costs no open and no new stream buffer.
+  std::istream &reader() const;
+  mutable std::unique_ptr<std::istream> reader_;
+  // Reused by all reads: the current line and the columns to append to.
+  mutable std::string line_;
+  mutable std::vector<std::vector<float> *> targetColumns_;
+
+  // Cells to interpolate after a read: index in the column and column index.
+  mutable std::vector<std::pair<size_t, size_t>> repairs_;
+
+  // Interpolate the cells in repairs_.
+  void repairCells() const;
+
+  // Compression of the file, detected by validateFile().
+  Compression compression_ = Compression::None;
+  // The access points for seeking in a gzipped file, shared by all streams
+  // opened on it.
+  std::shared_ptr<GzipIndex> gzipIndex_;
+
+  // The row index, it is extended lazily by the const getters, hence mutable.
+  // rowIndex_[k] is the byte offset of data row k * rowIndexStride_.
+  mutable std::vector<std::streamoff> rowIndex_;
+  // rowIndexTimes_[k] is the time stamp of data row k * rowIndexStride_.
+  mutable std::vector<float> rowIndexTimes_;
+  // ROW_INDEX_STRIDE, doubled with every coarsenRowIndex().
+  mutable int rowIndexStride_ = ROW_INDEX_STRIDE;
+  size_t maxRowIndexSize_ = ROW_INDEX_MAX_ENTRIES;
+  mutable bool uniformSampling_ = true;
+  // Number of complete data rows scanned so far and the offset right after
+  // them.
+  mutable int indexedRows_ = 0;
+  mutable std::streamoff indexedBytes_ = 0;
+  // If there is an incomplete last row (no newline yet) after them.
+  mutable bool hasPartialRow_ = false;
+};
+
+// Magic number at the beginning of an archive (includes the format version).
+#define ARCHIVE_MAGIC "FPFARCH2"
+
+// Number of rows per block of an archive. Blocks are decoded independently.
+#define ARCHIVE_BLOCK_ROWS 4096
+
+// Number of values per frame within a block. All values of a frame are packed
+// with the same bit width.
+#define ARCHIVE_FRAME_VALUES 128
+
+// Number of interleaved lanes of a full frame (see KistlerArchiveFile).
+#define ARCHIVE_FRAME_LANES 4
+
+// Maximum number of decimals for storing values as decimal integers.
+#define ARCHIVE_MAX_DECIMALS 7
+
+// Statistics of a block of an archive: where it is, which rows and times it
+// holds and the minimum and maximum of every column (in the order of the
+// column names, NaNs are ignored).
+struct KistlerArchiveBlock {
+  int64_t offset;
+  int numBytes;
+  int firstRow;
+  int numRows;
+  float firstTime;
+  float lastTime;
+  std::vector<float> min;
+  std::vector<float> max;
+};
+
+// Subclass to represent our own compressed archive of a recording. It can be
+// written from any KistlerFile and is typically 5-10x smaller than the
+// BioWare text.
+//
+// The rows are stored in blocks of ARCHIVE_BLOCK_ROWS rows, each column of a
+// block is encoded on its own:
+// - Values that are decimals with at most ARCHIVE_MAX_DECIMALS digits (like
+//   everything BioWare writes) are stored as integers (value * 10^decimals)
+//   and their deltas.
+// - Other values as the XOR of their float bits with the previous value.
+// The deltas or XORs are bit-packed in frames of ARCHIVE_FRAME_VALUES values,
+// with the bit width (and for deltas the minimum) of each frame. Full frames
+// are packed into ARCHIVE_FRAME_LANES interleaved lanes of 32 bit words, and
+// their deltas and XORs go to the value ARCHIVE_FRAME_LANES before instead of
+// the previous one. That way unpacking (one loop per bit width) and summing
+// up work on all lanes at once and vectorize. A last frame that isn't full is
+// packed in order.
+//
+// An index with the statistics of all blocks (see KistlerArchiveBlock) is at
+// the end of the file, so range queries only decode the blocks they need.
+class KistlerArchiveFile : public KistlerFile {
+public:
+  KistlerArchiveFile() : KistlerFile() {}
+  KistlerArchiveFile(const std::string &fileName);
+
+  // Checks the magic number and reads the column names and the block index.
+  void validateFile() override;
+
+  // Archive-specific implementation of getData, only decodes the blocks with
+  // the rows. Throws a CorruptKistlerFileException if a block can't be
+  // decoded.
+  const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+  getData(int startRow = -1, int stopRow = -1) const override;
+
+  // Archive-specific implementation of readRows. The last decoded block is
+  // kept, so reading on a few rows at a time (like the playback) decodes
+  // every block once.
+  int readRows(int startRow, int stopRow,
+               std::unordered_map<std::string, std::vector<float>> *data)
+      const override;
+
+  // Archive-specific implementation of getDataByTime. Blocks outside of the
+  // time range are skipped by their statistics.
+  const std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+  getDataByTime(float startTime, float stopTime) const override;
+
+  int getNumRows() const override { return numRows_; }
+
+  // The rows are found by binary search over the time ranges of the blocks
+  // and the time stamps of one block.
+  int getRowAtTime(float time) const override;
+  int getRowAfterTime(float time) const override;
+  float getTimeOfRow(int row) const override;
+
+  const std::vector<KistlerArchiveBlock> &getBlocks() const { return blocks_; }
+
+  // The blocks that may have values of a column within [lower, upper], by
+  // their statistics (e.g. to find the parts of a recording with load on the
+  // plate without decoding everything).
+  std::vector<int> getBlocksInRange(const std::string &column, float lower,
+                                    float upper) const;
+
+  // Write all rows of a file into an archive (reading blockRows rows at a
+  // time). Returns false (and prints why) if that failed.
+  static bool write(const KistlerFile &source, const std::string &fileName,
+                    int blockRows = ARCHIVE_BLOCK_ROWS);
+
+  FRIEND_TEST(KistlerArchiveFileTest, encodeColumn);
+
+private:
+  // Encode the values of a column of a block and append it to the buffer.
+  static void encodeColumn(const std::vector<float> &values,
+                           std::string *buffer);
+
+  // Decode numValues values of a column starting at data (and move data after
+  // them). Returns false if the column would end after the end.
+  static bool decodeColumn(const unsigned char **data,
+                           const unsigned char *end, int numValues,
+                           std::vector<float> *values);
+
+  // Decode the given rows of a block (relative to the block) and append them
+  // to the data.
+  void decodeBlock(
+      std::istream &file, int block, int fromRow, int toRow,
+      std::unordered_map<std::string, std::vector<float>> *data) const;
+
+  // An empty map with all columns.
+  std::shared_ptr<std::unordered_map<std::string, std::vector<float>>>
+  makeData() const;
+
+  // The block with the row (numRows_ must be > 0).
+  int findBlock(int row) const;
+
+  // All rows of a block, decoded on first use (the last one is kept).
+  const std::unordered_map<std::string, std::vector<float>> &
+  getBlock(int block) const;
+
+  // The first row with a time stamp >= threshold, getNumRows() if there is
+  // none.
+  int findRow(float threshold) const;
+
+  std::vector<KistlerArchiveBlock> blocks_;
+  int numRows_ = 0;
+  // Index of "abs time (s)" in the columns, -1 if there is none.
+  int timeColumn_ = -1;
+
+  // The stream the blocks are read with (opened on first use) and the last
+  // decoded block, hence mutable.
+  mutable std::unique_ptr<std::ifstream> reader_;
+  mutable int cachedBlock_ = -1;
+  mutable std::unordered_map<std::string, std::vector<float>> cachedRows_;
 };
 
 // Subclass to represent binary .dat files with raw data.
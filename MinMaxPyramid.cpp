@@ -0,0 +1,154 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#include "./MinMaxPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// ____________________________________________________________________________
+MinMaxPyramid::MinMaxPyramid(int baseLevel)
+    : initialBaseLevel_(std::max(baseLevel, 0)),
+      baseLevel_(initialBaseLevel_), maxBytes_(0), numSamples_(0) {}
+
+// ____________________________________________________________________________
+void MinMaxPyramid::clear() {
+  numSamples_ = 0;
+  baseLevel_ = initialBaseLevel_;
+  levels_.clear();
+}
+
+// ____________________________________________________________________________
+void MinMaxPyramid::setMaxBytes(size_t maxBytes) {
+  maxBytes_ = maxBytes;
+  enforceMaxBytes();
+}
+
+// ____________________________________________________________________________
+size_t MinMaxPyramid::getMemoryBytes() const {
+  size_t bytes = 0;
+  for (const auto &level : levels_)
+    bytes += level.capacity() * sizeof(MinMax);
+  return bytes;
+}
+
+// ____________________________________________________________________________
+void MinMaxPyramid::enforceMaxBytes() {
+  // Level 1 becomes the new level 0. Its last bucket may be partial, just like
+  // the last bucket of level 0, so appending continues seamlessly.
+  while (maxBytes_ > 0 && levels_.size() > 1 && getMemoryBytes() > maxBytes_) {
+    levels_.erase(levels_.begin());
+    baseLevel_++;
+  }
+}
+
+// ____________________________________________________________________________
+void MinMaxPyramid::append(const float *values, size_t numValues) {
+  if (numValues == 0)
+    return;
+
+  if (levels_.empty())
+    levels_.emplace_back();
+
+  // Level 0 directly from the samples. The first changed bucket may be a
+  // partial one from the last call.
+  size_t bucketSize = getBucketSize(0);
+  size_t changedBucket = numSamples_ / bucketSize;
+  std::vector<MinMax> &base = levels_[0];
+  for (size_t i = 0; i < numValues; i++) {
+    float value = values[i];
+    if (numSamples_ % bucketSize == 0) {
+      base.push_back({value, value});
+    } else {
+      base.back().min = std::min(base.back().min, value);
+      base.back().max = std::max(base.back().max, value);
+    }
+    numSamples_++;
+  }
+
+  // The levels above, only from the first changed bucket on. A new level is
+  // added as soon as the level below has more than one bucket.
+  for (size_t level = 1; levels_[level - 1].size() > 1; level++) {
+    if (level == levels_.size()) {
+      levels_.emplace_back();
+      changedBucket = 0;
+    } else {
+      changedBucket /= 2;
+    }
+    updateLevel(level, changedBucket);
+  }
+
+  enforceMaxBytes();
+}
+
+// ____________________________________________________________________________
+void MinMaxPyramid::updateLevel(int level, size_t firstBucket) {
+  const std::vector<MinMax> &below = levels_[level - 1];
+  std::vector<MinMax> &buckets = levels_[level];
+
+  buckets.resize((below.size() + 1) / 2);
+  for (size_t i = firstBucket; i < buckets.size(); i++) {
+    buckets[i] = below[2 * i];
+    if (2 * i + 1 < below.size()) {
+      buckets[i].min = std::min(buckets[i].min, below[2 * i + 1].min);
+      buckets[i].max = std::max(buckets[i].max, below[2 * i + 1].max);
+    }
+  }
+}
+
+// ____________________________________________________________________________
+MinMax MinMaxPyramid::getRange() const {
+  if (numSamples_ == 0)
+    return {0, 0};
+
+  // The top level has only a single bucket (or two, before the next level is
+  // added).
+  MinMax range = levels_.back().front();
+  for (const MinMax &bucket : levels_.back()) {
+    range.min = std::min(range.min, bucket.min);
+    range.max = std::max(range.max, bucket.max);
+  }
+  return range;
+}
+
+// ____________________________________________________________________________
+int MinMaxPyramid::query(double firstSample, double lastSample, int numPixels,
+                         std::vector<MinMax> *columns) const {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  columns->assign(std::max(numPixels, 0), {nan, nan});
+  if (numSamples_ == 0 || numPixels <= 0 || lastSample <= firstSample)
+    return 0;
+
+  // The coarsest level with at least one bucket per pixel.
+  double samplesPerPixel = (lastSample - firstSample) / numPixels;
+  int level = 0;
+  while (level + 1 < getNumLevels() &&
+         getBucketSize(level + 1) <= samplesPerPixel)
+    level++;
+
+  const std::vector<MinMax> &buckets = levels_[level];
+  double bucketSize = getBucketSize(level);
+  for (int pixel = 0; pixel < numPixels; pixel++) {
+    double start = std::max(firstSample + pixel * samplesPerPixel, 0.0);
+    double end = std::min(firstSample + (pixel + 1) * samplesPerPixel,
+                          static_cast<double>(numSamples_));
+    if (end <= 0)
+      continue;
+    if (start >= numSamples_)
+      break;
+
+    size_t first = start / bucketSize;
+    size_t last = std::max<size_t>(std::ceil(end / bucketSize), first + 1);
+    last = std::min(last, buckets.size());
+
+    MinMax column = buckets[first];
+    for (size_t i = first + 1; i < last; i++) {
+      column.min = std::min(column.min, buckets[i].min);
+      column.max = std::max(column.max, buckets[i].max);
+    }
+    (*columns)[pixel] = column;
+  }
+
+  return level;
+}
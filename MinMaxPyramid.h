@@ -0,0 +1,93 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+// Minimum and maximum of a range of samples.
+struct MinMax {
+  float min;
+  float max;
+};
+
+// A level-of-detail pyramid for plotting long time series: level l holds the
+// min/max of buckets of 2^(baseLevel + l) consecutive samples, every level
+// halves the resolution of the one below. For plotting, the coarsest level
+// that still has at least one bucket per pixel is taken, so drawing a channel
+// costs about as much as the plot is wide, independent of the zoom.
+// The pyramid is built incrementally: append() only updates the buckets at
+// the end of every level (the last bucket of each level may be partial), so
+// it can grow along with a recording that is still being read.
+// Memory is about 4 / 2^baseLevel floats per sample (all levels together),
+// i.e. with baseLevel 0 (exact down to single samples) four times the raw
+// channel, with baseLevel 2 as much as the raw channel.
+// With a memory limit, the finest level is dropped whenever the pyramid
+// outgrows it (halving the memory), so the memory stays bounded for
+// recordings of any length at the price of resolution when zoomed in.
+class MinMaxPyramid {
+public:
+  explicit MinMaxPyramid(int baseLevel = 0);
+
+  // Append samples (in order).
+  void append(const float *values, size_t numValues);
+  void append(const std::vector<float> &values) {
+    append(values.data(), values.size());
+  }
+
+  // Start over (with the base level given to the constructor).
+  void clear();
+
+  // Limit the memory of the buckets (0 for no limit).
+  void setMaxBytes(size_t maxBytes);
+  size_t getMaxBytes() const { return maxBytes_; }
+
+  // Memory held by the buckets in bytes.
+  size_t getMemoryBytes() const;
+
+  size_t getNumSamples() const { return numSamples_; }
+  int getBaseLevel() const { return baseLevel_; }
+  int getNumLevels() const { return levels_.size(); }
+
+  // Number of samples per bucket on the given level.
+  size_t getBucketSize(int level) const {
+    return static_cast<size_t>(1) << (baseLevel_ + level);
+  }
+
+  // The buckets of a level.
+  const std::vector<MinMax> &getLevel(int level) const {
+    return levels_[level];
+  }
+
+  // Min/max of all samples, {0, 0} if there are none.
+  MinMax getRange() const;
+
+  // Min/max per pixel column for the samples [firstSample, lastSample) drawn
+  // on numPixels columns. Columns outside the available samples are NaN. When
+  // zoomed in beyond the sample resolution, neighbouring columns show the
+  // same sample. Returns the level that was used.
+  int query(double firstSample, double lastSample, int numPixels,
+            std::vector<MinMax> *columns) const;
+
+private:
+  // Recalculate the buckets of a level (>= 1) from the given bucket on from
+  // the level below.
+  void updateLevel(int level, size_t firstBucket);
+
+  // Drop the finest levels until the memory limit is met.
+  void enforceMaxBytes();
+
+  int initialBaseLevel_;
+  int baseLevel_;
+  size_t maxBytes_;
+  size_t numSamples_;
+
+  // The buckets of level 0 are built from the samples directly, the samples
+  // themselves are not kept.
+  std::vector<std::vector<MinMax>> levels_;
+
+  FRIEND_TEST(MinMaxPyramidTest, append);
+};
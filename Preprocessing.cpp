@@ -0,0 +1,384 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#include "./Preprocessing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// ____________________________________________________________________________
+RunningMedian::RunningMedian(int windowSize)
+    : windowSize_(std::max(windowSize, 1)), values_(windowSize_),
+      lower_(windowSize_), upper_(windowSize_), inLower_(windowSize_),
+      heapIndex_(windowSize_) {
+  reset();
+}
+
+// ____________________________________________________________________________
+void RunningMedian::reset() {
+  size_ = 0;
+  next_ = 0;
+  numLower_ = 0;
+  numUpper_ = 0;
+}
+
+// ____________________________________________________________________________
+void RunningMedian::swapEntries(bool lower, int i, int j) {
+  std::vector<int> &heap = lower ? lower_ : upper_;
+  std::swap(heap[i], heap[j]);
+  heapIndex_[heap[i]] = i;
+  heapIndex_[heap[j]] = j;
+}
+
+// ____________________________________________________________________________
+void RunningMedian::siftUp(bool lower, int i) {
+  const std::vector<int> &heap = lower ? lower_ : upper_;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!outranks(lower, heap[i], heap[parent]))
+      break;
+    swapEntries(lower, i, parent);
+    i = parent;
+  }
+}
+
+// ____________________________________________________________________________
+void RunningMedian::siftDown(bool lower, int i) {
+  const std::vector<int> &heap = lower ? lower_ : upper_;
+  int size = lower ? numLower_ : numUpper_;
+  while (true) {
+    int best = i;
+    for (int child = 2 * i + 1; child <= 2 * i + 2 && child < size; child++)
+      if (outranks(lower, heap[child], heap[best]))
+        best = child;
+    if (best == i)
+      break;
+    swapEntries(lower, i, best);
+    i = best;
+  }
+}
+
+// ____________________________________________________________________________
+void RunningMedian::insert(bool lower, int slot) {
+  std::vector<int> &heap = lower ? lower_ : upper_;
+  int &size = lower ? numLower_ : numUpper_;
+  heap[size] = slot;
+  heapIndex_[slot] = size;
+  inLower_[slot] = lower;
+  size++;
+  siftUp(lower, size - 1);
+}
+
+// ____________________________________________________________________________
+int RunningMedian::popTop(bool lower) {
+  std::vector<int> &heap = lower ? lower_ : upper_;
+  int &size = lower ? numLower_ : numUpper_;
+  int slot = heap[0];
+  size--;
+  if (size > 0) {
+    heap[0] = heap[size];
+    heapIndex_[heap[0]] = 0;
+    siftDown(lower, 0);
+  }
+  return slot;
+}
+
+// ____________________________________________________________________________
+float RunningMedian::push(float value) {
+  if (size_ < windowSize_) {
+    // Still filling up, the slots are taken in order.
+    int slot = size_++;
+    values_[slot] = value;
+    insert(numLower_ == 0 || value <= values_[lower_[0]], slot);
+
+    // The lower half has as many values as the upper one, or one more.
+    if (numLower_ > numUpper_ + 1)
+      insert(false, popTop(true));
+    else if (numUpper_ > numLower_)
+      insert(true, popTop(false));
+  } else {
+    // Replace the oldest value where it is, the halves keep their sizes.
+    int slot = next_;
+    next_ = (next_ + 1) % windowSize_;
+    values_[slot] = value;
+    bool lower = inLower_[slot];
+    siftUp(lower, heapIndex_[slot]);
+    siftDown(lower, heapIndex_[slot]);
+
+    // The new value may belong to the other half, then the tops change
+    // places.
+    if (numUpper_ > 0 && values_[lower_[0]] > values_[upper_[0]]) {
+      std::swap(lower_[0], upper_[0]);
+      heapIndex_[lower_[0]] = 0;
+      heapIndex_[upper_[0]] = 0;
+      inLower_[lower_[0]] = true;
+      inLower_[upper_[0]] = false;
+      siftDown(true, 0);
+      siftDown(false, 0);
+    }
+  }
+  return getMedian();
+}
+
+// ____________________________________________________________________________
+float RunningMedian::getMedian() const {
+  if (size_ == 0)
+    return 0;
+  if (numLower_ > numUpper_)
+    return values_[lower_[0]];
+  return (values_[lower_[0]] + values_[upper_[0]]) / 2;
+}
+
+// ____________________________________________________________________________
+void SpikeFilter::configure(const std::vector<std::string> &columnNames,
+                            int windowSize) {
+  windowSize_ = std::max(windowSize, 1);
+  columnNames_.clear();
+  for (const auto &name : columnNames)
+    if (name != "abs time (s)")
+      columnNames_.push_back(name);
+  medians_.assign(columnNames_.size(), RunningMedian(windowSize_));
+  nextRow_ = -1;
+}
+
+// ____________________________________________________________________________
+void SpikeFilter::reset() {
+  for (auto &median : medians_)
+    median.reset();
+  nextRow_ = -1;
+}
+
+// ____________________________________________________________________________
+int SpikeFilter::getColumn(const std::string &columnName) const {
+  for (size_t i = 0; i < columnNames_.size(); i++)
+    if (columnNames_[i] == columnName)
+      return i;
+  return -1;
+}
+
+// ____________________________________________________________________________
+void SpikeFilter::start(int firstRow) {
+  if (firstRow != nextRow_)
+    reset();
+}
+
+// ____________________________________________________________________________
+void SpikeFilter::apply(
+    std::unordered_map<std::string, std::vector<float>> *columns,
+    size_t firstIndex, int firstRow) {
+  if (!isEnabled() || columns->empty())
+    return;
+
+  start(firstRow);
+
+  size_t numRows = 0;
+  for (size_t i = 0; i < columnNames_.size(); i++) {
+    auto column = columns->find(columnNames_[i]);
+    if (column == columns->end())
+      continue;
+    std::vector<float> &values = column->second;
+    for (size_t k = firstIndex; k < values.size(); k++)
+      values[k] = medians_[i].push(values[k]);
+    numRows = values.size() - std::min(firstIndex, values.size());
+  }
+  finish(firstRow, numRows);
+}
+
+// ____________________________________________________________________________
+void OffsetCalibrator::configure(const std::vector<std::string> &columnNames,
+                                 float samplingRate, float unloadedThreshold) {
+  columnNames_.clear();
+  for (const auto &name : columnNames)
+    if (name != "abs time (s)" && name != "Ax" && name != "Ay")
+      columnNames_.push_back(name);
+  offsets_.assign(columnNames_.size(), 0);
+  calibrated_ = false;
+  samplingRate_ = samplingRate;
+  unloadedThreshold_ = unloadedThreshold;
+}
+
+// ____________________________________________________________________________
+void OffsetCalibrator::clear() {
+  columnNames_.clear();
+  offsets_.clear();
+  calibrated_ = false;
+}
+
+// ____________________________________________________________________________
+int OffsetCalibrator::findChannel(const std::string &columnName) const {
+  for (size_t i = 0; i < columnNames_.size(); i++)
+    if (columnNames_[i] == columnName)
+      return i;
+  return -1;
+}
+
+// ____________________________________________________________________________
+float OffsetCalibrator::getOffset(const std::string &columnName) const {
+  int channel = findChannel(columnName);
+  return channel >= 0 ? offsets_[channel] : 0;
+}
+
+// ____________________________________________________________________________
+int OffsetCalibrator::findUnloaded(
+    const std::unordered_map<std::string, std::vector<float>> &data,
+    size_t firstIndex) {
+  unloaded_.clear();
+  auto fz = data.find("Fz");
+  if (fz == data.end() || fz->second.size() <= firstIndex)
+    return 0;
+
+  int numUnloaded = 0;
+  for (size_t k = firstIndex; k < fz->second.size(); k++) {
+    bool unloaded = std::abs(fz->second[k]) < unloadedThreshold_;
+    unloaded_.push_back(unloaded ? 1 : 0);
+    numUnloaded += unloaded;
+  }
+  return numUnloaded;
+}
+
+// ____________________________________________________________________________
+bool OffsetCalibrator::estimate(
+    const std::unordered_map<std::string, std::vector<float>> &data,
+    size_t firstIndex) {
+  int numUnloaded = findUnloaded(data, firstIndex);
+  if (numUnloaded == 0)
+    return false;
+
+  for (size_t i = 0; i < columnNames_.size(); i++) {
+    offsets_[i] = 0;
+    auto column = data.find(columnNames_[i]);
+    if (column == data.end())
+      continue;
+    const std::vector<float> &values = column->second;
+    double sum = 0;
+    for (size_t k = firstIndex; k < values.size(); k++)
+      sum += unloaded_[k - firstIndex] * values[k];
+    offsets_[i] = sum / numUnloaded;
+  }
+  calibrated_ = true;
+  return true;
+}
+
+// ____________________________________________________________________________
+bool OffsetCalibrator::calibrate(
+    const std::unordered_map<std::string, std::vector<float>> &data) {
+  if (!isEnabled())
+    return false;
+  return estimate(data, 0);
+}
+
+// ____________________________________________________________________________
+void OffsetCalibrator::apply(
+    std::unordered_map<std::string, std::vector<float>> *columns,
+    size_t firstIndex, SpikeFilter *spikeFilter, int firstRow) {
+  // The offsets (and the unloaded rows) are of the filtered values. Until
+  // they are estimated, the spikes are filtered in a pass of their own.
+  if (spikeFilter != nullptr && spikeFilter->isEnabled()) {
+    if (isEnabled() && calibrated_) {
+      applyFiltered(columns, firstIndex, spikeFilter, firstRow);
+      return;
+    }
+    spikeFilter->apply(columns, firstIndex, firstRow);
+  }
+  if (!isEnabled())
+    return;
+
+  // Not calibrated yet, the first unloaded rows do it (no drift to track in
+  // them then).
+  int numUnloaded = 0;
+  if (!calibrated_) {
+    if (!estimate(*columns, firstIndex))
+      return;
+  } else if (driftTime_ > 0) {
+    numUnloaded = findUnloaded(*columns, firstIndex);
+  }
+
+  sums_.assign(columnNames_.size(), 0);
+  for (size_t i = 0; i < columnNames_.size(); i++) {
+    auto column = columns->find(columnNames_[i]);
+    if (column == columns->end())
+      continue;
+    std::vector<float> &values = column->second;
+    const float offset = offsets_[i];
+
+    if (numUnloaded == 0) {
+      // Someone on the plate, just the subtraction (which vectorizes).
+      for (size_t k = firstIndex; k < values.size(); k++)
+        values[k] -= offset;
+    } else {
+      // Subtract and sum up the unloaded rows in the same pass.
+      float sum = 0;
+      for (size_t k = firstIndex; k < values.size(); k++) {
+        sum += unloaded_[k - firstIndex] * values[k];
+        values[k] -= offset;
+      }
+      sums_[i] = sum;
+    }
+  }
+  trackDrift(*columns, numUnloaded);
+}
+
+// ____________________________________________________________________________
+void OffsetCalibrator::applyFiltered(
+    std::unordered_map<std::string, std::vector<float>> *columns,
+    size_t firstIndex, SpikeFilter *spikeFilter, int firstRow) {
+  spikeFilter->start(firstRow);
+  unloaded_.clear();
+  sums_.assign(columnNames_.size(), 0);
+  int numUnloaded = 0;
+  size_t numRows = 0;
+
+  // Filter, sum up the unloaded rows and subtract, value by value.
+  auto filter = [&](const std::string &name, std::vector<float> *values) {
+    int median = spikeFilter->getColumn(name);
+    int channel = findChannel(name);
+    if (median < 0 && channel < 0)
+      return;
+    const float offset = channel >= 0 ? offsets_[channel] : 0;
+    const bool findingUnloaded = driftTime_ > 0 && name == "Fz";
+    const bool summing = driftTime_ > 0 && channel >= 0;
+    float sum = 0;
+    for (size_t k = firstIndex; k < values->size(); k++) {
+      float value = median >= 0 ? spikeFilter->push(median, (*values)[k])
+                                : (*values)[k];
+      if (findingUnloaded) {
+        unloaded_.push_back(std::abs(value) < unloadedThreshold_ ? 1 : 0);
+        numUnloaded += unloaded_.back();
+      }
+      if (summing && !unloaded_.empty())
+        sum += unloaded_[k - firstIndex] * value;
+      (*values)[k] = value - offset;
+    }
+    if (channel >= 0)
+      sums_[channel] = sum;
+    numRows = values->size() - std::min(firstIndex, values->size());
+  };
+
+  // Fz first, the unloaded rows are found from it.
+  auto fz = columns->find("Fz");
+  if (fz != columns->end())
+    filter(fz->first, &fz->second);
+  for (auto &column : *columns)
+    if (column.first != "Fz")
+      filter(column.first, &column.second);
+
+  spikeFilter->finish(firstRow, numRows);
+  trackDrift(*columns, numUnloaded);
+}
+
+// ____________________________________________________________________________
+void OffsetCalibrator::trackDrift(
+    const std::unordered_map<std::string, std::vector<float>> &columns,
+    int numUnloaded) {
+  if (numUnloaded == 0)
+    return;
+
+  // The mean of the unloaded rows goes into the moving average with the
+  // weight it would have gotten sample by sample.
+  float alpha = 1 / std::max(driftTime_ * samplingRate_, 1.f);
+  float weight = 1 - std::pow(1 - alpha, numUnloaded);
+  for (size_t i = 0; i < columnNames_.size(); i++)
+    if (columns.count(columnNames_[i]) > 0)
+      offsets_[i] += weight * (sums_[i] / numUnloaded - offsets_[i]);
+}
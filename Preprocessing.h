@@ -0,0 +1,200 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Window of the spike filter in samples when it is switched on in the
+// ConfigWindow. Spikes of up to 2 samples (2 ms at 1 kHz) are removed, the
+// signal is delayed by 2 samples.
+#define SPIKE_FILTER_WINDOW 5
+
+// The median of the last windowSize values of a stream. The values are kept in
+// a ring buffer and in two heaps (the smaller half in a max-heap, the larger
+// half in a min-heap, their tops are the median). A new value replaces the
+// oldest one in its place in the heap, so an update is O(log windowSize) and
+// nothing is allocated after the constructor.
+class RunningMedian {
+public:
+  explicit RunningMedian(int windowSize = 1);
+
+  // Add a value (replacing the oldest one once the window is full) and return
+  // the median of the window.
+  float push(float value);
+
+  // Median of the values in the window (the mean of the middle two for an
+  // even number), 0 if there are none.
+  float getMedian() const;
+
+  // Number of values in the window (less than the window size at the start).
+  int size() const { return size_; }
+  int getWindowSize() const { return windowSize_; }
+
+  // Forget all values.
+  void reset();
+
+private:
+  int windowSize_;
+  int size_;
+  // The slot of the ring buffer the next value goes to once it is full.
+  int next_;
+
+  // The values by slot of the ring buffer.
+  std::vector<float> values_;
+  // The heaps hold slots. lower_ is the max-heap of the smaller half and has
+  // the extra value for an odd number, upper_ is the min-heap of the larger
+  // half.
+  std::vector<int> lower_;
+  std::vector<int> upper_;
+  int numLower_;
+  int numUpper_;
+  // Which heap a slot is in and where.
+  std::vector<char> inLower_;
+  std::vector<int> heapIndex_;
+
+  // If slot a belongs closer to the top of the heap than slot b.
+  bool outranks(bool lower, int a, int b) const {
+    return lower ? values_[a] > values_[b] : values_[a] < values_[b];
+  }
+
+  // Heap operations on lower_ or upper_.
+  void swapEntries(bool lower, int i, int j);
+  void siftUp(bool lower, int i);
+  void siftDown(bool lower, int i);
+  void insert(bool lower, int slot);
+  int popTop(bool lower);
+};
+
+// Removes electrical spikes from the samples: every channel (all columns but
+// the time) is replaced by its running median over the last windowSize
+// samples. Spikes shorter than half the window are removed completely, steps
+// are kept (delayed by half the window). The rows are filtered as they come,
+// each once.
+class SpikeFilter {
+public:
+  // Set the columns and the window (1 or less switches the filter off).
+  void configure(const std::vector<std::string> &columnNames, int windowSize);
+
+  bool isEnabled() const { return windowSize_ > 1; }
+  int getWindowSize() const { return windowSize_; }
+
+  // Filter the rows from firstIndex to the end of the columns in place, they
+  // are the rows from firstRow on of the file. If they don't continue the
+  // rows filtered before, the filter starts over.
+  void apply(std::unordered_map<std::string, std::vector<float>> *columns,
+             size_t firstIndex, int firstRow);
+
+  // The same value by value, for a pass over the rows that does more (see
+  // OffsetCalibrator::apply()): start with the rows from firstRow on, filter
+  // the values of the columns (by getColumn(), -1 for the ones without a
+  // filter) and finish after numRows rows.
+  int getColumn(const std::string &columnName) const;
+  void start(int firstRow);
+  float push(int column, float value) { return medians_[column].push(value); }
+  void finish(int firstRow, size_t numRows) { nextRow_ = firstRow + numRows; }
+
+  // Start over with the next rows.
+  void reset();
+
+private:
+  int windowSize_ = 1;
+  // The filtered columns and their medians.
+  std::vector<std::string> columnNames_;
+  std::vector<RunningMedian> medians_;
+  // The row the next rows have to start with to continue, -1 for none.
+  int nextRow_ = -1;
+};
+
+// Seconds of the unloaded plate right before the contact (or at the start of
+// files without a contact period) that the offsets are estimated from.
+#define CALIBRATION_S 1
+
+// Time constant in seconds of tracking the drift of the offsets while the
+// plate is unloaded during the playback.
+#define CALIBRATION_DRIFT_S 60
+
+// Removes the zero offsets of the force and moment channels (sensor drift, so
+// the unloaded plate doesn't read 0). The offsets are the means of the
+// unloaded rows (|Fz| below a threshold) of a calibration interval, and are
+// subtracted from the rows as they come, each once. While the plate is
+// unloaded, the offsets follow the drift with an exponentially weighted moving
+// average. The COP columns are computed from the forces by BioWare and time is
+// time, these are left alone.
+class OffsetCalibrator {
+public:
+  // Set the columns, the sampling rate (for the drift time constant) and the
+  // |Fz| below which the plate counts as unloaded. Forgets the offsets.
+  void configure(const std::vector<std::string> &columnNames,
+                 float samplingRate, float unloadedThreshold);
+
+  // Switch it off (no channels).
+  void clear();
+
+  bool isEnabled() const { return !columnNames_.empty(); }
+
+  // Estimate the offsets from the unloaded rows of the data. Returns false
+  // (and keeps the offsets) if there are none.
+  bool calibrate(
+      const std::unordered_map<std::string, std::vector<float>> &data);
+
+  // If there are offsets. Until then apply() takes them from the first
+  // unloaded rows it gets.
+  bool isCalibrated() const { return calibrated_; }
+
+  // Offset of a column, 0 for those without one.
+  float getOffset(const std::string &columnName) const;
+
+  // Time constant of the drift tracking in seconds (0 for none).
+  void setDriftTime(float driftTime) { driftTime_ = std::max(driftTime, 0.f); }
+  float getDriftTime() const { return driftTime_; }
+
+  // Subtract the offsets from the rows from firstIndex to the end of the
+  // columns in place, the unloaded ones among them update the offsets after.
+  // With a spike filter (see SpikeFilter::apply(), the rows are the rows from
+  // firstRow on of the file), the rows are filtered first, in the same pass
+  // over every column once there are offsets.
+  void apply(std::unordered_map<std::string, std::vector<float>> *columns,
+             size_t firstIndex, SpikeFilter *spikeFilter = nullptr,
+             int firstRow = 0);
+
+private:
+  std::vector<std::string> columnNames_;
+  std::vector<float> offsets_;
+  bool calibrated_ = false;
+  float samplingRate_ = 1;
+  float unloadedThreshold_ = 0;
+  float driftTime_ = CALIBRATION_DRIFT_S;
+
+  // 1 for the unloaded rows of the last data, 0 for the others. Reused.
+  std::vector<float> unloaded_;
+  // Sums of the unloaded rows by channel. Reused.
+  std::vector<float> sums_;
+
+  // Index of a column in columnNames_, -1 if it has no offset.
+  int findChannel(const std::string &columnName) const;
+
+  // apply() with the spike filter, once calibrated.
+  void applyFiltered(
+      std::unordered_map<std::string, std::vector<float>> *columns,
+      size_t firstIndex, SpikeFilter *spikeFilter, int firstRow);
+
+  // Move the offsets of the columns towards the means of the numUnloaded
+  // unloaded rows (their sums by channel are in sums_).
+  void trackDrift(
+      const std::unordered_map<std::string, std::vector<float>> &columns,
+      int numUnloaded);
+
+  // Fill unloaded_ for the rows from firstIndex on, returns their number.
+  int findUnloaded(
+      const std::unordered_map<std::string, std::vector<float>> &data,
+      size_t firstIndex);
+
+  // Set the offsets to the means of the unloaded rows from firstIndex on,
+  // false if there are none.
+  bool estimate(const std::unordered_map<std::string, std::vector<float>> &data,
+                size_t firstIndex);
+};
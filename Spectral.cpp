@@ -0,0 +1,363 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#include "./Spectral.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <utility>
+
+// ____________________________________________________________________________
+std::shared_ptr<const RealFft> RealFft::get(int size) {
+  static std::mutex mutex;
+  // The most recently used last.
+  static std::vector<std::shared_ptr<const RealFft>> cache;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t i = 0; i < cache.size(); i++) {
+    if (cache[i]->getSize() == size) {
+      std::shared_ptr<const RealFft> fft = cache[i];
+      cache.erase(cache.begin() + i);
+      cache.push_back(fft);
+      return fft;
+    }
+  }
+
+  std::shared_ptr<const RealFft> fft(new RealFft(size));
+  cache.push_back(fft);
+  if (cache.size() > SPECTRUM_CACHE_SIZES)
+    cache.erase(cache.begin());
+  return fft;
+}
+
+// ____________________________________________________________________________
+// The product without the checks for infinities of std::complex (which make
+// it a function call).
+static inline std::complex<double> multiply(const std::complex<double> &a,
+                                            const std::complex<double> &b) {
+  return std::complex<double>(a.real() * b.real() - a.imag() * b.imag(),
+                              a.real() * b.imag() + a.imag() * b.real());
+}
+
+// ____________________________________________________________________________
+static bool isGoodSize(int size) {
+  if (size < 2 || size % 2 != 0)
+    return false;
+  int half = size / 2;
+  for (int radix : {2, 3, 5})
+    while (half % radix == 0)
+      half /= radix;
+  return half == 1;
+}
+
+// ____________________________________________________________________________
+int RealFft::getGoodSize(int maxSize) {
+  for (int size = maxSize - maxSize % 2; size >= 2; size -= 2)
+    if (isGoodSize(size))
+      return size;
+  return 0;
+}
+
+// ____________________________________________________________________________
+RealFft::RealFft(int size) : size_(size) {
+  const double pi = std::acos(-1.0);
+
+  // The stages of the complex FFT of half the size, the twiddles of a stage
+  // of length n and radix r are exp(-2 pi i p k / n) for p < n / r, k < r.
+  int length = size_ / 2;
+  for (int radix : {4, 2, 3, 5}) {
+    while (length % radix == 0) {
+      radices_.push_back(radix);
+      stageOffsets_.push_back(stageTwiddles_.size());
+      for (int p = 0; p < length / radix; p++)
+        for (int k = 0; k < radix; k++)
+          stageTwiddles_.push_back(std::polar(1.0, -2 * pi * p * k / length));
+      length /= radix;
+    }
+  }
+
+  twiddles_.resize(size_ / 2 + 1);
+  for (int k = 0; k <= size_ / 2; k++)
+    twiddles_[k] = std::polar(1.0, -2 * pi * k / size_);
+
+  hannWindow_.resize(size_);
+  hannPower_ = 0;
+  for (int i = 0; i < size_; i++) {
+    hannWindow_[i] = 0.5 - 0.5 * std::cos(2 * pi * i / size_);
+    hannPower_ += hannWindow_[i] * hannWindow_[i];
+  }
+}
+
+// ____________________________________________________________________________
+void RealFft::transform(const float *values,
+                        std::vector<std::complex<double>> *bins,
+                        std::vector<std::complex<double>> *work) const {
+  work->resize(size_);
+  for (int i = 0; i < size_ / 2; i++)
+    (*work)[i] = std::complex<double>(values[2 * i], values[2 * i + 1]);
+  transformLoaded(bins, work);
+}
+
+// ____________________________________________________________________________
+void RealFft::transform(const double *values,
+                        std::vector<std::complex<double>> *bins,
+                        std::vector<std::complex<double>> *work) const {
+  work->resize(size_);
+  for (int i = 0; i < size_ / 2; i++)
+    (*work)[i] = std::complex<double>(values[2 * i], values[2 * i + 1]);
+  transformLoaded(bins, work);
+}
+
+// ____________________________________________________________________________
+void RealFft::transformLoaded(std::vector<std::complex<double>> *bins,
+                              std::vector<std::complex<double>> *work) const {
+  const int half = size_ / 2;
+  bins->resize(half + 1);
+  std::complex<double> *x = work->data();
+  std::complex<double> *y = work->data() + half;
+
+  // Stockham: every stage goes from x to y with the radix-r DFTs of the
+  // values length / r apart, the next one with a stride r times as long.
+  // Radix 2 and 4 (most of the stages) are written out.
+  const double pi = std::acos(-1.0);
+  int stride = 1;
+  int length = half;
+  for (size_t stage = 0; stage < radices_.size(); stage++) {
+    const int radix = radices_[stage];
+    const int m = length / radix;
+    const std::complex<double> *twiddles =
+        stageTwiddles_.data() + stageOffsets_[stage];
+
+    if (radix == 2) {
+      for (int p = 0; p < m; p++) {
+        const std::complex<double> w1 = twiddles[2 * p + 1];
+        for (int q = 0; q < stride; q++) {
+          const std::complex<double> a0 = x[q + stride * p];
+          const std::complex<double> a1 = x[q + stride * (p + m)];
+          y[q + stride * 2 * p] = a0 + a1;
+          y[q + stride * (2 * p + 1)] = multiply(a0 - a1, w1);
+        }
+      }
+    } else if (radix == 4) {
+      for (int p = 0; p < m; p++) {
+        const std::complex<double> w1 = twiddles[4 * p + 1];
+        const std::complex<double> w2 = twiddles[4 * p + 2];
+        const std::complex<double> w3 = twiddles[4 * p + 3];
+        for (int q = 0; q < stride; q++) {
+          const std::complex<double> a0 = x[q + stride * p];
+          const std::complex<double> a1 = x[q + stride * (p + m)];
+          const std::complex<double> a2 = x[q + stride * (p + 2 * m)];
+          const std::complex<double> a3 = x[q + stride * (p + 3 * m)];
+          const std::complex<double> t0 = a0 + a2;
+          const std::complex<double> t1 = a0 - a2;
+          const std::complex<double> t2 = a1 + a3;
+          // (a1 - a3) times -i.
+          const std::complex<double> t3(a1.imag() - a3.imag(),
+                                        a3.real() - a1.real());
+          y[q + stride * 4 * p] = t0 + t2;
+          y[q + stride * (4 * p + 1)] = multiply(t1 + t3, w1);
+          y[q + stride * (4 * p + 2)] = multiply(t0 - t2, w2);
+          y[q + stride * (4 * p + 3)] = multiply(t1 - t3, w3);
+        }
+      }
+    } else {
+      std::complex<double> roots[5];
+      for (int j = 0; j < radix; j++)
+        roots[j] = std::polar(1.0, -2 * pi * j / radix);
+      for (int p = 0; p < m; p++) {
+        for (int q = 0; q < stride; q++) {
+          std::complex<double> a[5];
+          for (int j = 0; j < radix; j++)
+            a[j] = x[q + stride * (p + j * m)];
+          for (int k = 0; k < radix; k++) {
+            std::complex<double> sum = a[0];
+            for (int j = 1; j < radix; j++)
+              sum += multiply(a[j], roots[(j * k) % radix]);
+            y[q + stride * (radix * p + k)] =
+                multiply(sum, twiddles[p * radix + k]);
+          }
+        }
+      }
+    }
+    std::swap(x, y);
+    stride *= radix;
+    length = m;
+  }
+
+  // Split into the transforms of the even and odd values, and those into the
+  // bins of the real values.
+  for (int k = 0; k <= half; k++) {
+    std::complex<double> z = x[k % half];
+    std::complex<double> zMirrored = std::conj(x[(half - k) % half]);
+    std::complex<double> even = (z + zMirrored) * 0.5;
+    std::complex<double> odd =
+        (z - zMirrored) * std::complex<double>(0, -0.5);
+    (*bins)[k] = even + multiply(twiddles_[k], odd);
+  }
+}
+
+// ____________________________________________________________________________
+void SlidingDft::reset(std::shared_ptr<const RealFft> fft, const float *values,
+                       int numBins) {
+  const int size = fft->getSize();
+  numBins = std::min(numBins, size / 2 + 1);
+  fft->transform(values, &allBins_, &work_);
+  bins_.assign(allBins_.begin(), allBins_.begin() + numBins);
+
+  // The rotations only change with the size.
+  if (fft != fft_ || static_cast<int>(rotations_.size()) != numBins) {
+    rotations_.resize(numBins);
+    for (int k = 0; k < numBins; k++)
+      rotations_[k] = std::conj(fft->getTwiddle(k));
+  }
+  fft_ = std::move(fft);
+
+  values_.assign(values, values + size);
+  oldest_ = 0;
+  numPushed_ = 0;
+}
+
+// ____________________________________________________________________________
+void SlidingDft::push(float value) {
+  const double difference = static_cast<double>(value) - values_[oldest_];
+  values_[oldest_] = value;
+  oldest_ = oldest_ + 1 == static_cast<int>(values_.size()) ? 0 : oldest_ + 1;
+  numPushed_++;
+
+  for (size_t k = 0; k < bins_.size(); k++)
+    bins_[k] = multiply(bins_[k] + difference, rotations_[k]);
+}
+
+// ____________________________________________________________________________
+SpectralAnalyzer::SpectralAnalyzer(bool sliding)
+    : sliding_(sliding), numTransforms_(0) {
+  reset();
+}
+
+// ____________________________________________________________________________
+void SpectralAnalyzer::reset() {
+  size_ = 0;
+  numBins_ = 0;
+  samplingRate_ = 0;
+  lastTime_ = -std::numeric_limits<float>::infinity();
+  power_.clear();
+  resolution_ = 0;
+  summary_ = SpectrumSummary();
+}
+
+// ____________________________________________________________________________
+void SpectralAnalyzer::analyze(const float *times, const float *values,
+                               int numValues) {
+  if (numValues < 4 || times[numValues - 1] <= times[0]) {
+    reset();
+    return;
+  }
+
+  // Slide on if the new values continue the old ones and the window has not
+  // turned over yet (then an FFT is cheaper anyway, and the rounding errors
+  // are gone). The size stays, as long as the window is large enough.
+  if (sliding_ && size_ > 0 && size_ <= numValues) {
+    const float tolerance = 0.25f / samplingRate_;
+    const int firstNew =
+        std::upper_bound(times, times + numValues, lastTime_ + tolerance) -
+        times;
+    const int numNew = numValues - firstNew;
+    if (firstNew > 0 &&
+        std::abs(times[firstNew - 1] - lastTime_) <= tolerance &&
+        dft_.getNumPushed() + numNew <= size_) {
+      for (int i = firstNew; i < numValues; i++)
+        dft_.push(values[i]);
+      lastTime_ = times[numValues - 1];
+      if (numNew > 0)
+        setSlidingPower();
+      return;
+    }
+  }
+
+  // A full FFT of the last values.
+  const int size = RealFft::getGoodSize(numValues);
+  if (size < 4) {
+    reset();
+    return;
+  }
+  if (!fft_ || fft_->getSize() != size)
+    fft_ = RealFft::get(size);
+  size_ = size;
+  samplingRate_ = (numValues - 1) / (times[numValues - 1] - times[0]);
+  resolution_ = samplingRate_ / size_;
+  numBins_ = std::min(static_cast<int>(SPECTRUM_MAX_HZ / resolution_),
+                      size_ / 2 - 1);
+  lastTime_ = times[numValues - 1];
+  numTransforms_++;
+
+  const float *first = values + numValues - size_;
+  if (sliding_) {
+    // One bin more on each side for the Hann window.
+    dft_.reset(fft_, first, numBins_ + 2);
+    setSlidingPower();
+    return;
+  }
+
+  double mean = 0;
+  for (int i = 0; i < size_; i++)
+    mean += first[i];
+  mean /= size_;
+  const std::vector<float> &window = fft_->getHannWindow();
+  windowed_.resize(size_);
+  for (int i = 0; i < size_; i++)
+    windowed_[i] = (first[i] - mean) * window[i];
+  fft_->transform(windowed_.data(), &bins_, &work_);
+  setPower(bins_);
+}
+
+// ____________________________________________________________________________
+void SpectralAnalyzer::setSlidingPower() {
+  // Without the mean bin 0 is 0, and the Hann window weights every bin with
+  // 1/2 and its neighbours with -1/4 (bin -1 is the conjugate of bin 1).
+  const std::vector<std::complex<double>> &bins = dft_.getBins();
+  bins_.resize(numBins_ + 1);
+  bins_[0] = 0;
+  for (int k = 1; k <= numBins_; k++) {
+    std::complex<double> previous = k > 1 ? bins[k - 1] : 0;
+    bins_[k] = 0.5 * bins[k] - 0.25 * (previous + bins[k + 1]);
+  }
+  setPower(bins_);
+}
+
+// ____________________________________________________________________________
+void SpectralAnalyzer::setPower(
+    const std::vector<std::complex<double>> &windowedBins) {
+  // One-sided density, scaled by the power of the window.
+  const double scale = 2 / (samplingRate_ * fft_->getHannPower());
+  power_.resize(numBins_ + 1);
+  power_[0] = 0;
+  double totalPower = 0;
+  for (int k = 1; k <= numBins_; k++) {
+    power_[k] = std::norm(windowedBins[k]) * scale;
+    totalPower += power_[k] * resolution_;
+  }
+
+  summary_ = SpectrumSummary();
+  summary_.totalPower = totalPower;
+  const float bandEdges[SPECTRUM_NUM_BANDS] = {SPECTRUM_BAND_EDGES_HZ};
+  double belowPower = 0;
+  for (int k = 1; k <= numBins_; k++) {
+    const double binPower = power_[k] * resolution_;
+    const float frequency = k * resolution_;
+    for (int band = 0; band < SPECTRUM_NUM_BANDS; band++) {
+      if (frequency <= bandEdges[band] + resolution_ / 4) {
+        summary_.bandPower[band] += binPower;
+        break;
+      }
+    }
+
+    // Bin k has the power from (k - 1/2) to (k + 1/2) times the resolution.
+    if (summary_.medianFrequency == 0 && binPower > 0 &&
+        belowPower + binPower >= totalPower / 2)
+      summary_.medianFrequency =
+          (k - 0.5 + (totalPower / 2 - belowPower) / binPower) * resolution_;
+    belowPower += binPower;
+  }
+}
@@ -0,0 +1,185 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#pragma once
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The spectra go up to this frequency in Hz, postural sway has next to no
+// power above. The median frequency and the total power are of (0, max].
+#define SPECTRUM_MAX_HZ 10
+
+// Upper edges of the frequency bands in Hz the power is reported for (the
+// first band starts at 0).
+#define SPECTRUM_NUM_BANDS 3
+#define SPECTRUM_BAND_EDGES_HZ 0.5f, 1.0f, 3.0f
+
+// How many sizes of FFTs keep their twiddles and windows cached.
+#define SPECTRUM_CACHE_SIZES 8
+
+// How the spectra of BalanceParameters are calculated: not at all, with an
+// FFT of the whole window at every update, or sliding the window on by the new
+// rows (for live windows that move on by a few rows at a time).
+enum class SpectralAnalysis { None, Full, Sliding };
+
+// Discrete Fourier transform of real values. The size is even, and half of
+// it has no prime factors but 2, 3 and 5 (see getGoodSize()). The transform
+// is a complex FFT of half the size (mixed radix, Stockham, so no bit
+// reversal) with the even values as real and the odd ones as imaginary part,
+// split into the bins of the real values after. The twiddles and a Hann
+// window of the size are calculated once and shared, see get().
+class RealFft {
+public:
+  // The FFT of the size, from the cache or made (and cached). Thread-safe.
+  static std::shared_ptr<const RealFft> get(int size);
+
+  // The largest size for at most maxSize values, 0 for less than 2.
+  static int getGoodSize(int maxSize);
+
+  int getSize() const { return size_; }
+
+  // Bins 0 to size / 2 of the transform of size values. The work vector is
+  // for the intermediate results (to be reused by the caller), so the FFT can
+  // be shared by threads.
+  void transform(const float *values, std::vector<std::complex<double>> *bins,
+                 std::vector<std::complex<double>> *work) const;
+  // The same for values that need the precision.
+  void transform(const double *values, std::vector<std::complex<double>> *bins,
+                 std::vector<std::complex<double>> *work) const;
+
+  // exp(-2 pi i k / size) for k from 0 to size / 2.
+  std::complex<double> getTwiddle(int k) const { return twiddles_[k]; }
+
+  // Periodic Hann window of the size and the sum of its squares.
+  const std::vector<float> &getHannWindow() const { return hannWindow_; }
+  double getHannPower() const { return hannPower_; }
+
+private:
+  explicit RealFft(int size);
+
+  // The transform of the values in the first half of the work vector (the
+  // even ones as real, the odd ones as imaginary part).
+  void transformLoaded(std::vector<std::complex<double>> *bins,
+                       std::vector<std::complex<double>> *work) const;
+
+  int size_;
+  // The radices of the stages of the complex FFT and where their twiddles
+  // start.
+  std::vector<int> radices_;
+  std::vector<int> stageOffsets_;
+  std::vector<std::complex<double>> stageTwiddles_;
+  // For splitting into the bins of the real values.
+  std::vector<std::complex<double>> twiddles_;
+  std::vector<float> hannWindow_;
+  double hannPower_;
+};
+
+// The bins of the DFT of the last size values of a stream, updated with every
+// new value in O(number of bins): the oldest value drops out, the new one
+// comes in and the phases are turned by a sample. Only the bins that are
+// needed are kept. The rounding errors add up, so it is reset now and then.
+class SlidingDft {
+public:
+  // Start over with the size values (the size of the FFT), bins 0 to
+  // numBins - 1 are kept.
+  void reset(std::shared_ptr<const RealFft> fft, const float *values,
+             int numBins);
+
+  // Slide on by a value.
+  void push(float value);
+
+  const std::vector<std::complex<double>> &getBins() const { return bins_; }
+  int getSize() const { return fft_ ? fft_->getSize() : 0; }
+
+  // Values pushed since the last reset.
+  int getNumPushed() const { return numPushed_; }
+
+private:
+  std::shared_ptr<const RealFft> fft_;
+  // The values in the window, a ring buffer starting with the oldest.
+  std::vector<float> values_;
+  int oldest_ = 0;
+  int numPushed_ = 0;
+  std::vector<std::complex<double>> bins_;
+  // exp(2 pi i k / size), turning bin k by a sample.
+  std::vector<std::complex<double>> rotations_;
+  std::vector<std::complex<double>> allBins_;
+  std::vector<std::complex<double>> work_;
+};
+
+// Summary of a power spectrum, the powers in unit^2 (e.g. m^2 for the COP).
+struct SpectrumSummary {
+  float totalPower = 0;
+  // Half of the total power is below it.
+  float medianFrequency = 0;
+  // The power in (0, 0.5], (0.5, 1] and (1, 3] Hz (SPECTRUM_BAND_EDGES_HZ).
+  float bandPower[SPECTRUM_NUM_BANDS] = {};
+};
+
+// Power spectral density of a signal (e.g. the COP) over a window: the mean
+// is removed, the values are weighted with a Hann window and transformed with
+// a RealFft of the largest size that fits into the window (the oldest values
+// are left out, at most a few percent). Sliding, successive windows overlap
+// and only the new values are slid into a SlidingDft, with the Hann window
+// applied to its bins (the Hann window is a convolution with 3 bins in the
+// frequency domain). It is reset with an FFT once the window has turned
+// over, or if the new values don't continue the old ones.
+class SpectralAnalyzer {
+public:
+  explicit SpectralAnalyzer(bool sliding = false);
+
+  // The spectrum of the values with the time stamps (in s). The sampling rate
+  // follows from the time stamps, which also tell which values are new.
+  void analyze(const std::vector<float> &times,
+               const std::vector<float> &values) {
+    analyze(times.data(), values.data(), std::min(times.size(), values.size()));
+  }
+  // The same for numValues values read in place (e.g. from a SampleView).
+  void analyze(const float *times, const float *values, int numValues);
+
+  // Forget the spectrum (also the window to slide on).
+  void reset();
+
+  bool isSliding() const { return sliding_; }
+
+  // The power spectral density (unit^2 / Hz) by bin up to SPECTRUM_MAX_HZ,
+  // bin k is at k times the resolution (in Hz). The mean is removed, so bin 0
+  // is 0.
+  const std::vector<float> &getPowerSpectrum() const { return power_; }
+  float getResolution() const { return resolution_; }
+  const SpectrumSummary &getSummary() const { return summary_; }
+
+  // Number of values transformed, 0 if there is no spectrum.
+  int getSize() const { return size_; }
+
+  // Number of full FFTs so far (the rest was slid).
+  uint64_t getNumTransforms() const { return numTransforms_; }
+
+private:
+  bool sliding_;
+  std::shared_ptr<const RealFft> fft_;
+  SlidingDft dft_;
+  int size_;
+  int numBins_;
+  float samplingRate_;
+  // Time stamp of the last value slid in.
+  float lastTime_;
+  uint64_t numTransforms_;
+
+  std::vector<float> windowed_;
+  std::vector<std::complex<double>> bins_;
+  std::vector<std::complex<double>> work_;
+
+  std::vector<float> power_;
+  float resolution_;
+  SpectrumSummary summary_;
+
+  // The spectrum from the bins of the windowed values (bins 0 to numBins_).
+  void setPower(const std::vector<std::complex<double>> &windowedBins);
+  // The spectrum from the bins of the SlidingDft.
+  void setSlidingPower();
+};
@@ -0,0 +1,121 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#include "./TrialSegmenter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+// ____________________________________________________________________________
+TrialSegmenter::TrialSegmenter(float minTrialDuration, float onThreshold,
+                               float offThreshold)
+    : minTrialDuration_(minTrialDuration), onThreshold_(onThreshold),
+      offThreshold_(offThreshold) {}
+
+// ____________________________________________________________________________
+std::vector<Trial> TrialSegmenter::segment(const KistlerCSVFile &file) const {
+  TRACE_SCOPE("TrialSegmenter::segment");
+
+  std::vector<Trial> trials;
+  if (!file.isValid())
+    return trials;
+
+  ContactDetector detector(onThreshold_, offThreshold_);
+  int row = 0;
+  while (true) {
+    auto data = file.getData(row, row + SEGMENTATION_CHUNK_ROWS - 1);
+    auto forces = data->find("Fz");
+    if (forces == data->end() || forces->second.empty())
+      break;
+    detector.update(forces->second, row);
+    row += forces->second.size();
+  }
+
+  // Only contacts long enough for a trial.
+  int minTrialRows = minTrialDuration_ * file.getSamplingRate();
+  for (const auto &period : detector.getContactPeriods()) {
+    int lastRow = period.second >= 0 ? period.second : row - 1;
+    if (lastRow - period.first + 1 >= minTrialRows)
+      trials.push_back({period.first, lastRow, BalanceParameters()});
+  }
+  return trials;
+}
+
+// ____________________________________________________________________________
+void TrialSegmenter::calculateParameters(const KistlerCSVFile &file,
+                                         std::vector<Trial> *trials,
+                                         int numThreads) const {
+  TRACE_SCOPE("TrialSegmenter::calculateParameters");
+
+  if (numThreads <= 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  numThreads = std::min<int>(numThreads, trials->size());
+
+  // The threads take the next trial until all are done, so long and short
+  // trials even out.
+  std::atomic<size_t> nextTrial(0);
+  auto work = [&]() {
+    KistlerCSVFile reader(file);
+    while (true) {
+      size_t i = nextTrial++;
+      if (i >= trials->size())
+        return;
+      Trial &trial = (*trials)[i];
+      trial.parameters.setSpectralAnalysis(SpectralAnalysis::Full);
+      trial.parameters.setDiffusionAnalysis(true);
+      try {
+        trial.parameters.update(reader.getData(trial.firstRow, trial.lastRow));
+        trial.parameters.releaseData();
+      } catch (CorruptKistlerFileException &e) {
+        std::cerr << "Error in TrialSegmenter::calculateParameters(): Trial "
+                  << i + 1 << ": " << e.what() << std::endl;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < numThreads; i++)
+    threads.emplace_back(work);
+  // This thread helps as well.
+  if (numThreads > 0)
+    work();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+// ____________________________________________________________________________
+std::vector<Trial> TrialSegmenter::run(const std::string &fileName,
+                                       int numThreads) const {
+  // A glitch in the recording doesn't cost the trial.
+  KistlerCSVFile file(fileName);
+  file.setCorruptDataPolicy(CorruptDataPolicy::Interpolate);
+  std::vector<Trial> trials = segment(file);
+  calculateParameters(file, &trials, numThreads);
+  return trials;
+}
+
+// ____________________________________________________________________________
+void TrialSegmenter::writeTable(const std::vector<Trial> &trials,
+                                std::ostream &out) {
+  out << "trial\tfirst row\tlast row\tstart time (s)\tstop time (s)\t"
+         "duration (s)\tmean Fx (N)\tmean Fy (N)\tmean COP x (m)\t"
+         "mean COP y (m)\tmedian freq x (Hz)\tmedian freq y (Hz)\t"
+         "critical time (s)\tshort-term D (m^2/s)\tlong-term D (m^2/s)\n";
+  for (size_t i = 0; i < trials.size(); i++) {
+    const Trial &trial = trials[i];
+    const BalanceParameters &parameters = trial.parameters;
+    out << i + 1 << "\t" << trial.firstRow << "\t" << trial.lastRow << "\t"
+        << parameters.getStartTime() << "\t" << parameters.getStopTime()
+        << "\t" << parameters.getTimeframe() << "\t"
+        << parameters.getMeanForceX() << "\t" << parameters.getMeanForceY()
+        << "\t" << parameters.getMeanCopX() << "\t"
+        << parameters.getMeanCopY() << "\t"
+        << parameters.getCopSpectrumX().medianFrequency << "\t"
+        << parameters.getCopSpectrumY().medianFrequency << "\t"
+        << parameters.getDiffusionPlanar().criticalTime << "\t"
+        << parameters.getDiffusionPlanar().shortTermCoefficient << "\t"
+        << parameters.getDiffusionPlanar().longTermCoefficient << "\n";
+  }
+}
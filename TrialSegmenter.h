@@ -0,0 +1,61 @@
+// Copyright 2024
+// Author: Paul Soelder <p.soelder@mailbox.org>
+
+#pragma once
+
+#include "./DataModel.h"
+#include "./KistlerFile.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Minimum duration of a trial in seconds. Shorter contacts (e.g. stepping on
+// and off again to get into position) are no trial.
+#define MIN_TRIAL_S 2
+
+// Rows read at a time when looking for the trials.
+#define SEGMENTATION_CHUNK_ROWS 16384
+
+// A standing trial: the rows of one contact period and their parameters.
+struct Trial {
+  int firstRow;
+  int lastRow;
+  BalanceParameters parameters;
+};
+
+// Splits a recording of many standing trials into the trials (they are
+// separated by stepping off the plate) and calculates the BalanceParameters
+// of every trial, so the files don't have to be cut by hand.
+class TrialSegmenter {
+public:
+  TrialSegmenter(float minTrialDuration = MIN_TRIAL_S,
+                 float onThreshold = CONTACT_ON_THRESHOLD_N,
+                 float offThreshold = CONTACT_OFF_THRESHOLD_N);
+
+  // Find the trials in one pass over Fz of the file, with a ContactDetector.
+  // A trial still going on at the end of the file ends with the last row.
+  // The parameters are not calculated yet.
+  std::vector<Trial> segment(const KistlerCSVFile &file) const;
+
+  // Calculate the parameters of the trials on numThreads threads (0 for one
+  // per core). Every thread reads its trials with its own copy of the file
+  // (the row index is not thread-safe), which starts with the index that
+  // segment() built. Only the parameters (with the COP spectra and the
+  // stabilogram diffusion of the whole trial) are kept, not the samples. The
+  // parameters of trials that can't be read stay invalid.
+  void calculateParameters(const KistlerCSVFile &file,
+                           std::vector<Trial> *trials,
+                           int numThreads = 0) const;
+
+  // Both, no trials if the file is invalid. Corrupt cells are interpolated.
+  std::vector<Trial> run(const std::string &fileName,
+                         int numThreads = 0) const;
+
+  // Write a tab-separated table with a header line and a line per trial.
+  static void writeTable(const std::vector<Trial> &trials, std::ostream &out);
+
+private:
+  float minTrialDuration_;
+  float onThreshold_;
+  float offThreshold_;
+};